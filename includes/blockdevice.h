@@ -72,6 +72,33 @@ public:
     /// \param [out] buffer Buffer storing the content to write.
     /// \return 0 on success, -ERRNO on failure.
     int write(uint32_t blockNo, char *buffer);
+
+    /// @brief Read a range of consecutive blocks.
+    ///
+    /// This method reads numBlocks blocks starting at blockNo with a single request to the container file. Blocks
+    /// beyond the end of the container file are returned as zeros. Note that the size of the buffer must be at least
+    /// numBlocks blocks.
+    /// \param [in] blockNo Number of the first block to read.
+    /// \param [in] numBlocks Number of blocks to read.
+    /// \param [out] buffer Buffer for storing the content of the blocks.
+    /// \return 0 on success, -ERRNO on failure.
+    int readBlocks(uint32_t blockNo, uint32_t numBlocks, char *buffer);
+
+    /// @brief Write a range of consecutive blocks.
+    ///
+    /// This method writes numBlocks blocks starting at blockNo with a single request to the container file. Note
+    /// that the size of the buffer must be at least numBlocks blocks.
+    /// \param [in] blockNo Number of the first block to write.
+    /// \param [in] numBlocks Number of blocks to write.
+    /// \param [in] buffer Buffer storing the content to write.
+    /// \return 0 on success, -ERRNO on failure.
+    int writeBlocks(uint32_t blockNo, uint32_t numBlocks, const char *buffer);
+
+    /// @brief Flush written blocks to stable storage.
+    ///
+    /// This method returns after all blocks written so far have reached the underlying storage device.
+    /// \return 0 on success, -ERRNO on failure.
+    int sync();
 };
 
 #endif /* blockdevice_h */
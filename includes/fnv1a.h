@@ -0,0 +1,30 @@
+//
+//  fnv1a.h
+//  myfs
+//
+
+#ifndef MYFS_FNV1A_H
+#define MYFS_FNV1A_H
+
+#include <cstddef>
+#include <cstdint>
+
+#define FNV1A_OFFSET_BASIS 2166136261u
+#define FNV1A_PRIME 16777619u
+
+/// @brief Hash bytes with FNV-1a, for names in hash tables and checksums of records.
+///
+/// Data in several parts is hashed by passing the hash of the parts before.
+/// \param [in] data Bytes to hash.
+/// \param [in] size Number of bytes.
+/// \param [in] hash Hash of the bytes before data.
+/// \return Hash of all bytes.
+static inline uint32_t fnv1a(const char *data, size_t size, uint32_t hash = FNV1A_OFFSET_BASIS) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (uint8_t) data[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+#endif //MYFS_FNV1A_H
@@ -0,0 +1,98 @@
+//
+//  handletable.h
+//  myfs
+//
+
+#ifndef MYFS_HANDLETABLE_H
+#define MYFS_HANDLETABLE_H
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+using namespace std;
+
+/// @brief Table of open file handles.
+///
+/// Handles are kept in a slab that only grows, closed handles are reused before the slab grows. A handle is identified
+/// by its index plus one, so the value 0 of an unset fuse_file_info::fh never refers to an open handle. Looking up a
+/// handle is a bounds check and an array access.
+template<typename T>
+class HandleTable {
+    vector<T> handles;
+    vector<bool> used;
+    vector<uint32_t> freeIndexes;   // Closed handles, the next one to reuse is at the back
+    size_t count = 0;
+
+public:
+    size_t size() const { return this->count; }
+    bool empty() const { return this->count == 0; }
+
+    /// @brief Store a new handle.
+    ///
+    /// Opening may grow the slab, which invalidates pointers returned by get().
+    /// \param [in] handle Content of the handle.
+    /// \return Identifier of the handle, never 0.
+    uint64_t open(T &&handle) {
+        uint32_t index;
+        if (!this->freeIndexes.empty()) {
+            index = this->freeIndexes.back();
+            this->freeIndexes.pop_back();
+            this->handles[index] = move(handle);
+        } else {
+            index = this->handles.size();
+            this->handles.push_back(move(handle));
+            this->used.push_back(false);
+        }
+
+        this->used[index] = true;
+        this->count++;
+        return (uint64_t) index + 1;
+    }
+
+    /// @brief Find an open handle.
+    ///
+    /// \param [in] fh Identifier returned by open().
+    /// \return Pointer to the handle, nullptr if the identifier does not refer to an open handle.
+    T *get(uint64_t fh) {
+        if (fh == 0 || fh > this->handles.size() || !this->used[fh - 1])
+            return nullptr;
+        return &this->handles[fh - 1];
+    }
+
+    /// @brief Close a handle.
+    ///
+    /// \param [in] fh Identifier returned by open().
+    /// \return True if the handle was open.
+    bool close(uint64_t fh) {
+        if (get(fh) == nullptr)
+            return false;
+
+        this->handles[fh - 1] = T();
+        this->used[fh - 1] = false;
+        this->freeIndexes.push_back(fh - 1);
+        this->count--;
+        return true;
+    }
+
+    /// @brief Call a function for every open handle.
+    ///
+    /// \param [in] function Called with the identifier and a reference to each handle.
+    template<typename F>
+    void forEach(F function) {
+        for (size_t i = 0; i < this->handles.size(); i++) {
+            if (this->used[i])
+                function((uint64_t) i + 1, this->handles[i]);
+        }
+    }
+
+    /// @brief Close all handles.
+    void clear() {
+        this->handles.clear();
+        this->used.clear();
+        this->freeIndexes.clear();
+        this->count = 0;
+    }
+};
+
+#endif //MYFS_HANDLETABLE_H
@@ -0,0 +1,263 @@
+//
+//  memoryarena.h
+//  myfs
+//
+
+#ifndef MYFS_MEMORYARENA_H
+#define MYFS_MEMORYARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/mman.h>
+
+using namespace std;
+
+/// @brief Memory of an allocator, in bytes.
+struct ArenaUsage {
+    size_t bytesUsed = 0;       // Handed out and not given back
+    size_t bytesReserved = 0;   // Taken from the system, including bytes kept for reuse
+
+    ArenaUsage &operator+=(const ArenaUsage &other) {
+        this->bytesUsed += other.bytesUsed;
+        this->bytesReserved += other.bytesReserved;
+        return *this;
+    }
+};
+
+/// @brief Allocator for objects of one type.
+///
+/// Objects are placed in slabs of about SLAB_BYTES, destroyed objects are kept in a free list and their slots are
+/// reused before a new slab is allocated. Creating and destroying an object is a few pointer operations, and objects
+/// that are created together end up next to each other instead of being spread over the heap. Slabs are only freed
+/// when the allocator is destroyed, all objects must be destroyed before.
+template<typename T>
+class SlabAllocator {
+    enum { SLAB_BYTES = 64 * 1024 };
+
+    union Slot {
+        Slot *next;     // Next free slot
+        typename aligned_storage<sizeof(T), alignof(T)>::type object;
+    };
+
+    enum { SLOTS_PER_SLAB = SLAB_BYTES / sizeof(Slot) > 0 ? SLAB_BYTES / sizeof(Slot) : 1 };
+
+    vector<unique_ptr<Slot[]>> slabs;
+    Slot *freeSlots = nullptr;
+    size_t count = 0;
+
+public:
+    SlabAllocator() {}
+
+    SlabAllocator(const SlabAllocator &) = delete;
+    SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+    size_t size() const { return this->count; }
+
+    ArenaUsage usage() const {
+        ArenaUsage usage;
+        usage.bytesUsed = this->count * sizeof(Slot);
+        usage.bytesReserved = this->slabs.size() * SLOTS_PER_SLAB * sizeof(Slot);
+        return usage;
+    }
+
+    /// @brief Construct a new object.
+    ///
+    /// \param [in] args Arguments for the constructor of the object.
+    /// \return Pointer to the object, it keeps its address until it is destroyed.
+    template<typename... Args>
+    T *create(Args &&... args) {
+        if (this->freeSlots == nullptr)
+            grow();
+
+        // The object overwrites the link to the next free slot
+        Slot *slot = this->freeSlots;
+        this->freeSlots = slot->next;
+        try {
+            T *object = new(&slot->object) T(forward<Args>(args)...);
+            this->count++;
+            return object;
+        } catch (...) {
+            slot->next = this->freeSlots;
+            this->freeSlots = slot;
+            throw;
+        }
+    }
+
+    /// @brief Destroy an object and keep its slot for reuse.
+    ///
+    /// \param [in] object Pointer returned by create().
+    void destroy(T *object) {
+        if (object == nullptr)
+            return;
+
+        object->~T();
+        Slot *slot = reinterpret_cast<Slot *>(object);
+        slot->next = this->freeSlots;
+        this->freeSlots = slot;
+        this->count--;
+    }
+
+private:
+    void grow() {
+        this->slabs.emplace_back(new Slot[SLOTS_PER_SLAB]);
+        Slot *slab = this->slabs.back().get();
+        for (size_t i = SLOTS_PER_SLAB; i > 0; i--) {
+            slab[i - 1].next = this->freeSlots;
+            this->freeSlots = &slab[i - 1];
+        }
+    }
+};
+
+/// @brief Allocator for pages of file content.
+///
+/// Pages are cut from chunks of CHUNK_BYTES that are mapped from the system, freed pages are reused before a new chunk
+/// is mapped. With huge pages, chunks are aligned to their size and the kernel is asked to back them with transparent
+/// huge pages, which saves TLB misses when large files are read. Chunks are only unmapped when the arena is destroyed.
+///
+/// A page can be shared by several owners, every owner frees it once and it is reused after the last one did. Shared
+/// pages are counted once in the usage.
+///
+/// Pages may be allocated, shared and freed by several threads at the same time.
+class PageArena {
+public:
+    enum { PAGE_BYTES = 4096, CHUNK_BYTES = 2 * 1024 * 1024 };
+
+private:
+    vector<char *> chunks;
+    vector<char *> freePages;
+    char *nextFresh = nullptr;      // Pages of the last chunk that were never handed out, they are still zero
+    char *chunkEnd = nullptr;
+    size_t count = 0;
+    bool hugePages = false;
+    unordered_map<const char *, size_t> shares;    // Owners besides the first of shared pages
+    atomic<size_t> sharedPages;                     // Entries in shares, checked without the lock
+    mutable mutex lock;
+
+public:
+    PageArena() : sharedPages(0) {}
+
+    PageArena(const PageArena &) = delete;
+    PageArena &operator=(const PageArena &) = delete;
+
+    ~PageArena() {
+        for (char *chunk : this->chunks)
+            munmap(chunk, CHUNK_BYTES);
+    }
+
+    /// @brief Ask the kernel for huge pages in chunks that are mapped from now on.
+    void setHugePages(bool enabled) { this->hugePages = enabled; }
+
+    size_t size() const {
+        lock_guard<mutex> guard(this->lock);
+        return this->count;
+    }
+
+    ArenaUsage usage() const {
+        lock_guard<mutex> guard(this->lock);
+        ArenaUsage usage;
+        usage.bytesUsed = this->count * PAGE_BYTES;
+        usage.bytesReserved = this->chunks.size() * CHUNK_BYTES;
+        return usage;
+    }
+
+    /// @brief Get a page filled with zeros.
+    ///
+    /// Throws std::bad_alloc if no chunk can be mapped, like operator new.
+    /// \return Pointer to PAGE_BYTES bytes.
+    char *allocate() {
+        unique_lock<mutex> guard(this->lock);
+        if (this->freePages.empty()) {
+            if (this->nextFresh == this->chunkEnd)
+                mapChunk();
+            char *page = this->nextFresh;
+            this->nextFresh += PAGE_BYTES;
+            this->count++;
+            return page;
+        }
+
+        char *page = this->freePages.back();
+        this->freePages.pop_back();
+        this->count++;
+        guard.unlock();
+        memset(page, 0, PAGE_BYTES);
+        return page;
+    }
+
+    /// @brief Add an owner to a page.
+    ///
+    /// \param [in] page Pointer returned by allocate().
+    /// \return The page, it must be freed by the new owner as well.
+    char *share(char *page) {
+        lock_guard<mutex> guard(this->lock);
+        if (this->shares[page]++ == 0)
+            this->sharedPages++;
+        return page;
+    }
+
+    /// @brief Check if a page has more than one owner, it must not be written then.
+    bool isShared(const char *page) const {
+        if (this->sharedPages == 0)
+            return false;
+        lock_guard<mutex> guard(this->lock);
+        return this->shares.count(page) > 0;
+    }
+
+    /// @brief Give a page back for reuse.
+    ///
+    /// \param [in] page Pointer returned by allocate().
+    void free(char *page) {
+        if (page == nullptr)
+            return;
+
+        // A shared page is kept for its other owners
+        lock_guard<mutex> guard(this->lock);
+        auto shared = this->sharedPages == 0 ? this->shares.end() : this->shares.find(page);
+        if (shared != this->shares.end()) {
+            if (--shared->second == 0) {
+                this->shares.erase(shared);
+                this->sharedPages--;
+            }
+            return;
+        }
+
+        this->freePages.push_back(page);
+        this->count--;
+    }
+
+private:
+    void mapChunk() {
+        // Map twice the size when huge pages are requested, so an aligned chunk can be cut out
+        size_t length = this->hugePages ? 2 * CHUNK_BYTES : CHUNK_BYTES;
+        void *mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        if (mapped == MAP_FAILED)
+            throw bad_alloc();
+
+        char *chunk = (char *) mapped;
+        if (this->hugePages) {
+            size_t head = (CHUNK_BYTES - (uintptr_t) chunk % CHUNK_BYTES) % CHUNK_BYTES;
+            if (head > 0)
+                munmap(chunk, head);
+            munmap(chunk + head + CHUNK_BYTES, CHUNK_BYTES - head);
+            chunk += head;
+#ifdef MADV_HUGEPAGE
+            madvise(chunk, CHUNK_BYTES, MADV_HUGEPAGE);
+#endif
+        }
+
+        this->chunks.push_back(chunk);
+        this->freePages.reserve(this->chunks.size() * (CHUNK_BYTES / PAGE_BYTES));
+        this->nextFresh = chunk;
+        this->chunkEnd = chunk + CHUNK_BYTES;
+    }
+};
+
+#endif //MYFS_MEMORYARENA_H
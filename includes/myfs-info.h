@@ -11,9 +11,35 @@
 #ifndef myfs_info_h
 #define myfs_info_h
 
+#include <stddef.h>
+
+// Access time updates on read
+#define ATIME_RELATIME 0    // Only if the access time is older than the last change or a day old
+#define ATIME_STRICT 1      // On every read
+#define ATIME_NOATIME 2     // Never
+
+// Default time in seconds the kernel caches names, attributes and failed lookups. All changes go through the kernel,
+// so it does not miss any of them while it caches.
+#define DEFAULT_ENTRY_TIMEOUT 1.0
+#define DEFAULT_ATTR_TIMEOUT 1.0
+#define DEFAULT_NEGATIVE_TIMEOUT 1.0
+
+// Syncs of the operation log, other values are milliseconds between syncs
+#define OPLOG_SYNC_ALWAYS 0 // Before every operation returns
+#define OPLOG_SYNC_NEVER -1 // Only on fsync, compaction and unmount
+
 struct MyFsInfo {
     char *logFile;
     char *contFile;
+    int atimeMode;      // One of ATIME_*
+    int lazytime;       // Keep changes of timestamps in memory until the file is synced
+    int hugePages;      // Back the content of in-memory files with huge pages
+    size_t memoryLimit; // Bytes the in-memory file system may use, 0 for no limit
+    char *spillFile;    // Container that takes in-memory files over the limit, nullptr to fail writes instead
+    char *snapshotFile; // Image the in-memory files are loaded from and saved to, nullptr to start empty
+    char *opLogFile;    // Log of changes to in-memory files since the snapshot, nullptr for none
+    int opLogSync;      // Milliseconds between syncs of the log, OPLOG_SYNC_ALWAYS or OPLOG_SYNC_NEVER
+    int compressAfter;  // Seconds without use after which in-memory files are compressed, 0 to never compress them
 };
 
 #endif /* myfs_info_h */
@@ -0,0 +1,23 @@
+//
+//  myfs-mount.h
+//  myfs
+//
+//  Command line helpers shared by the FUSE 2 and FUSE 3 mount commands.
+//
+
+#ifndef myfs_mount_h
+#define myfs_mount_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void myfs_usage(void);
+int myfs_oplog_sync(const char *value);
+char *myfs_container_path(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* myfs_mount_h */
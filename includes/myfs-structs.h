@@ -11,72 +11,273 @@
 
 #define NAME_LENGTH 255
 #define BLOCK_SIZE 512
-#define NUM_DIR_ENTRIES 64
-#define NUM_OPEN_FILES 64
 
 
 #define FILE_BLOCK_BLOCK_OFFSET 1
 
 #define SUPERBLOCK_COUNT 1
 #define SUPERBLOCK_OFFSET 0
+#define SUPERBLOCK_MAGIC 0x5346594d         // "MYFS"
+#define SUPERBLOCK_VERSION 1                // Incremented when the container layout changes
 
 #define DMAP_BLOCK_COUNT 128
 #define DMAP_BLOCK_OFFSET 1
 #define DMAP_ENTRIES_PER_BLOCK 512
+#define DMAP_REBUILD_MAX_THREADS 8
 
 #define FAT_BLOCK_COUNT 512
 #define FAT_BLOCK_OFFSET 129
 #define FAT_ENTRIES_PER_BLOCK 128
+#define FAT_MAX_HOLE_BLOCKS 32767           // Longest hole between two blocks of a chain, longer ones are split by zeros
 
-#define ROOT_BLOCK_COUNT 64
-#define ROOT_BLOCK_OFFSET 641
+#define INODE_SIZE 64
+#define INODE_BLOCK_COUNT 4096
+#define INODE_BLOCK_OFFSET 641
+#define INODES_PER_BLOCK 8                  // BLOCK_SIZE / INODE_SIZE
+#define NUM_INODES 32768                    // INODE_BLOCK_COUNT * INODES_PER_BLOCK
+#define ROOT_INODE 1                        // Inode 0 is never used, it marks unused directory entries
+
+#define DIR_RECORD_ALIGNMENT 4              // Records of directory entries start at multiples of 4 bytes
+
+#define JOURNAL_BLOCK_COUNT 1024
+#define JOURNAL_BLOCK_OFFSET 4737
+#define JOURNAL_MAGIC 0x4c4e524a            // "JRNL"
+#define JOURNAL_RECORD_MAX_BLOCKS 124       // (BLOCK_SIZE - 16) / sizeof(uint32_t)
+#define JOURNAL_RECORD_CONTINUED 1          // The operation continues in the next record
+#define JOURNAL_GROUP_COMMIT_OPS 32         // Operations collected before a group is committed
+#define JOURNAL_COMMIT_INTERVAL 5           // Seconds an operation may wait for its group commit
+
+#define RELATIME_INTERVAL 86400             // Seconds after which relatime updates the access time anyway
+#define LAZYTIME_MAX_AGE 3600               // Seconds changed timestamps may stay in memory with lazytime
+
+#define READAHEAD_MIN_BLOCKS 8              // Readahead window of the first sequential read of a handle
+#define READAHEAD_MAX_BLOCKS 128            // Largest readahead window (64 KiB), larger reads bypass the window
+
+#define MAX_REQUEST_SIZE 1048576            // Largest read and write requests asked from the kernel (1 MiB)
+#define WRITE_THROUGH_MIN_BLOCKS 128        // Writes of at least this many blocks bypass the write-back cache (64 KiB)
+
+#define DATA_CACHE_MAX_BLOCKS 2048          // Dirty file blocks kept in the write-back cache (1 MiB)
+#define DENTRY_CACHE_MAX_ENTRIES 4096       // Resolved paths kept in the dentry cache
+#define SPILL_CHUNK_BYTES 131072            // Bytes copied at once between memory and the spill container
+#define CLONE_XATTR "user.myfs.clone"      // Setting it on a file replaces its content by a copy of the file its value names
+#define COMPRESSION_XATTR "user.myfs.compression"   // Bytes before and after compression and their ratio
+#define COMPRESS_MIN_SAVING 8               // Files are compressed if it saves at least 1/8 of their pages
+
+#define SNAPSHOT_MAGIC 0x50414e53           // "SNAP"
+#define SNAPSHOT_VERSION 2
+
+#define OPLOG_CREATE 1                      // Create the file ino in parent, value is the mode, the payload the name
+#define OPLOG_REMOVE 2                      // Remove an entry of parent, value is 1 for a directory, the payload the name
+#define OPLOG_RENAME 3                      // Move an entry of parent to the directory value, the payload is both names
+#define OPLOG_LINK 4                        // Add an entry for ino to parent, the payload is the name
+#define OPLOG_CHMOD 5                       // Set the mode of ino to value
+#define OPLOG_CHOWN 6                       // Set the owner of ino, value is the user ID << 32 | the group ID
+#define OPLOG_TRUNCATE 7                    // Set the size of ino to value
+#define OPLOG_WRITE 8                       // Write the payload to ino at the offset value
+#define OPLOG_UTIMENS 9                     // Set the access and modification time of ino, the payload holds both
+#define OPLOG_CLONE 10                      // Replace the content of ino by the content of the file value
+#define OPLOG_COPY 11                       // Copy a range of the file value into ino, the payload holds both offsets and the size
+#define OPLOG_COMPACT_BYTES 67108864        // Size of the operation log that starts a new snapshot (64 MiB)
 
 #define DISK_SIZE 33554432      // 2^25 (33.554432 MB)
 #define FILE_BLOCK_COUNT 65536  // DISK_SIZE / BLOCK_SIZE
-#define FILE_BLOCK_OFFSET 705
+#define FILE_BLOCK_OFFSET 5761
 
-#define MAX_BLOCK_COUNT 66241 // 33915904 B (33.915904 MB)
+#define MAX_BLOCK_COUNT 71297 // 36504064 B (36.504064 MB)
 
+#include <atomic>
+#include <cstdint>
 #include <vector>
+#include <set>
 #include <limits>
+#include <memory>
+
+#include "pathindex.h"
+#include "pagedcontent.h"
+#include "rwlock.h"
+#include "pagecodec.h"
 
 using namespace std;
 
 // TODO: Add structures of your file system here
+struct SnapshotHeader {
+    uint32_t magic = SNAPSHOT_MAGIC;
+    uint32_t version = SNAPSHOT_VERSION;
+    uint64_t length = 0;            // Size of the image in bytes, a shorter image was not written completely
+    uint64_t nextIno = 0;           // Inode number of the next new file
+    uint64_t numFiles = 0;          // Number of file records, the root directory comes first
+    uint64_t numEntries = 0;        // Number of directory entry records
+    uint64_t numPages = 0;          // Number of stored pages of all files
+    uint64_t filesOffset = 0;       // Position of the file records
+    uint64_t entriesOffset = 0;     // Position of the directory entry records
+    uint64_t namesOffset = 0;       // Position of the names of the entries, without terminators
+    uint64_t pagesOffset = 0;       // Position of the page numbers of the stored pages
+    uint64_t dataOffset = 0;        // Position of the stored pages, aligned to a memory page
+    uint64_t sequence = 0;          // Last record of the operation log the image contains
+};
+
+struct SnapshotFile {
+    uint64_t ino;           // Inode number
+    uint64_t size;          // Size of the content in bytes
+    uint64_t firstPage;     // Index of the first stored page of the file, its pages follow in ascending order
+    uint64_t numPages;      // Number of stored pages, the other pages of the content are holes
+    int64_t atime;          // Last accessed time
+    int64_t mtime;          // Last modified time
+    int64_t ctime;          // Last changed time
+    uint32_t uid;           // Owner user ID
+    uint32_t gid;           // Owner group ID
+    uint32_t mode;          // File type and permissions
+    uint32_t reserved;
+};
+
+struct SnapshotEntry {
+    uint64_t parent;        // Inode number of the directory
+    uint64_t ino;           // Inode number of the file
+    uint64_t nameOffset;    // Position of the name relative to the names
+    uint32_t nameLength;    // Number of characters of the name
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 96 && sizeof(SnapshotFile) == 72 && sizeof(SnapshotEntry) == 32,
+              "Snapshot records must not contain padding");
+
+struct MyFsCompressedContent {
+    vector<uint64_t> pageNumbers;   // Pages that hold data, in ascending order
+    vector<uint64_t> ends;          // End of each compressed page in data, a page of PAGE_BYTES is stored uncompressed
+    vector<char> data;
+
+    size_t originalBytes() const { return this->pageNumbers.size() * PagedContent::PAGE_BYTES; }
+    size_t storedBytes() const {
+        return this->data.size() + this->pageNumbers.size() * 2 * sizeof(uint64_t);
+    }
+};
+
 struct MyFsMemoryInfo {
 
     // File data
-    vector<char> content;
+    PagedContent content;
+    bool spilled = false; // The content was moved to the spill container, content only keeps its size
+    size_t spilledPages = 0; // Pages of the content before it was spilled
+    const SnapshotFile *image = nullptr; // Record in the mapped snapshot the content is still stored in, content only keeps its size
+    MyFsMemoryInfo *colder = nullptr; // Neighbours in the list of files that hold pages, by last access
+    MyFsMemoryInfo *warmer = nullptr;
+    unique_ptr<MyFsCompressedContent> compressed; // Pages of a cold file after compression, content only keeps its size
+    atomic<int64_t> usedAt{0}; // Time the content was last used, atime is not updated with every mount option
+    int64_t incompressibleVersion = -1; // Content version that did not compress well enough
+    RwLock lock; // Held for reading while the content or metadata is read and for writing while it changes
 
     // File metadata
+    uint64_t ino = 0; // Inode number
+    uint64_t contentVersion = 0; // Incremented when the content changes
+    int64_t cachedVersion = -1; // Content version at the last open, -1 if the file was not opened yet
+    uint32_t nlink = 1; // Number of directory entries referencing the file
+    uint32_t openCount = 0; // Number of open handles, a deleted file is freed when the last one is closed
     __uid_t uid; // User ID
     __gid_t gid; // Group ID
     __mode_t mode; // File mode
     __time_t  atime; // Time of last access
     __time_t  mtime; // Time of last modification
     __time_t  ctime; // Time of last status change
+
+    // Entries of a directory, keyed by name. Files are allocated on their own, entries only point to them.
+    PathIndex<MyFsMemoryInfo *> children;
+};
+
+struct MyFsMemoryHandle {
+    MyFsMemoryInfo *file = nullptr;         // Open file, it keeps its address while it is renamed or deleted
+};
+
+struct MyFsInode {
+    uint64_t size = 0;      // File size            64bit
+    int64_t atime = 0;      // Last accessed time   64bit
+    int64_t mtime = 0;      // Last modified time   64bit
+    int64_t ctime = 0;      // Last changed time    64bit
+    uint32_t uid = 0;       // Owner user ID        32bit
+    uint32_t gid = 0;       // Owner group ID       32bit
+    uint32_t mode = 0;      // File type and permissions    32bit
+    uint32_t nlink = 0;     // Number of directory entries referencing the inode, 0 if it is free  32bit
+    uint32_t data = 0;      // First block allocated to the file    32bit
+    uint32_t blocks = 0;    // Number of blocks allocated to the file   32bit
+    uint32_t dataIndex = 0; // Position of the first allocated block in the file, the blocks before it are a hole  32bit
+    uint32_t reserved[1] = {};
+};
+
+static_assert(sizeof(MyFsInode) == INODE_SIZE, "An inode must fill its slot in the inode table");
+
+struct MyFsDiskEntry {
+    uint32_t ino;               // Inode of the file, 0 if the record is unused
+    uint16_t recordLength;      // Bytes from the start of this record to the next one in the block
+    uint8_t nameLength;         // Number of characters of the name
+    uint8_t type;               // File type bits of the mode (mode >> 12)
+    // The name follows without terminator
+};
+
+struct MyFsDirectory;
+
+struct MyFsDirEntry {
+    // In memory only, the name is the key of the entry in its directory
+    uint32_t ino;               // Inode of the file
+    uint32_t block;             // Index of the directory block holding the record of the entry
+    MyFsDirectory *parent = nullptr;    // Directory holding the entry
+};
+
+struct MyFsDirBlock {
+    // In memory only
+    uint16_t block;             // File block
+    uint16_t free = BLOCK_SIZE; // Bytes not used by records
+    vector<PathIndex<MyFsDirEntry>::Entry *> records;   // Entries stored in the block in order
 };
 
-struct MyFsDiskInfo {
-    char name[NAME_LENGTH];  // File name
-    size_t size;    // File size            64bit
-    uint16_t data;  // First block allocated to the file  32bit
-    __uid_t uid;    // Owner user ID        32bit
-    __gid_t gid;    // Owner group ID       32bit
-    __mode_t mode;  // File permissions     32bit
-    __time_t atime; // Last accessed time   64bit
-    __time_t mtime; // Last modified time   64bit
-    __time_t ctime; // Creation time        64bit
+struct MyFsDirectory {
+    // In memory only, a directory is stored as a chain of file blocks with variable-length records
+    PathIndex<MyFsDirEntry> entries;    // Entries keyed by name
+    vector<MyFsDirBlock> blocks;        // Blocks of the directory in order
+    uint32_t ino = 0;                   // Inode of the directory
+};
+
+struct MyFsFile : MyFsInode {
+    // In memory only
+    uint32_t ino = 0;           // Number of the inode
+    uint32_t metaSequence = 0;  // Journal record of the last change to the inode
+    uint32_t dataSequence = 0;  // Journal record of the last change to the size or the blocks of the file
+    set<uint16_t> dirtyData;    // Blocks of the file that are held in the write-back cache
+    unique_ptr<MyFsDirectory> directory;    // Entries of the file if it is a directory
+    uint32_t openCount = 0;     // Number of open handles, a deleted file is freed when the last one is closed
+    uint64_t lookups = 0;       // References held by the kernel through the FUSE 3 low-level API
+    uint32_t chainVersion = 0;  // Incremented when blocks are cut from the chain
+    uint32_t contentVersion = 0;    // Incremented when the content changes
+    int64_t cachedVersion = -1;     // Content version at the last open, -1 if the file was not opened yet
+    bool unsyncedData = false;      // Data was written past the write-back cache and is not synced yet
+};
+
+struct MyFsHandle {
+    // In memory only
+    uint32_t ino = 0;           // Inode of the open file
+    bool positioned = false;    // Set if the position below is known
+    uint32_t blockIndex = 0;    // Position in the block chain reached by the last access
+    uint16_t block = 0;         // Block at that position
+    uint32_t chainVersion = 0;  // Chain version of the file the position belongs to
+    off_t nextOffset = 0;       // Offset where a sequential read continues
+    uint32_t window = 0;        // Number of blocks to read ahead
+    uint32_t bufferIndex = 0;   // Position in the block chain of the first block in the buffer
+    uint32_t bufferVersion = 0; // Content version of the file the buffer was read at
+    vector<char> buffer;        // Blocks read ahead
 };
 
 struct SuperBlock {
+    uint32_t magic = SUPERBLOCK_MAGIC;                          // Identifies a MyFS container
+    uint32_t version = SUPERBLOCK_VERSION;                      // Layout of the container
     uint32_t blockSize = BLOCK_SIZE;                            // Size of a block in bytes
     uint32_t numBlocks = MAX_BLOCK_COUNT;                       // Total number of blocks in the file system
-    uint32_t numFreeBlocks = numeric_limits<uint16_t>::max();   // Number of free blocks in this dmap block
+    uint32_t numFreeBlocks = FILE_BLOCK_COUNT;                  // Number of free blocks in the file system
     uint32_t dmapBlockOffset = DMAP_BLOCK_OFFSET;                // Block number of the data map
     uint32_t fatBlockOffset = FAT_BLOCK_OFFSET;                  // Block number of the file allocation table
-    uint32_t rootBlockOffset = ROOT_BLOCK_OFFSET;                // Block number of the root directory
-    uint32_t fileBlockOffset = FILE_BLOCK_OFFSET;               // Block number of the root directory
+    uint32_t fileBlockOffset = FILE_BLOCK_OFFSET;               // Block number of the first file block
+    uint32_t journalBlockOffset = JOURNAL_BLOCK_OFFSET;         // Block number of the metadata journal
+    uint32_t journalBlockCount = JOURNAL_BLOCK_COUNT;           // Number of blocks in the metadata journal
+    uint32_t clean = 0;                                         // Set if the file system was unmounted cleanly
+    uint32_t inodeBlockOffset = INODE_BLOCK_OFFSET;             // Block number of the inode table
+    uint32_t inodeBlockCount = INODE_BLOCK_COUNT;               // Number of blocks in the inode table
 };
 
 struct DMapEntry {
@@ -84,8 +285,27 @@ struct DMapEntry {
 };
 
 struct FATEntry {
-    uint16_t nextBlock = 0; // Block number of the next block in the file
-    bool isLast = true;     // Flag indicating whether this is the last block in the file
+    uint16_t nextBlock = 0;     // Block number of the next block in the file
+    uint16_t isLast : 1;        // Flag indicating whether this is the last block in the file
+    uint16_t holeAfter : 15;    // Number of blocks of the file between this block and the next one that are a hole
+
+    FATEntry() : isLast(1), holeAfter(0) {}
+};
+
+static_assert(sizeof(FATEntry) * FAT_ENTRIES_PER_BLOCK == BLOCK_SIZE, "The FAT entries must fill their blocks");
+
+struct JournalHeader {
+    uint32_t magic = JOURNAL_MAGIC;     // Marks an initialized journal
+    uint32_t sequence = 1;              // Sequence number of the first record that has not been checkpointed
+};
+
+struct JournalRecord {
+    uint32_t magic = JOURNAL_MAGIC;     // Marks the descriptor block of a record
+    uint32_t sequence = 0;              // Sequence number of the record
+    uint16_t numBlocks = 0;             // Number of block images following the descriptor
+    uint16_t flags = 0;                 // JOURNAL_RECORD_CONTINUED if the operation spans more records
+    uint32_t checksum = 0;              // Checksum over the descriptor and all block images
+    uint32_t blockNo[JOURNAL_RECORD_MAX_BLOCKS];  // Home location of each block image
 };
 
 #endif /* myfs_structs_h */
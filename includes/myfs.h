@@ -11,9 +11,27 @@
 
 #include <fuse.h>
 #include <cmath>
+#include <mutex>
 
 #include "blockdevice.h"
 #include "myfs-structs.h"
+#include "myfs-info.h"
+
+// FUSE 3 added flags to the filler of readdir
+#if FUSE_USE_VERSION >= 30
+#define FILL_DIR(filler, buf, name) (filler)(buf, name, NULL, 0, (enum fuse_fill_dir_flags) 0)
+#else
+#define FILL_DIR(filler, buf, name) (filler)(buf, name, NULL, 0)
+#endif
+
+/// @brief Add an entry to a directory listing of the inode interface.
+///
+/// \param [in] buf Buffer passed to inodeReaddir().
+/// \param [in] name Name of the entry.
+/// \param [in] statbuf Inode number and type of the entry in st_ino and st_mode.
+/// \param [in] offset Offset to pass to inodeReaddir() to continue after the entry.
+/// \return 0 if the entry was added, 1 if the buffer is full.
+typedef int (*MyFsFiller)(void *buf, const char *name, const struct stat *statbuf, off_t offset);
 
 class MyFS {
 protected:
@@ -21,6 +39,20 @@ protected:
     FILE *logFile;
 
     BlockDevice *blockDevice;
+
+    // Mount options
+    MyFsInfo *info = nullptr;           // Set if the mount command does not pass it in the FUSE context
+    int atimeMode = ATIME_RELATIME;     // When reading a file updates its access time
+    bool lazytime = false;              // Keep changes of timestamps in memory until the file is synced
+
+    // Inodes whose attributes changed without a request of the kernel, only collected if the mount command can tell
+    // the kernel to drop its cached attributes. Requests on several threads add to them.
+    bool collectInvalidations = false;
+    vector<uint64_t> invalidations;
+    mutex invalidationLock;
+
+    // Set by fuseInit() if the stored file system cannot be read, fuseDestroy() then leaves it untouched
+    bool initFailed = false;
     
 public:
     static MyFS *Instance();
@@ -68,10 +100,51 @@ public:
     virtual int fuseFsyncdir(const char *path, int datasync, struct fuse_file_info *fileInfo);
     virtual int fuseTruncate(const char *path, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseCreate(const char *, mode_t, struct fuse_file_info *);
+    virtual off_t fuseLseek(const char *path, off_t offset, int whence, struct fuse_file_info *fileInfo);
+    virtual ssize_t fuseCopyFileRange(const char *pathIn, struct fuse_file_info *fileInfoIn, off_t offsetIn,
+                                      const char *pathOut, struct fuse_file_info *fileInfoOut, off_t offsetOut,
+                                      size_t size, int flags);
     virtual void fuseDestroy();
+
+    // --- Methods called by the FUSE 3 low-level mount command ---
+    // Files are identified by inode numbers, ROOT_INODE is the root directory. Every entry returned in statbuf counts
+    // as a lookup of its inode, an inode is kept until all its lookups are forgotten. Open files are read, written,
+    // flushed, synced and released with the methods above, which find them through fileInfo->fh.
+    virtual int inodeLookup(uint64_t parent, const char *name, struct stat *statbuf);
+    virtual void inodeForget(uint64_t ino, uint64_t count);
+    virtual int inodeGetattr(uint64_t ino, struct stat *statbuf);
+    virtual int inodeChmod(uint64_t ino, mode_t mode);
+    virtual int inodeChown(uint64_t ino, uid_t uid, gid_t gid);
+    virtual int inodeTruncate(uint64_t ino, off_t newSize, struct fuse_file_info *fileInfo);
+    virtual int inodeUtimens(uint64_t ino, const struct timespec times[2]);
+    virtual int inodeMknod(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf);
+    virtual int inodeMkdir(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf);
+    virtual int inodeUnlink(uint64_t parent, const char *name);
+    virtual int inodeRmdir(uint64_t parent, const char *name);
+    virtual int inodeRename(uint64_t parent, const char *name, uint64_t newParent, const char *newName);
+    virtual int inodeLink(uint64_t ino, uint64_t newParent, const char *newName, struct stat *statbuf);
+    virtual int inodeOpen(uint64_t ino, struct fuse_file_info *fileInfo);
+    virtual int inodeCreate(uint64_t parent, const char *name, mode_t mode, struct fuse_file_info *fileInfo,
+                            struct stat *statbuf);
+    virtual int inodeReaddir(uint64_t ino, void *buf, MyFsFiller filler, off_t offset);
+    virtual int inodeSetxattr(uint64_t ino, const char *name, const char *value, size_t size, int flags);
+    virtual int inodeGetxattr(uint64_t ino, const char *name, char *value, size_t size);
+
+    void setMountInfo(MyFsInfo *info);
+    void enableInvalidations();
+    bool takeInvalidation(uint64_t &ino);
+    bool mountFailed() const;
     
     // TODO: [PART 2] You may add methods of your file system here
-    
+
+protected:
+    MyFsInfo *mountInfo();
+    void setMountOptions(const MyFsInfo *info);
+    bool updatesAtime(time_t atime, time_t mtime, time_t ctime, time_t now);
+    void invalidateInode(uint64_t ino);
+    void configureConnection(struct fuse_conn_info *conn);
+    static void setKeepCache(struct fuse_file_info *fileInfo, int64_t &cachedVersion, uint64_t contentVersion);
+
 };
 
 #endif /* myfs_h */
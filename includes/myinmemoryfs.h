@@ -7,14 +7,31 @@
 #define MYFS_MYINMEMORYFS_H
 
 #include <fuse.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <atomic>
+#include <climits>
+#include <cstring>
 #include <cmath>
+#include <condition_variable>
 #include <string>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 #include "myfs.h"
+#include "myondiskfs.h"
 #include "blockdevice.h"
 #include "myfs-structs.h"
+#include "pathindex.h"
+#include "handletable.h"
+#include "memoryarena.h"
+#include "oplog.h"
+#include "rwlock.h"
 
 using namespace std;
 
@@ -26,21 +43,67 @@ protected:
 public:
     static MyInMemoryFS *Instance();
 
-    map<string, MyFsMemoryInfo> files;
-    unordered_set<string> openFiles;
+    // Memory of files, directory entries and file content, declared first so it outlives everything stored in it
+    SlabAllocator<MyFsMemoryInfo> fileSlab;
+    SlabAllocator<PathIndex<MyFsMemoryInfo *>::Entry> entrySlab;
+    PageArena pageArena;
 
+    // Locks of requests on several threads, see the section below
+    ShardedRwLock namespaceLock;            // Held for writing by requests that change directories or inodes
+    mutable ShardedRwLock dentryLock;       // Held for writing while the dentry cache changes within a reading request
+    RwLock handleLock;                      // Held for writing while files are opened and closed
+    mutex orderedLock;                      // Held while a directory builds its sorted view of the entries
+    recursive_mutex memoryLock;             // Guards the list of files by last access and the spill container
+
+    MyFsMemoryInfo root;                    // Root directory
+    PathIndex<MyFsMemoryInfo *> dentries;   // Cache of resolved paths
+    HandleTable<MyFsMemoryHandle> handles;  // Open files
+    unordered_map<uint64_t, MyFsMemoryInfo *> nodes;   // Files by inode number, allocated from fileSlab
+    uint64_t nextIno = ROOT_INODE + 1;      // Inode number of the next new file
+
+    // Memory limit, see the section below
+    size_t memoryLimit = 0;                 // Bytes in use before files are spilled, 0 for no limit
+    unique_ptr<MyOnDiskFS> spill;           // Container for the content of cold files, nullptr if there is none
+    MyFsInfo spillInfo;
+    MyFsMemoryInfo *hottest = nullptr;      // Files that hold pages, by last access
+    MyFsMemoryInfo *coldest = nullptr;
+
+    // Snapshot, see the section below
+    const char *image = nullptr;            // Mapped snapshot the files were loaded from, nullptr if there is none
+    size_t imageLength = 0;
+
+    // Operation log, see the section below
+    OpLog opLog;                            // Changes since the snapshot, closed if there is no log
+    pid_t compactor = 0;                    // Child process writing a snapshot, 0 if there is none
+    atomic<uint64_t> compactAt{OPLOG_COMPACT_BYTES};    // Size of the log that starts the next snapshot
+    atomic<bool> compactDue{false};         // The log reached compactAt, the snapshot starts when the request ends
+    time_t replayTime = 0;                  // Time of the operation that is replayed, 0 if none is
+
+    // Compression, see the section below
+    int compressAfter = 0;                  // Seconds without use before a file is compressed, 0 for never
+    thread compressThread;                  // Compresses cold files in the background
+    mutex compressLock;                     // Guards compressStopping, the thread waits on it between passes
+    condition_variable compressWakeup;
+    bool compressStopping = false;
+    atomic<size_t> compressedOriginal{0};   // Bytes of all compressed files before and after compression
+    atomic<size_t> compressedStored{0};
 
     MyInMemoryFS();
     ~MyInMemoryFS();
 
     static void SetInstance();
 
+    ArenaUsage memoryUsage() const;
+
     // --- Methods called by FUSE ---
     // For Documentation see https://libfuse.github.io/doxygen/structfuse__operations.html
     virtual int fuseGetattr(const char *path, struct stat *statbuf);
     virtual int fuseMknod(const char *path, mode_t mode, dev_t dev);
+    virtual int fuseMkdir(const char *path, mode_t mode);
     virtual int fuseUnlink(const char *path);
+    virtual int fuseRmdir(const char *path);
     virtual int fuseRename(const char *path, const char *newpath);
+    virtual int fuseLink(const char *path, const char *newpath);
     virtual int fuseChmod(const char *path, mode_t mode);
     virtual int fuseChown(const char *path, uid_t uid, gid_t gid);
     virtual int fuseTruncate(const char *path, off_t newSize);
@@ -50,9 +113,1576 @@ public:
     virtual int fuseRelease(const char *path, struct fuse_file_info *fileInfo);
     virtual void* fuseInit(struct fuse_conn_info *conn);
     virtual int fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo);
+    virtual int fuseFsync(const char *path, int datasync, struct fuse_file_info *fileInfo);
+    virtual int fuseFsyncdir(const char *path, int datasync, struct fuse_file_info *fileInfo);
     virtual int fuseTruncate(const char *path, off_t offset, struct fuse_file_info *fileInfo);
+    virtual int fuseCreate(const char *path, mode_t mode, struct fuse_file_info *fileInfo);
+    virtual off_t fuseLseek(const char *path, off_t offset, int whence, struct fuse_file_info *fileInfo);
+    virtual ssize_t fuseCopyFileRange(const char *pathIn, struct fuse_file_info *fileInfoIn, off_t offsetIn,
+                                      const char *pathOut, struct fuse_file_info *fileInfoOut, off_t offsetOut,
+                                      size_t size, int flags);
+#ifdef __APPLE__
+    virtual int fuseSetxattr(const char *path, const char *name, const char *value, size_t size, int flags, uint32_t x);
+    virtual int fuseGetxattr(const char *path, const char *name, char *value, size_t size, uint x);
+#else
+    virtual int fuseSetxattr(const char *path, const char *name, const char *value, size_t size, int flags);
+    virtual int fuseGetxattr(const char *path, const char *name, char *value, size_t size);
+#endif
     virtual void fuseDestroy();
 
+    // --- Methods called by the FUSE 3 low-level mount command ---
+    virtual int inodeLookup(uint64_t parent, const char *name, struct stat *statbuf);
+    virtual int inodeGetattr(uint64_t ino, struct stat *statbuf);
+    virtual int inodeChmod(uint64_t ino, mode_t mode);
+    virtual int inodeChown(uint64_t ino, uid_t uid, gid_t gid);
+    virtual int inodeTruncate(uint64_t ino, off_t newSize, struct fuse_file_info *fileInfo);
+    virtual int inodeUtimens(uint64_t ino, const struct timespec times[2]);
+    virtual int inodeMknod(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf);
+    virtual int inodeMkdir(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf);
+    virtual int inodeUnlink(uint64_t parent, const char *name);
+    virtual int inodeRmdir(uint64_t parent, const char *name);
+    virtual int inodeRename(uint64_t parent, const char *name, uint64_t newParent, const char *newName);
+    virtual int inodeLink(uint64_t ino, uint64_t newParent, const char *newName, struct stat *statbuf);
+    virtual int inodeOpen(uint64_t ino, struct fuse_file_info *fileInfo);
+    virtual int inodeCreate(uint64_t parent, const char *name, mode_t mode, struct fuse_file_info *fileInfo,
+                            struct stat *statbuf);
+    virtual int inodeReaddir(uint64_t ino, void *buf, MyFsFiller filler, off_t offset);
+    virtual int inodeSetxattr(uint64_t ino, const char *name, const char *value, size_t size, int flags);
+    virtual int inodeGetxattr(uint64_t ino, const char *name, char *value, size_t size);
+
+private:
+
+    // --- Locking ---
+    //
+    // With a multi-threaded mount, requests run at the same time. Requests that change directories or inode numbers
+    // hold the namespace lock for writing and run alone. All others hold it for reading and lock the files they use:
+    // reading a file holds its lock for reading, changing it holds the lock for writing, so requests on different files
+    // run in parallel. Opening and closing files only changes the handle table, which has a lock of its own, unless the
+    // last handle of a deleted file is closed, which frees the file. Reading a directory builds its sorted view of the
+    // entries under a lock of its own. The dentry cache, the list of files by last access with the spill container, the
+    // page arena and the operation log have locks of their own, which are taken after the file locks. A file that is
+    // locked is not spilled, the next colder one is. A snapshot in the background is started when a request ends, with
+    // the namespace lock held for writing, so the child process sees no half-done change.
+
+    /// @brief Namespace lock of a request, held until the request returns.
+    class RequestLock {
+        MyInMemoryFS &fs;
+        bool exclusive;
+        bool outer;
+
+        static bool &inRequest() {
+            static thread_local bool active = false;
+            return active;
+        }
+
+    public:
+        RequestLock(MyInMemoryFS &fs, bool exclusive) : fs(fs), exclusive(exclusive), outer(!inRequest()) {
+            // A request that calls another one keeps the lock of the outer request
+            if (!this->outer)
+                return;
+
+            inRequest() = true;
+            if (exclusive)
+                fs.namespaceLock.lock();
+            else
+                fs.namespaceLock.lockShared();
+        }
+
+        ~RequestLock() {
+            if (this->outer) {
+                this->fs.endRequest(this->exclusive);
+                inRequest() = false;
+            }
+        }
+    };
+
+    void endRequest(bool exclusive) {
+        if (!exclusive) {
+            this->namespaceLock.unlockShared();
+            if (!this->compactDue)
+                return;
+            this->namespaceLock.lock();
+        }
+
+        // A failed snapshot keeps its old log, the next one takes it over
+        finishCompaction(false);
+        if (this->compactDue && this->compactor == 0) {
+            this->compactDue = false;
+            compactLog(true);
+        }
+        this->namespaceLock.unlock();
+    }
+
+    // --- Path resolution ---
+    //
+    // Every directory has its own index of entries. A path is resolved by looking up one component after the other,
+    // resolved paths are remembered in the dentry cache. Entries of the cache are removed when their file is deleted
+    // or moved, the whole cache is dropped when a directory is moved.
+
+    MyFsMemoryInfo *findFile(const char *path, size_t length) {
+
+        // Check the dentry cache first, requests that only read the namespace fill it at the same time
+        uint32_t hash = PathIndex<MyFsMemoryInfo *>::hash(path, length);
+        {
+            LockHolder<ShardedRwLock> guard(this->dentryLock, false);
+            auto cached = this->dentries.find(path, length, hash);
+            if (cached != this->dentries.end())
+                return cached->second;
+        }
+
+        // Walk the path component by component
+        MyFsMemoryInfo *file = &this->root;
+        size_t position = 0;
+        while (position < length) {
+            while (position < length && path[position] == '/')
+                position++;
+            if (position == length)
+                break;
+
+            size_t end = position;
+            while (end < length && path[end] != '/')
+                end++;
+
+            // Only directories can have further components
+            if (!S_ISDIR(file->mode))
+                return nullptr;
+
+            auto iterator = file->children.find(path + position, end - position);
+            if (iterator == file->children.end())
+                return nullptr;
+
+            file = iterator->second;
+            position = end;
+        }
+
+        if (file != &this->root) {
+            LockHolder<ShardedRwLock> guard(this->dentryLock, true);
+            if (this->dentries.size() >= DENTRY_CACHE_MAX_ENTRIES)
+                this->dentries.clear();
+            this->dentries.emplace(path, length, move(file));
+        }
+
+        return file;
+    }
+
+    MyFsMemoryInfo *findFile(const char *path) {
+        MyFsMemoryInfo *file = findFile(path, strlen(path));
+
+        // The root directory is not a file
+        return file != &this->root ? file : nullptr;
+    }
+
+    static bool isCanonicalPath(const string &path) {
+        // Paths from the kernel start with '/' and have no empty, "." or ".." components and no trailing '/'
+        if (path.size() < 2 || path[0] != '/' || path.back() == '/' || path.find('\0') != string::npos)
+            return false;
+
+        size_t position = 1;
+        while (position < path.size()) {
+            size_t end = path.find('/', position);
+            if (end == string::npos)
+                end = path.size();
+            if (end == position || path.compare(position, end - position, ".") == 0
+                || path.compare(position, end - position, "..") == 0)
+                return false;
+            position = end + 1;
+        }
+        return true;
+    }
+
+    MyFsMemoryInfo *findDirectory(const char *path, size_t length) {
+        MyFsMemoryInfo *directory = findFile(path, length);
+        return (directory != nullptr && S_ISDIR(directory->mode)) ? directory : nullptr;
+    }
+
+    MyFsMemoryInfo *findParent(const char *path, const char *&name) {
+        const char *separator = strrchr(path, '/');
+        if (separator == nullptr)
+            return nullptr;
+
+        name = separator + 1;
+        return findDirectory(path, separator - path);
+    }
+
+    void forgetFile(MyFsMemoryInfo &file, const char *path) {
+        // Cached paths below a directory point into it, drop all of them, files removed through the inode interface
+        // have no path
+        if (S_ISDIR(file.mode) || path == nullptr)
+            this->dentries.clear();
+        else
+            this->dentries.erase(path);
+    }
+
+    const vector<PathIndex<MyFsMemoryInfo *>::Entry *> &orderedChildren(MyFsMemoryInfo &directory) {
+        // The view stays valid until the directory changes, which needs the namespace lock for writing
+        lock_guard<mutex> guard(this->orderedLock);
+        return directory.children.ordered();
+    }
+
+    // --- Inode numbers ---
+    //
+    // Every file gets an inode number when it is created. The map from numbers to files holds every file, a file is
+    // freed when its last entry is removed and it is not open. Numbers of deleted files are not reused.
+
+    MyFsMemoryInfo *findInode(uint64_t ino) {
+        if (ino == ROOT_INODE)
+            return &this->root;
+
+        // Deleted files are still found while they are open
+        auto iterator = this->nodes.find(ino);
+        return iterator != this->nodes.end() ? iterator->second : nullptr;
+    }
+
+    void freeUnused(MyFsMemoryInfo &file) {
+        if (file.nlink == 0 && file.openCount == 0) {
+            unlistFile(file);
+            discardSpilled(file);
+            discardCompressed(file);
+            this->nodes.erase(file.ino);
+            this->fileSlab.destroy(&file);
+        }
+    }
+
+    void freeAllFiles() {
+        this->dentries.clear();
+        this->handles.clear();
+        this->root.children.clear();
+        for (auto &node : this->nodes)
+            this->fileSlab.destroy(node.second);
+        this->nodes.clear();
+        this->hottest = this->coldest = nullptr;
+        this->compressedOriginal = this->compressedStored = 0;
+    }
+
+    // --- Memory limit ---
+    //
+    // With a memory limit, files that hold pages are kept in a list by last access. Before a write or a spilled file
+    // needs pages that do not fit into the limit, the content of the coldest files is moved into the spill container,
+    // a file of its own per inode. A spilled file is loaded back before its content is used and removed from the
+    // container. The container has the fixed size of the on-disk file system, FILE_BLOCK_COUNT blocks of BLOCK_SIZE
+    // bytes (32 MiB). A file that does not fit into what is left of it stays in memory and the next warmer one is
+    // spilled instead. Without a spill container or when no file can be spilled, writes that do not fit fail with
+    // ENOSPC. The list and the container are guarded by the memory lock.
+
+    bool isListed(const MyFsMemoryInfo &file) const {
+        return this->hottest == &file || file.warmer != nullptr;
+    }
+
+    void unlistFile(MyFsMemoryInfo &file) {
+        if (this->memoryLimit == 0)
+            return;
+
+        lock_guard<recursive_mutex> guard(this->memoryLock);
+        if (!isListed(file))
+            return;
+
+        (file.warmer != nullptr ? file.warmer->colder : this->hottest) = file.colder;
+        (file.colder != nullptr ? file.colder->warmer : this->coldest) = file.warmer;
+        file.warmer = file.colder = nullptr;
+    }
+
+    void touchFile(MyFsMemoryInfo &file) {
+        // The compression thread looks for files that were not used for a while
+        if (this->compressAfter > 0) {
+            int64_t now = time(nullptr);
+            if (file.usedAt != now)
+                file.usedAt = now;
+        }
+
+        if (this->memoryLimit == 0 || file.content.allocatedPages() == 0)
+            return;
+
+        lock_guard<recursive_mutex> guard(this->memoryLock);
+        if (this->hottest == &file)
+            return;
+
+        unlistFile(file);
+        file.colder = this->hottest;
+        (this->hottest != nullptr ? this->hottest->warmer : this->coldest) = &file;
+        this->hottest = &file;
+    }
+
+    static void spillPath(const MyFsMemoryInfo &file, char *path, size_t length) {
+        snprintf(path, length, "/%llu", (unsigned long long) file.ino);
+    }
+
+    int spillFile(MyFsMemoryInfo &file) {
+        char path[32];
+        spillPath(file, path, sizeof(path));
+        int ret = this->spill->fuseMknod(path, S_IFREG | 0600, 0);
+        if (ret < 0)
+            return ret;
+
+        // Only runs of pages are written, holes stay holes in the container
+        vector<char> buffer(SPILL_CHUNK_BYTES);
+        size_t size = file.content.size();
+        for (size_t offset = file.content.nextData(0); offset < size && ret >= 0;) {
+            size_t end = file.content.nextHole(offset);
+            while (offset < end && ret >= 0) {
+                size_t count = file.content.read(offset, min(end - offset, buffer.size()), buffer.data());
+                ret = this->spill->fuseWrite(path, buffer.data(), count, offset, nullptr);
+                if (ret >= 0 && (size_t) ret < count)
+                    ret = -ENOSPC;
+                offset += count;
+            }
+            offset = file.content.nextData(end);
+        }
+        if (ret >= 0)
+            ret = this->spill->fuseTruncate(path, size);
+
+        if (ret < 0) {
+            this->spill->fuseUnlink(path);
+            return ret;
+        }
+
+        unlistFile(file);
+        file.spilledPages = file.content.allocatedPages();
+        file.content.dropPages();
+        file.spilled = true;
+        return 0;
+    }
+
+    void discardSpilled(MyFsMemoryInfo &file) {
+        if (!file.spilled)
+            return;
+
+        lock_guard<recursive_mutex> guard(this->memoryLock);
+        char path[32];
+        spillPath(file, path, sizeof(path));
+        this->spill->fuseUnlink(path);
+        file.spilled = false;
+        file.spilledPages = 0;
+    }
+
+    int reserveMemory(MyFsMemoryInfo &file, size_t bytes) {
+        if (this->memoryLimit == 0)
+            return 0;
+
+        lock_guard<recursive_mutex> guard(this->memoryLock);
+        MyFsMemoryInfo *victim = this->coldest;
+        while (memoryUsage().bytesUsed + bytes > this->memoryLimit) {
+            // Files that other requests use are skipped, so are the ones of this request
+            while (victim != nullptr && (victim == &file || !victim->lock.tryLock()))
+                victim = victim->warmer;
+            if (!this->spill || victim == nullptr)
+                return -ENOSPC;
+
+            // A file that cannot be spilled, for example because the container is full, stays in memory
+            MyFsMemoryInfo *next = victim->warmer;
+            if (victim->content.allocatedPages() == 0)
+                unlistFile(*victim);
+            else
+                spillFile(*victim);
+            victim->lock.unlock();
+            victim = next;
+        }
+        return 0;
+    }
+
+    int loadFile(MyFsMemoryInfo &file) {
+        if (file.compressed != nullptr)
+            return decompressFile(file);
+        if (file.image != nullptr) {
+            loadImage(file);
+            return 0;
+        }
+        if (!file.spilled)
+            return 0;
+
+        // Loading goes over the limit if nothing else can be spilled, reading must not fail because of it
+        lock_guard<recursive_mutex> guard(this->memoryLock);
+        reserveMemory(file, file.spilledPages * PagedContent::PAGE_BYTES);
+
+        char path[32];
+        spillPath(file, path, sizeof(path));
+        vector<char> buffer(SPILL_CHUNK_BYTES);
+        size_t size = file.content.size();
+        int ret = 0;
+        off_t offset = this->spill->fuseLseek(path, 0, SEEK_DATA, nullptr);
+        while (offset >= 0 && ret >= 0) {
+            off_t end = this->spill->fuseLseek(path, offset, SEEK_HOLE, nullptr);
+            if (end < 0)
+                ret = (int) end;
+
+            while (offset < end && ret >= 0) {
+                size_t count = min((size_t) (end - offset), buffer.size());
+                ret = this->spill->fuseRead(path, buffer.data(), count, offset, nullptr);
+                if (ret == 0)
+                    ret = -EIO;
+                if (ret > 0) {
+                    file.content.write(offset, buffer.data(), ret);
+                    offset += ret;
+                }
+            }
+
+            if (ret >= 0 && (size_t) end < size)
+                offset = this->spill->fuseLseek(path, end, SEEK_DATA, nullptr);
+            else
+                offset = -ENXIO;
+        }
+        if (ret >= 0 && offset != -ENXIO)
+            ret = (int) offset;
+
+        if (ret < 0) {
+            file.content.dropPages();
+            return ret;
+        }
+
+        discardSpilled(file);
+        touchFile(file);
+        return 0;
+    }
+
+    int resizeContent(MyFsMemoryInfo &file, off_t newSize) {
+
+        // A file that is emptied does not have to be loaded
+        int ret = (newSize != 0) ? loadFile(file) : 0;
+        if (ret >= 0)
+            ret = logOp(OPLOG_TRUNCATE, file.ino, 0, newSize);
+        if (ret < 0)
+            return ret;
+
+        if (newSize == 0) {
+            discardSpilled(file);
+            discardCompressed(file);
+            file.image = nullptr;
+        }
+
+        file.content.resize(newSize);
+        file.contentVersion++;
+        file.mtime = file.ctime = currentTime();
+        return 0;
+    }
+
+    // --- Compression ---
+    //
+    // With compression, a thread in the background looks for files whose content was not used for a while and
+    // compresses their pages one by one with PageCodec. A compressed file keeps its pages in one buffer and its content
+    // only keeps the size, like a spilled file. Requests that use the content decompress it again, except for reads of
+    // a snapshot or of the source of a copy, which decompress the pages they need. Files that do not save at least
+    // 1/COMPRESS_MIN_SAVING of their memory are left alone until they change, so are files that share pages with a
+    // clone and files that requests hold at the moment.
+
+    void startCompression() {
+        this->compressAfter = max(mountInfo()->compressAfter, 0);
+        if (this->compressAfter == 0)
+            return;
+
+        this->compressStopping = false;
+        this->compressThread = thread(&MyInMemoryFS::compressLoop, this);
+    }
+
+    void stopCompression() {
+        if (this->compressThread.joinable()) {
+            {
+                lock_guard<mutex> guard(this->compressLock);
+                this->compressStopping = true;
+            }
+            this->compressWakeup.notify_all();
+            this->compressThread.join();
+        }
+        this->compressAfter = 0;
+    }
+
+    void compressLoop() {
+        // Files are checked several times per interval, so they are compressed soon after they became cold
+        unique_lock<mutex> guard(this->compressLock);
+        while (!this->compressStopping) {
+            this->compressWakeup.wait_for(guard, chrono::seconds(max(this->compressAfter / 4, 1)));
+            if (this->compressStopping)
+                break;
+
+            guard.unlock();
+            compressColdFiles(time(nullptr) - this->compressAfter);
+            guard.lock();
+        }
+    }
+
+    size_t compressColdFiles(time_t before) {
+
+        // Candidates are collected first, so requests that change the namespace only wait for one file at a time
+        vector<uint64_t> candidates;
+        {
+            RequestLock request(*this, false);
+            for (auto &node : this->nodes) {
+                int64_t usedAt = node.second->usedAt;
+                if (S_ISREG(node.second->mode) && usedAt != 0 && usedAt < before)
+                    candidates.push_back(node.first);
+            }
+        }
+
+        size_t compressed = 0;
+        for (uint64_t ino : candidates) {
+            RequestLock request(*this, false);
+            MyFsMemoryInfo *file = findInode(ino);
+            if (file != nullptr && file->lock.tryLock()) {
+                compressed += compressFile(*file, before) ? 1 : 0;
+                file->lock.unlock();
+            }
+        }
+        return compressed;
+    }
+
+    bool compressFile(MyFsMemoryInfo &file, time_t before) {
+
+        // The file may have been used since it was picked, otherwise it is only picked again after its next use
+        int64_t usedAt = file.usedAt;
+        if (usedAt == 0 || usedAt >= before)
+            return false;
+        file.usedAt = 0;
+
+        size_t pages = file.content.allocatedPages();
+        if (file.compressed != nullptr || file.spilled || file.image != nullptr || pages == 0
+            || file.incompressibleVersion == (int64_t) file.contentVersion)
+            return false;
+
+        // Pages that do not get smaller are stored as they are
+        unique_ptr<MyFsCompressedContent> packed(new MyFsCompressedContent());
+        packed->pageNumbers.reserve(pages);
+        packed->ends.reserve(pages);
+        size_t limit = pages * PagedContent::PAGE_BYTES / COMPRESS_MIN_SAVING * (COMPRESS_MIN_SAVING - 1);
+        char buffer[PagedContent::PAGE_BYTES];
+        for (size_t index = 0; index < file.content.numPages() && packed->storedBytes() <= limit; index++) {
+            const char *page = file.content.page(index);
+            if (page == nullptr)
+                continue;
+
+            // A page shared with a clone would be stored twice
+            if (this->pageArena.isShared(page))
+                return false;
+
+            size_t length = PageCodec::compress(page, PagedContent::PAGE_BYTES, buffer, PagedContent::PAGE_BYTES - 1);
+            if (length == 0) {
+                memcpy(buffer, page, PagedContent::PAGE_BYTES);
+                length = PagedContent::PAGE_BYTES;
+            }
+            packed->data.insert(packed->data.end(), buffer, buffer + length);
+            packed->pageNumbers.push_back(index);
+            packed->ends.push_back(packed->data.size());
+        }
+        if (packed->storedBytes() > limit) {
+            file.incompressibleVersion = (int64_t) file.contentVersion;
+            return false;
+        }
+
+        packed->data.shrink_to_fit();
+        this->compressedOriginal += packed->originalBytes();
+        this->compressedStored += packed->storedBytes();
+        unlistFile(file);
+        file.content.dropPages();
+        file.compressed = move(packed);
+        return true;
+    }
+
+    ssize_t readCompressedPage(const MyFsCompressedContent &packed, size_t index, char *page) const {
+        size_t start = index > 0 ? packed.ends[index - 1] : 0;
+        size_t length = packed.ends[index] - start;
+        if (length == PagedContent::PAGE_BYTES) {
+            memcpy(page, &packed.data[start], length);
+            return length;
+        }
+        return PageCodec::decompress(&packed.data[start], length, page, PagedContent::PAGE_BYTES);
+    }
+
+    int readCompressed(const MyFsMemoryInfo &file, size_t offset, size_t size, char *buf) const {
+        size_t length = file.content.size();
+        if (offset >= length)
+            return 0;
+        size = min(size, length - offset);
+
+        // Pages are found by their page number like in the snapshot, the others are holes
+        const MyFsCompressedContent &packed = *file.compressed;
+        char page[PagedContent::PAGE_BYTES];
+        for (size_t done = 0; done < size;) {
+            size_t number = (offset + done) / PagedContent::PAGE_BYTES;
+            size_t pageOffset = (offset + done) % PagedContent::PAGE_BYTES;
+            size_t count = min(size - done, (size_t) PagedContent::PAGE_BYTES - pageOffset);
+
+            auto found = lower_bound(packed.pageNumbers.begin(), packed.pageNumbers.end(), (uint64_t) number);
+            if (found != packed.pageNumbers.end() && *found == number) {
+                if (readCompressedPage(packed, found - packed.pageNumbers.begin(), page) != PagedContent::PAGE_BYTES)
+                    return -EIO;
+                memcpy(buf + done, page + pageOffset, count);
+            } else {
+                memset(buf + done, 0, count);
+            }
+            done += count;
+        }
+
+        return (int) size;
+    }
+
+    int decompressFile(MyFsMemoryInfo &file) {
+
+        // Decompressing goes over the limit if nothing else can be spilled, reading must not fail because of it
+        const MyFsCompressedContent &packed = *file.compressed;
+        reserveMemory(file, packed.originalBytes());
+
+        char page[PagedContent::PAGE_BYTES];
+        size_t size = file.content.size();
+        for (size_t index = 0; index < packed.pageNumbers.size(); index++) {
+            if (readCompressedPage(packed, index, page) != PagedContent::PAGE_BYTES) {
+                file.content.dropPages();
+                return -EIO;
+            }
+            size_t offset = packed.pageNumbers[index] * PagedContent::PAGE_BYTES;
+            file.content.write(offset, page, min((size_t) PagedContent::PAGE_BYTES, size - offset));
+        }
+
+        discardCompressed(file);
+        touchFile(file);
+        return 0;
+    }
+
+    void discardCompressed(MyFsMemoryInfo &file) {
+        if (file.compressed == nullptr)
+            return;
+
+        this->compressedOriginal -= file.compressed->originalBytes();
+        this->compressedStored -= file.compressed->storedBytes();
+        file.compressed.reset();
+    }
+
+    int compressionXattr(const MyFsMemoryInfo &file, char *value, size_t size) {
+
+        // The root directory reports all files, the pages of files that are not compressed count as they are
+        size_t original, stored;
+        if (&file == &this->root) {
+            size_t pages = this->pageArena.usage().bytesUsed;
+            original = this->compressedOriginal + pages;
+            stored = this->compressedStored + pages;
+        } else if (file.compressed != nullptr) {
+            original = file.compressed->originalBytes();
+            stored = file.compressed->storedBytes();
+        } else {
+            original = stored = file.content.allocatedPages() * PagedContent::PAGE_BYTES;
+        }
+
+        char text[64];
+        int length = snprintf(text, sizeof(text), "%zu %zu %.2f", original, stored,
+                              stored > 0 ? (double) original / stored : 1.0);
+        if (size == 0)
+            return length;
+        if (size < (size_t) length)
+            return -ERANGE;
+        memcpy(value, text, length);
+        return length;
+    }
+
+    // --- Copies ---
+    //
+    // A clone of a file shares the pages of its source, a page is copied when one of the two writes it. A clone of a
+    // file of the snapshot reads the same pages of the mapped image instead. Copies of ranges share the whole pages that
+    // keep their position within a page and copy the rest.
+
+    int cloneContent(MyFsMemoryInfo &target, MyFsMemoryInfo &source) {
+        if (&target == &source)
+            return 0;
+
+        // Loading the source may spill the target, its old content is dropped anyway
+        int ret = (source.image == nullptr) ? loadFile(source) : 0;
+        if (ret >= 0)
+            ret = logOp(OPLOG_CLONE, target.ino, 0, source.ino);
+        if (ret < 0)
+            return ret;
+
+        if (source.image != nullptr) {
+            discardSpilled(target);
+            discardCompressed(target);
+            unlistFile(target);
+            target.content.clear();
+            target.content.resize(source.content.size());
+            target.image = source.image;
+        } else {
+            discardSpilled(target);
+            discardCompressed(target);
+            target.image = nullptr;
+            target.content.clone(source.content);
+            touchFile(target);
+        }
+
+        target.contentVersion++;
+        target.mtime = target.ctime = currentTime();
+        return 0;
+    }
+
+    int cloneFromPath(MyFsMemoryInfo &target, const char *value, size_t size) {
+        // The value names the source, tools may count the terminating zero as part of it
+        string sourcePath(value, size);
+        if (!sourcePath.empty() && sourcePath.back() == '\0')
+            sourcePath.pop_back();
+
+        // Other spellings of a path would stay in the dentry cache when the file is removed
+        if (!isCanonicalPath(sourcePath))
+            return -EINVAL;
+
+        MyFsMemoryInfo *source = findFile(sourcePath.c_str());
+        if (source == nullptr)
+            return -ENOENT;
+        if (S_ISDIR(target.mode) || S_ISDIR(source->mode))
+            return -EISDIR;
+        if (!S_ISREG(target.mode) || !S_ISREG(source->mode))
+            return -EINVAL;
+
+        // The kernel did not see the content change
+        invalidateInode(target.ino);
+        return cloneContent(target, *source);
+    }
+
+    int copyContent(MyFsMemoryInfo &target, size_t offset, MyFsMemoryInfo &source, size_t sourceOffset, size_t size) {
+        size_t length = source.content.size();
+        size = sourceOffset < length ? min(size, length - sourceOffset) : 0;
+        size = min(size, (size_t) INT_MAX & ~(size_t) (PagedContent::PAGE_BYTES - 1));
+        if (size == 0)
+            return 0;
+        if (&target == &source && sourceOffset < offset + size && offset < sourceOffset + size)
+            return -EINVAL;
+
+        // Shared pages need no memory, only the partial pages at both ends are copied
+        int ret = loadFile(target);
+        size_t pages = target.content.missingPages(offset, size);
+        bool inMemory = source.image == nullptr && !source.spilled && source.compressed == nullptr;
+        if (ret >= 0 && inMemory && target.content.canShare(source.content, sourceOffset, offset))
+            ret = reserveMemory(target, min(pages, (size_t) 2) * PagedContent::PAGE_BYTES);
+        else if (ret >= 0)
+            ret = reserveMemory(target, pages * PagedContent::PAGE_BYTES);
+        if (ret < 0)
+            return ret;
+
+        // The copy is logged before it is made. A deleted source is gone when the log is replayed, so the copied bytes
+        // are logged instead and only the part that made it into the log is copied.
+        if (source.nlink > 0) {
+            uint64_t range[3] = {sourceOffset, offset, size};
+            ret = logOp(OPLOG_COPY, target.ino, 0, source.ino, (const char *) range, sizeof(range));
+        } else if (this->opLog.isOpen()) {
+            ret = logCopiedBytes(target, offset, source, sourceOffset, size);
+            if (ret > 0)
+                size = (size_t) ret;
+        }
+        if (ret < 0)
+            return ret;
+
+        if (inMemory) {
+            target.content.copy(source.content, sourceOffset, offset, size);
+            touchFile(source);
+        } else {
+            // A source that is not in memory is read from where it is and copied
+            ret = reserveMemory(target, pages * PagedContent::PAGE_BYTES);
+            vector<char> buffer(min(size, (size_t) SPILL_CHUNK_BYTES));
+            for (size_t done = 0; done < size && ret >= 0; done += ret) {
+                ret = readContent(source, sourceOffset + done, min(size - done, buffer.size()), buffer.data());
+                if (ret == 0)
+                    ret = -EIO;
+                if (ret > 0)
+                    target.content.write(offset + done, buffer.data(), ret);
+            }
+            if (ret < 0)
+                return ret;
+        }
+
+        target.contentVersion++;
+        target.mtime = target.ctime = currentTime();
+        touchFile(target);
+        return (int) size;
+    }
+
+    int logCopiedBytes(const MyFsMemoryInfo &target, size_t offset, MyFsMemoryInfo &source, size_t sourceOffset,
+                       size_t size) {
+        // Records hold at most one request, the bytes logged before a failure are still copied
+        vector<char> buffer(min(size, (size_t) MAX_REQUEST_SIZE));
+        size_t done = 0;
+        int ret = 0;
+        while (done < size) {
+            ret = readContent(source, sourceOffset + done, min(size - done, buffer.size()), buffer.data());
+            if (ret == 0)
+                ret = -EIO;
+            if (ret > 0) {
+                size_t count = (size_t) ret;
+                ret = logOp(OPLOG_WRITE, target.ino, 0, offset + done, buffer.data(), count);
+                if (ret >= 0)
+                    done += count;
+            }
+            if (ret < 0)
+                break;
+        }
+        return done > 0 ? (int) done : ret;
+    }
+
+    // --- Snapshot ---
+    //
+    // The image holds a header, the records of all files and directory entries, the page numbers of the stored pages
+    // and the names of the entries, followed by the stored pages at page-aligned positions. A mount maps the image and
+    // only reads the records, a file reads its pages from the mapping until it is changed, then they are copied into
+    // memory. The mapping is kept until the file system is unmounted. A new image is written next to the old one and
+    // renamed over it, so a crash leaves either of them.
+
+    const SnapshotHeader &imageHeader() const {
+        return *(const SnapshotHeader *) this->image;
+    }
+
+    const uint64_t *imagePageNumbers(const MyFsMemoryInfo &file) const {
+        return (const uint64_t *) (this->image + imageHeader().pagesOffset) + file.image->firstPage;
+    }
+
+    const char *imagePage(const MyFsMemoryInfo &file, size_t index) const {
+        return this->image + imageHeader().dataOffset + (file.image->firstPage + index) * PagedContent::PAGE_BYTES;
+    }
+
+    size_t readImage(const MyFsMemoryInfo &file, size_t offset, size_t size, char *buf) const {
+        size_t length = file.content.size();
+        if (offset >= length)
+            return 0;
+        size = min(size, length - offset);
+
+        // Stored pages are found by their page number, the others are holes
+        const uint64_t *numbers = imagePageNumbers(file);
+        const uint64_t *end = numbers + file.image->numPages;
+        for (size_t done = 0; done < size;) {
+            size_t page = (offset + done) / PagedContent::PAGE_BYTES;
+            size_t pageOffset = (offset + done) % PagedContent::PAGE_BYTES;
+            size_t count = min(size - done, (size_t) PagedContent::PAGE_BYTES - pageOffset);
+
+            const uint64_t *found = lower_bound(numbers, end, (uint64_t) page);
+            if (found != end && *found == page)
+                memcpy(buf + done, imagePage(file, found - numbers) + pageOffset, count);
+            else
+                memset(buf + done, 0, count);
+            done += count;
+        }
+
+        return size;
+    }
+
+    void loadImage(MyFsMemoryInfo &file) {
+
+        // Loading goes over the limit if nothing else can be spilled, reading must not fail because of it
+        reserveMemory(file, file.image->numPages * PagedContent::PAGE_BYTES);
+
+        const uint64_t *numbers = imagePageNumbers(file);
+        size_t size = file.content.size();
+        for (size_t index = 0; index < file.image->numPages; index++) {
+            size_t offset = numbers[index] * PagedContent::PAGE_BYTES;
+            file.content.write(offset, imagePage(file, index), min((size_t) PagedContent::PAGE_BYTES, size - offset));
+        }
+
+        file.image = nullptr;
+        touchFile(file);
+    }
+
+    void unmapImage() {
+        if (this->image != nullptr)
+            munmap((void *) this->image, this->imageLength);
+        this->image = nullptr;
+        this->imageLength = 0;
+    }
+
+    int storedPages(const MyFsMemoryInfo &file, vector<uint64_t> &numbers) {
+        if (file.image != nullptr) {
+            numbers.insert(numbers.end(), imagePageNumbers(file), imagePageNumbers(file) + file.image->numPages);
+            return 0;
+        }
+
+        if (file.compressed != nullptr) {
+            numbers.insert(numbers.end(), file.compressed->pageNumbers.begin(), file.compressed->pageNumbers.end());
+            return 0;
+        }
+
+        if (!file.spilled) {
+            for (size_t page = 0; page < file.content.numPages(); page++) {
+                if (file.content.page(page) != nullptr)
+                    numbers.push_back(page);
+            }
+            return 0;
+        }
+
+        // The spill container knows the runs of data of the file, every page they touch is stored
+        lock_guard<recursive_mutex> guard(this->memoryLock);
+        char path[32];
+        spillPath(file, path, sizeof(path));
+        size_t first = numbers.size();
+        off_t size = (off_t) file.content.size();
+        off_t offset = this->spill->fuseLseek(path, 0, SEEK_DATA, nullptr);
+        while (offset >= 0 && offset < size) {
+            off_t end = this->spill->fuseLseek(path, offset, SEEK_HOLE, nullptr);
+            if (end < 0)
+                return (int) end;
+
+            for (uint64_t page = offset / PagedContent::PAGE_BYTES; page * PagedContent::PAGE_BYTES < (uint64_t) end;
+                 page++) {
+                if (numbers.size() == first || numbers.back() < page)
+                    numbers.push_back(page);
+            }
+            offset = end < size ? this->spill->fuseLseek(path, end, SEEK_DATA, nullptr) : size;
+        }
+        return (offset >= 0 || offset == -ENXIO) ? 0 : (int) offset;
+    }
+
+    int readContent(MyFsMemoryInfo &file, size_t offset, size_t size, char *buf) {
+        if (file.image != nullptr)
+            return (int) readImage(file, offset, size, buf);
+        if (file.compressed != nullptr)
+            return readCompressed(file, offset, size, buf);
+
+        if (file.spilled) {
+            lock_guard<recursive_mutex> guard(this->memoryLock);
+            char path[32];
+            spillPath(file, path, sizeof(path));
+            return this->spill->fuseRead(path, buf, size, offset, nullptr);
+        }
+
+        return (int) file.content.read(offset, size, buf);
+    }
+
+    int writeSnapshot(const char *path) {
+
+        // Deleted files that are still open are not part of the image
+        vector<MyFsMemoryInfo *> files(1, &this->root);
+        for (auto &node : this->nodes) {
+            if (node.second->nlink > 0)
+                files.push_back(node.second);
+        }
+
+        SnapshotHeader header;
+        vector<SnapshotFile> records(files.size());
+        vector<SnapshotEntry> entries;
+        vector<uint64_t> pages;
+        string names;
+        for (size_t i = 0; i < files.size(); i++) {
+            const MyFsMemoryInfo &file = *files[i];
+            SnapshotFile &record = records[i];
+            memset(&record, 0, sizeof(record));
+            record.ino = file.ino;
+            record.size = file.content.size();
+            record.atime = file.atime;
+            record.mtime = file.mtime;
+            record.ctime = file.ctime;
+            record.uid = file.uid;
+            record.gid = file.gid;
+            record.mode = file.mode;
+            record.firstPage = pages.size();
+            int ret = storedPages(file, pages);
+            if (ret < 0)
+                return ret;
+            record.numPages = pages.size() - record.firstPage;
+
+            for (auto &child : file.children) {
+                SnapshotEntry entry;
+                memset(&entry, 0, sizeof(entry));
+                entry.parent = file.ino;
+                entry.ino = child.second->ino;
+                entry.nameOffset = names.size();
+                entry.nameLength = (uint32_t) child.first.size();
+                entries.push_back(entry);
+                names += child.first;
+            }
+        }
+
+        header.nextIno = this->nextIno;
+        header.sequence = this->opLog.sequence();
+        header.numFiles = records.size();
+        header.numEntries = entries.size();
+        header.numPages = pages.size();
+        header.filesOffset = sizeof(header);
+        header.entriesOffset = header.filesOffset + records.size() * sizeof(SnapshotFile);
+        header.pagesOffset = header.entriesOffset + entries.size() * sizeof(SnapshotEntry);
+        header.namesOffset = header.pagesOffset + pages.size() * sizeof(uint64_t);
+        header.dataOffset = (header.namesOffset + names.size() + PagedContent::PAGE_BYTES - 1)
+                            / PagedContent::PAGE_BYTES * PagedContent::PAGE_BYTES;
+        header.length = header.dataOffset + pages.size() * PagedContent::PAGE_BYTES;
+
+        string temporary = string(path) + ".tmp";
+        FILE *out = fopen(temporary.c_str(), "w");
+        if (out == nullptr)
+            return -errno;
+
+        vector<char> buffer(PagedContent::PAGE_BYTES);
+        size_t padding = header.dataOffset - header.namesOffset - names.size();
+        errno = 0;
+        bool written = fwrite(&header, sizeof(header), 1, out) == 1
+                       && fwrite(records.data(), sizeof(SnapshotFile), records.size(), out) == records.size()
+                       && fwrite(entries.data(), sizeof(SnapshotEntry), entries.size(), out) == entries.size()
+                       && fwrite(pages.data(), sizeof(uint64_t), pages.size(), out) == pages.size()
+                       && fwrite(names.data(), 1, names.size(), out) == names.size()
+                       && fwrite(buffer.data(), 1, padding, out) == padding;
+
+        // Pages follow in the order of their records, bytes behind the end of a file are zeros
+        int ret = 0;
+        for (size_t i = 0; i < files.size() && written; i++) {
+            const SnapshotFile &record = records[i];
+            for (uint64_t page = record.firstPage; page < record.firstPage + record.numPages && written; page++) {
+                size_t offset = pages[page] * PagedContent::PAGE_BYTES;
+                memset(buffer.data(), 0, buffer.size());
+                ret = readContent(*files[i], offset, min((uint64_t) buffer.size(), record.size - offset), buffer.data());
+                written = ret >= 0 && fwrite(buffer.data(), buffer.size(), 1, out) == 1;
+            }
+        }
+
+        written = written && fflush(out) == 0 && fsync(fileno(out)) == 0;
+        if (!written && ret >= 0)
+            ret = errno != 0 ? -errno : -EIO;
+        if (fclose(out) != 0 && ret >= 0)
+            ret = -EIO;
+        if (ret >= 0 && rename(temporary.c_str(), path) < 0)
+            ret = -errno;
+        if (ret < 0) {
+            unlink(temporary.c_str());
+            return ret;
+        }
+
+        // The new name must survive a crash as well
+        OpLog::syncDirectory(path);
+        return 0;
+    }
+
+    bool imageHolds(uint64_t offset, uint64_t count, size_t size) const {
+        return offset <= this->imageLength && count <= (this->imageLength - offset) / size;
+    }
+
+    int loadSnapshot() {
+
+        // Every part must lie within the image, counts are compared to the length so their products cannot overflow
+        const SnapshotHeader &header = imageHeader();
+        if (header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION || header.length != this->imageLength
+            || header.numFiles == 0 || header.filesOffset % 8 != 0 || header.entriesOffset % 8 != 0
+            || header.pagesOffset % 8 != 0 || header.dataOffset % PagedContent::PAGE_BYTES != 0
+            || header.namesOffset > header.dataOffset
+            || !imageHolds(header.filesOffset, header.numFiles, sizeof(SnapshotFile))
+            || !imageHolds(header.entriesOffset, header.numEntries, sizeof(SnapshotEntry))
+            || !imageHolds(header.pagesOffset, header.numPages, sizeof(uint64_t))
+            || !imageHolds(header.dataOffset, header.numPages, PagedContent::PAGE_BYTES))
+            return -EINVAL;
+
+        const SnapshotFile *records = (const SnapshotFile *) (this->image + header.filesOffset);
+        const uint64_t *pages = (const uint64_t *) (this->image + header.pagesOffset);
+        size_t directories = 0;
+        for (size_t i = 0; i < header.numFiles; i++) {
+            const SnapshotFile &record = records[i];
+
+            // The root directory comes first, inode numbers are unique and below the next one
+            bool isRoot = (i == 0);
+            if (isRoot != (record.ino == ROOT_INODE) || record.ino == 0 || record.ino >= header.nextIno
+                || this->nodes.count(record.ino) != 0 || (isRoot && !S_ISDIR(record.mode))
+                || record.size > (uint64_t) numeric_limits<off_t>::max())
+                return -EINVAL;
+
+            // Stored pages lie within the content, in ascending order
+            uint64_t numPages = (record.size + PagedContent::PAGE_BYTES - 1) / PagedContent::PAGE_BYTES;
+            if (record.firstPage > header.numPages || record.numPages > header.numPages - record.firstPage)
+                return -EINVAL;
+            for (uint64_t page = record.firstPage; page < record.firstPage + record.numPages; page++) {
+                if (pages[page] >= numPages || (page > record.firstPage && pages[page] <= pages[page - 1]))
+                    return -EINVAL;
+            }
+
+            MyFsMemoryInfo *file = &this->root;
+            if (!isRoot) {
+                file = this->fileSlab.create();
+                file->ino = record.ino;
+                file->nlink = 0;
+                file->children.setAllocator(&this->entrySlab);
+                file->content.setArena(&this->pageArena);
+                this->nodes[file->ino] = file;
+                directories += S_ISDIR(record.mode) ? 1 : 0;
+            }
+            file->uid = record.uid;
+            file->gid = record.gid;
+            file->mode = record.mode;
+            file->atime = record.atime;
+            file->mtime = record.mtime;
+            file->ctime = record.ctime;
+
+            // Directories have no content
+            if (!S_ISDIR(record.mode)) {
+                file->content.resize(record.size);
+                if (record.numPages > 0)
+                    file->image = &record;
+            }
+        }
+        this->nextIno = header.nextIno;
+
+        // A directory has exactly one entry, the root directory none
+        const SnapshotEntry *entries = (const SnapshotEntry *) (this->image + header.entriesOffset);
+        const char *names = this->image + header.namesOffset;
+        uint64_t namesLength = header.dataOffset - header.namesOffset;
+        for (size_t i = 0; i < header.numEntries; i++) {
+            const SnapshotEntry &entry = entries[i];
+            MyFsMemoryInfo *parent = findInodeDirectory(entry.parent);
+            MyFsMemoryInfo *file = findInode(entry.ino);
+            if (parent == nullptr || file == nullptr || file == &this->root || entry.nameLength == 0
+                || entry.nameLength > NAME_LENGTH || entry.nameOffset > namesLength
+                || entry.nameLength > namesLength - entry.nameOffset || (S_ISDIR(file->mode) && file->nlink > 0))
+                return -EINVAL;
+
+            const char *name = names + entry.nameOffset;
+            if (memchr(name, '/', entry.nameLength) != nullptr
+                || parent->children.find(name, entry.nameLength) != parent->children.end())
+                return -EINVAL;
+
+            MyFsMemoryInfo *child = file;
+            parent->children.emplace(name, entry.nameLength, move(child));
+            file->nlink++;
+        }
+
+        // Every file has an entry and every directory can be reached from the root directory, so there are no cycles
+        vector<MyFsMemoryInfo *> pending(1, &this->root);
+        size_t reached = 0;
+        while (!pending.empty()) {
+            MyFsMemoryInfo *directory = pending.back();
+            pending.pop_back();
+            for (auto &entry : directory->children) {
+                if (S_ISDIR(entry.second->mode)) {
+                    pending.push_back(entry.second);
+                    reached++;
+                }
+            }
+        }
+        for (auto &node : this->nodes) {
+            if (node.second->nlink == 0)
+                return -EINVAL;
+        }
+        return reached == directories ? 0 : -EINVAL;
+    }
+
+    int readSnapshot(const char *path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return -errno;
+
+        struct stat status;
+        int ret = fstat(fd, &status) < 0 ? -errno : 0;
+        if (ret == 0 && (size_t) status.st_size < sizeof(SnapshotHeader))
+            ret = -EINVAL;
+        if (ret < 0) {
+            close(fd);
+            return ret;
+        }
+
+        // Pages are read from the mapping when they are first used
+        void *mapped = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ret = mapped == MAP_FAILED ? -errno : 0;
+        close(fd);
+        if (ret < 0)
+            return ret;
+
+        this->image = (const char *) mapped;
+        this->imageLength = status.st_size;
+        ret = loadSnapshot();
+        if (ret < 0) {
+            freeAllFiles();
+            unmapImage();
+            this->nextIno = ROOT_INODE + 1;
+        }
+        return ret;
+    }
+
+    // --- Operation log ---
+    //
+    // With an operation log, every change is appended to the log after everything that can fail was checked and before
+    // it is made in memory, so a change that cannot be logged is not made. At mount, the log is replayed on top of the
+    // snapshot, records the snapshot already contains are skipped by their sequence number. When the log has grown
+    // large, a child process writes a new snapshot from its copy of the memory while new records go into a fresh log,
+    // the old log is discarded once the child succeeds. The child cannot read the spill container, with a memory limit
+    // the snapshot is written by the file system itself.
+
+    time_t currentTime() const {
+        // Replayed operations happen at the time they were logged
+        return this->replayTime != 0 ? this->replayTime : time(nullptr);
+    }
+
+    int logOp(uint32_t type, uint64_t ino, uint64_t parent, uint64_t value, const char *payload = nullptr,
+              size_t size = 0) {
+        if (!this->opLog.isOpen())
+            return 0;
+
+        OpLogRecord record;
+        record.type = type;
+        record.time = time(nullptr);
+        record.ino = ino;
+        record.parent = parent;
+        record.value = value;
+        int ret = this->opLog.append(record, payload, size);
+        if (ret < 0)
+            return ret;
+
+        // Other requests may be changing files, the snapshot is started when this one ends
+        if (this->opLog.size() >= this->compactAt)
+            this->compactDue = true;
+        return 0;
+    }
+
+    int finishCompaction(bool wait) {
+        if (this->compactor == 0)
+            return 0;
+
+        int status;
+        pid_t done = waitpid(this->compactor, &status, wait ? 0 : WNOHANG);
+        if (done == 0)
+            return 0;
+
+        this->compactor = 0;
+        if (done < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            return -EIO;
+
+        this->opLog.discardOld();
+        return 0;
+    }
+
+    int compactLog(bool background) {
+
+        // A running child writes the same snapshot
+        finishCompaction(true);
+
+        const char *path = mountInfo()->snapshotFile;
+        if (background && !this->spill && this->opLog.rotate() == 0) {
+            pid_t child = fork();
+            if (child == 0)
+                _exit(writeSnapshot(path) < 0 ? 1 : 0);
+            if (child > 0) {
+                this->compactor = child;
+                this->compactAt = OPLOG_COMPACT_BYTES;
+                return 0;
+            }
+        }
+
+        int ret = writeSnapshot(path);
+        if (ret == 0 && this->opLog.isOpen())
+            ret = this->opLog.discard();
+
+        // After a failure, the next try waits until the log has grown as much again
+        this->compactAt = this->opLog.size() + OPLOG_COMPACT_BYTES;
+        return ret;
+    }
+
+    int applyOp(const OpLogRecord &record, const char *payload) {
+        MyFsMemoryInfo *file = findInode(record.ino);
+        MyFsMemoryInfo *parent = findInodeDirectory(record.parent);
+
+        // Files that were deleted while they were open are changed until they are closed, then they are gone
+        if (file == nullptr && record.type >= OPLOG_CHMOD)
+            return 0;
+
+        int ret = 0;
+        this->replayTime = record.time;
+        switch (record.type) {
+            case OPLOG_CREATE: {
+                if (parent == nullptr || file != nullptr || record.ino <= ROOT_INODE) {
+                    ret = -EINVAL;
+                    break;
+                }
+                uint64_t nextIno = this->nextIno;
+                this->nextIno = record.ino;
+                MyFsMemoryInfo *created;
+                ret = createFile(*parent, payload, (mode_t) record.value, created);
+                this->nextIno = max(nextIno, record.ino + 1);
+                break;
+            }
+            case OPLOG_REMOVE:
+                ret = parent != nullptr ? removeFile(*parent, payload, nullptr, record.value != 0) : -EINVAL;
+                break;
+            case OPLOG_RENAME: {
+                MyFsMemoryInfo *newParent = findInodeDirectory(record.value);
+                size_t length = strlen(payload);
+                ret = (parent != nullptr && newParent != nullptr && length < record.length)
+                      ? moveFile(*parent, payload, nullptr, *newParent, payload + length + 1) : -EINVAL;
+                break;
+            }
+            case OPLOG_LINK:
+                ret = (file != nullptr && parent != nullptr) ? addLink(*file, *parent, payload) : -EINVAL;
+                break;
+            case OPLOG_CHMOD:
+                file->mode = (mode_t) record.value;
+                file->ctime = record.time;
+                break;
+            case OPLOG_CHOWN:
+                file->uid = (uid_t) (record.value >> 32);
+                file->gid = (gid_t) (record.value & 0xffffffff);
+                file->ctime = record.time;
+                break;
+            case OPLOG_TRUNCATE:
+                ret = resizeContent(*file, (off_t) record.value);
+                break;
+            case OPLOG_WRITE:
+                ret = loadFile(*file);
+                if (ret >= 0)
+                    ret = reserveMemory(*file, file->content.missingPages(record.value, record.length)
+                                               * PagedContent::PAGE_BYTES);
+                if (ret >= 0) {
+                    file->content.write(record.value, payload, record.length);
+                    file->contentVersion++;
+                    touchFile(*file);
+                    file->mtime = file->ctime = record.time;
+                }
+                break;
+            case OPLOG_CLONE: {
+                MyFsMemoryInfo *source = findInode(record.value);
+                ret = (source != nullptr && S_ISREG(source->mode)) ? cloneContent(*file, *source) : -EINVAL;
+                break;
+            }
+            case OPLOG_COPY: {
+                MyFsMemoryInfo *source = findInode(record.value);
+                uint64_t range[3];
+                if (source == nullptr || record.length != sizeof(range)) {
+                    ret = -EINVAL;
+                    break;
+                }
+                memcpy(range, payload, sizeof(range));
+                ret = copyContent(*file, range[1], *source, range[0], range[2]);
+                break;
+            }
+            case OPLOG_UTIMENS: {
+                int64_t times[2];
+                if (record.length != sizeof(times)) {
+                    ret = -EINVAL;
+                    break;
+                }
+                memcpy(times, payload, sizeof(times));
+                file->atime = times[0];
+                file->mtime = times[1];
+                file->ctime = record.time;
+                break;
+            }
+            default:
+                ret = -EINVAL;
+        }
+        this->replayTime = 0;
+        return ret;
+    }
+
+    int replayLog(const char *path, uint64_t &last) {
+
+        // Records of the old and the current log are applied in order of their sequence numbers, a gap ends the replay
+        int replayed = 0;
+        bool failed = false;
+        auto apply = [&](const OpLogRecord &record, const char *payload) {
+            if (record.sequence <= last)
+                return true;
+            if (record.sequence != last + 1 || applyOp(record, payload) < 0) {
+                failed = true;
+                return false;
+            }
+            last = record.sequence;
+            replayed++;
+            return true;
+        };
+
+        OpLog::replay(OpLog::oldPath(path), apply);
+        if (!failed)
+            OpLog::replay(path, apply);
+        return failed ? -EINVAL : replayed;
+    }
+
+    MyFsMemoryInfo *findInodeDirectory(uint64_t ino) {
+        MyFsMemoryInfo *directory = findInode(ino);
+        return (directory != nullptr && S_ISDIR(directory->mode)) ? directory : nullptr;
+    }
+
+    static void fillStat(const MyFsMemoryInfo &file, struct stat *statbuf) {
+        statbuf->st_ino = file.ino;
+        statbuf->st_uid = getuid(); // The owner of the file/directory is the user who mounted the filesystem
+        statbuf->st_gid = getgid(); // The group of the file/directory is the same as the group of the user who mounted the filesystem
+        statbuf->st_mode = file.mode;
+        statbuf->st_nlink = S_ISDIR(file.mode) ? 2 : file.nlink;
+        statbuf->st_size = file.content.size();
+        size_t pages = file.spilled ? file.spilledPages
+                       : file.image != nullptr ? file.image->numPages : file.content.allocatedPages();
+        statbuf->st_blocks = (blkcnt_t) pages * (PagedContent::PAGE_BYTES / 512);
+        if (file.compressed != nullptr)
+            statbuf->st_blocks = (blkcnt_t) ((file.compressed->storedBytes() + 511) / 512);
+        statbuf->st_atime = file.atime; // The last "a"ccess of the file/directory
+        statbuf->st_mtime = file.mtime; // The last "m"odification of the file/directory
+        statbuf->st_ctime = file.ctime; // The last status change of the file/directory
+    }
+
+    // --- Operations ---
+    //
+    // The FUSE methods resolve their path or inode number and share the rest of the work.
+
+    int removeFile(MyFsMemoryInfo &parent, const char *name, const char *path, bool directory) {
+        auto iterator = parent.children.find(name);
+        if (iterator == parent.children.end())
+            return -ENOENT;
+
+        MyFsMemoryInfo &file = *iterator->second;
+        if (S_ISDIR(file.mode) != directory)
+            return directory ? -ENOTDIR : -EISDIR;
+
+        if (directory && !file.children.empty())
+            return -ENOTEMPTY;
+
+        int ret = logOp(OPLOG_REMOVE, file.ino, parent.ino, directory ? 1 : 0, name, strlen(name));
+        if (ret < 0)
+            return ret;
+
+        // Remove the entry from its directory, the file is freed with its last entry unless it is still open
+        forgetFile(file, path);
+        parent.children.erase(iterator);
+        parent.mtime = parent.ctime = file.ctime = currentTime();
+        file.nlink--;
+        freeUnused(file);
+        return 0;
+    }
+
+    bool containsFile(MyFsMemoryInfo &directory, MyFsMemoryInfo *other) {
+        if (&directory == other)
+            return true;
+
+        for (auto &entry : directory.children) {
+            if (S_ISDIR(entry.second->mode) && containsFile(*entry.second, other))
+                return true;
+        }
+        return false;
+    }
+
+    int moveFile(MyFsMemoryInfo &parent, const char *name, const char *path, MyFsMemoryInfo &newParent,
+                 const char *newName) {
+        auto oldIterator = parent.children.find(name);
+        if (oldIterator == parent.children.end())
+            return -ENOENT;
+
+        // Check length of given filename
+        if (strlen(newName) > NAME_LENGTH)
+            return -EINVAL;
+
+        // Check if the new file already exists
+        if (*newName == '\0' || newParent.children.find(newName) != newParent.children.end())
+            return -EEXIST;
+
+        // A directory cannot be moved into itself
+        MyFsMemoryInfo &file = *oldIterator->second;
+        if (S_ISDIR(file.mode) && containsFile(file, &newParent))
+            return -EINVAL;
+
+        // Both names go into the log, separated by their terminator
+        string names = string(name) + '\0' + newName;
+        int ret = logOp(OPLOG_RENAME, file.ino, parent.ino, newParent.ino, names.data(), names.size());
+        if (ret < 0)
+            return ret;
+
+        // Move the entry to its new directory, the file itself stays where it is
+        forgetFile(file, path);
+        newParent.children.emplace(newName, &file);
+        parent.children.erase(oldIterator);
+
+        // Update the change time of the file
+        file.ctime = currentTime();
+        parent.mtime = parent.ctime = newParent.mtime = newParent.ctime = currentTime();
+        return 0;
+    }
+
+    int addLink(MyFsMemoryInfo &file, MyFsMemoryInfo &parent, const char *name) {
+
+        // Directories have exactly one entry
+        if (S_ISDIR(file.mode))
+            return -EPERM;
+
+        // Check length of given filename
+        if (strlen(name) > NAME_LENGTH)
+            return -EINVAL;
+
+        // Check if a file with the same name already exists
+        if (*name == '\0' || parent.children.find(name) != parent.children.end())
+            return -EEXIST;
+
+        int ret = logOp(OPLOG_LINK, file.ino, parent.ino, 0, name, strlen(name));
+        if (ret < 0)
+            return ret;
+
+        parent.children.emplace(name, &file);
+        file.nlink++;
+        parent.mtime = parent.ctime = file.ctime = currentTime();
+        return 0;
+    }
+
+    // --- File handles ---
+    //
+    // A handle points to its file, which keeps its address while it is renamed. A file that is deleted while it is open
+    // is freed when its last handle is closed.
+
+    MyFsMemoryInfo *openFile(const char *path, struct fuse_file_info *fileInfo) {
+        MyFsMemoryInfo *file = handleFile(fileInfo);
+        return file != nullptr ? file : findFile(path);
+    }
+
+    MyFsMemoryInfo *handleFile(struct fuse_file_info *fileInfo) {
+        if (fileInfo == nullptr)
+            return nullptr;
+
+        LockHolder<RwLock> guard(this->handleLock, false);
+        MyFsMemoryHandle *handle = this->handles.get(fileInfo->fh);
+        return handle != nullptr ? handle->file : nullptr;
+    }
+
+    void openHandle(MyFsMemoryInfo &file, struct fuse_file_info *fileInfo) {
+        LockHolder<RwLock> fileLock(file.lock, false);
+        LockHolder<RwLock> guard(this->handleLock, true);
+
+        // A file may be open several times, every open gets its own handle, the table grows as needed
+        MyFsMemoryHandle handle;
+        handle.file = &file;
+        file.openCount++;
+        setKeepCache(fileInfo, file.cachedVersion, file.contentVersion);
+        fileInfo->fh = this->handles.open(move(handle));
+    }
+
+    int closeHandle(struct fuse_file_info *fileInfo, bool freeing) {
+        LockHolder<RwLock> guard(this->handleLock, true);
+        MyFsMemoryHandle *handle = (fileInfo != nullptr) ? this->handles.get(fileInfo->fh) : nullptr;
+        if (handle == nullptr)
+            return -EBADF;
+
+        // Freeing a deleted file with its last handle needs the namespace lock for writing, the caller retries with it
+        MyFsMemoryInfo *file = handle->file;
+        if (!freeing && file->nlink == 0 && file->openCount == 1)
+            return -EAGAIN;
+
+        this->handles.close(fileInfo->fh);
+        file->openCount--;
+        if (freeing)
+            freeUnused(*file);
+        return 0;
+    }
+
+    int createFile(MyFsMemoryInfo &parent, const char *name, mode_t mode, MyFsMemoryInfo *&created) {
+
+        // Check length of given filename
+        if (strlen(name) > NAME_LENGTH)
+            return -EINVAL;
+
+        // Check if a file with the same name already exists
+        if (*name == '\0' || parent.children.find(name) != parent.children.end())
+            return -EEXIST;
+
+        int ret = logOp(OPLOG_CREATE, this->nextIno, parent.ino, mode, name, strlen(name));
+        if (ret < 0)
+            return ret;
+
+        MyFsMemoryInfo &file = *this->fileSlab.create();
+        file.ino = this->nextIno++;
+        file.gid = getgid();
+        file.uid = getuid();
+        file.mode = mode;
+        file.atime = file.ctime = file.mtime = currentTime();
+        file.children.setAllocator(&this->entrySlab);
+        file.content.setArena(&this->pageArena);
+
+        // Insert the file into the directory
+        created = &file;
+        parent.children.emplace(name, &file);
+        this->nodes[file.ino] = &file;
+        parent.mtime = parent.ctime = currentTime();
+        return 0;
+    }
+
+    int createFile(const char *path, mode_t mode, MyFsMemoryInfo *&created) {
+
+        // Check if the directory of the new file exists
+        const char *name;
+        MyFsMemoryInfo *parent = findParent(path, name);
+        if (parent == nullptr)
+            return -ENOENT;
+
+        return createFile(*parent, name, mode, created);
+    }
 };
 
 #endif //MYFS_MYINMEMORYFS_H
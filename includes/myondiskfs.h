@@ -10,10 +10,20 @@
 #include <cstring>
 #include <array>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <unordered_set>
 #include <iterator>
+#include <ctime>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 #include "myfs.h"
+#include "pathindex.h"
+#include "handletable.h"
+#include "fnv1a.h"
 
 /// @brief On-disk implementation of a simple file system.
 class MyOnDiskFS : public MyFS {
@@ -23,8 +33,40 @@ protected:
     SuperBlock superBlock;
     array<DMapEntry, FILE_BLOCK_COUNT> dmap;
     array<FATEntry, FILE_BLOCK_COUNT> fat;
-    map<string, MyFsDiskInfo> root;
-    unordered_set<string> openFiles;
+    HandleTable<MyFsHandle> handles;    // Open files
+    uint16_t freeHint = 0;              // Block after the last allocated one, the search for free blocks starts there
+
+    // Inodes
+    vector<MyFsFile> inodes;            // Inode table, indexed by inode number
+    vector<uint32_t> freeInodes;        // Unused inodes, the next one to use is at the back
+
+    // Directories
+    unordered_map<uint16_t, pair<MyFsDirectory *, uint32_t>> directoryBlocks;  // Directory and position of each block
+    PathIndex<MyFsDirEntry *> dentries;     // Cache of resolved paths
+
+    // Metadata journal
+    set<uint32_t> dirtyBlocks;          // Metadata blocks changed by the running operation
+    set<uint32_t> journaledBlocks;      // Metadata blocks whose latest version is only stored in the journal
+    vector<char> journalBuffer;         // Records of the current group that are not committed yet
+    uint32_t journalHead;               // Next free journal block, relative to the journal region
+    uint32_t journalSequence;           // Sequence number of the next record
+    uint32_t journalCommitted;          // Sequence number of the first record that is not committed
+    uint32_t journalGroupOps;           // Number of operations in the current group
+    time_t journalGroupStart;           // Time the first operation of the current group finished
+    set<uint32_t> lazyInodes;           // Inodes whose changed timestamps are only kept in memory (lazytime)
+    time_t lazyStart;                   // Time the oldest of these changes was made
+
+    // Write-back cache for file data
+    unordered_map<uint16_t, vector<char>> dataCache;    // Dirty file blocks that are not written yet
+    set<uint16_t> freshBlocks;          // Blocks allocated since the last commit
+
+    // Background flusher, see the section below
+    recursive_mutex requestLock;        // Held by every request and by the flusher while it commits
+    bool flushEnabled = true;           // Cleared for containers that do not have to survive a crash
+    thread flushThread;                 // Commits journal groups whose deadline passed
+    mutex flushLock;                    // Guards flushStopping, the thread waits on it between checks
+    condition_variable flushWakeup;
+    bool flushStopping = false;
 
 public:
     static MyOnDiskFS *Instance();
@@ -35,13 +77,18 @@ public:
     ~MyOnDiskFS();
 
     static void SetInstance();
+    static bool isContainer(const char *path);
+    void disableFlusher();
 
     // --- Methods called by FUSE ---
     // For Documentation see https://libfuse.github.io/doxygen/structfuse__operations.html
     virtual int fuseGetattr(const char *path, struct stat *statbuf);
     virtual int fuseMknod(const char *path, mode_t mode, dev_t dev);
+    virtual int fuseMkdir(const char *path, mode_t mode);
     virtual int fuseUnlink(const char *path);
+    virtual int fuseRmdir(const char *path);
     virtual int fuseRename(const char *path, const char *newpath);
+    virtual int fuseLink(const char *path, const char *newpath);
     virtual int fuseChmod(const char *path, mode_t mode);
     virtual int fuseChown(const char *path, uid_t uid, gid_t gid);
     virtual int fuseTruncate(const char *path, off_t newSize);
@@ -49,6 +96,30 @@ public:
     virtual int fuseRead(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseRelease(const char *path, struct fuse_file_info *fileInfo);
+    virtual int fuseFlush(const char *path, struct fuse_file_info *fileInfo);
+    virtual int fuseFsync(const char *path, int datasync, struct fuse_file_info *fileInfo);
+    virtual int fuseFsyncdir(const char *path, int datasync, struct fuse_file_info *fileInfo);
+    virtual int fuseCreate(const char *path, mode_t mode, struct fuse_file_info *fileInfo);
+    virtual off_t fuseLseek(const char *path, off_t offset, int whence, struct fuse_file_info *fileInfo);
+
+    // --- Methods called by the FUSE 3 low-level mount command ---
+    virtual int inodeLookup(uint64_t parent, const char *name, struct stat *statbuf);
+    virtual void inodeForget(uint64_t ino, uint64_t count);
+    virtual int inodeGetattr(uint64_t ino, struct stat *statbuf);
+    virtual int inodeChmod(uint64_t ino, mode_t mode);
+    virtual int inodeChown(uint64_t ino, uid_t uid, gid_t gid);
+    virtual int inodeTruncate(uint64_t ino, off_t newSize, struct fuse_file_info *fileInfo);
+    virtual int inodeUtimens(uint64_t ino, const struct timespec times[2]);
+    virtual int inodeMknod(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf);
+    virtual int inodeMkdir(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf);
+    virtual int inodeUnlink(uint64_t parent, const char *name);
+    virtual int inodeRmdir(uint64_t parent, const char *name);
+    virtual int inodeRename(uint64_t parent, const char *name, uint64_t newParent, const char *newName);
+    virtual int inodeLink(uint64_t ino, uint64_t newParent, const char *newName, struct stat *statbuf);
+    virtual int inodeOpen(uint64_t ino, struct fuse_file_info *fileInfo);
+    virtual int inodeCreate(uint64_t parent, const char *name, mode_t mode, struct fuse_file_info *fileInfo,
+                            struct stat *statbuf);
+    virtual int inodeReaddir(uint64_t ino, void *buf, MyFsFiller filler, off_t offset);
     virtual void* fuseInit(struct fuse_conn_info *conn);
     virtual int fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo);
     virtual int fuseTruncate(const char *path, off_t offset, struct fuse_file_info *fileInfo);
@@ -57,17 +128,138 @@ public:
     // TODO: Add methods of your file system here
 private:
 
-    int readSuperblock() {
+    int readMetadata() {
+
+        // Read the superblock, DMAP, FAT, inode and journal regions with a single request
+        vector<char> metadata((size_t) FILE_BLOCK_OFFSET * BLOCK_SIZE);
+        int ret = this->blockDevice->readBlocks(SUPERBLOCK_OFFSET, FILE_BLOCK_OFFSET, metadata.data());
+        if (ret < 0)
+            return ret;
+
+        // The superblock describes where the other regions are
+        memcpy(&this->superBlock, &metadata[SUPERBLOCK_OFFSET * BLOCK_SIZE], sizeof(SuperBlock));
+        if (this->superBlock.magic != SUPERBLOCK_MAGIC || this->superBlock.version != SUPERBLOCK_VERSION
+            || this->superBlock.blockSize != BLOCK_SIZE)
+            return -EINVAL;
+        if (this->superBlock.journalBlockOffset + this->superBlock.journalBlockCount > FILE_BLOCK_OFFSET
+            || this->superBlock.inodeBlockCount != INODE_BLOCK_COUNT
+            || this->superBlock.inodeBlockOffset + INODE_BLOCK_COUNT > FILE_BLOCK_OFFSET)
+            return -EIO;
+
+        // Bring the home locations up to date before decoding them
+        int replayed = journalReplay(metadata);
+        if (replayed < 0)
+            return replayed;
+
+        // Decode the regions in place
+        memcpy(&this->superBlock, &metadata[SUPERBLOCK_OFFSET * BLOCK_SIZE], sizeof(SuperBlock));
+        memcpy(this->dmap.data(), &metadata[this->superBlock.dmapBlockOffset * BLOCK_SIZE],
+               sizeof(DMapEntry) * FILE_BLOCK_COUNT);
+        memcpy(this->fat.data(), &metadata[this->superBlock.fatBlockOffset * BLOCK_SIZE],
+               sizeof(FATEntry) * FILE_BLOCK_COUNT);
+
+        resetInodes();
+        const char *table = &metadata[this->superBlock.inodeBlockOffset * BLOCK_SIZE];
+        for (uint32_t ino = 0; ino < NUM_INODES; ino++)
+            memcpy(static_cast<MyFsInode *>(&this->inodes[ino]), table + (size_t) ino * INODE_SIZE, INODE_SIZE);
+
+        MyFsFile &root = this->inodes[ROOT_INODE];
+        if (!S_ISDIR(root.mode))
+            return -EIO;
+
+        // Read the directory tree starting at the root
+        this->directoryBlocks.clear();
+        this->dentries.clear();
+        root.directory.reset(new MyFsDirectory());
+        root.directory->ino = ROOT_INODE;
+        ret = readDirectory(*root.directory);
+        if (ret < 0)
+            return ret;
+
+        collectFreeInodes();
+
+        return replayed;
+    }
 
-        int ret;
-        char *buffer = (char *) malloc(BLOCK_SIZE);
+    int readDirectory(MyFsDirectory &directory) {
 
-        // Read Superblock
-        ret = this->blockDevice->read(0, buffer);
-        memcpy(&this->superBlock, buffer, sizeof(SuperBlock));
-        free(buffer);
+        const MyFsFile &self = this->inodes[directory.ino];
+        uint32_t numBlocks = self.size / BLOCK_SIZE;
 
-        return ret;
+        // Collect the blocks of the directory from the FAT
+        uint16_t block = self.data;
+        for (uint32_t i = 0; i < numBlocks; i++) {
+            this->directoryBlocks[block] = make_pair(&directory, i);
+            MyFsDirBlock dirBlock;
+            dirBlock.block = block;
+            directory.blocks.push_back(move(dirBlock));
+            if (this->fat.at(block).isLast)
+                break;
+            block = this->fat.at(block).nextBlock;
+        }
+        if (directory.blocks.size() < numBlocks)
+            return -EIO;
+
+        // Read consecutive blocks of the directory with a single request
+        vector<char> buffer((size_t) numBlocks * BLOCK_SIZE);
+        for (uint32_t i = 0; i < numBlocks;) {
+            uint32_t run = 1;
+            while (i + run < numBlocks && directory.blocks[i + run].block == directory.blocks[i].block + run)
+                run++;
+
+            int ret = this->blockDevice->readBlocks(directory.blocks[i].block + this->superBlock.fileBlockOffset, run,
+                                                    &buffer[(size_t) i * BLOCK_SIZE]);
+            if (ret < 0)
+                return ret;
+            i += run;
+        }
+
+        // Decode the records of every block
+        for (uint32_t i = 0; i < numBlocks; i++) {
+            const char *data = &buffer[(size_t) i * BLOCK_SIZE];
+            size_t offset = 0;
+
+            while (offset < BLOCK_SIZE) {
+                MyFsDiskEntry record;
+                memcpy(&record, data + offset, sizeof(MyFsDiskEntry));
+                if (record.recordLength < sizeof(MyFsDiskEntry) || record.recordLength % DIR_RECORD_ALIGNMENT != 0
+                    || offset + record.recordLength > BLOCK_SIZE)
+                    return -EIO;
+
+                if (record.ino != 0) {
+                    if (record.nameLength == 0 || sizeof(MyFsDiskEntry) + record.nameLength > record.recordLength
+                        || record.ino >= NUM_INODES || this->inodes[record.ino].nlink == 0)
+                        return -EIO;
+
+                    MyFsDirEntry file;
+                    file.ino = record.ino;
+                    file.block = i;
+                    file.parent = &directory;
+                    auto inserted = directory.entries.emplace(data + offset + sizeof(MyFsDiskEntry), record.nameLength,
+                                                              move(file));
+                    if (!inserted.second)
+                        return -EIO;
+                    directory.blocks[i].records.push_back(&*inserted.first);
+                    directory.blocks[i].free -= recordSize(record.nameLength);
+
+                    // Read the subdirectories, a directory has exactly one entry
+                    MyFsFile &inode = this->inodes[record.ino];
+                    if (S_ISDIR(inode.mode)) {
+                        if (inode.directory)
+                            return -EIO;
+                        inode.directory.reset(new MyFsDirectory());
+                        inode.directory->ino = record.ino;
+                        int ret = readDirectory(*inode.directory);
+                        if (ret < 0)
+                            return ret;
+                    }
+                }
+
+                offset += record.recordLength;
+            }
+        }
+
+        return 0;
     }
 
     int writeSuperblock() {
@@ -84,24 +276,24 @@ private:
         return 0;
     }
 
-    int readDmap() {
+    int writeDmap() {
 
-        // Read the blocks of the DMAP to the file system
+        // Write the blocks of the DMAP to the file system
         for (int i = 0; i < DMAP_BLOCK_COUNT; i++) {
 
             // Allocate a buffer for the DMAP
             char *buffer = (char*) malloc(BLOCK_SIZE);
             memset(buffer, 0, BLOCK_SIZE);
 
-            // Write the entries to the buffer
-            this->blockDevice->read(i + this->superBlock.dmapBlockOffset, buffer);
-
             // Calculate the start index of the entries in this block
             int startIndex = i * DMAP_ENTRIES_PER_BLOCK;
             size_t bytes = sizeof(DMapEntry) * DMAP_ENTRIES_PER_BLOCK;
 
-            // Copy the buffer into the entries for this block
-            memcpy(&this->dmap[startIndex], buffer, bytes);
+            // Copy the entries for this block into the buffer
+            memcpy(buffer, &this->dmap[startIndex], bytes);
+
+            // Write the entries to the block
+            this->blockDevice->write(i + this->superBlock.dmapBlockOffset, buffer);
 
             // Free the buffer
             free(buffer);
@@ -110,24 +302,24 @@ private:
         return 0;
     }
 
-    int writeDmap() {
+    int writeFat() {
 
-        // Write the blocks of the DMAP to the file system
-        for (int i = 0; i < DMAP_BLOCK_COUNT; i++) {
+        // Write the blocks of the FAT to the file system
+        for (int i = 0; i < FAT_BLOCK_COUNT; i++) {
 
-            // Allocate a buffer for the DMAP
+            // Allocate a buffer for the FAT
             char *buffer = (char*) malloc(BLOCK_SIZE);
             memset(buffer, 0, BLOCK_SIZE);
 
             // Calculate the start index of the entries in this block
-            int startIndex = i * DMAP_ENTRIES_PER_BLOCK;
-            size_t bytes = sizeof(DMapEntry) * DMAP_ENTRIES_PER_BLOCK;
+            int startIndex = i * FAT_ENTRIES_PER_BLOCK;
+            size_t bytes = sizeof(FATEntry) * FAT_ENTRIES_PER_BLOCK;
 
             // Copy the entries for this block into the buffer
-            memcpy(buffer, &this->dmap[startIndex], bytes);
+            memcpy(buffer, &this->fat[startIndex], bytes);
 
             // Write the entries to the block
-            this->blockDevice->write(i + this->superBlock.dmapBlockOffset, buffer);
+            this->blockDevice->write(i + this->superBlock.fatBlockOffset, buffer);
 
             // Free the buffer
             free(buffer);
@@ -136,159 +328,719 @@ private:
         return 0;
     }
 
-    int readFat() {
+    int writeInodes() {
 
-        // Read the blocks of the FAT to the file system
-        for (int i = 0; i < FAT_BLOCK_COUNT; i++) {
+        // Write the whole inode table with a single request
+        vector<char> buffer((size_t) INODE_BLOCK_COUNT * BLOCK_SIZE);
+        for (uint32_t i = 0; i < INODE_BLOCK_COUNT; i++)
+            encodeBlock(this->superBlock.inodeBlockOffset + i, &buffer[(size_t) i * BLOCK_SIZE]);
 
-            // Allocate a buffer for the FAT
-            char *buffer = (char*) malloc(BLOCK_SIZE);
-            memset(buffer, 0, BLOCK_SIZE);
+        return this->blockDevice->writeBlocks(this->superBlock.inodeBlockOffset, INODE_BLOCK_COUNT, buffer.data());
+    }
 
-            // Write the entries to the buffer
-            this->blockDevice->read(i + this->superBlock.fatBlockOffset, buffer);
+    // --- Inodes ---
+    //
+    // The attributes and the first block of a file live in its inode, directory entries only map a name to an inode
+    // number. Several entries may reference the same inode, the inode is freed when the last one is removed.
+
+    void resetInodes() {
+        this->inodes.clear();
+        this->inodes.resize(NUM_INODES);
+        for (uint32_t ino = 0; ino < NUM_INODES; ino++)
+            this->inodes[ino].ino = ino;
+        this->freeInodes.clear();
+    }
 
-            // Calculate the start index of the entries in this block
-            int startIndex = i * FAT_ENTRIES_PER_BLOCK;
-            size_t bytes = sizeof(FATEntry) * FAT_ENTRIES_PER_BLOCK;
+    void initRoot() {
+        MyFsFile &root = this->inodes[ROOT_INODE];
+        root.gid = getgid();
+        root.uid = getuid();
+        root.mode = S_IFDIR | 0755;
+        root.nlink = 2;
+        root.atime = root.ctime = root.mtime = time(NULL);
+        root.directory.reset(new MyFsDirectory());
+        root.directory->ino = ROOT_INODE;
+
+        collectFreeInodes();
+    }
 
-            // Copy the buffer into the entries for this block
-            memcpy(&this->fat[startIndex], buffer, bytes);
+    void collectFreeInodes() {
+        this->freeInodes.clear();
+        for (uint32_t ino = NUM_INODES - 1; ino > ROOT_INODE; ino--) {
+            if (this->inodes[ino].nlink == 0)
+                this->freeInodes.push_back(ino);
+        }
+    }
 
-            // Free the buffer
-            free(buffer);
+    MyFsFile &allocateInode(mode_t mode) {
+        MyFsFile &file = this->inodes[this->freeInodes.back()];
+        this->freeInodes.pop_back();
+
+        static_cast<MyFsInode &>(file) = MyFsInode();
+        file.gid = getgid();
+        file.uid = getuid();
+        file.mode = mode;
+        file.nlink = 1;
+        file.atime = file.ctime = file.mtime = time(NULL);
+        markInodeDirty(file, true);
+
+        return file;
+    }
+
+    void freeInode(MyFsFile &file) {
+        static_cast<MyFsInode &>(file) = MyFsInode();
+        file.directory.reset();
+        file.dirtyData.clear();
+        markInodeDirty(file, true);
+        this->freeInodes.push_back(file.ino);
+    }
+
+    // --- Path resolution ---
+    //
+    // Every directory has its own index of entries. A path is resolved by looking up one component after the other,
+    // resolved paths are remembered in the dentry cache. Entries of the cache are removed when their entry is deleted
+    // or moved, the whole cache is dropped when a directory is moved.
+
+    MyFsDirEntry *findEntry(const char *path, size_t length) {
+
+        // Check the dentry cache first
+        uint32_t hash = PathIndex<MyFsDirEntry *>::hash(path, length);
+        auto cached = this->dentries.find(path, length, hash);
+        if (cached != this->dentries.end())
+            return cached->second;
+
+        // Walk the path component by component
+        MyFsDirectory *directory = this->inodes[ROOT_INODE].directory.get();
+        MyFsDirEntry *entry = nullptr;
+        size_t position = 0;
+        while (position < length) {
+            while (position < length && path[position] == '/')
+                position++;
+            if (position == length)
+                break;
+
+            size_t end = position;
+            while (end < length && path[end] != '/')
+                end++;
+
+            // Only directories can have further components
+            if (directory == nullptr)
+                return nullptr;
+
+            auto iterator = directory->entries.find(path + position, end - position);
+            if (iterator == directory->entries.end())
+                return nullptr;
+
+            entry = &iterator->second;
+            directory = this->inodes[entry->ino].directory.get();
+            position = end;
+        }
+
+        if (entry != nullptr) {
+            if (this->dentries.size() >= DENTRY_CACHE_MAX_ENTRIES)
+                this->dentries.clear();
+            this->dentries.emplace(path, length, move(entry));
         }
 
+        return entry;
+    }
+
+    MyFsDirEntry *findEntry(const char *path) {
+        return findEntry(path, strlen(path));
+    }
+
+    MyFsFile *findFile(const char *path, size_t length) {
+
+        // The root directory has no entry
+        if (strspn(path, "/") >= length)
+            return &this->inodes[ROOT_INODE];
+
+        MyFsDirEntry *entry = findEntry(path, length);
+        return entry != nullptr ? &this->inodes[entry->ino] : nullptr;
+    }
+
+    MyFsFile *findFile(const char *path) {
+        return findFile(path, strlen(path));
+    }
+
+    MyFsDirectory *findDirectory(const char *path, size_t length) {
+        MyFsFile *file = findFile(path, length);
+        return file != nullptr ? file->directory.get() : nullptr;
+    }
+
+    MyFsDirectory *findParent(const char *path, const char *&name) {
+        const char *separator = strrchr(path, '/');
+        if (separator == nullptr)
+            return nullptr;
+
+        name = separator + 1;
+        return findDirectory(path, separator - path);
+    }
+
+    void forgetEntry(MyFsDirEntry &entry, const char *path) {
+        // Cached paths below a directory point into it, drop all of them, entries removed through the inode interface
+        // have no path
+        if (this->inodes[entry.ino].directory || path == nullptr)
+            this->dentries.clear();
+        else
+            this->dentries.erase(path);
+    }
+
+    MyFsFile *findInode(uint64_t ino) {
+        if (ino == 0 || ino >= NUM_INODES)
+            return nullptr;
+
+        // Deleted files are still found while they are in use
+        MyFsFile &file = this->inodes[ino];
+        return (file.nlink > 0 || inUse(file)) ? &file : nullptr;
+    }
+
+    MyFsDirectory *findDirectory(uint64_t ino) {
+        MyFsFile *file = findInode(ino);
+        return file != nullptr ? file->directory.get() : nullptr;
+    }
+
+    MyFsDirEntry *lookupEntry(uint64_t parent, const char *name) {
+        MyFsDirectory *directory = findDirectory(parent);
+        if (directory == nullptr)
+            return nullptr;
+
+        auto iterator = directory->entries.find(name);
+        return iterator != directory->entries.end() ? &iterator->second : nullptr;
+    }
+
+    static bool inUse(const MyFsFile &file) {
+        return file.openCount > 0 || file.lookups > 0;
+    }
+
+    static void fillStat(const MyFsFile &file, struct stat *statbuf) {
+        statbuf->st_ino = file.ino;
+        statbuf->st_mode = file.mode;
+        statbuf->st_nlink = file.nlink; // Why "two" hardlinks for a directory? The answer is here: http://unix.stackexchange.com/a/101536
+        statbuf->st_uid = file.uid;
+        statbuf->st_gid = file.gid;
+        statbuf->st_size = file.size;
+        statbuf->st_blocks = (blkcnt_t) file.blocks * (BLOCK_SIZE / 512);
+        statbuf->st_atime = file.atime;
+        statbuf->st_mtime = file.mtime;
+        statbuf->st_ctime = file.ctime;
+    }
+
+    void insertEntry(MyFsDirectory &directory, uint32_t index, const char *name, uint32_t ino) {
+        MyFsDirEntry entry;
+        entry.ino = ino;
+        entry.block = index;
+        entry.parent = &directory;
+        directory.blocks[index].records.push_back(&*directory.entries.emplace(name, move(entry)).first);
+        markDirBlockDirty(directory, index);
+
+        // fsync of the file waits for the record carrying the new entry
+        this->inodes[ino].metaSequence = this->journalSequence;
+    }
+
+    void removeEntry(MyFsDirEntry &entry, const char *path) {
+        MyFsDirectory &parent = *entry.parent;
+        uint32_t index = entry.block;
+        vector<PathIndex<MyFsDirEntry>::Entry *> &records = parent.blocks[index].records;
+
+        forgetEntry(entry, path);
+
+        // Give the space of the record back to its block
+        auto record = find_if(records.begin(), records.end(), [&entry](const PathIndex<MyFsDirEntry>::Entry *other) {
+            return &other->second == &entry;
+        });
+        parent.blocks[index].free += recordSize((*record)->first.size());
+        markDirBlockDirty(parent, index);
+
+        parent.entries.erase(parent.entries.find((*record)->first));
+        records.erase(record);
+    }
+
+    int linkEntry(MyFsDirectory &parent, const char *name, uint32_t ino) {
+
+        // Check length of given filename
+        if (strlen(name) >= NAME_LENGTH)
+            return -EINVAL;
+
+        // Check if a file with the same name already exists
+        if (*name == '\0' || parent.entries.find(name) != parent.entries.end())
+            return -EEXIST;
+
+        // Find room in the directory for the record
+        int index = allocateRecord(parent, strlen(name));
+        if (index < 0)
+            return index;
+
+        insertEntry(parent, index, name, ino);
         return 0;
     }
 
-    int writeFat() {
+    int linkEntry(const char *path, uint32_t ino) {
 
-        // Write the blocks of the FAT to the file system
-        for (int i = 0; i < FAT_BLOCK_COUNT; i++) {
+        // Check if the directory of the new entry exists
+        const char *name;
+        MyFsDirectory *parent = findParent(path, name);
+        if (parent == nullptr)
+            return -ENOENT;
 
-            // Allocate a buffer for the FAT
-            char *buffer = (char*) malloc(BLOCK_SIZE);
-            memset(buffer, 0, BLOCK_SIZE);
+        return linkEntry(*parent, name, ino);
+    }
 
-            // Calculate the start index of the entries in this block
-            int startIndex = i * FAT_ENTRIES_PER_BLOCK;
-            size_t bytes = sizeof(FATEntry) * FAT_ENTRIES_PER_BLOCK;
+    int createEntry(MyFsDirectory &parent, const char *name, mode_t mode, MyFsFile *&created) {
 
-            // Copy the entries for this block into the buffer
-            memcpy(buffer, &this->fat[startIndex], bytes);
+        // Check if an inode is available
+        if (this->freeInodes.empty())
+            return -ENOSPC;
 
-            // Write the entries to the block
-            this->blockDevice->write(i + this->superBlock.fatBlockOffset, buffer);
+        // Reference the next free inode from the directory before it is initialized
+        uint32_t ino = this->freeInodes.back();
+        int ret = linkEntry(parent, name, ino);
+        if (ret < 0)
+            return ret;
 
-            // Free the buffer
-            free(buffer);
+        MyFsFile &file = allocateInode(mode);
+        if (S_ISDIR(mode)) {
+            file.nlink = 2;
+            file.directory.reset(new MyFsDirectory());
+            file.directory->ino = ino;
         }
 
+        created = &file;
         return 0;
     }
 
-    int readRoot() {
+    int createEntry(const char *path, mode_t mode, MyFsFile *&created) {
 
-        // Clear the root map before it gets read
-        this->root.clear();
+        // Check if the directory of the new file exists
+        const char *name;
+        MyFsDirectory *parent = findParent(path, name);
+        if (parent == nullptr)
+            return -ENOENT;
 
-        // Read the blocks of the Root to the file system
-        for (int i = 0; i < NUM_DIR_ENTRIES; i++) {
+        return createEntry(*parent, name, mode, created);
+    }
 
-            // Allocate a buffer for the FAT
-            char *buffer = (char*) malloc(BLOCK_SIZE);
-            memset(buffer, 0, BLOCK_SIZE);
+    // --- Operations ---
+    //
+    // The FUSE methods resolve their path or inode number and share the rest of the work. Entries that are removed
+    // through the inode interface have no path, they drop the whole dentry cache.
+
+    int unlinkEntry(MyFsDirEntry &entry, const char *path) {
+        MyFsFile &file = this->inodes[entry.ino];
+        if (file.directory)
+            return -EISDIR;
+
+        // Remove the entry from its directory
+        removeEntry(entry, path);
+
+        // The file is deleted with its last entry, unless it is still open or known to the kernel
+        file.ctime = time(NULL);
+        if (--file.nlink > 0 || inUse(file))
+            markInodeDirty(file);
+        else
+            deleteFile(file);
 
-            // Write the entries to the buffer
-            this->blockDevice->read(i + this->superBlock.rootBlockOffset, buffer);
+        return journalAppend();
+    }
+
+    int removeDirectory(MyFsDirEntry &entry, const char *path) {
+        MyFsFile &directory = this->inodes[entry.ino];
+        if (!directory.directory)
+            return -ENOTDIR;
+
+        if (!directory.directory->entries.empty())
+            return -ENOTEMPTY;
+
+        // Free the blocks of the directory
+        int ret = freeDirectory(directory);
+        if (ret < 0)
+            return ret;
+
+        // Remove the directory from its parent, the inode is kept while the kernel knows it
+        removeEntry(entry, path);
+        directory.size = 0;
+        directory.nlink = 0;
+        directory.directory.reset();
+        if (inUse(directory))
+            markInodeDirty(directory, true);
+        else
+            freeInode(directory);
+
+        return journalAppend();
+    }
+
+    bool containsDirectory(MyFsDirectory &directory, MyFsDirectory *other) {
+        if (&directory == other)
+            return true;
+
+        for (const auto &entry : directory.entries) {
+            MyFsDirectory *child = this->inodes[entry.second.ino].directory.get();
+            if (child != nullptr && containsDirectory(*child, other))
+                return true;
+        }
+        return false;
+    }
+
+    int moveEntry(MyFsDirEntry &entry, const char *path, MyFsDirectory &parent, const char *name) {
+
+        // Check length of given filename
+        if (strlen(name) >= NAME_LENGTH)
+            return -EINVAL;
+
+        // Check if the new file already exists
+        if (*name == '\0' || parent.entries.find(name) != parent.entries.end())
+            return -EEXIST;
+
+        // A directory cannot be moved into itself
+        MyFsDirectory *directory = this->inodes[entry.ino].directory.get();
+        if (directory != nullptr && containsDirectory(*directory, &parent))
+            return -EINVAL;
+
+        // Reserve the record for the new name before the old one is removed
+        int ret = allocateRecord(parent, strlen(name));
+        if (ret < 0)
+            return ret;
+
+        // Move the entry to the new name, the inode of the file is not touched
+        uint32_t ino = entry.ino;
+        removeEntry(entry, path);
+        insertEntry(parent, ret, name, ino);
+
+        return journalAppend();
+    }
+
+    int addLink(MyFsFile &file, MyFsDirectory &parent, const char *name) {
+
+        // Directories have exactly one entry
+        if (file.directory)
+            return -EPERM;
+
+        // Add the new entry for the inode
+        int ret = linkEntry(parent, name, file.ino);
+        if (ret < 0)
+            return ret;
+
+        file.nlink++;
+        file.ctime = time(NULL);
+        markInodeDirty(file);
+
+        return journalAppend();
+    }
+
+    int changeMode(MyFsFile &file, mode_t mode) {
+        // The type of the file does not change
+        file.mode = (file.mode & S_IFMT) | (mode & ~S_IFMT);
+        file.ctime = time(NULL);
+        markInodeDirty(file);
+        return journalAppend();
+    }
+
+    int changeOwner(MyFsFile &file, uid_t uid, gid_t gid) {
+        // An id of -1 keeps the current one
+        if (uid != (uid_t) -1)
+            file.uid = uid;
+        if (gid != (gid_t) -1)
+            file.gid = gid;
+        file.ctime = time(NULL);
+        markInodeDirty(file);
+        return journalAppend();
+    }
+
+    int changeTimes(MyFsFile &file, const struct timespec times[2]) {
+        time_t now = time(NULL);
+        if (times[0].tv_nsec != UTIME_OMIT)
+            file.atime = (times[0].tv_nsec == UTIME_NOW) ? now : times[0].tv_sec;
+        if (times[1].tv_nsec != UTIME_OMIT)
+            file.mtime = (times[1].tv_nsec == UTIME_NOW) ? now : times[1].tv_sec;
+        file.ctime = now;
+        markInodeDirty(file);
+        return journalAppend();
+    }
+
+    void openHandle(MyFsFile &file, struct fuse_file_info *fileInfo) {
+        // A file may be open several times, every open gets its own handle, the table grows as needed
+        MyFsHandle handle;
+        handle.ino = file.ino;
+        file.openCount++;
+        setKeepCache(fileInfo, file.cachedVersion, file.contentVersion);
+        fileInfo->fh = this->handles.open(move(handle));
+    }
+
+    // --- Directories ---
+    //
+    // A directory is stored like a file. Every block holds a sequence of records with the inode number and the name of
+    // an entry. Records have a variable length and do not span blocks, the last record of a block covers the rest of
+    // it. The inode of a directory holds its first block and its size. Directories only grow, space of deleted records
+    // is reused.
+
+    static uint16_t recordSize(size_t nameLength) {
+        return (sizeof(MyFsDiskEntry) + nameLength + DIR_RECORD_ALIGNMENT - 1) & ~(DIR_RECORD_ALIGNMENT - 1);
+    }
 
-            // Copy the buffer into the entries for this block
-            MyFsDiskInfo file;
-            memcpy(&file, buffer, sizeof(MyFsDiskInfo));
+    int allocateRecord(MyFsDirectory &directory, size_t nameLength) {
+        uint16_t size = recordSize(nameLength);
 
-            // Write the key with a slash for easier path finding
-            if(strcmp(file.name, "") != 0) {
-                string key = "/";
-                key.append(file.name);
-                this->root.emplace(key, file);
+        // Use the first block with enough room
+        for (uint32_t i = 0; i < directory.blocks.size(); i++) {
+            if (directory.blocks[i].free >= size) {
+                directory.blocks[i].free -= size;
+                return i;
             }
+        }
 
-            // Free the buffer
-            free(buffer);
+        // Grow the directory by one block
+        if (this->superBlock.numFreeBlocks == 0)
+            return -ENOSPC;
+
+        MyFsFile &self = this->inodes[directory.ino];
+        uint16_t block = this->setBlock(this->findFreeBlock(0));
+        this->fat.at(block).isLast = true;
+        this->fat.at(block).holeAfter = 0;
+        markFatDirty(block);
+
+        if (!directory.blocks.empty()) {
+            this->fat.at(directory.blocks.back().block).nextBlock = block;
+            this->fat.at(directory.blocks.back().block).isLast = false;
+            this->fat.at(directory.blocks.back().block).holeAfter = 0;
+            markFatDirty(directory.blocks.back().block);
+        } else {
+            self.data = block;
         }
 
+        uint32_t index = directory.blocks.size();
+        this->directoryBlocks[block] = make_pair(&directory, index);
+        MyFsDirBlock dirBlock;
+        dirBlock.block = block;
+        dirBlock.free = BLOCK_SIZE - size;
+        directory.blocks.push_back(move(dirBlock));
+
+        // Store the new size
+        self.size = (size_t) directory.blocks.size() * BLOCK_SIZE;
+        self.blocks = directory.blocks.size();
+        markInodeDirty(self, true);
+
+        return index;
     }
 
-    int writeRoot() {
+    int freeDirectory(MyFsFile &file) {
 
-        // Clear the root container before it gets written
-        for (int i = 0; i < NUM_DIR_ENTRIES; ++i) {
+        if (file.directory->blocks.empty())
+            return 0;
 
-            // Allocate a buffer for the Root
-            char *buffer = (char*) malloc(BLOCK_SIZE);
-            memset(buffer, 0, BLOCK_SIZE);
+        // Blocks with an image in the journal must not be reused before the journal is checkpointed, replaying the
+        // image would overwrite the new content
+        bool journaled = false;
+        for (const MyFsDirBlock &dirBlock : file.directory->blocks)
+            journaled |= this->journaledBlocks.count(dirBlock.block + this->superBlock.fileBlockOffset) > 0;
 
-            // Clear the block
-            this->blockDevice->write(i + this->superBlock.rootBlockOffset, buffer);
+        if (journaled) {
+            int ret = journalCommit();
+            if (ret >= 0)
+                ret = journalCheckpoint();
+            if (ret < 0)
+                return ret;
+        }
 
-            // Free the buffer
-            free(buffer);
+        for (const MyFsDirBlock &dirBlock : file.directory->blocks)
+            this->directoryBlocks.erase(dirBlock.block);
+        freeBlocks(file.data, file.directory->blocks.size());
+        file.directory->blocks.clear();
+
+        return 0;
+    }
+
+    // --- File handles ---
+    //
+    // A handle remembers the block of the chain its last access ended at, so sequential access does not walk the
+    // chain from the start for every request. The position is dropped when blocks are cut from the chain.
+    //
+    // The chain only holds the blocks that were written. The inode stores the position of the first block in the
+    // file, every FAT entry the length of the hole behind its block. Positions behind the last block are a hole up to
+    // the size of the file. Holes read as zeros and get blocks when they are written.
+
+    bool findBlock(MyFsFile &file, MyFsHandle *handle, uint32_t index, uint16_t &block, uint32_t &blockIndex) {
+        if (file.blocks == 0 || index < file.dataIndex)
+            return false; // No block at or before the position
+
+        block = file.data;
+        blockIndex = file.dataIndex;
+
+        // Continue from the position of the handle if it is not behind the wanted block
+        if (handle != nullptr && handle->positioned && handle->chainVersion == file.chainVersion
+            && handle->blockIndex <= index) {
+            block = handle->block;
+            blockIndex = handle->blockIndex;
         }
 
-        // Write root
-        size_t index = 0;
-        for (const auto& entry : this->root) {
+        while (!this->fat[block].isLast && blockIndex + 1 + this->fat[block].holeAfter <= index) {
+            blockIndex += 1 + this->fat[block].holeAfter;
+            block = this->fat[block].nextBlock;
+        }
 
-            // Allocate a buffer for the Root
-            char *buffer = (char*) malloc(BLOCK_SIZE);
-            memset(buffer, 0, BLOCK_SIZE);
+        if (handle != nullptr) {
+            handle->positioned = true;
+            handle->blockIndex = blockIndex;
+            handle->block = block;
+            handle->chainVersion = file.chainVersion;
+        }
+        return true;
+    }
 
-            // Copy the entries for this block into the buffer
-            memcpy(buffer, &entry.second, sizeof(MyFsDiskInfo));
+    uint32_t mapBlocks(MyFsFile &file, MyFsHandle *handle, uint32_t index, uint32_t count, int &first) {
+        uint16_t block;
+        uint32_t blockIndex;
+        uint32_t next = UINT32_MAX; // Position of the block that ends the hole
+
+        if (!findBlock(file, handle, index, block, blockIndex)) {
+            if (file.blocks > 0)
+                next = file.dataIndex;
+        } else if (blockIndex == index) {
+            // Count the blocks of the chain that follow each other on disk
+            uint32_t run = 1;
+            while (run < count && !this->fat[block + run - 1].isLast && this->fat[block + run - 1].holeAfter == 0
+                   && this->fat[block + run - 1].nextBlock == block + run)
+                run++;
+
+            if (handle != nullptr) {
+                handle->blockIndex = index + run - 1;
+                handle->block = block + run - 1;
+            }
+            first = block;
+            return run;
+        } else if (!this->fat[block].isLast) {
+            next = blockIndex + 1 + this->fat[block].holeAfter;
+        }
 
-            // Write the entries to the block
-            this->blockDevice->write(index + this->superBlock.rootBlockOffset, buffer);
+        first = -1;
+        return min(count, next - index);
+    }
 
-            // Free the buffer
-            free(buffer);
+    int readFile(MyFsFile &file, MyFsHandle *handle, uint32_t index, uint32_t numBlocks, char *buf) {
+        // Walk with a temporary position if the caller has no handle
+        MyFsHandle cursor;
+        if (handle == nullptr)
+            handle = &cursor;
 
-            index++;
+        for (uint32_t i = 0; i < numBlocks;) {
+            int first;
+            uint32_t run = mapBlocks(file, handle, index + i, numBlocks - i, first);
+            char *out = buf + (size_t) i * BLOCK_SIZE;
 
-            if(index >= NUM_DIR_ENTRIES)
-                break;
+            if (first < 0) {
+                // Holes read as zeros
+                memset(out, 0, (size_t) run * BLOCK_SIZE);
+            }
+
+            for (uint32_t j = 0; first >= 0 && j < run;) {
+                uint32_t uncached = 0;
+
+                auto cached = this->dataCache.find(first + j);
+                if (cached != this->dataCache.end()) {
+                    // Dirty blocks are served from the write-back cache
+                    memcpy(out + (size_t) j * BLOCK_SIZE, cached->second.data(), BLOCK_SIZE);
+                    j++;
+                    continue;
+                }
+
+                // Read consecutive blocks of the file with a single request
+                while (j + uncached < run && this->dataCache.count(first + j + uncached) == 0)
+                    uncached++;
+
+                int ret = this->blockDevice->readBlocks(first + j + this->superBlock.fileBlockOffset, uncached,
+                                                        out + (size_t) j * BLOCK_SIZE);
+                if (ret < 0)
+                    return ret;
+                j += uncached;
+            }
+
+            i += run;
         }
+
+        return 0;
     }
 
-    int readFileBlock(uint16_t block, char* buf) {
-        // Allocate a buffer for a file block
-        char *buffer = (char*) malloc(BLOCK_SIZE);
-        memset(buffer, 0, BLOCK_SIZE);
+    int readRange(MyFsFile &file, MyFsHandle *handle, off_t offset, size_t size, char *buf) {
+        uint32_t index = offset / BLOCK_SIZE;
+        size_t start = offset % BLOCK_SIZE;
+        size_t done = 0;
+        char block[BLOCK_SIZE];
 
-        // Write the content to the buffer
-        int ret = this->blockDevice->read(block + this->superBlock.fileBlockOffset, buffer);
+        // Partial blocks at both ends go through a block buffer
+        if (start != 0) {
+            int ret = readFile(file, handle, index, 1, block);
+            if (ret < 0)
+                return ret;
 
-        // Write the block buffer to the output buffer
-        memcpy(buf, buffer, BLOCK_SIZE);
+            done = min((size_t) BLOCK_SIZE - start, size);
+            memcpy(buf, block + start, done);
+            index++;
+        }
 
-        // Free the buffer
-        free(buffer);
+        // Whole blocks are read into the caller's buffer
+        uint32_t whole = (size - done) / BLOCK_SIZE;
+        if (whole > 0) {
+            int ret = readFile(file, handle, index, whole, buf + done);
+            if (ret < 0)
+                return ret;
 
-        return ret;
+            done += (size_t) whole * BLOCK_SIZE;
+            index += whole;
+        }
+
+        if (done < size) {
+            int ret = readFile(file, handle, index, 1, block);
+            if (ret < 0)
+                return ret;
+
+            memcpy(buf + done, block, size - done);
+        }
+
+        return 0;
     }
 
-    int readFile(uint16_t block, char* buf, uint16_t numBlocks) {
+    int readAhead(MyFsFile &file, MyFsHandle &handle, uint32_t index, uint32_t numBlocks, char *buf) {
+        uint32_t fileBlocks = bytesToBlocks(file.size);
+
+        for (uint32_t i = 0; i < numBlocks; i++) {
+            uint32_t current = index + i;
+
+            // Refill the buffer if the block is not in it or the file changed since it was read
+            if (handle.bufferVersion != file.contentVersion || current < handle.bufferIndex
+                || current >= handle.bufferIndex + handle.buffer.size() / BLOCK_SIZE) {
+                uint32_t count = min(max(numBlocks - i, handle.window), fileBlocks - current);
+                handle.buffer.resize((size_t) count * BLOCK_SIZE);
+
+                int ret = readFile(file, &handle, current, count, handle.buffer.data());
+                if (ret < 0) {
+                    handle.buffer.clear();
+                    return ret;
+                }
+                handle.bufferIndex = current;
+                handle.bufferVersion = file.contentVersion;
+            }
 
-        // iterate through every block
-        for (int i = 0; i < numBlocks; i++) {
-            // Write file block into the buffer
-            readFileBlock(block, buf + (i * BLOCK_SIZE));
-            block = fat.at(block).nextBlock;
+            memcpy(buf + (size_t) i * BLOCK_SIZE, &handle.buffer[(size_t) (current - handle.bufferIndex) * BLOCK_SIZE],
+                   BLOCK_SIZE);
         }
 
         return 0;
     }
 
+    MyFsFile *openFile(const char *path, struct fuse_file_info *fileInfo, MyFsHandle **handle) {
+        // Files are found by their handle, so they can be used after they were renamed or deleted
+        *handle = (fileInfo != nullptr) ? this->handles.get(fileInfo->fh) : nullptr;
+        if (*handle != nullptr)
+            return &this->inodes[(*handle)->ino];
+        return findFile(path);
+    }
+
+    void deleteFile(MyFsFile &file) {
+        if (file.blocks > 0)
+            freeBlocks(file.data, file.blocks);
+        file.chainVersion++;
+        freeInode(file);
+    }
+
     int writeFileBlock(uint16_t block, const char* buf) {
         // Allocate a buffer for a file block
         char *buffer = (char*) malloc(BLOCK_SIZE);
@@ -325,11 +1077,14 @@ private:
             return -ENOSPC; // No space left on device
         }
 
-        // Iterate through the bits of the value
+        // Continue after the last allocated block, so blocks appended to a file follow each other on disk and the
+        // search does not pass the used blocks again
         for (size_t i = 0; i < FILE_BLOCK_COUNT; i++) {
-            // Check if the i-th block is free
-            if(this->dmap.at(i).isFree)
-                return i; // The i-th block is free
+            uint16_t block = (this->freeHint + i) % FILE_BLOCK_COUNT;
+            if(this->dmap[block].isFree) {
+                this->freeHint = block + 1;
+                return block; // The block is free
+            }
         }
 
         return -ERANGE; // No bits set to 1 found
@@ -338,63 +1093,88 @@ private:
     uint16_t setBlock(uint16_t block) {
         this->dmap.at(block).isFree = false;
         this->superBlock.numFreeBlocks--;
+        this->freshBlocks.insert(block);
+        markDmapDirty(block);
         return block;
     }
 
     uint16_t clearBlock(uint16_t block) {
         this->dmap.at(block).isFree = true;
         this->superBlock.numFreeBlocks++;
+        this->dataCache.erase(block);
+        markDmapDirty(block);
         return block;
     }
 
-    uint16_t bytesToBlocks(size_t size) {
-        return ceil((double) size / BLOCK_SIZE);
+    uint32_t bytesToBlocks(size_t size) {
+        return (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
     }
 
-    uint16_t allocateBlocks(int firstBlock, uint16_t numBlocks) {
-
-        // Check if enough blocks are available
-        if(this->superBlock.numFreeBlocks < numBlocks) {
-            return -ENOSPC; // Not enough space left on device
-        }
+    int linkBlock(MyFsFile &file, MyFsHandle *handle, uint32_t index) {
 
-        uint16_t block = firstBlock;
-
-        // Check if there is a starting block
-        if(firstBlock >= 0) {
-            // Iterate to the last block
-            while(!this->fat.at(block).isLast)
-                block = this->fat.at(block).nextBlock;
+        // Check if a block is available
+        if (this->superBlock.numFreeBlocks == 0)
+            return -ENOSPC; // No space left on device
 
-        } else {
-            // Init first block
-            block = this->findFreeBlock(0);
-            this->fat.at(block).isLast = false;
-            firstBlock = this->setBlock(block);
-            numBlocks--;
+        uint16_t previous;
+        uint32_t previousIndex;
+        bool linked = findBlock(file, handle, index, previous, previousIndex);
+
+        // Holes longer than a FAT entry can describe are split by blocks of zeros
+        uint32_t anchor = 0;
+        if (linked && index - previousIndex - 1 > FAT_MAX_HOLE_BLOCKS)
+            anchor = previousIndex + 1 + FAT_MAX_HOLE_BLOCKS;
+        else if (!linked && file.blocks > 0 && file.dataIndex - index - 1 > FAT_MAX_HOLE_BLOCKS)
+            anchor = file.dataIndex - 1 - FAT_MAX_HOLE_BLOCKS;
+        if (anchor != 0) {
+            int ret = linkBlock(file, handle, anchor);
+            if (ret < 0)
+                return ret;
+            cacheBlock(file, ret, false);
+            return linkBlock(file, handle, index);
         }
 
-        // Add number of blocks
-        for (size_t i = 0; i < numBlocks; ++i) {
-            uint16_t freeBlock = this->findFreeBlock(0);
-            this->fat.at(block).isLast = false;
-            this->fat.at(block).nextBlock = freeBlock;
-            block = this->setBlock(freeBlock);
+        uint16_t block = this->setBlock(this->findFreeBlock(0));
+        FATEntry &entry = this->fat.at(block);
+
+        if (linked) {
+            // Split the hole behind the previous block
+            FATEntry &before = this->fat.at(previous);
+            entry.nextBlock = before.nextBlock;
+            entry.isLast = before.isLast;
+            entry.holeAfter = before.isLast ? 0 : previousIndex + before.holeAfter - index;
+            before.nextBlock = block;
+            before.isLast = false;
+            before.holeAfter = index - previousIndex - 1;
+            markFatDirty(previous);
+        } else {
+            // The block becomes the first one of the chain
+            entry.nextBlock = file.data;
+            entry.isLast = file.blocks == 0;
+            entry.holeAfter = (file.blocks == 0) ? 0 : file.dataIndex - index - 1;
+            file.data = block;
+            file.dataIndex = index;
         }
+        markFatDirty(block);
 
-        // Set the last block as last
-        this->fat.at(block).isLast = true;
+        file.blocks++;
+        markInodeDirty(file, true);
 
-        // Return first block
-        return firstBlock;
+        if (handle != nullptr) {
+            handle->positioned = true;
+            handle->blockIndex = index;
+            handle->block = block;
+            handle->chainVersion = file.chainVersion;
+        }
+        return block;
     }
 
-    int freeBlocks(uint16_t firstBlock, uint16_t numBlocks) {
+    int freeBlocks(uint16_t firstBlock, uint32_t numBlocks) {
 
         uint16_t block = firstBlock;
 
         // Count the number of allocated blocks
-        uint16_t numAllocBlocks = 1;
+        uint32_t numAllocBlocks = 1;
         while(!this->fat.at(block).isLast) {
             block = this->fat.at(block).nextBlock;
             numAllocBlocks++;
@@ -412,11 +1192,639 @@ private:
                 // Check if the new last block is reached
             } else if((i+1) == (numAllocBlocks - numBlocks)) {
                 this->fat.at(block).isLast = true;
+                markFatDirty(block);
             }
 
             // Get the next block
             block = this->fat.at(block).nextBlock;
         }
+
+        return 0;
+    }
+
+    int cutBlocks(MyFsFile &file, uint32_t numBlocks) {
+        uint16_t last;
+        uint32_t lastIndex;
+
+        if (numBlocks == 0 || !findBlock(file, nullptr, numBlocks - 1, last, lastIndex)) {
+            // No block is left
+            if (file.blocks > 0)
+                freeBlocks(file.data, file.blocks);
+            file.data = file.dataIndex = file.blocks = 0;
+        } else if (!this->fat[last].isLast) {
+            // Free the blocks behind the last one that is left
+            for (uint16_t block = this->fat[last].nextBlock;; block = this->fat[block].nextBlock) {
+                this->clearBlock(block);
+                file.blocks--;
+                if (this->fat[block].isLast)
+                    break;
+            }
+
+            this->fat[last].isLast = true;
+            this->fat[last].holeAfter = 0;
+            markFatDirty(last);
+        }
+
+        // Positions of handles may point to freed blocks
+        file.chainVersion++;
+        return 0;
+    }
+
+    int resizeFile(MyFsFile &file, off_t newSize) {
+
+        // Calculate the new block number
+        uint32_t newBlockNumber = bytesToBlocks(newSize);
+        if (newSize < 0 || newBlockNumber > FILE_BLOCK_COUNT)
+            return -EFBIG; // File too large
+
+        // Growing leaves a hole behind the old end, shrinking frees the blocks behind the new one
+        if ((uint64_t) newSize < file.size) {
+            cutBlocks(file, newBlockNumber);
+
+            // Bytes cut from the last block must read as zeros if the file grows again
+            uint16_t last;
+            uint32_t lastIndex;
+            size_t tail = newSize % BLOCK_SIZE;
+            if (tail != 0 && findBlock(file, nullptr, newBlockNumber - 1, last, lastIndex)
+                && lastIndex == newBlockNumber - 1)
+                memset(cacheBlock(file, last, true) + tail, 0, BLOCK_SIZE - tail);
+        }
+
+        // Update the file size
+        file.size = newSize;
+        file.contentVersion++;
+        markInodeDirty(file, true);
+
+        return 0;
+    }
+
+    int truncateFile(MyFsFile &file, off_t newSize) {
+        // Allocate or free blocks to fit the new size
+        int ret = resizeFile(file, newSize);
+        if (ret < 0)
+            return ret;
+
+        // Update the changed and modified time
+        file.ctime = file.mtime = time(NULL);
+
+        return journalAppend();
+    }
+
+    int rebuildDmap() {
+
+        // Collect the files that own blocks, directories own blocks like a file
+        vector<MyFsFile *> files;
+        for (MyFsFile &file : this->inodes) {
+            if (file.nlink > 0 && file.blocks > 0)
+                files.push_back(&file);
+        }
+
+        // Walk the block chains in parallel, every thread marks the blocks it finds in its own map
+        unsigned numThreads = max(1u, min(thread::hardware_concurrency(), (unsigned) DMAP_REBUILD_MAX_THREADS));
+        vector<vector<bool>> used(numThreads, vector<bool>(FILE_BLOCK_COUNT, false));
+        vector<uint32_t> found(files.size(), 0);
+        vector<uint32_t> ends(files.size(), 0);
+        vector<thread> threads;
+
+        for (unsigned t = 0; t < numThreads; t++) {
+            threads.emplace_back([this, t, numThreads, &files, &used, &found, &ends]() {
+                for (size_t f = t; f < files.size(); f += numThreads) {
+                    uint32_t expected = files[f]->blocks;
+                    uint16_t block = files[f]->data;
+                    ends[f] = files[f]->dataIndex;
+
+                    for (uint32_t i = 0; i < expected; i++) {
+                        used[t][block] = true;
+                        found[f]++;
+                        ends[f]++;
+
+                        if (this->fat[block].isLast)
+                            break;
+                        ends[f] += this->fat[block].holeAfter;
+                        block = this->fat[block].nextBlock;
+                    }
+                }
+            });
+        }
+        for (thread &worker : threads)
+            worker.join();
+
+        // Merge the maps of all threads into the DMAP
+        this->superBlock.numFreeBlocks = 0;
+        for (size_t block = 0; block < FILE_BLOCK_COUNT; block++) {
+            bool isUsed = false;
+            for (unsigned t = 0; t < numThreads && !isUsed; t++)
+                isUsed = used[t][block];
+
+            this->dmap[block].isFree = !isUsed;
+            if (!isUsed)
+                this->superBlock.numFreeBlocks++;
+        }
+
+        // Cut files whose block chain ends early
+        bool repaired = false;
+        for (size_t f = 0; f < files.size(); f++) {
+            if (found[f] < files[f]->blocks && !S_ISDIR(files[f]->mode)) {
+                files[f]->blocks = found[f];
+                files[f]->size = min(files[f]->size, (uint64_t) ends[f] * BLOCK_SIZE);
+                repaired = true;
+            }
+        }
+
+        writeSuperblock();
+        writeDmap();
+        if (repaired)
+            writeInodes();
+
+        return this->blockDevice->sync();
+    }
+
+    // --- Write-back cache ---
+    //
+    // Written file data is kept in the cache until the file is flushed or synced, the cache is full or the file
+    // system is unmounted. Blocks that were allocated since the last journal commit are written before the commit,
+    // so committed metadata never points to blocks whose content is not on disk.
+
+    char *cacheBlock(MyFsFile &file, uint16_t block, bool load) {
+        auto cached = this->dataCache.find(block);
+        if (cached == this->dataCache.end()) {
+            cached = this->dataCache.emplace(block, vector<char>(BLOCK_SIZE, 0)).first;
+
+            // Keep the old content of blocks that are only partially overwritten
+            if (load)
+                this->blockDevice->read(block + this->superBlock.fileBlockOffset, cached->second.data());
+        }
+
+        file.dirtyData.insert(block);
+        return cached->second.data();
+    }
+
+    int writeThrough(MyFsFile &file, uint16_t firstBlock, uint32_t count, const char *buf) {
+        // Cached content of the blocks is older than the new one
+        for (uint32_t i = 0; i < count; i++) {
+            this->dataCache.erase(firstBlock + i);
+            file.dirtyData.erase(firstBlock + i);
+        }
+
+        file.unsyncedData = true;
+        return this->blockDevice->writeBlocks(firstBlock + this->superBlock.fileBlockOffset, count, buf);
+    }
+
+    int writeRun(uint16_t firstBlock, vector<char> &run, vector<uint16_t> &runBlocks) {
+        int ret = this->blockDevice->writeBlocks(firstBlock + this->superBlock.fileBlockOffset, runBlocks.size(),
+                                                 run.data());
+
+        // Written blocks are clean again
+        if (ret >= 0) {
+            for (uint16_t block : runBlocks)
+                this->dataCache.erase(block);
+        }
+
+        run.clear();
+        runBlocks.clear();
+        return ret;
+    }
+
+    int flushBlocks(const set<uint16_t> &blocks) {
+
+        vector<char> run;
+        vector<uint16_t> runBlocks;
+        int flushed = 0;
+        int ret = 0;
+
+        // Write consecutive cached blocks with a single request
+        for (uint16_t block : blocks) {
+            auto cached = this->dataCache.find(block);
+            if (cached == this->dataCache.end())
+                continue;
+
+            if (!runBlocks.empty() && runBlocks.front() + runBlocks.size() != block) {
+                ret = writeRun(runBlocks.front(), run, runBlocks);
+                if (ret < 0)
+                    return ret;
+            }
+
+            run.insert(run.end(), cached->second.begin(), cached->second.end());
+            runBlocks.push_back(block);
+            flushed++;
+        }
+
+        if (!runBlocks.empty())
+            ret = writeRun(runBlocks.front(), run, runBlocks);
+
+        return ret < 0 ? ret : flushed;
+    }
+
+    int flushFileData(MyFsFile &file) {
+        int ret = flushBlocks(file.dirtyData);
+        if (ret >= 0)
+            file.dirtyData.clear();
+        return ret;
+    }
+
+    int flushDataCache() {
+        set<uint16_t> blocks;
+        for (const auto& cached : this->dataCache)
+            blocks.insert(cached.first);
+
+        return flushBlocks(blocks);
+    }
+
+    // --- Metadata journal ---
+    //
+    // Operations do not write metadata to its home location. They mark the metadata blocks they change as dirty and
+    // call journalAppend() when they are done. This appends the images of the dirty blocks as one record to the
+    // current group. The group is written to the journal region with one sequential write and one sync when enough
+    // operations have been collected, when the group is getting old or when a file is synced. Blocks are copied to
+    // their home locations only when the journal runs full or the file system is unmounted.
+
+    void markDirty(uint32_t blockNo) {
+        this->dirtyBlocks.insert(blockNo);
+    }
+
+    void markDmapDirty(uint16_t block) {
+        markDirty(SUPERBLOCK_OFFSET); // The number of free blocks changed
+        markDirty(this->superBlock.dmapBlockOffset + block / DMAP_ENTRIES_PER_BLOCK);
+    }
+
+    void markFatDirty(uint16_t block) {
+        markDirty(this->superBlock.fatBlockOffset + block / FAT_ENTRIES_PER_BLOCK);
+    }
+
+    void markDirBlockDirty(MyFsDirectory &directory, uint32_t index) {
+        markDirty(directory.blocks[index].block + this->superBlock.fileBlockOffset);
+    }
+
+    void markInodeDirty(MyFsFile &file, bool dataChanged = false) {
+        markDirty(this->superBlock.inodeBlockOffset + file.ino / INODES_PER_BLOCK);
+        this->lazyInodes.erase(file.ino);
+
+        // Remember the record that will carry the change, fsync and fdatasync wait for it
+        file.metaSequence = this->journalSequence;
+        if (dataChanged)
+            file.dataSequence = this->journalSequence;
+    }
+
+    void touchInode(MyFsFile &file) {
+        // With lazytime, changed timestamps reach the journal with the next real change of the inode, an fsync, the
+        // unmount or when they are getting old
+        if (!this->lazytime) {
+            markInodeDirty(file);
+            return;
+        }
+
+        if (this->lazyInodes.empty())
+            this->lazyStart = time(NULL);
+        this->lazyInodes.insert(file.ino);
+    }
+
+    void writeLazyInodes(bool force) {
+        if (this->lazyInodes.empty() || (!force && time(NULL) - this->lazyStart < LAZYTIME_MAX_AGE))
+            return;
+
+        set<uint32_t> inodes;
+        inodes.swap(this->lazyInodes);
+        for (uint32_t ino : inodes)
+            markInodeDirty(this->inodes[ino]);
+    }
+
+    bool encodeBlock(uint32_t blockNo, char *buffer) {
+        memset(buffer, 0, BLOCK_SIZE);
+
+        if (blockNo == SUPERBLOCK_OFFSET) {
+            memcpy(buffer, &this->superBlock, sizeof(SuperBlock));
+
+        } else if (blockNo >= this->superBlock.dmapBlockOffset && blockNo < this->superBlock.fatBlockOffset) {
+            size_t startIndex = (blockNo - this->superBlock.dmapBlockOffset) * DMAP_ENTRIES_PER_BLOCK;
+            memcpy(buffer, &this->dmap[startIndex], sizeof(DMapEntry) * DMAP_ENTRIES_PER_BLOCK);
+
+        } else if (blockNo >= this->superBlock.fatBlockOffset && blockNo < this->superBlock.inodeBlockOffset) {
+            size_t startIndex = (blockNo - this->superBlock.fatBlockOffset) * FAT_ENTRIES_PER_BLOCK;
+            memcpy(buffer, &this->fat[startIndex], sizeof(FATEntry) * FAT_ENTRIES_PER_BLOCK);
+
+        } else if (blockNo >= this->superBlock.inodeBlockOffset && blockNo < this->superBlock.journalBlockOffset) {
+            size_t startIndex = (blockNo - this->superBlock.inodeBlockOffset) * INODES_PER_BLOCK;
+            for (size_t i = 0; i < INODES_PER_BLOCK; i++)
+                memcpy(buffer + i * INODE_SIZE, static_cast<const MyFsInode *>(&this->inodes[startIndex + i]), INODE_SIZE);
+
+        } else if (blockNo >= this->superBlock.fileBlockOffset) {
+            auto index = this->directoryBlocks.find(blockNo - this->superBlock.fileBlockOffset);
+            if (index == this->directoryBlocks.end())
+                return false; // Not a metadata block (anymore)
+
+            // Pack the records of the block, the last one covers the rest of the block
+            const MyFsDirBlock &dirBlock = index->second.first->blocks[index->second.second];
+            size_t offset = 0;
+            for (size_t i = 0; i < dirBlock.records.size(); i++) {
+                const PathIndex<MyFsDirEntry>::Entry *entry = dirBlock.records[i];
+
+                MyFsDiskEntry record;
+                record.ino = entry->second.ino;
+                record.nameLength = entry->first.size();
+                record.type = this->inodes[record.ino].mode >> 12;
+                record.recordLength = (i + 1 < dirBlock.records.size()) ? recordSize(record.nameLength)
+                                                                         : BLOCK_SIZE - offset;
+                memcpy(buffer + offset, &record, sizeof(MyFsDiskEntry));
+                memcpy(buffer + offset + sizeof(MyFsDiskEntry), entry->first.data(), record.nameLength);
+                offset += record.recordLength;
+            }
+
+            // An empty block holds a single unused record
+            if (dirBlock.records.empty()) {
+                MyFsDiskEntry record;
+                record.ino = 0;
+                record.recordLength = BLOCK_SIZE;
+                record.nameLength = 0;
+                record.type = 0;
+                memcpy(buffer, &record, sizeof(MyFsDiskEntry));
+            }
+        }
+
+        return true;
+    }
+
+    int writeJournalHeader() {
+        char *buffer = (char*) malloc(BLOCK_SIZE);
+        memset(buffer, 0, BLOCK_SIZE);
+
+        JournalHeader header;
+        header.sequence = this->journalSequence;
+        memcpy(buffer, &header, sizeof(JournalHeader));
+
+        int ret = this->blockDevice->write(this->superBlock.journalBlockOffset, buffer);
+        free(buffer);
+
+        return ret;
+    }
+
+    int journalAppend() {
+
+        writeLazyInodes(false);
+
+        if (this->dirtyBlocks.empty())
+            return 0;
+
+        uint32_t numBlocks = this->dirtyBlocks.size();
+        uint32_t numRecords = (numBlocks + JOURNAL_RECORD_MAX_BLOCKS - 1) / JOURNAL_RECORD_MAX_BLOCKS;
+        uint32_t recordBlocks = numBlocks + numRecords;
+        uint32_t pendingBlocks = this->journalBuffer.size() / BLOCK_SIZE;
+
+        // Make room in the journal if the operation does not fit behind the current group
+        if (this->journalHead + pendingBlocks + recordBlocks > this->superBlock.journalBlockCount) {
+            int ret = journalCommit();
+            if (ret >= 0)
+                ret = journalCheckpoint();
+            if (ret < 0)
+                return ret;
+        }
+
+        // Operations larger than the whole journal are written to their home locations directly
+        if (1 + recordBlocks > this->superBlock.journalBlockCount) {
+            int ret = flushBlocks(this->freshBlocks);
+            if (ret < 0)
+                return ret;
+            this->freshBlocks.clear();
+
+            char *buffer = (char*) malloc(BLOCK_SIZE);
+            for (uint32_t blockNo : this->dirtyBlocks) {
+                if (encodeBlock(blockNo, buffer))
+                    this->blockDevice->write(blockNo, buffer);
+            }
+            free(buffer);
+            this->dirtyBlocks.clear();
+            return this->blockDevice->sync();
+        }
+
+        // Append the block images as one or more records to the current group
+        auto iterator = this->dirtyBlocks.begin();
+        for (uint32_t r = 0; r < numRecords; r++) {
+
+            JournalRecord record;
+            record.sequence = this->journalSequence++;
+            record.numBlocks = min(numBlocks - r * JOURNAL_RECORD_MAX_BLOCKS, (uint32_t) JOURNAL_RECORD_MAX_BLOCKS);
+            record.flags = (r + 1 < numRecords) ? JOURNAL_RECORD_CONTINUED : 0;
+            memset(record.blockNo, 0, sizeof(record.blockNo));
+
+            size_t recordOffset = this->journalBuffer.size();
+            this->journalBuffer.resize(recordOffset + (1 + record.numBlocks) * BLOCK_SIZE);
+
+            // Write the block images behind the descriptor
+            for (uint16_t i = 0; i < record.numBlocks; i++, iterator++) {
+                record.blockNo[i] = *iterator;
+                encodeBlock(*iterator, &this->journalBuffer[recordOffset + (1 + i) * BLOCK_SIZE]);
+                this->journaledBlocks.insert(*iterator);
+            }
+
+            // Write the descriptor with the checksum over the whole record
+            memcpy(&this->journalBuffer[recordOffset], &record, sizeof(JournalRecord));
+            record.checksum = fnv1a(&this->journalBuffer[recordOffset], (1 + record.numBlocks) * BLOCK_SIZE);
+            memcpy(&this->journalBuffer[recordOffset], &record, sizeof(JournalRecord));
+        }
+
+        this->dirtyBlocks.clear();
+
+        // Commit the group if it is large or old enough
+        if (this->journalGroupOps++ == 0)
+            this->journalGroupStart = time(NULL);
+
+        if (this->journalGroupOps >= JOURNAL_GROUP_COMMIT_OPS
+            || time(NULL) - this->journalGroupStart >= JOURNAL_COMMIT_INTERVAL)
+            return journalCommit();
+
+        return 0;
+    }
+
+    int journalCommit() {
+
+        if (this->journalBuffer.empty())
+            return 0;
+
+        // Write the data of newly allocated blocks before the metadata pointing to them
+        int ret = flushBlocks(this->freshBlocks);
+        if (ret < 0)
+            return ret;
+        this->freshBlocks.clear();
+
+        // Write the group behind the last committed record and wait until it is stable
+        uint32_t numBlocks = this->journalBuffer.size() / BLOCK_SIZE;
+        ret = this->blockDevice->writeBlocks(this->superBlock.journalBlockOffset + this->journalHead, numBlocks,
+                                                 this->journalBuffer.data());
+        if (ret >= 0)
+            ret = this->blockDevice->sync();
+        if (ret < 0)
+            return ret;
+
+        this->journalHead += numBlocks;
+        this->journalCommitted = this->journalSequence;
+        this->journalBuffer.clear();
+        this->journalGroupOps = 0;
+
+        return 0;
+    }
+
+    int journalCheckpoint() {
+
+        if (this->journaledBlocks.empty())
+            return 0;
+
+        // Copy the journaled blocks to their home locations
+        char *buffer = (char*) malloc(BLOCK_SIZE);
+        for (uint32_t blockNo : this->journaledBlocks) {
+            if (encodeBlock(blockNo, buffer))
+                this->blockDevice->write(blockNo, buffer);
+        }
+        free(buffer);
+
+        int ret = this->blockDevice->sync();
+        if (ret < 0)
+            return ret;
+
+        // Invalidate the checkpointed records
+        this->journaledBlocks.clear();
+        this->journalHead = 1;
+
+        ret = writeJournalHeader();
+        if (ret >= 0)
+            ret = this->blockDevice->sync();
+
+        return ret;
+    }
+
+    int journalReplay(vector<char> &metadata) {
+
+        // Read the journal header
+        JournalHeader header;
+        const char *journal = &metadata[this->superBlock.journalBlockOffset * BLOCK_SIZE];
+        memcpy(&header, journal, sizeof(JournalHeader));
+
+        this->journalSequence = (header.magic == JOURNAL_MAGIC) ? header.sequence : 1;
+        this->journalHead = 1;
+        this->journalBuffer.clear();
+        this->journalGroupOps = 0;
+        this->dirtyBlocks.clear();
+        this->journaledBlocks.clear();
+
+        uint32_t replayed = 0;
+        uint32_t position = 1;
+        vector<char> transaction;
+        vector<uint32_t> transactionBlocks;
+
+        while (header.magic == JOURNAL_MAGIC && position < this->superBlock.journalBlockCount) {
+
+            // Validate the descriptor of the next record
+            JournalRecord record;
+            const char *descriptor = journal + position * BLOCK_SIZE;
+            memcpy(&record, descriptor, sizeof(JournalRecord));
+
+            if (record.magic != JOURNAL_MAGIC || record.sequence != this->journalSequence
+                || record.numBlocks > JOURNAL_RECORD_MAX_BLOCKS
+                || position + 1 + record.numBlocks > this->superBlock.journalBlockCount)
+                break;
+
+            // Verify the checksum over the descriptor and the block images
+            uint32_t expected = record.checksum;
+            record.checksum = 0;
+            uint32_t actual = fnv1a((const char *) &record, sizeof(JournalRecord));
+            actual = fnv1a(descriptor + sizeof(JournalRecord), BLOCK_SIZE - sizeof(JournalRecord), actual);
+            actual = fnv1a(descriptor + BLOCK_SIZE, record.numBlocks * BLOCK_SIZE, actual);
+            if (actual != expected)
+                break;
+
+            for (uint16_t i = 0; i < record.numBlocks; i++) {
+                transactionBlocks.push_back(record.blockNo[i]);
+                transaction.insert(transaction.end(), descriptor + (1 + i) * BLOCK_SIZE, descriptor + (2 + i) * BLOCK_SIZE);
+            }
+
+            position += 1 + record.numBlocks;
+            this->journalSequence++;
+
+            // Copy the blocks of a complete operation to their home locations
+            if (!(record.flags & JOURNAL_RECORD_CONTINUED)) {
+                for (size_t i = 0; i < transactionBlocks.size(); i++) {
+                    this->blockDevice->write(transactionBlocks[i], &transaction[i * BLOCK_SIZE]);
+
+                    // Keep the copy of the metadata region up to date
+                    if (transactionBlocks[i] < FILE_BLOCK_OFFSET)
+                        memcpy(&metadata[transactionBlocks[i] * BLOCK_SIZE], &transaction[i * BLOCK_SIZE], BLOCK_SIZE);
+                }
+
+                replayed += transactionBlocks.size();
+                transaction.clear();
+                transactionBlocks.clear();
+            }
+        }
+
+        this->journalCommitted = this->journalSequence;
+
+        // Nothing to do if the journal is empty
+        if (header.magic == JOURNAL_MAGIC && position == 1)
+            return 0;
+
+        // Start over with an empty journal
+        int ret = this->blockDevice->sync();
+        if (ret >= 0)
+            ret = writeJournalHeader();
+        if (ret >= 0)
+            ret = this->blockDevice->sync();
+
+        return ret < 0 ? ret : replayed;
+    }
+
+    // --- Background flusher ---
+    //
+    // Requests only check the commit deadline of the current group and the age of timestamps kept back by lazytime
+    // when they append to the journal. The flusher does both while no further requests come in. It takes the request
+    // lock, so it never runs in the middle of an operation.
+
+    void startFlusher() {
+        if (!this->flushEnabled)
+            return;
+
+        this->flushStopping = false;
+        this->flushThread = thread(&MyOnDiskFS::flushLoop, this);
+    }
+
+    void stopFlusher() {
+        if (this->flushThread.joinable()) {
+            {
+                lock_guard<mutex> guard(this->flushLock);
+                this->flushStopping = true;
+            }
+            this->flushWakeup.notify_all();
+            this->flushThread.join();
+        }
+    }
+
+    void flushLoop() {
+        // Deadlines are whole seconds, so they are checked once per second
+        unique_lock<mutex> guard(this->flushLock);
+        while (!this->flushStopping) {
+            this->flushWakeup.wait_for(guard, chrono::seconds(1));
+            if (this->flushStopping)
+                break;
+
+            guard.unlock();
+            {
+                // A group that fails to commit stays in the buffer, the next check or request tries again
+                lock_guard<recursive_mutex> request(this->requestLock);
+                flushExpired();
+            }
+            guard.lock();
+        }
+    }
+
+    int flushExpired() {
+        // Old lazytime timestamps start a group of their own, which is committed by a later check
+        if (!this->lazyInodes.empty() && time(NULL) - this->lazyStart >= LAZYTIME_MAX_AGE) {
+            int ret = journalAppend();
+            if (ret < 0)
+                return ret;
+        }
+
+        if (this->journalBuffer.empty() || time(NULL) - this->journalGroupStart < JOURNAL_COMMIT_INTERVAL)
+            return 0;
+
+        return journalCommit();
     }
 
 };
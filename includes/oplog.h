@@ -0,0 +1,340 @@
+//
+//  oplog.h
+//  myfs
+//
+
+#ifndef MYFS_OPLOG_H
+#define MYFS_OPLOG_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include "fnv1a.h"
+#include "myfs-info.h"
+
+using namespace std;
+
+#define OPLOG_MAGIC 0x474f4c4f              // "OLOG"
+#define OPLOG_MAX_PAYLOAD 16777216          // Longest payload of a record, longer ones are taken as garbage
+
+/// @brief Header of a record in an operation log, the payload follows it.
+struct OpLogRecord {
+    uint32_t magic = OPLOG_MAGIC;
+    uint32_t type = 0;          // Operation, defined by the user of the log
+    uint32_t length = 0;        // Bytes of the payload
+    uint32_t checksum = 0;      // Checksum over the header and the payload
+    uint64_t sequence = 0;      // Number of the operation, one more than the one before
+    int64_t time = 0;           // Time of the operation
+    uint64_t ino = 0;           // File the operation changes
+    uint64_t parent = 0;        // Directory the operation changes
+    uint64_t value = 0;         // Argument of the operation
+};
+
+static_assert(sizeof(OpLogRecord) == 56, "Records of the operation log must not contain padding");
+
+/// @brief Append-only log of operations.
+///
+/// Every record carries a sequence number and a checksum, a record that was not written completely ends the log when
+/// it is replayed. Records are synced as the sync interval demands: with OPLOG_SYNC_ALWAYS before append() returns,
+/// with an interval by a thread in the background and with OPLOG_SYNC_NEVER only when sync() is called.
+///
+/// A snapshot of the state covers the log up to some record. rotate() moves the log aside to the old log, so a snapshot
+/// can be written while new records go into a fresh log. Once the snapshot is written, the old log is discarded.
+///
+/// Several threads may append at the same time, their records are numbered in the order they are written.
+class OpLog {
+    string path;
+    int fd = -1;
+    atomic<uint64_t> length;        // Bytes in the log
+    atomic<uint64_t> nextSequence;
+    int syncInterval = OPLOG_SYNC_ALWAYS;
+    mutex appending;                // Held while a record is written and while the descriptor changes
+
+    // Background sync, the thread only reads the descriptor while it holds the lock
+    thread syncer;
+    mutex lock;
+    condition_variable wakeup;
+    bool stopping = false;
+    atomic<bool> unsynced;
+
+public:
+    OpLog() : length(0), nextSequence(1), unsynced(false) {}
+
+    OpLog(const OpLog &) = delete;
+    OpLog &operator=(const OpLog &) = delete;
+
+    ~OpLog() {
+        close();
+    }
+
+    bool isOpen() const { return this->fd >= 0; }
+    uint64_t size() const { return this->length; }
+
+    /// @brief Get the name of the old log of a log.
+    static string oldPath(const string &path) { return path + ".old"; }
+
+    /// @brief Get the sequence number of the last record.
+    uint64_t sequence() const { return this->nextSequence - 1; }
+
+    /// @brief Continue the sequence numbers after a record, only allowed before the first append().
+    void setSequence(uint64_t last) { this->nextSequence = last + 1; }
+
+    /// @brief Open a log for appending, it is created if it does not exist.
+    ///
+    /// \param [in] path Name of the log file.
+    /// \param [in] syncInterval Milliseconds between syncs, OPLOG_SYNC_ALWAYS or OPLOG_SYNC_NEVER.
+    /// \return 0 on success, -ERRNO on failure.
+    int open(const char *path, int syncInterval) {
+        close();
+
+        int fd = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+        if (fd < 0)
+            return -errno;
+
+        struct stat status;
+        if (fstat(fd, &status) < 0) {
+            int ret = -errno;
+            ::close(fd);
+            return ret;
+        }
+
+        this->path = path;
+        this->fd = fd;
+        this->length = status.st_size;
+        this->syncInterval = syncInterval;
+        this->stopping = false;
+        if (syncInterval > 0)
+            this->syncer = thread(&OpLog::syncLoop, this);
+        return 0;
+    }
+
+    /// @brief Sync and close the log.
+    void close() {
+        if (this->syncer.joinable()) {
+            {
+                lock_guard<mutex> guard(this->lock);
+                this->stopping = true;
+            }
+            this->wakeup.notify_all();
+            this->syncer.join();
+        }
+
+        if (this->fd >= 0) {
+            fdatasync(this->fd);
+            ::close(this->fd);
+        }
+        this->fd = -1;
+        this->length = 0;
+    }
+
+    /// @brief Append a record.
+    ///
+    /// \param [in,out] record Header of the record, its sequence number, length and checksum are set.
+    /// \param [in] payload Bytes following the header.
+    /// \param [in] size Number of bytes of the payload.
+    /// \return 0 on success, -ERRNO on failure. A record that was not written completely is cut off again.
+    int append(OpLogRecord &record, const char *payload, size_t size) {
+        if (size > OPLOG_MAX_PAYLOAD)
+            return -EFBIG;
+
+        unique_lock<mutex> appendGuard(this->appending);
+        record.magic = OPLOG_MAGIC;
+        record.sequence = this->nextSequence;
+        record.length = (uint32_t) size;
+        record.checksum = 0;
+        record.checksum = fnv1a(payload, size, fnv1a((const char *) &record, sizeof(record)));
+
+        struct iovec parts[2] = {{&record, sizeof(record)}, {(void *) payload, size}};
+        size_t total = sizeof(record) + size;
+        ssize_t written = writev(this->fd, parts, size > 0 ? 2 : 1);
+        while (written >= 0 && (size_t) written < total) {
+            // Finish a short write from where it stopped
+            ssize_t more = written < (ssize_t) sizeof(record)
+                           ? write(this->fd, (const char *) &record + written, sizeof(record) - written)
+                           : write(this->fd, payload + (written - sizeof(record)), total - written);
+            written = more < 0 ? more : written + more;
+        }
+        if (written < 0) {
+            int ret = -errno;
+            if (ftruncate(this->fd, this->length) < 0)
+                ret = -EIO;
+            return ret;
+        }
+
+        this->nextSequence++;
+        this->length += total;
+
+        if (this->syncInterval != OPLOG_SYNC_ALWAYS) {
+            this->unsynced = true;
+            return 0;
+        }
+
+        // Other threads append while this one waits for the disk, one sync may then cover several records
+        int fd = this->fd;
+        appendGuard.unlock();
+        return fdatasync(fd) < 0 ? -errno : 0;
+    }
+
+    /// @brief Write all records to the disk.
+    ///
+    /// \return 0 on success, -ERRNO on failure.
+    int sync() {
+        this->unsynced = false;
+        return fdatasync(this->fd) < 0 ? -errno : 0;
+    }
+
+    /// @brief Move the records to the old log and continue with an empty log.
+    ///
+    /// An old log that was not discarded yet takes the records as well. No append() may run at the same time.
+    /// \return 0 on success, -ERRNO on failure.
+    int rotate() {
+        int ret = sync();
+        if (ret < 0)
+            return ret;
+
+        string old = oldPath(this->path);
+        if (access(old.c_str(), F_OK) == 0)
+            ret = appendFile(this->path, old);
+        else if (rename(this->path.c_str(), old.c_str()) < 0)
+            ret = -errno;
+        if (ret < 0)
+            return ret;
+
+        int fd = ::open(this->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+        if (fd < 0)
+            return -errno;
+        syncDirectory(this->path);
+
+        {
+            lock_guard<mutex> appendGuard(this->appending);
+            lock_guard<mutex> guard(this->lock);
+            ::close(this->fd);
+            this->fd = fd;
+            this->length = 0;
+        }
+        return 0;
+    }
+
+    /// @brief Remove all records, after a snapshot took them over.
+    ///
+    /// \return 0 on success, -ERRNO on failure.
+    int discard() {
+        {
+            lock_guard<mutex> appendGuard(this->appending);
+            if (ftruncate(this->fd, 0) < 0)
+                return -errno;
+            this->length = 0;
+        }
+        discardOld();
+        return sync();
+    }
+
+    /// @brief Remove the old log, after a snapshot took its records over.
+    void discardOld() {
+        if (unlink(oldPath(this->path).c_str()) == 0)
+            syncDirectory(this->path);
+    }
+
+    /// @brief Read the records of a log.
+    ///
+    /// \param [in] path Name of the log file.
+    /// \param [in] apply Called for every complete record with its payload, replaying stops if it returns false.
+    /// \return Number of bytes of complete records, -ERRNO if the log cannot be read.
+    static int64_t replay(const string &path, const function<bool(const OpLogRecord &, const char *)> &apply) {
+        FILE *in = fopen(path.c_str(), "r");
+        if (in == nullptr)
+            return -errno;
+
+        int64_t valid = 0;
+        vector<char> payload;
+        OpLogRecord record;
+        while (fread(&record, sizeof(record), 1, in) == 1) {
+            if (record.magic != OPLOG_MAGIC || record.length > OPLOG_MAX_PAYLOAD)
+                break;
+
+            payload.resize(record.length + 1);
+            if (fread(payload.data(), 1, record.length, in) != record.length)
+                break;
+            payload[record.length] = '\0';
+
+            uint32_t expected = record.checksum;
+            record.checksum = 0;
+            if (fnv1a(payload.data(), record.length, fnv1a((const char *) &record, sizeof(record))) != expected)
+                break;
+            record.checksum = expected;
+
+            if (!apply(record, payload.data()))
+                break;
+            valid += sizeof(record) + record.length;
+        }
+
+        fclose(in);
+        return valid;
+    }
+
+    /// @brief Sync the directory of a file, so a new or renamed file survives a crash.
+    static void syncDirectory(const string &path) {
+        size_t separator = path.rfind('/');
+        string directory = separator == string::npos ? "." : separator == 0 ? "/" : path.substr(0, separator);
+        int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY);
+        if (fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+    }
+
+private:
+    static int appendFile(const string &from, const string &to) {
+        int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        int out = ::open(to.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        int ret = (in < 0 || out < 0) ? -errno : 0;
+
+        vector<char> buffer(1 << 16);
+        ssize_t count = 0;
+        while (ret == 0 && (count = read(in, buffer.data(), buffer.size())) > 0) {
+            if (write(out, buffer.data(), count) != count)
+                ret = -EIO;
+        }
+        if (ret == 0 && (count < 0 || fdatasync(out) < 0))
+            ret = -errno;
+
+        if (in >= 0)
+            ::close(in);
+        if (out >= 0)
+            ::close(out);
+        return ret;
+    }
+
+    void syncLoop() {
+        unique_lock<mutex> guard(this->lock);
+        while (!this->stopping) {
+            this->wakeup.wait_for(guard, chrono::milliseconds(this->syncInterval));
+            if (this->stopping || !this->unsynced.exchange(false))
+                continue;
+
+            // Appends go on while the records are synced through a copy of the descriptor
+            int fd = dup(this->fd);
+            guard.unlock();
+            if (fd >= 0) {
+                fdatasync(fd);
+                ::close(fd);
+            }
+            guard.lock();
+        }
+    }
+};
+
+#endif //MYFS_OPLOG_H
@@ -0,0 +1,210 @@
+//
+//  pagecodec.h
+//  myfs
+//
+
+#ifndef MYFS_PAGECODEC_H
+#define MYFS_PAGECODEC_H
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <sys/types.h>
+
+using namespace std;
+
+/// @brief Fast compression of small blocks such as pages, in the LZ4 block format.
+///
+/// A block is a series of sequences, each of a run of literal bytes followed by a match that repeats bytes found up to
+/// 64 KiB before it. Matches are found through a hash table of the last position of every 4-byte value, which trades
+/// some ratio for speed like LZ4 does. Blocks are at most MAX_BLOCK_BYTES bytes long.
+class PageCodec {
+public:
+    enum { MAX_BLOCK_BYTES = 65536 };
+
+private:
+    enum {
+        HASH_BITS = 12,
+        MIN_MATCH = 4,          // Shortest match worth a sequence
+        LAST_LITERALS = 5,      // The last bytes of a block are always literals
+        MATCH_LIMIT = 12,       // A match starts at least this many bytes before the end
+        SKIP_STRENGTH = 6       // The search speeds up after 2^SKIP_STRENGTH positions without a match
+    };
+
+public:
+    /// @brief Compress a block.
+    ///
+    /// \param [in] src Bytes to compress.
+    /// \param [in] size Number of bytes, at most MAX_BLOCK_BYTES.
+    /// \param [out] dst Buffer for the compressed block.
+    /// \param [in] capacity Size of dst.
+    /// \return Number of compressed bytes, 0 if they do not fit into capacity.
+    static size_t compress(const char *src, size_t size, char *dst, size_t capacity) {
+        if (size > MAX_BLOCK_BYTES)
+            return 0;
+
+        const uint8_t *base = (const uint8_t *) src;
+        const uint8_t *end = base + size;
+        const uint8_t *anchor = base;
+        uint8_t *op = (uint8_t *) dst;
+        uint8_t *opEnd = op + capacity;
+
+        if (size > MATCH_LIMIT) {
+            uint16_t table[1 << HASH_BITS];
+            memset(table, 0, sizeof(table));
+
+            const uint8_t *matchEnd = end - LAST_LITERALS;
+            const uint8_t *searchEnd = end - MATCH_LIMIT;
+            const uint8_t *ip = base + 1;
+            size_t misses = 0;
+            while (ip < searchEnd) {
+                uint32_t value = read32(ip);
+                uint32_t hash = hashOf(value);
+                const uint8_t *ref = base + table[hash];
+                table[hash] = (uint16_t) (ip - base);
+
+                if (ref >= ip || read32(ref) != value) {
+                    ip += 1 + (misses++ >> SKIP_STRENGTH);
+                    continue;
+                }
+                misses = 0;
+
+                // Extend the match backwards into the literals and forwards as far as allowed
+                while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                    ip--;
+                    ref--;
+                }
+                size_t offset = ip - ref;
+                const uint8_t *match = ip + MIN_MATCH;
+                ref += MIN_MATCH;
+                while (match < matchEnd && *match == *ref) {
+                    match++;
+                    ref++;
+                }
+
+                op = writeSequence(op, opEnd, anchor, ip - anchor, offset, match - ip);
+                if (op == nullptr)
+                    return 0;
+                ip = anchor = match;
+            }
+        }
+
+        op = writeSequence(op, opEnd, anchor, end - anchor, 0, 0);
+        return op != nullptr ? op - (uint8_t *) dst : 0;
+    }
+
+    /// @brief Decompress a block.
+    ///
+    /// Blocks are checked while they are decompressed, a damaged block never writes outside of dst.
+    /// \param [in] src Compressed block.
+    /// \param [in] size Number of bytes of the block.
+    /// \param [out] dst Buffer for the decompressed bytes.
+    /// \param [in] capacity Size of dst.
+    /// \return Number of decompressed bytes, -EIO if the block is damaged or does not fit into capacity.
+    static ssize_t decompress(const char *src, size_t size, char *dst, size_t capacity) {
+        const uint8_t *ip = (const uint8_t *) src;
+        const uint8_t *ipEnd = ip + size;
+        uint8_t *op = (uint8_t *) dst;
+        uint8_t *opEnd = op + capacity;
+
+        while (ip < ipEnd) {
+            uint8_t token = *ip++;
+
+            size_t literals = token >> 4;
+            if (literals == 15 && !readLength(ip, ipEnd, literals))
+                return -EIO;
+            if (literals > (size_t) (ipEnd - ip) || literals > (size_t) (opEnd - op))
+                return -EIO;
+            memcpy(op, ip, literals);
+            ip += literals;
+            op += literals;
+
+            // The last sequence has no match
+            if (ip == ipEnd)
+                break;
+
+            if (ipEnd - ip < 2)
+                return -EIO;
+            size_t offset = ip[0] | (size_t) ip[1] << 8;
+            ip += 2;
+            if (offset == 0 || offset > (size_t) (op - (uint8_t *) dst))
+                return -EIO;
+
+            size_t length = token & 15;
+            if (length == 15 && !readLength(ip, ipEnd, length))
+                return -EIO;
+            length += MIN_MATCH;
+            if (length > (size_t) (opEnd - op))
+                return -EIO;
+
+            // A match may overlap the bytes it produces, which repeats them
+            const uint8_t *ref = op - offset;
+            if (offset >= length) {
+                memcpy(op, ref, length);
+                op += length;
+            } else {
+                for (size_t i = 0; i < length; i++)
+                    *op++ = *ref++;
+            }
+        }
+
+        return op - (uint8_t *) dst;
+    }
+
+private:
+    static uint32_t read32(const uint8_t *p) {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint32_t hashOf(uint32_t value) {
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static uint8_t *writeLength(uint8_t *op, size_t length) {
+        for (; length >= 255; length -= 255)
+            *op++ = 255;
+        *op++ = (uint8_t) length;
+        return op;
+    }
+
+    static bool readLength(const uint8_t *&ip, const uint8_t *ipEnd, size_t &length) {
+        uint8_t byte;
+        do {
+            if (ip == ipEnd)
+                return false;
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    /// @brief Append literals and a match, a match of length 0 ends the block.
+    static uint8_t *writeSequence(uint8_t *op, uint8_t *opEnd, const uint8_t *literals, size_t count, size_t offset,
+                                  size_t length) {
+        // Token, literal length, literals, offset and match length in the worst case
+        size_t needed = 1 + (count / 255 + 1) + count + (length > 0 ? 2 + length / 255 + 1 : 0);
+        if (needed > (size_t) (opEnd - op))
+            return nullptr;
+
+        size_t matchCode = length > 0 ? length - MIN_MATCH : 0;
+        *op++ = (uint8_t) ((count < 15 ? count : 15) << 4 | (matchCode < 15 ? matchCode : 15));
+        if (count >= 15)
+            op = writeLength(op, count - 15);
+        if (count > 0)
+            memcpy(op, literals, count);
+        op += count;
+
+        if (length > 0) {
+            *op++ = (uint8_t) offset;
+            *op++ = (uint8_t) (offset >> 8);
+            if (matchCode >= 15)
+                op = writeLength(op, matchCode - 15);
+        }
+        return op;
+    }
+};
+
+#endif //MYFS_PAGECODEC_H
@@ -0,0 +1,276 @@
+//
+//  pagedcontent.h
+//  myfs
+//
+
+#ifndef MYFS_PAGEDCONTENT_H
+#define MYFS_PAGEDCONTENT_H
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "memoryarena.h"
+
+using namespace std;
+
+/// @brief Content of a file in memory, stored in fixed-size pages.
+///
+/// Pages are allocated when they are first written, so growing a file neither copies nor zero-fills existing data and
+/// a large file needs no contiguous allocation. Pages that were never written are holes, they read as zeros. Pages
+/// come from a PageArena if one is set, otherwise from the heap.
+///
+/// Contents with the same arena can share pages. A shared page is copied before it is written, so a copy of a file
+/// costs no memory until one of the copies is changed.
+class PagedContent {
+public:
+    enum { PAGE_BYTES = PageArena::PAGE_BYTES };
+
+private:
+    vector<char *> pages;               // nullptr for pages that were never written
+    size_t length = 0;
+    size_t allocated = 0;               // Number of pages that are not nullptr
+    PageArena *arena = nullptr;
+
+public:
+    PagedContent() {}
+
+    PagedContent(const PagedContent &) = delete;
+    PagedContent &operator=(const PagedContent &) = delete;
+
+    ~PagedContent() {
+        clear();
+    }
+
+    /// @brief Take pages from an arena, only allowed while the content is empty.
+    void setArena(PageArena *arena) { this->arena = arena; }
+
+    size_t size() const { return this->length; }
+    bool empty() const { return this->length == 0; }
+    size_t allocatedPages() const { return this->allocated; }
+    size_t numPages() const { return this->pages.size(); }
+
+    /// @brief Get a page of the content, nullptr if it is a hole.
+    const char *page(size_t index) const { return this->pages[index]; }
+
+    /// @brief Find the next byte that is stored in a page.
+    ///
+    /// \param [in] offset Position to start at.
+    /// \return Position of the byte, size() if there is none.
+    size_t nextData(size_t offset) const {
+        for (size_t page = offset / PAGE_BYTES; page < this->pages.size(); page++) {
+            if (this->pages[page])
+                return max(offset, page * PAGE_BYTES);
+        }
+        return this->length;
+    }
+
+    /// @brief Find the next byte that lies in a hole.
+    ///
+    /// \param [in] offset Position to start at.
+    /// \return Position of the byte, size() if there is none.
+    size_t nextHole(size_t offset) const {
+        for (size_t page = offset / PAGE_BYTES; page < this->pages.size(); page++) {
+            if (!this->pages[page])
+                return min(max(offset, page * PAGE_BYTES), this->length);
+        }
+        return this->length;
+    }
+
+    /// @brief Count the pages a write would allocate.
+    ///
+    /// \param [in] offset Position of the first byte to write.
+    /// \param [in] size Number of bytes to write.
+    /// \return Number of pages in the range that were never written or are shared.
+    size_t missingPages(size_t offset, size_t size) const {
+        if (size == 0)
+            return 0;
+
+        size_t missing = 0;
+        for (size_t page = offset / PAGE_BYTES; page <= (offset + size - 1) / PAGE_BYTES; page++) {
+            if (page >= this->pages.size() || !this->pages[page] || isShared(page))
+                missing++;
+        }
+        return missing;
+    }
+
+    /// @brief Copy bytes out of the content.
+    ///
+    /// \param [in] offset Position of the first byte to read.
+    /// \param [in] size Number of bytes to read.
+    /// \param [out] buf Buffer for the bytes.
+    /// \return Number of bytes read, less than size at the end of the content.
+    size_t read(size_t offset, size_t size, char *buf) const {
+        if (offset >= this->length)
+            return 0;
+        size = min(size, this->length - offset);
+
+        for (size_t done = 0; done < size;) {
+            size_t page = (offset + done) / PAGE_BYTES;
+            size_t pageOffset = (offset + done) % PAGE_BYTES;
+            size_t count = min(size - done, (size_t) PAGE_BYTES - pageOffset);
+
+            if (this->pages[page])
+                memcpy(buf + done, this->pages[page] + pageOffset, count);
+            else
+                memset(buf + done, 0, count);
+            done += count;
+        }
+
+        return size;
+    }
+
+    /// @brief Copy bytes into the content, growing it if they end behind its size.
+    ///
+    /// \param [in] offset Position of the first byte to write.
+    /// \param [in] buf Bytes to write.
+    /// \param [in] size Number of bytes to write.
+    void write(size_t offset, const char *buf, size_t size) {
+        if (offset + size > this->length)
+            resize(offset + size);
+
+        for (size_t done = 0; done < size;) {
+            size_t page = (offset + done) / PAGE_BYTES;
+            size_t pageOffset = (offset + done) % PAGE_BYTES;
+            size_t count = min(size - done, (size_t) PAGE_BYTES - pageOffset);
+
+            memcpy(writablePage(page) + pageOffset, buf + done, count);
+            done += count;
+        }
+    }
+
+    /// @brief Copy bytes of another content into the content, growing it if they end behind its size.
+    ///
+    /// Whole pages are shared instead of copied if both contents use the same arena and the bytes keep their position
+    /// within a page, holes stay holes. The ranges must not overlap if both contents are the same.
+    /// \param [in] source Content to copy from.
+    /// \param [in] sourceOffset Position of the first byte to copy.
+    /// \param [in] offset Position the first byte is copied to.
+    /// \param [in] size Number of bytes to copy, bytes behind the end of the source are not copied.
+    /// \return Number of bytes copied.
+    size_t copy(const PagedContent &source, size_t sourceOffset, size_t offset, size_t size) {
+        size = sourceOffset < source.length ? min(size, source.length - sourceOffset) : 0;
+        if (offset + size > this->length)
+            resize(offset + size);
+
+        char buffer[PAGE_BYTES];
+        for (size_t done = 0; done < size;) {
+            size_t page = (offset + done) / PAGE_BYTES;
+            size_t pageOffset = (offset + done) % PAGE_BYTES;
+            size_t count = min(size - done, (size_t) PAGE_BYTES - pageOffset);
+            const char *sourcePage = source.pages[(sourceOffset + done) / PAGE_BYTES];
+
+            // The last page of both contents may be shared as well, the bytes behind their ends are zeros
+            bool wholePage = count == PAGE_BYTES || (pageOffset == 0 && offset + done + count == this->length
+                                                     && sourceOffset + done + count == source.length);
+            if (wholePage && canShare(source, sourceOffset, offset)) {
+                if (this->pages[page]) {
+                    freePage(this->pages[page]);
+                    this->allocated--;
+                }
+                this->pages[page] = sourcePage ? this->arena->share((char *) sourcePage) : nullptr;
+                if (sourcePage)
+                    this->allocated++;
+            } else if (sourcePage || this->pages[page]) {
+                source.read(sourceOffset + done, count, buffer);
+                memcpy(writablePage(page) + pageOffset, buffer, count);
+            }
+            done += count;
+        }
+
+        return size;
+    }
+
+    /// @brief Replace the content by a copy of another content.
+    ///
+    /// \param [in] source Content to copy, all pages are shared if both contents use the same arena.
+    void clone(const PagedContent &source) {
+        if (&source == this)
+            return;
+
+        clear();
+        copy(source, 0, 0, source.length);
+    }
+
+    /// @brief Check if copy() shares the whole pages of a range.
+    ///
+    /// \param [in] source Content to copy from.
+    /// \param [in] sourceOffset Position of the first byte to copy.
+    /// \param [in] offset Position the first byte is copied to.
+    bool canShare(const PagedContent &source, size_t sourceOffset, size_t offset) const {
+        return this->arena != nullptr && this->arena == source.arena && sourceOffset % PAGE_BYTES == offset % PAGE_BYTES;
+    }
+
+    /// @brief Change the size of the content.
+    ///
+    /// New bytes read as zeros. Pages behind the new size are freed.
+    /// \param [in] newSize New size in bytes.
+    void resize(size_t newSize) {
+        // Bytes cut off from the last page must read as zeros if the content grows again
+        if (newSize < this->length && newSize % PAGE_BYTES != 0 && this->pages[newSize / PAGE_BYTES]) {
+            size_t pageOffset = newSize % PAGE_BYTES;
+            memset(writablePage(newSize / PAGE_BYTES) + pageOffset, 0, PAGE_BYTES - pageOffset);
+        }
+
+        size_t numPages = (newSize + PAGE_BYTES - 1) / PAGE_BYTES;
+        for (size_t page = numPages; page < this->pages.size(); page++) {
+            if (this->pages[page]) {
+                freePage(this->pages[page]);
+                this->allocated--;
+            }
+        }
+
+        this->pages.resize(numPages);
+        this->length = newSize;
+    }
+
+    /// @brief Free all pages but keep the size, the content reads as zeros until it is written again.
+    void dropPages() {
+        for (char *&page : this->pages) {
+            freePage(page);
+            page = nullptr;
+        }
+        this->allocated = 0;
+    }
+
+    /// @brief Free all pages.
+    void clear() {
+        for (char *page : this->pages)
+            freePage(page);
+        this->pages.clear();
+        this->length = 0;
+        this->allocated = 0;
+    }
+
+private:
+    bool isShared(size_t page) const {
+        return this->arena != nullptr && this->arena->isShared(this->pages[page]);
+    }
+
+    char *writablePage(size_t page) {
+        if (!this->pages[page]) {
+            this->pages[page] = allocatePage();
+            this->allocated++;
+        } else if (isShared(page)) {
+            // Other owners keep the old page
+            char *copy = allocatePage();
+            memcpy(copy, this->pages[page], PAGE_BYTES);
+            this->arena->free(this->pages[page]);
+            this->pages[page] = copy;
+        }
+        return this->pages[page];
+    }
+
+    char *allocatePage() {
+        return this->arena != nullptr ? this->arena->allocate() : new char[PAGE_BYTES]();
+    }
+
+    void freePage(char *page) {
+        if (this->arena != nullptr)
+            this->arena->free(page);
+        else
+            delete[] page;
+    }
+};
+
+#endif //MYFS_PAGEDCONTENT_H
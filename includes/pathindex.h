@@ -0,0 +1,330 @@
+//
+//  pathindex.h
+//  myfs
+//
+
+#ifndef MYFS_PATHINDEX_H
+#define MYFS_PATHINDEX_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+#include "memoryarena.h"
+#include "fnv1a.h"
+
+using namespace std;
+
+/// @brief Hash index from paths to values.
+///
+/// Open addressing with linear probing over a power-of-two slot array. Every slot stores the hash of its path next to
+/// a pointer to the entry, so probing rarely has to touch the entries and lookups with a plain C string never allocate
+/// a temporary std::string. Entries are allocated individually, from a SlabAllocator if one is set, and keep their
+/// address until they are erased. A sorted view of the entries is only built on demand for listing a directory.
+template<typename T>
+class PathIndex {
+public:
+    typedef pair<const string, T> Entry;
+    typedef Entry value_type;
+
+private:
+    enum SlotState : uint32_t { EMPTY, USED, DELETED };
+    enum { MIN_CAPACITY = 16 };
+
+    struct Slot {
+        uint32_t hash = 0;
+        SlotState state = EMPTY;
+        Entry *entry = nullptr;
+    };
+
+    vector<Slot> slots;
+    size_t count = 0;           // Slots in state USED
+    size_t deleted = 0;         // Slots in state DELETED
+    vector<Entry *> sorted;
+    bool sortedValid = true;
+    SlabAllocator<Entry> *allocator = nullptr;
+
+public:
+    /// @brief Iterator over the entries in slot order.
+    class iterator {
+        friend class PathIndex;
+
+        const PathIndex *index = nullptr;
+        size_t slot = 0;
+        Entry *entry = nullptr;
+
+        iterator(const PathIndex *index, size_t slot) : index(index), slot(slot) {
+            skip();
+        }
+
+        void skip() {
+            while (this->slot < this->index->slots.size() && this->index->slots[this->slot].state != USED)
+                this->slot++;
+            this->entry = (this->slot < this->index->slots.size()) ? this->index->slots[this->slot].entry : nullptr;
+        }
+
+    public:
+        typedef forward_iterator_tag iterator_category;
+        typedef Entry value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Entry *pointer;
+        typedef Entry &reference;
+
+        iterator() {}
+
+        reference operator*() const { return *this->entry; }
+        pointer operator->() const { return this->entry; }
+
+        iterator &operator++() {
+            this->slot++;
+            skip();
+            return *this;
+        }
+
+        iterator operator++(int) {
+            iterator old = *this;
+            ++(*this);
+            return old;
+        }
+
+        bool operator==(const iterator &other) const { return this->entry == other.entry; }
+        bool operator!=(const iterator &other) const { return this->entry != other.entry; }
+    };
+
+    typedef iterator const_iterator;
+
+    PathIndex() {}
+
+    PathIndex(const PathIndex &) = delete;
+    PathIndex &operator=(const PathIndex &) = delete;
+
+    PathIndex(PathIndex &&other) {
+        swap(other);
+    }
+
+    PathIndex &operator=(PathIndex &&other) {
+        clear();
+        swap(other);
+        return *this;
+    }
+
+    ~PathIndex() {
+        clear();
+    }
+
+    /// @brief Compute the FNV-1a hash of a path.
+    ///
+    /// The value 0 is never returned, so it can mark unused slots.
+    /// \param [in] path Path to hash, it does not need to be terminated.
+    /// \param [in] length Number of characters of the path.
+    static uint32_t hash(const char *path, size_t length) {
+        uint32_t hash = fnv1a(path, length);
+        return hash == 0 ? 1 : hash;
+    }
+
+    static uint32_t hash(const char *path) { return hash(path, strlen(path)); }
+
+    /// @brief Allocate entries from a slab, only allowed while the index is empty.
+    void setAllocator(SlabAllocator<Entry> *allocator) { this->allocator = allocator; }
+
+    size_t size() const { return this->count; }
+    bool empty() const { return this->count == 0; }
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, this->slots.size()); }
+
+    /// @brief Find the entry of a path.
+    ///
+    /// \param [in] path Path to look up, it does not need to be terminated.
+    /// \param [in] length Number of characters of the path.
+    /// \param [in] hash Precomputed hash of the path, see hash().
+    /// \return Iterator to the entry, end() if the path is not in the index.
+    iterator find(const char *path, size_t length, uint32_t hash) const {
+        size_t slot = probe(path, length, hash);
+        return slot < this->slots.size() ? iterator(this, slot) : end();
+    }
+
+    iterator find(const char *path, size_t length) const { return find(path, length, hash(path, length)); }
+    iterator find(const char *path) const { return find(path, strlen(path)); }
+    iterator find(const string &path) const { return find(path.c_str(), path.size()); }
+
+    /// @brief Insert a new entry.
+    ///
+    /// Existing entries are not replaced. Inserting may rehash the slots, which invalidates iterators but not the
+    /// addresses of the entries.
+    /// \param [in] path Path of the entry.
+    /// \param [in] value Value of the entry.
+    /// \return Iterator to the entry with the given path and whether it was inserted.
+    pair<iterator, bool> emplace(const string &path, T &&value) {
+        uint32_t hash = PathIndex::hash(path.c_str(), path.size());
+        size_t slot = probe(path.c_str(), path.size(), hash);
+        if (slot < this->slots.size())
+            return make_pair(iterator(this, slot), false);
+
+        // Keep the load including deleted slots below 3/4
+        if ((this->count + this->deleted + 1) * 4 > this->slots.size() * 3)
+            rehash((this->count + 1) * 2);
+
+        size_t mask = this->slots.size() - 1;
+        slot = hash & mask;
+        while (this->slots[slot].state == USED)
+            slot = (slot + 1) & mask;
+
+        if (this->slots[slot].state == DELETED)
+            this->deleted--;
+        this->slots[slot].hash = hash;
+        this->slots[slot].state = USED;
+        this->slots[slot].entry = createEntry(path, move(value));
+        this->count++;
+        this->sortedValid = false;
+
+        return make_pair(iterator(this, slot), true);
+    }
+
+    pair<iterator, bool> emplace(const char *path, T &&value) {
+        return emplace(string(path), move(value));
+    }
+
+    pair<iterator, bool> emplace(const char *path, size_t length, T &&value) {
+        return emplace(string(path, length), move(value));
+    }
+
+    /// @brief Remove an entry.
+    ///
+    /// The iterator may come from before a rehash, the entry is located again by its address.
+    /// \param [in] position Iterator to the entry to remove.
+    void erase(iterator position) {
+        Entry *entry = position.entry;
+        if (entry == nullptr)
+            return;
+
+        size_t mask = this->slots.size() - 1;
+        size_t slot = hash(entry->first.c_str(), entry->first.size()) & mask;
+        while (this->slots[slot].state != EMPTY) {
+            if (this->slots[slot].state == USED && this->slots[slot].entry == entry) {
+                destroyEntry(entry);
+                this->slots[slot].entry = nullptr;
+                this->slots[slot].state = DELETED;
+                this->count--;
+                this->deleted++;
+                this->sortedValid = false;
+                return;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+
+    /// @brief Remove the entry of a path.
+    ///
+    /// \param [in] path Path of the entry.
+    /// \return Number of removed entries.
+    size_t erase(const char *path) {
+        iterator position = find(path);
+        if (position == end())
+            return 0;
+        erase(position);
+        return 1;
+    }
+
+    size_t erase(const string &path) { return erase(path.c_str()); }
+
+    /// @brief Exchange the entries with another index.
+    void swap(PathIndex &other) {
+        this->slots.swap(other.slots);
+        std::swap(this->count, other.count);
+        std::swap(this->deleted, other.deleted);
+        this->sorted.swap(other.sorted);
+        std::swap(this->sortedValid, other.sortedValid);
+        std::swap(this->allocator, other.allocator);
+    }
+
+    /// @brief Remove all entries.
+    void clear() {
+        for (Slot &slot : this->slots)
+            destroyEntry(slot.entry);
+        this->slots.clear();
+        this->count = 0;
+        this->deleted = 0;
+        this->sorted.clear();
+        this->sortedValid = true;
+    }
+
+    /// @brief Get the entries sorted by path.
+    ///
+    /// The view is cached until the next insertion or removal.
+    /// \return Pointers to the entries in ascending order of their paths.
+    const vector<Entry *> &ordered() {
+        if (!this->sortedValid) {
+            this->sorted.clear();
+            this->sorted.reserve(this->count);
+            for (const Slot &slot : this->slots)
+                if (slot.state == USED)
+                    this->sorted.push_back(slot.entry);
+            sort(this->sorted.begin(), this->sorted.end(), [](const Entry *a, const Entry *b) {
+                return a->first < b->first;
+            });
+            this->sortedValid = true;
+        }
+        return this->sorted;
+    }
+
+private:
+    Entry *createEntry(const string &path, T &&value) {
+        return this->allocator != nullptr ? this->allocator->create(path, move(value)) : new Entry(path, move(value));
+    }
+
+    void destroyEntry(Entry *entry) {
+        if (this->allocator != nullptr)
+            this->allocator->destroy(entry);
+        else
+            delete entry;
+    }
+
+    /// @brief Find the slot of a path.
+    ///
+    /// \return Index of the slot, slots.size() if the path is not in the index.
+    size_t probe(const char *path, size_t length, uint32_t hash) const {
+        if (this->slots.empty())
+            return 0;
+
+        size_t mask = this->slots.size() - 1;
+        size_t slot = hash & mask;
+        while (this->slots[slot].state != EMPTY) {
+            const Slot &current = this->slots[slot];
+            if (current.state == USED && current.hash == hash && current.entry->first.size() == length
+                && memcmp(current.entry->first.data(), path, length) == 0)
+                return slot;
+            slot = (slot + 1) & mask;
+        }
+        return this->slots.size();
+    }
+
+    /// @brief Move all entries into a new slot array.
+    ///
+    /// \param [in] minimum Minimum number of slots, rounded up to a power of two.
+    void rehash(size_t minimum) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity < minimum)
+            capacity *= 2;
+
+        vector<Slot> old(capacity);
+        old.swap(this->slots);
+
+        size_t mask = capacity - 1;
+        for (const Slot &current : old) {
+            if (current.state != USED)
+                continue;
+            size_t slot = current.hash & mask;
+            while (this->slots[slot].state != EMPTY)
+                slot = (slot + 1) & mask;
+            this->slots[slot] = current;
+        }
+        this->deleted = 0;
+    }
+};
+
+#endif //MYFS_PATHINDEX_H
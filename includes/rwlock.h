@@ -0,0 +1,148 @@
+//
+//  rwlock.h
+//  myfs
+//
+
+#ifndef MYFS_RWLOCK_H
+#define MYFS_RWLOCK_H
+
+#include <atomic>
+#include <cstddef>
+#include <pthread.h>
+
+using namespace std;
+
+/// @brief Reader-writer lock, held by any number of readers or by one writer.
+///
+/// Waiting writers are preferred over new readers where the C library allows it, so a stream of readers cannot starve
+/// them. A thread must therefore not take a lock for reading that it already holds.
+class RwLock {
+    pthread_rwlock_t rwlock;
+
+public:
+    RwLock() {
+        pthread_rwlockattr_t attributes;
+        pthread_rwlockattr_init(&attributes);
+#ifdef __GLIBC__
+        pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+        pthread_rwlock_init(&this->rwlock, &attributes);
+        pthread_rwlockattr_destroy(&attributes);
+    }
+
+    RwLock(const RwLock &) = delete;
+    RwLock &operator=(const RwLock &) = delete;
+
+    ~RwLock() {
+        pthread_rwlock_destroy(&this->rwlock);
+    }
+
+    void lock() { pthread_rwlock_wrlock(&this->rwlock); }
+    void unlock() { pthread_rwlock_unlock(&this->rwlock); }
+    void lockShared() { pthread_rwlock_rdlock(&this->rwlock); }
+    void unlockShared() { pthread_rwlock_unlock(&this->rwlock); }
+
+    /// @brief Lock for writing if no other thread holds the lock.
+    ///
+    /// \return true if the lock was taken.
+    bool tryLock() { return pthread_rwlock_trywrlock(&this->rwlock) == 0; }
+};
+
+/// @brief Reader-writer lock for data that is read far more often than it is changed.
+///
+/// The lock is split into shards on separate cache lines. A reader only locks the shard of its thread, so readers on
+/// different cores do not bounce a cache line between them. A writer locks all shards in order.
+class ShardedRwLock {
+public:
+    enum { NUM_SHARDS = 16, CACHE_LINE_BYTES = 64 };
+
+private:
+    struct Shard {
+        RwLock lock;
+        char padding[CACHE_LINE_BYTES - sizeof(RwLock) % CACHE_LINE_BYTES];
+    };
+
+    Shard shards[NUM_SHARDS];
+
+    /// @brief Get the shard of the calling thread, threads are assigned to shards in turn.
+    static size_t shardOfThread() {
+        static atomic<size_t> nextShard(0);
+        static thread_local size_t shard = nextShard++ % NUM_SHARDS;
+        return shard;
+    }
+
+public:
+    ShardedRwLock() {}
+
+    ShardedRwLock(const ShardedRwLock &) = delete;
+    ShardedRwLock &operator=(const ShardedRwLock &) = delete;
+
+    void lock() {
+        for (size_t i = 0; i < NUM_SHARDS; i++)
+            this->shards[i].lock.lock();
+    }
+
+    void unlock() {
+        for (size_t i = NUM_SHARDS; i > 0; i--)
+            this->shards[i - 1].lock.unlock();
+    }
+
+    void lockShared() { this->shards[shardOfThread()].lock.lockShared(); }
+    void unlockShared() { this->shards[shardOfThread()].lock.unlockShared(); }
+};
+
+/// @brief Holds a lock for reading or writing until it is released or goes out of scope.
+template<typename Lock>
+class LockHolder {
+    Lock *held = nullptr;
+    bool exclusive = false;
+
+public:
+    LockHolder() {}
+
+    LockHolder(Lock &lock, bool exclusive) {
+        acquire(lock, exclusive);
+    }
+
+    LockHolder(const LockHolder &) = delete;
+    LockHolder &operator=(const LockHolder &) = delete;
+
+    ~LockHolder() {
+        release();
+    }
+
+    bool isExclusive() const { return this->held != nullptr && this->exclusive; }
+
+    void acquire(Lock &lock, bool exclusive) {
+        release();
+        if (exclusive)
+            lock.lock();
+        else
+            lock.lockShared();
+        this->held = &lock;
+        this->exclusive = exclusive;
+    }
+
+    void release() {
+        if (this->held == nullptr)
+            return;
+        if (this->exclusive)
+            this->held->unlock();
+        else
+            this->held->unlockShared();
+        this->held = nullptr;
+    }
+
+    /// @brief Change a lock held for reading to one held for writing.
+    ///
+    /// The lock is released in between, so other writers may have changed the data and the caller must check it again.
+    void upgrade() {
+        if (this->held != nullptr && !this->exclusive) {
+            Lock &lock = *this->held;
+            release();
+            acquire(lock, true);
+        }
+    }
+};
+
+#endif //MYFS_RWLOCK_H
@@ -119,3 +119,65 @@ int BlockDevice::write(uint32_t blockNo, char *buffer) {
     return 0;
 }
 
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::readBlocks(uint32_t blockNo, uint32_t numBlocks, char *buffer) {
+#ifdef DEBUG
+    fprintf(stderr, "BlockDevice: Reading %d blocks starting at block %d\n", numBlocks, blockNo);
+#endif
+    off_t pos = (off_t) blockNo * this->blockSize;
+    size_t size = (size_t) numBlocks * this->blockSize;
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t r = ::pread(this->contFile, buffer + done, size - done, pos + done);
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (r == 0)
+            break;
+        done += r;
+    }
+    if (done < size)
+        memset(buffer + done, 0, size - done);
+
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::writeBlocks(uint32_t blockNo, uint32_t numBlocks, const char *buffer) {
+#ifdef DEBUG
+    fprintf(stderr, "BlockDevice: Writing %d blocks starting at block %d\n", numBlocks, blockNo);
+#endif
+    off_t pos = (off_t) blockNo * this->blockSize;
+    size_t size = (size_t) numBlocks * this->blockSize;
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t w = ::pwrite(this->contFile, buffer + done, size - done, pos + done);
+        if (w < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (w == 0)
+            return -ENOSPC;
+        done += w;
+    }
+
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::sync() {
+#ifdef __APPLE__
+    if (::fsync(this->contFile) < 0)
+#else
+    if (::fdatasync(this->contFile) < 0)
+#endif
+        return -errno;
+
+    return 0;
+}
@@ -15,6 +15,7 @@
 #include <stddef.h>
 
 #include "myfs-info.h"
+#include "myfs-mount.h"
 
 #define PACKAGE_VERSION "v0.2"
 
@@ -23,6 +24,19 @@ struct fuse_operations myfs_oper;
 struct myfs_config {
     char *containerFileName;
     char *logFileName;
+    int atimeMode;
+    int lazytime;
+    int hugePages;
+    unsigned long memoryLimit;
+    char *spillFileName;
+    char *snapshotFileName;
+    char *opLogFileName;
+    char *opLogSync;
+    int threads;
+    int compressAfter;
+    double entryTimeout;
+    double attrTimeout;
+    double negativeTimeout;
 };
 enum {
     KEY_HELP,
@@ -36,6 +50,21 @@ static struct fuse_opt myfs_opts[] = {
         MYFS_OPT("containerfile=%s",  containerFileName, 0),
         MYFS_OPT("-l %s",             logFileName, 0),
         MYFS_OPT("logfile=%s",        logFileName, 0),
+        MYFS_OPT("relatime",          atimeMode, ATIME_RELATIME),
+        MYFS_OPT("strictatime",       atimeMode, ATIME_STRICT),
+        MYFS_OPT("noatime",           atimeMode, ATIME_NOATIME),
+        MYFS_OPT("lazytime",          lazytime, 1),
+        MYFS_OPT("hugepages",         hugePages, 1),
+        MYFS_OPT("memory_limit=%lu",  memoryLimit, 0),
+        MYFS_OPT("spillfile=%s",      spillFileName, 0),
+        MYFS_OPT("snapshot=%s",       snapshotFileName, 0),
+        MYFS_OPT("oplog=%s",          opLogFileName, 0),
+        MYFS_OPT("oplog_sync=%s",     opLogSync, 0),
+        MYFS_OPT("threads",           threads, 1),
+        MYFS_OPT("compress=%d",       compressAfter, 0),
+        MYFS_OPT("entry_timeout=%lf", entryTimeout, 0),
+        MYFS_OPT("attr_timeout=%lf",  attrTimeout, 0),
+        MYFS_OPT("negative_timeout=%lf", negativeTimeout, 0),
 
         FUSE_OPT_KEY("-V",             KEY_VERSION),
         FUSE_OPT_KEY("--version",      KEY_VERSION),
@@ -50,13 +79,7 @@ static int myfs_opt_proc(void *data, const char *arg, int key, struct fuse_args
         case KEY_HELP:
             fuse_opt_add_arg(outargs, "-h");
             fuse_main(outargs->argc, outargs->argv, &myfs_oper, NULL);
-            fprintf(stderr,
-                    "\n"
-                    "Myfs options:\n"
-                    "    -o containerfile=FILE\n"
-                    "    -c FILE            same as '-o containerfile=FILE'\n"
-                    "    -o logfile=FILE\n"
-                    "    -l FILE            same as '-o logfile=FILE'\n");
+            myfs_usage();
             exit(1);
 
         case KEY_VERSION:
@@ -102,6 +125,7 @@ int main(int argc, char *argv[]) {
     myfs_oper.fsyncdir = wrap_fsyncdir;
     myfs_oper.init = wrap_init;
     myfs_oper.ftruncate = wrap_ftruncate;
+    myfs_oper.create = wrap_create;
     myfs_oper.destroy = wrap_destroy;
 
     char* containerFileName= NULL;
@@ -112,6 +136,9 @@ int main(int argc, char *argv[]) {
     struct myfs_config conf;
 
     memset(&conf, 0, sizeof(conf));
+    conf.entryTimeout = DEFAULT_ENTRY_TIMEOUT;
+    conf.attrTimeout = DEFAULT_ATTR_TIMEOUT;
+    conf.negativeTimeout = DEFAULT_NEGATIVE_TIMEOUT;
 
     fuse_opt_parse(&args, &conf, myfs_opts, myfs_opt_proc);
 
@@ -120,35 +147,7 @@ int main(int argc, char *argv[]) {
     FsInfo= malloc(sizeof(struct MyFsInfo));
     // check if container file is accessible
     if(conf.containerFileName != NULL) {
-        containerFileName= realpath(conf.containerFileName, NULL);
-
-        if(containerFileName == NULL) {
-            // container file does not exist, check if path is writable
-            char *containerFileNameCpy= malloc(strlen(conf.containerFileName)+1);
-            strcpy(containerFileNameCpy, conf.containerFileName);
-            char *dirName= dirname(containerFileNameCpy);
-            char *containerPathName= realpath(dirName, NULL);
-            // free(dirName);
-            if (containerPathName == NULL || access(containerPathName, R_OK | W_OK) != 0 ) {
-                fprintf(stderr, "Error: Cannot access container directory %s\n", containerPathName == NULL ? "" : containerPathName);
-                exit(EXIT_FAILURE);
-            }
-            containerFileName= (char *) malloc(PATH_MAX);
-            strcpy(containerFileNameCpy, conf.containerFileName);
-            char *containerBaseName= basename(containerFileNameCpy);
-            strcpy(containerFileName, containerPathName);
-            strcat(containerFileName, "/");
-            strcat(containerFileName, containerBaseName);
-            // free(containerBaseName);
-            free(containerPathName);
-            free(containerFileNameCpy);
-        } else {
-            // container file does exit, check if it is writable
-            if (containerFileName == NULL || access(containerFileName, R_OK | W_OK) != 0 ) {
-                fprintf(stderr, "Error: Cannot access container file %s\n", containerFileName);
-                exit(EXIT_FAILURE);
-            }
-        }
+        containerFileName= myfs_container_path(conf.containerFileName);
 
         // container file is used, so we are not in memory!
         setInstance(1);
@@ -156,6 +155,26 @@ int main(int argc, char *argv[]) {
         setInstance(0);
     }
 
+    // in memory, the coldest files over the memory limit may be moved into a container of their own
+    char* spillFileName= NULL;
+    if(conf.containerFileName == NULL && conf.spillFileName != NULL)
+        spillFileName= myfs_container_path(conf.spillFileName);
+
+    // in memory, the files may be kept in a snapshot image between mounts
+    char* snapshotFileName= NULL;
+    if(conf.containerFileName == NULL && conf.snapshotFileName != NULL)
+        snapshotFileName= myfs_container_path(conf.snapshotFileName);
+
+    // the operation log is compacted into the snapshot
+    char* opLogFileName= NULL;
+    if(conf.containerFileName == NULL && conf.opLogFileName != NULL) {
+        if(snapshotFileName == NULL) {
+            fprintf(stderr, "Error: The operation log needs a snapshot (use -o snapshot=FILE)\n");
+            exit(EXIT_FAILURE);
+        }
+        opLogFileName= myfs_container_path(conf.opLogFileName);
+    }
+
     // check if logfile can be accessed
     if(conf.logFileName != NULL) {
         FILE *logFile = fopen(conf.logFileName, "w+");
@@ -175,9 +194,25 @@ int main(int argc, char *argv[]) {
     // container & log file name will be passed to fuse functions
     FsInfo->contFile= containerFileName;
     FsInfo->logFile= logFileName;
-
-    // add additoinal "-s"
-    fuse_opt_add_arg(&args, "-s");
+    FsInfo->atimeMode= conf.atimeMode;
+    FsInfo->lazytime= conf.lazytime;
+    FsInfo->hugePages= conf.hugePages;
+    FsInfo->memoryLimit= (size_t) conf.memoryLimit * 1024 * 1024;
+    FsInfo->spillFile= spillFileName;
+    FsInfo->snapshotFile= snapshotFileName;
+    FsInfo->opLogFile= opLogFileName;
+    FsInfo->opLogSync= myfs_oplog_sync(conf.opLogSync);
+    FsInfo->compressAfter= conf.compressAfter;
+
+    // add additoinal "-s", only the in-memory file system can handle requests on several threads
+    if(conf.containerFileName != NULL || !conf.threads)
+        fuse_opt_add_arg(&args, "-s");
+
+    // pass the cache timeouts on to fuse, with our defaults if they were not given
+    char timeouts[128];
+    snprintf(timeouts, sizeof(timeouts), "-oentry_timeout=%g,attr_timeout=%g,negative_timeout=%g",
+             conf.entryTimeout, conf.attrTimeout, conf.negativeTimeout);
+    fuse_opt_add_arg(&args, timeouts);
 
     // call fuse initialization method
     fuse_stat = fuse_main(args.argc, args.argv, &myfs_oper, FsInfo);
@@ -187,6 +222,9 @@ int main(int argc, char *argv[]) {
     // cleanup
     free(FsInfo);
     free(containerFileName);
+    free(spillFileName);
+    free(snapshotFileName);
+    free(opLogFileName);
     free(logFileName);
 
     return fuse_stat;
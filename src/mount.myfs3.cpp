@@ -0,0 +1,578 @@
+//
+//  mount.myfs3.cpp
+//  myfs
+//
+//  Mount command for the FUSE 3 low-level API. The kernel addresses files by inode numbers, which are passed to the
+//  inode methods of the file system instead of resolving a path for every request.
+//
+
+#include <fuse_lowlevel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <libgen.h>
+#include <unistd.h>
+
+#include "myfs.h"
+#include "myinmemoryfs.h"
+#include "myondiskfs.h"
+#include "myfs-info.h"
+#include "myfs-mount.h"
+
+#define PACKAGE_VERSION "v0.2"
+
+// Flag of renameat2(), older C libraries do not define it
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+struct myfs_config {
+    char *containerFileName;
+    char *logFileName;
+    int atimeMode;
+    int lazytime;
+    int hugePages;
+    unsigned long memoryLimit;
+    char *spillFileName;
+    char *snapshotFileName;
+    char *opLogFileName;
+    char *opLogSync;
+    int threads;
+    int compressAfter;
+    double entryTimeout;
+    double attrTimeout;
+    double negativeTimeout;
+};
+
+#define MYFS_OPT(t, p, v) { t, offsetof(struct myfs_config, p), v }
+
+static struct fuse_opt myfs_opts[] = {
+        MYFS_OPT("-c %s",             containerFileName, 0),
+        MYFS_OPT("containerfile=%s",  containerFileName, 0),
+        MYFS_OPT("-l %s",             logFileName, 0),
+        MYFS_OPT("logfile=%s",        logFileName, 0),
+        MYFS_OPT("relatime",          atimeMode, ATIME_RELATIME),
+        MYFS_OPT("strictatime",       atimeMode, ATIME_STRICT),
+        MYFS_OPT("noatime",           atimeMode, ATIME_NOATIME),
+        MYFS_OPT("lazytime",          lazytime, 1),
+        MYFS_OPT("hugepages",         hugePages, 1),
+        MYFS_OPT("memory_limit=%lu",  memoryLimit, 0),
+        MYFS_OPT("spillfile=%s",      spillFileName, 0),
+        MYFS_OPT("snapshot=%s",       snapshotFileName, 0),
+        MYFS_OPT("oplog=%s",          opLogFileName, 0),
+        MYFS_OPT("oplog_sync=%s",     opLogSync, 0),
+        MYFS_OPT("threads",           threads, 1),
+        MYFS_OPT("compress=%d",       compressAfter, 0),
+        MYFS_OPT("entry_timeout=%lf", entryTimeout, 0),
+        MYFS_OPT("attr_timeout=%lf",  attrTimeout, 0),
+        MYFS_OPT("negative_timeout=%lf", negativeTimeout, 0),
+        FUSE_OPT_END
+};
+
+static struct myfs_config conf;
+static struct fuse_session *session;
+
+// --- Replies ---
+
+static void myfs_fill_entry(struct fuse_entry_param *entry, const struct stat *statbuf) {
+    memset(entry, 0, sizeof(*entry));
+    entry->ino = statbuf->st_ino;
+    entry->attr = *statbuf;
+    entry->attr_timeout = conf.attrTimeout;
+    entry->entry_timeout = conf.entryTimeout;
+}
+
+static void myfs_reply_entry(fuse_req_t req, int ret, const struct stat *statbuf, bool lookup = false) {
+    struct fuse_entry_param entry;
+
+    // A name that is not found by a lookup is cached as an entry with inode number 0
+    if (lookup && ret == -ENOENT && conf.negativeTimeout > 0) {
+        memset(&entry, 0, sizeof(entry));
+        entry.entry_timeout = conf.negativeTimeout;
+        fuse_reply_entry(req, &entry);
+        return;
+    }
+
+    if (ret < 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+
+    myfs_fill_entry(&entry, statbuf);
+    fuse_reply_entry(req, &entry);
+}
+
+static void myfs_reply_attr(fuse_req_t req, fuse_ino_t ino) {
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(statbuf));
+
+    int ret = MyFS::Instance()->inodeGetattr(ino, &statbuf);
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_attr(req, &statbuf, conf.attrTimeout);
+}
+
+// Attributes the file system changed on its own, e.g. the access time on a read, are dropped from the kernel cache.
+// Only the attributes are invalidated, which does not wait for cached pages and is safe after the reply of a request.
+static void myfs_notify() {
+    uint64_t ino;
+    while (MyFS::Instance()->takeInvalidation(ino))
+        fuse_lowlevel_notify_inval_inode(session, ino, -1, 0);
+}
+
+// --- Operations ---
+
+static void myfs_init(void *userdata, struct fuse_conn_info *conn) {
+    MyFS::Instance()->fuseInit(conn);
+    if (MyFS::Instance()->mountFailed())
+        fuse_session_exit(session);
+}
+
+static void myfs_destroy(void *userdata) {
+    MyFS::Instance()->fuseDestroy();
+}
+
+static void myfs_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(statbuf));
+    myfs_reply_entry(req, MyFS::Instance()->inodeLookup(parent, name, &statbuf), &statbuf, true);
+}
+
+static void myfs_forget(fuse_req_t req, fuse_ino_t ino, uint64_t nlookup) {
+    MyFS::Instance()->inodeForget(ino, nlookup);
+    fuse_reply_none(req);
+}
+
+static void myfs_forget_multi(fuse_req_t req, size_t count, struct fuse_forget_data *forgets) {
+    for (size_t i = 0; i < count; i++)
+        MyFS::Instance()->inodeForget(forgets[i].ino, forgets[i].nlookup);
+    fuse_reply_none(req);
+}
+
+static void myfs_getattr(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    myfs_reply_attr(req, ino);
+}
+
+static void myfs_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr, int to_set, struct fuse_file_info *fi) {
+    MyFS *fs = MyFS::Instance();
+    int ret = 0;
+
+    if (to_set & FUSE_SET_ATTR_MODE)
+        ret = fs->inodeChmod(ino, attr->st_mode);
+
+    if (ret == 0 && (to_set & (FUSE_SET_ATTR_UID | FUSE_SET_ATTR_GID)))
+        ret = fs->inodeChown(ino, (to_set & FUSE_SET_ATTR_UID) ? attr->st_uid : (uid_t) -1,
+                             (to_set & FUSE_SET_ATTR_GID) ? attr->st_gid : (gid_t) -1);
+
+    if (ret == 0 && (to_set & FUSE_SET_ATTR_SIZE))
+        ret = fs->inodeTruncate(ino, attr->st_size, fi);
+
+    if (ret == 0 && (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME))) {
+        struct timespec times[2];
+        times[0].tv_sec = attr->st_atime;
+        times[0].tv_nsec = (to_set & FUSE_SET_ATTR_ATIME_NOW) ? UTIME_NOW : 0;
+        if (!(to_set & FUSE_SET_ATTR_ATIME))
+            times[0].tv_nsec = UTIME_OMIT;
+        times[1].tv_sec = attr->st_mtime;
+        times[1].tv_nsec = (to_set & FUSE_SET_ATTR_MTIME_NOW) ? UTIME_NOW : 0;
+        if (!(to_set & FUSE_SET_ATTR_MTIME))
+            times[1].tv_nsec = UTIME_OMIT;
+        ret = fs->inodeUtimens(ino, times);
+    }
+
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        myfs_reply_attr(req, ino);
+}
+
+static void myfs_mknod(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode, dev_t rdev) {
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(statbuf));
+    myfs_reply_entry(req, MyFS::Instance()->inodeMknod(parent, name, mode, &statbuf), &statbuf);
+}
+
+static void myfs_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode) {
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(statbuf));
+    myfs_reply_entry(req, MyFS::Instance()->inodeMkdir(parent, name, mode, &statbuf), &statbuf);
+}
+
+static void myfs_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    fuse_reply_err(req, -MyFS::Instance()->inodeUnlink(parent, name));
+}
+
+static void myfs_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    fuse_reply_err(req, -MyFS::Instance()->inodeRmdir(parent, name));
+}
+
+static void myfs_rename(fuse_req_t req, fuse_ino_t parent, const char *name, fuse_ino_t newparent,
+                        const char *newname, unsigned int flags) {
+    // Existing entries are never replaced, so RENAME_NOREPLACE is what every rename does
+    if (flags & ~RENAME_NOREPLACE) {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+    fuse_reply_err(req, -MyFS::Instance()->inodeRename(parent, name, newparent, newname));
+}
+
+static void myfs_link(fuse_req_t req, fuse_ino_t ino, fuse_ino_t newparent, const char *newname) {
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(statbuf));
+    myfs_reply_entry(req, MyFS::Instance()->inodeLink(ino, newparent, newname, &statbuf), &statbuf);
+}
+
+static void myfs_open(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    int ret = MyFS::Instance()->inodeOpen(ino, fi);
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_open(req, fi);
+}
+
+static void myfs_create(fuse_req_t req, fuse_ino_t parent, const char *name, mode_t mode,
+                        struct fuse_file_info *fi) {
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(statbuf));
+
+    int ret = MyFS::Instance()->inodeCreate(parent, name, mode, fi, &statbuf);
+    if (ret < 0) {
+        fuse_reply_err(req, -ret);
+        return;
+    }
+
+    struct fuse_entry_param entry;
+    myfs_fill_entry(&entry, &statbuf);
+    fuse_reply_create(req, &entry, fi);
+}
+
+// Open files are found through fi->fh, the methods of the high-level API do not need a path for them
+
+static void myfs_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi) {
+    char *buf = (char *) malloc(size);
+    if (buf == NULL) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    int ret = MyFS::Instance()->fuseRead("", buf, size, off, fi);
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_buf(req, buf, ret);
+    free(buf);
+
+    myfs_notify();
+}
+
+static void myfs_write(fuse_req_t req, fuse_ino_t ino, const char *buf, size_t size, off_t off,
+                       struct fuse_file_info *fi) {
+    int ret = MyFS::Instance()->fuseWrite("", buf, size, off, fi);
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_write(req, ret);
+}
+
+static void myfs_flush(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    fuse_reply_err(req, -MyFS::Instance()->fuseFlush("", fi));
+}
+
+static void myfs_release(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    fuse_reply_err(req, -MyFS::Instance()->fuseRelease("", fi));
+}
+
+static void myfs_fsync(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi) {
+    fuse_reply_err(req, -MyFS::Instance()->fuseFsync("", datasync, fi));
+}
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+static void myfs_lseek(fuse_req_t req, fuse_ino_t ino, off_t off, int whence, struct fuse_file_info *fi) {
+    off_t ret = MyFS::Instance()->fuseLseek("", off, whence, fi);
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_lseek(req, ret);
+}
+#endif
+
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+// File systems that cannot copy on their own answer ENOSYS, the kernel then copies through read and write
+static void myfs_copy_file_range(fuse_req_t req, fuse_ino_t ino_in, off_t off_in, struct fuse_file_info *fi_in,
+                                 fuse_ino_t ino_out, off_t off_out, struct fuse_file_info *fi_out, size_t len,
+                                 int flags) {
+    ssize_t ret = MyFS::Instance()->fuseCopyFileRange("", fi_in, off_in, "", fi_out, off_out, len, flags);
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_write(req, ret);
+}
+#endif
+
+static void myfs_opendir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(statbuf));
+
+    int ret = MyFS::Instance()->inodeGetattr(ino, &statbuf);
+    if (ret == 0 && !S_ISDIR(statbuf.st_mode))
+        ret = -ENOTDIR;
+
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_open(req, fi);
+}
+
+// Buffer of a readdir request that is filled by the file system
+struct myfs_dirbuf {
+    fuse_req_t req;
+    char *buf;
+    size_t size;
+    size_t used;
+};
+
+static int myfs_fill_dir(void *buf, const char *name, const struct stat *statbuf, off_t offset) {
+    struct myfs_dirbuf *dirbuf = (struct myfs_dirbuf *) buf;
+
+    size_t length = fuse_add_direntry(dirbuf->req, dirbuf->buf + dirbuf->used, dirbuf->size - dirbuf->used, name,
+                                      statbuf, offset);
+    if (length > dirbuf->size - dirbuf->used)
+        return 1;
+
+    dirbuf->used += length;
+    return 0;
+}
+
+static void myfs_readdir(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off, struct fuse_file_info *fi) {
+    struct myfs_dirbuf dirbuf;
+    dirbuf.req = req;
+    dirbuf.buf = (char *) malloc(size);
+    dirbuf.size = size;
+    dirbuf.used = 0;
+    if (dirbuf.buf == NULL) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    int ret = MyFS::Instance()->inodeReaddir(ino, &dirbuf, myfs_fill_dir, off);
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_buf(req, dirbuf.buf, dirbuf.used);
+    free(dirbuf.buf);
+}
+
+static void myfs_releasedir(fuse_req_t req, fuse_ino_t ino, struct fuse_file_info *fi) {
+    fuse_reply_err(req, 0);
+}
+
+static void myfs_fsyncdir(fuse_req_t req, fuse_ino_t ino, int datasync, struct fuse_file_info *fi) {
+    fuse_reply_err(req, -MyFS::Instance()->fuseFsyncdir("", datasync, fi));
+}
+
+static void myfs_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name, const char *value, size_t size,
+                          int flags) {
+    fuse_reply_err(req, -MyFS::Instance()->inodeSetxattr(ino, name, value, size, flags));
+    myfs_notify();
+}
+
+static void myfs_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name, size_t size) {
+    char *value = (char *) malloc(size > 0 ? size : 1);
+    if (value == NULL) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+
+    // A size of 0 asks for the length of the value only
+    int ret = MyFS::Instance()->inodeGetxattr(ino, name, value, size);
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else if (size == 0)
+        fuse_reply_xattr(req, ret);
+    else
+        fuse_reply_buf(req, value, ret);
+    free(value);
+}
+
+static void myfs_statfs(fuse_req_t req, fuse_ino_t ino) {
+    struct statvfs statInfo;
+    memset(&statInfo, 0, sizeof(statInfo));
+
+    int ret = MyFS::Instance()->fuseStatfs("/", &statInfo);
+    if (ret < 0)
+        fuse_reply_err(req, -ret);
+    else
+        fuse_reply_statfs(req, &statInfo);
+}
+
+// --- Command line ---
+
+int main(int argc, char *argv[]) {
+    struct fuse_lowlevel_ops myfs_oper;
+    memset(&myfs_oper, 0, sizeof(myfs_oper));
+
+    myfs_oper.init = myfs_init;
+    myfs_oper.destroy = myfs_destroy;
+    myfs_oper.lookup = myfs_lookup;
+    myfs_oper.forget = myfs_forget;
+    myfs_oper.forget_multi = myfs_forget_multi;
+    myfs_oper.getattr = myfs_getattr;
+    myfs_oper.setattr = myfs_setattr;
+    myfs_oper.mknod = myfs_mknod;
+    myfs_oper.mkdir = myfs_mkdir;
+    myfs_oper.unlink = myfs_unlink;
+    myfs_oper.rmdir = myfs_rmdir;
+    myfs_oper.rename = myfs_rename;
+    myfs_oper.link = myfs_link;
+    myfs_oper.open = myfs_open;
+    myfs_oper.create = myfs_create;
+    myfs_oper.read = myfs_read;
+    myfs_oper.write = myfs_write;
+    myfs_oper.flush = myfs_flush;
+    myfs_oper.release = myfs_release;
+    myfs_oper.fsync = myfs_fsync;
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 8)
+    myfs_oper.lseek = myfs_lseek;
+#endif
+#if FUSE_VERSION >= FUSE_MAKE_VERSION(3, 4)
+    myfs_oper.copy_file_range = myfs_copy_file_range;
+#endif
+    myfs_oper.opendir = myfs_opendir;
+    myfs_oper.readdir = myfs_readdir;
+    myfs_oper.releasedir = myfs_releasedir;
+    myfs_oper.fsyncdir = myfs_fsyncdir;
+    myfs_oper.setxattr = myfs_setxattr;
+    myfs_oper.getxattr = myfs_getxattr;
+    myfs_oper.statfs = myfs_statfs;
+
+    // parse arguments
+    struct fuse_args args = FUSE_ARGS_INIT(argc, argv);
+    struct fuse_cmdline_opts opts;
+
+    memset(&conf, 0, sizeof(conf));
+    conf.entryTimeout = DEFAULT_ENTRY_TIMEOUT;
+    conf.attrTimeout = DEFAULT_ATTR_TIMEOUT;
+    conf.negativeTimeout = DEFAULT_NEGATIVE_TIMEOUT;
+
+    if (fuse_opt_parse(&args, &conf, myfs_opts, NULL) != 0 || fuse_parse_cmdline(&args, &opts) != 0)
+        return EXIT_FAILURE;
+
+    if (opts.show_help) {
+        printf("usage: %s [options] <mountpoint>\n\n", argv[0]);
+        fuse_cmdline_help();
+        fuse_lowlevel_help();
+        myfs_usage();
+        return EXIT_SUCCESS;
+    }
+
+    if (opts.show_version) {
+        fprintf(stderr, "MyFS version %s\n", PACKAGE_VERSION);
+        fuse_lowlevel_version();
+        return EXIT_SUCCESS;
+    }
+
+    if (opts.mountpoint == NULL) {
+        fprintf(stderr, "Error: No mount point given\n");
+        return EXIT_FAILURE;
+    }
+
+    // container file is used, so we are not in memory!
+    char *containerFileName = NULL;
+    if (conf.containerFileName != NULL) {
+        containerFileName = myfs_container_path(conf.containerFileName);
+        MyOnDiskFS::SetInstance();
+    } else {
+        MyInMemoryFS::SetInstance();
+    }
+
+    // in memory, the coldest files over the memory limit may be moved into a container of their own
+    char *spillFileName = NULL;
+    if (conf.containerFileName == NULL && conf.spillFileName != NULL)
+        spillFileName = myfs_container_path(conf.spillFileName);
+
+    // in memory, the files may be kept in a snapshot image between mounts
+    char *snapshotFileName = NULL;
+    if (conf.containerFileName == NULL && conf.snapshotFileName != NULL)
+        snapshotFileName = myfs_container_path(conf.snapshotFileName);
+
+    // the operation log is compacted into the snapshot
+    char *opLogFileName = NULL;
+    if (conf.containerFileName == NULL && conf.opLogFileName != NULL) {
+        if (snapshotFileName == NULL) {
+            fprintf(stderr, "Error: The operation log needs a snapshot (use -o snapshot=FILE)\n");
+            exit(EXIT_FAILURE);
+        }
+        opLogFileName = myfs_container_path(conf.opLogFileName);
+    }
+
+    // check if logfile can be accessed
+    char *logFileName = NULL;
+    if (conf.logFileName != NULL) {
+        FILE *logFile = fopen(conf.logFileName, "w+");
+
+        if (logFile == NULL || (logFileName = realpath(conf.logFileName, NULL)) == NULL) {
+            fprintf(stderr, "Error: Cannot access log file %s\n", conf.logFileName);
+            exit(EXIT_FAILURE);
+        }
+
+        fclose(logFile);
+    } else {
+        fprintf(stderr, "Error: No log file given (use -l)\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The low-level API has no FUSE context, the file system gets the information directly
+    struct MyFsInfo info;
+    info.contFile = containerFileName;
+    info.logFile = logFileName;
+    info.atimeMode = conf.atimeMode;
+    info.lazytime = conf.lazytime;
+    info.hugePages = conf.hugePages;
+    info.memoryLimit = (size_t) conf.memoryLimit * 1024 * 1024;
+    info.spillFile = spillFileName;
+    info.snapshotFile = snapshotFileName;
+    info.opLogFile = opLogFileName;
+    info.opLogSync = myfs_oplog_sync(conf.opLogSync);
+    info.compressAfter = conf.compressAfter;
+    MyFS::Instance()->setMountInfo(&info);
+    MyFS::Instance()->enableInvalidations();
+
+    int ret = EXIT_FAILURE;
+    session = fuse_session_new(&args, &myfs_oper, sizeof(myfs_oper), NULL);
+    if (session != NULL) {
+        if (fuse_set_signal_handlers(session) == 0) {
+            if (fuse_session_mount(session, opts.mountpoint) == 0) {
+                fuse_daemonize(opts.foreground);
+
+                // Only the in-memory file system is thread-safe, the on-disk one handles requests one after another
+                if (conf.threads && conf.containerFileName == NULL)
+                    ret = fuse_session_loop_mt(session, 0);
+                else
+                    ret = fuse_session_loop(session);
+                if (MyFS::Instance()->mountFailed())
+                    ret = EXIT_FAILURE;
+
+                fuse_session_unmount(session);
+            }
+            fuse_remove_signal_handlers(session);
+        }
+        fuse_session_destroy(session);
+    }
+
+    fprintf(stderr, "fuse_session_loop returned %d\n", ret);
+
+    // cleanup
+    free(opts.mountpoint);
+    fuse_opt_free_args(&args);
+    free(containerFileName);
+    free(spillFileName);
+    free(snapshotFileName);
+    free(opLogFileName);
+    free(logFileName);
+
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
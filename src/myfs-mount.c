@@ -0,0 +1,95 @@
+//
+//  myfs-mount.c
+//  myfs
+//
+//  Command line helpers shared by the FUSE 2 and FUSE 3 mount commands.
+//
+
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "myfs-info.h"
+#include "myfs-mount.h"
+
+/// @brief Print the options of MyFS after the options of FUSE.
+void myfs_usage(void) {
+    fprintf(stderr,
+            "\n"
+            "Myfs options:\n"
+            "    -o containerfile=FILE\n"
+            "    -c FILE            same as '-o containerfile=FILE'\n"
+            "    -o logfile=FILE\n"
+            "    -l FILE            same as '-o logfile=FILE'\n"
+            "    -o relatime        update access times only if older than the last change or a day (default)\n"
+            "    -o strictatime     update access times on every read\n"
+            "    -o noatime         never update access times\n"
+            "    -o lazytime        keep changed timestamps in memory until fsync, unmount or they are old\n"
+            "    -o hugepages       back the content of in-memory files with transparent huge pages\n"
+            "    -o memory_limit=M  keep at most M MiB in memory, writes over the limit fail without a spill file\n"
+            "    -o spillfile=FILE  move the coldest in-memory files over the limit into the container FILE (up to 32 MiB)\n"
+            "    -o snapshot=FILE   load in-memory files from the image FILE and save them there at unmount\n"
+            "    -o oplog=FILE      log every change of in-memory files to FILE, needs a snapshot\n"
+            "    -o oplog_sync=S    sync the log always (default), never or every S milliseconds\n"
+            "    -o threads         handle requests on in-memory files on several threads\n"
+            "    -o compress=S      compress in-memory files that were not used for S seconds\n"
+            "    -o entry_timeout=T cache names for T seconds (default: %.1f)\n"
+            "    -o attr_timeout=T  cache attributes for T seconds (default: %.1f)\n"
+            "    -o negative_timeout=T cache failed lookups for T seconds (default: %.1f)\n",
+            DEFAULT_ENTRY_TIMEOUT, DEFAULT_ATTR_TIMEOUT, DEFAULT_NEGATIVE_TIMEOUT);
+}
+
+/// @brief Get the sync interval of the operation log.
+///
+/// \param [in] value Value of the oplog_sync option, NULL if it was not given.
+/// \return OPLOG_SYNC_ALWAYS, OPLOG_SYNC_NEVER or milliseconds between syncs, exits if the value is invalid.
+int myfs_oplog_sync(const char *value) {
+    if (value == NULL || strcmp(value, "always") == 0)
+        return OPLOG_SYNC_ALWAYS;
+    if (strcmp(value, "never") == 0)
+        return OPLOG_SYNC_NEVER;
+
+    char *end;
+    long interval = strtol(value, &end, 10);
+    if (*value == '\0' || *end != '\0' || interval <= 0 || interval > INT_MAX) {
+        fprintf(stderr, "Error: Invalid oplog_sync %s\n", value);
+        exit(EXIT_FAILURE);
+    }
+    return (int) interval;
+}
+
+/// @brief Get the absolute path of a container file.
+///
+/// \param [in] name Container file as given on the command line, it may not exist yet.
+/// \return Absolute path allocated with malloc(), exits if the file or its directory cannot be accessed.
+char *myfs_container_path(const char *name) {
+    char *path = realpath(name, NULL);
+
+    if (path != NULL) {
+        // container file does exist, check if it is writable
+        if (access(path, R_OK | W_OK) != 0) {
+            fprintf(stderr, "Error: Cannot access container file %s\n", path);
+            exit(EXIT_FAILURE);
+        }
+        return path;
+    }
+
+    // container file does not exist, check if its directory is writable
+    char *nameCopy = strdup(name);
+    char *directory = realpath(dirname(nameCopy), NULL);
+    if (directory == NULL || access(directory, R_OK | W_OK) != 0) {
+        fprintf(stderr, "Error: Cannot access container directory %s\n", directory == NULL ? "" : directory);
+        exit(EXIT_FAILURE);
+    }
+
+    strcpy(nameCopy, name);
+    path = malloc(PATH_MAX);
+    snprintf(path, PATH_MAX, "%s/%s", directory, basename(nameCopy));
+
+    free(directory);
+    free(nameCopy);
+    return path;
+}
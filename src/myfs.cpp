@@ -30,6 +30,230 @@
 
 // TODO: [PART 2] You may move some helper messages here
 
+/// @brief Take over the mount options.
+///
+/// \param [in] info Information passed from the mount command.
+void MyFS::setMountOptions(const MyFsInfo *info) {
+    this->atimeMode = info->atimeMode;
+    this->lazytime = info->lazytime != 0;
+}
+
+/// @brief Check if reading a file updates its access time.
+///
+/// With relatime, the access time is only updated if it is not newer than the last modification or status change, so
+/// tools can still tell whether a file was read since it changed, or if it is older than a day.
+/// \param [in] atime Current access time of the file.
+/// \param [in] mtime Last modification time of the file.
+/// \param [in] ctime Last status change time of the file.
+/// \param [in] now Time of the read.
+/// \return True if the access time has to be set to now.
+bool MyFS::updatesAtime(time_t atime, time_t mtime, time_t ctime, time_t now) {
+    switch (this->atimeMode) {
+        case ATIME_NOATIME:
+            return false;
+        case ATIME_STRICT:
+            return atime != now;
+        default:
+            return atime <= mtime || atime <= ctime || now - atime >= RELATIME_INTERVAL;
+    }
+}
+
+/// @brief Tell the kernel whether it may keep the cached content of a file that is opened.
+///
+/// The cached pages are only kept if the content did not change since the file was opened the last time. Each name of
+/// a file with several hard links has its own inode in the kernel, so a change through one name has to drop the cache
+/// of the others.
+/// \param [out] fileInfo keep_cache is set in the file info of the open.
+/// \param [in,out] cachedVersion Content version at the last open, it is set to the current one.
+/// \param [in] contentVersion Current content version of the file.
+void MyFS::setKeepCache(struct fuse_file_info *fileInfo, int64_t &cachedVersion, uint64_t contentVersion) {
+    fileInfo->keep_cache = (cachedVersion == (int64_t) contentVersion);
+    cachedVersion = contentVersion;
+}
+
+/// @brief Ask the kernel for large read and write requests.
+///
+/// Without big writes, FUSE 2 splits every write into requests of one page. FUSE 3 always allows them and has no flag
+/// for it. libfuse and the kernel lower the sizes to what their buffers can hold.
+/// \param [in,out] conn Connection passed to fuseInit(), may be nullptr if the file system is used without FUSE.
+void MyFS::configureConnection(struct fuse_conn_info *conn) {
+    if (conn == nullptr)
+        return;
+
+#ifdef FUSE_CAP_BIG_WRITES
+    if (conn->capable & FUSE_CAP_BIG_WRITES)
+        conn->want |= FUSE_CAP_BIG_WRITES;
+#endif
+    conn->max_write = MAX_REQUEST_SIZE;
+    conn->max_readahead = MAX_REQUEST_SIZE;
+}
+
+/// @brief Note that the attributes of an inode changed without a request of the kernel.
+///
+/// \param [in] ino Inode number of the changed file.
+void MyFS::invalidateInode(uint64_t ino) {
+    if (!this->collectInvalidations)
+        return;
+
+    // Changes are collected per request, a file rarely changes more than once
+    lock_guard<mutex> guard(this->invalidationLock);
+    if (this->invalidations.empty() || this->invalidations.back() != ino)
+        this->invalidations.push_back(ino);
+}
+
+/// @brief Collect the inodes whose attributes the kernel has to drop.
+///
+/// Mount commands that can notify the kernel call it once before the file system is initialized.
+void MyFS::enableInvalidations() {
+    this->collectInvalidations = true;
+}
+
+/// @brief Take the next inode whose cached attributes are outdated.
+///
+/// \param [out] ino Inode number of the changed file.
+/// \return False if there are no more changed inodes.
+bool MyFS::takeInvalidation(uint64_t &ino) {
+    lock_guard<mutex> guard(this->invalidationLock);
+    if (this->invalidations.empty())
+        return false;
+
+    ino = this->invalidations.back();
+    this->invalidations.pop_back();
+    return true;
+}
+
+/// @brief Check whether the file system could be initialized.
+///
+/// Mount commands call it after fuseInit() and stop handling requests if it failed.
+/// \return True if fuseInit() could not read the stored file system.
+bool MyFS::mountFailed() const {
+    return this->initFailed;
+}
+
+/// @brief Hand over the information of the mount command.
+///
+/// The FUSE 3 low-level mount command has no FUSE context to pass it in, so it is set before the file system is
+/// initialized.
+/// \param [in] info Information passed from the mount command.
+void MyFS::setMountInfo(MyFsInfo *info) {
+    this->info = info;
+}
+
+/// @brief Get the information of the mount command.
+///
+/// \return The information set with setMountInfo(), otherwise the private data of the FUSE context.
+MyFsInfo *MyFS::mountInfo() {
+    if (this->info != nullptr)
+        return this->info;
+    return (MyFsInfo *) fuse_get_context()->private_data;
+}
+
+// File systems that do not support finding holes or copying ranges fail these methods
+
+off_t MyFS::fuseLseek(const char *path, off_t offset, int whence, struct fuse_file_info *fileInfo) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+ssize_t MyFS::fuseCopyFileRange(const char *pathIn, struct fuse_file_info *fileInfoIn, off_t offsetIn,
+                                const char *pathOut, struct fuse_file_info *fileInfoOut, off_t offsetOut, size_t size,
+                                int flags) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+// File systems that do not support the inode interface fail all its methods
+
+int MyFS::inodeLookup(uint64_t parent, const char *name, struct stat *statbuf) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+void MyFS::inodeForget(uint64_t ino, uint64_t count) {
+    LOGM();
+}
+
+int MyFS::inodeGetattr(uint64_t ino, struct stat *statbuf) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeChmod(uint64_t ino, mode_t mode) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeChown(uint64_t ino, uid_t uid, gid_t gid) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeTruncate(uint64_t ino, off_t newSize, struct fuse_file_info *fileInfo) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeUtimens(uint64_t ino, const struct timespec times[2]) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeMknod(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeMkdir(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeUnlink(uint64_t parent, const char *name) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeRmdir(uint64_t parent, const char *name) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeRename(uint64_t parent, const char *name, uint64_t newParent, const char *newName) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeLink(uint64_t ino, uint64_t newParent, const char *newName, struct stat *statbuf) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeOpen(uint64_t ino, struct fuse_file_info *fileInfo) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeCreate(uint64_t parent, const char *name, mode_t mode, struct fuse_file_info *fileInfo,
+                      struct stat *statbuf) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeReaddir(uint64_t ino, void *buf, MyFsFiller filler, off_t offset) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeSetxattr(uint64_t ino, const char *name, const char *value, size_t size, int flags) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
+int MyFS::inodeGetxattr(uint64_t ino, const char *name, char *value, size_t size) {
+    LOGM();
+    RETURN(-ENOSYS);
+}
+
 // DO NOT EDIT ANYTHING BELOW THIS LINE!!!
 
 MyFS::MyFS() {
@@ -45,12 +45,44 @@ using namespace std;
 /// @brief Constructor of the in-memory file system class.
 ///
 /// You may add your own constructor code here.
-MyInMemoryFS::MyInMemoryFS() : MyFS() {}
+MyInMemoryFS::MyInMemoryFS() : MyFS() {
+    this->root.uid = getuid();
+    this->root.gid = getgid();
+    this->root.mode = S_IFDIR | 0755;
+    this->root.ino = ROOT_INODE;
+    this->root.atime = this->root.mtime = this->root.ctime = time(NULL);
+    this->root.children.setAllocator(&this->entrySlab);
+    this->dentries.setAllocator(&this->entrySlab);
+}
 
 /// @brief Destructor of the in-memory file system class.
 ///
 /// You may add your own destructor code here.
-MyInMemoryFS::~MyInMemoryFS() {}
+MyInMemoryFS::~MyInMemoryFS() {
+    stopCompression();
+
+    // Files live in the slabs, which are freed with the members
+    freeAllFiles();
+    unmapImage();
+}
+
+/// @brief Get the memory taken by files, directory entries and file content.
+///
+/// \return Bytes in use and bytes reserved from the system, which includes memory kept for reuse.
+ArenaUsage MyInMemoryFS::memoryUsage() const {
+    ArenaUsage usage = this->fileSlab.usage();
+    {
+        LockHolder<ShardedRwLock> guard(this->dentryLock, false);
+        usage += this->entrySlab.usage();
+    }
+    usage += this->pageArena.usage();
+
+    // Compressed pages live on the heap
+    size_t compressed = this->compressedStored;
+    usage.bytesUsed += compressed;
+    usage.bytesReserved += compressed;
+    return usage;
+}
 
 /// @brief Create a new file.
 ///
@@ -62,40 +94,31 @@ MyInMemoryFS::~MyInMemoryFS() {}
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseMknod(const char *path, mode_t mode, dev_t dev) {
     LOGM();
+    RequestLock request(*this, true);
 
     LOGF("--> Creating %s\n", path);
 
-    // Check if the filesystem is full
-    if(files.size() >= NUM_DIR_ENTRIES) {
-        LOG("Filesystem is full");
-        RETURN(-ENOSPC);
-    }
-
-    // Check length of given filename
-    if (strlen(path) - 1 > NAME_LENGTH) {
-        LOG("Filename too long");
-        RETURN(-EINVAL);
-    }
-
-    // Check if a file with the same name already exists
-    if(files.find(path) != files.end()) {
-        LOG("File already exists");
-        RETURN(-EEXIST);
-    }
+    MyFsMemoryInfo *file;
+    int ret = createFile(path, mode, file);
+    RETURN(ret);
+}
 
-    LOG("Create the file");
-    // Create a new MyFsMemoryInfo struct for the file
-    MyFsMemoryInfo file;
-    file.gid = getgid();
-    file.uid = getuid();
-    file.mode = mode;
-    file.atime = file.ctime = file.mtime = time(NULL);
+/// @brief Create a directory.
+///
+/// Create a new, empty directory with given name and permissions.
+/// You do not have to check file permissions, but can assume that it is always ok to access the directory.
+/// \param [in] path Name of the directory, starting with "/".
+/// \param [in] mode Permissions for directory access.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseMkdir(const char *path, mode_t mode) {
+    LOGM();
+    RequestLock request(*this, true);
 
-    LOG("Add file to filesystem");
-    // Insert the file into the map
-    files.emplace(path, move(file));
+    LOGF("--> Creating the directory %s\n", path);
 
-    RETURN(0);
+    MyFsMemoryInfo *directory;
+    int ret = createFile(path, S_IFDIR | (mode & ~S_IFMT), directory);
+    RETURN(ret);
 }
 
 /// @brief Delete a file.
@@ -106,20 +129,44 @@ int MyInMemoryFS::fuseMknod(const char *path, mode_t mode, dev_t dev) {
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseUnlink(const char *path) {
     LOGM();
+    RequestLock request(*this, true);
 
     LOGF("--> Deleting %s\n", path);
 
-    // Check if the file exists
-    auto iterator = files.find(path);
-    if (iterator == files.end()) {
-        LOG("File does not exist");
+    // Check if the directory of the file exists
+    const char *name;
+    MyFsMemoryInfo *parent = findParent(path, name);
+    if (parent == nullptr) {
+        LOG("Directory does not exist");
         RETURN(-ENOENT);
     }
 
-    // Remove the file from the map
-    files.erase(iterator);
+    int ret = removeFile(*parent, name, path, false);
+    RETURN(ret);
+}
+
+/// @brief Delete a directory.
+///
+/// Delete an empty directory with given name from the file system.
+/// You do not have to check file permissions, but can assume that it is always ok to access the directory.
+/// \param [in] path Name of the directory, starting with "/".
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseRmdir(const char *path) {
+    LOGM();
+    RequestLock request(*this, true);
 
-    RETURN(0);
+    LOGF("--> Deleting the directory %s\n", path);
+
+    // Check if the parent directory exists
+    const char *name;
+    MyFsMemoryInfo *parent = findParent(path, name);
+    if (parent == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = removeFile(*parent, name, path, true);
+    RETURN(ret);
 }
 
 /// @brief Rename a file.
@@ -133,36 +180,61 @@ int MyInMemoryFS::fuseUnlink(const char *path) {
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseRename(const char *path, const char *newpath) {
     LOGM();
+    RequestLock request(*this, true);
 
     LOGF("--> Renaming %s into %s\n", path, newpath);
 
-    // Check if the old file exists
-    auto oldIterator = files.find(path);
-    if (oldIterator == files.end()) {
-        LOG("File does not exist");
+    // Check if the old directory exists
+    const char *oldName;
+    MyFsMemoryInfo *oldParent = findParent(path, oldName);
+    if (oldParent == nullptr) {
+        LOG("Directory does not exist");
         RETURN(-ENOENT);
     }
 
-    // Check if the new file already exists
-    auto newIterator = files.find(newpath);
-    if (newIterator != files.end()) {
-        LOG("File already exists");
-        RETURN(-EEXIST);
+    // Check if the new directory exists
+    const char *newName;
+    MyFsMemoryInfo *newParent = findParent(newpath, newName);
+    if (newParent == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
     }
 
-    // Create a copy of the FileData struct for the new file
-    MyFsMemoryInfo newFile = oldIterator->second;
+    int ret = moveFile(*oldParent, oldName, path, *newParent, newName);
+    RETURN(ret);
+}
 
-    // Insert the new file into the map
-    files.emplace(newpath, move(newFile));
+/// @brief Create a hard link.
+///
+/// Create a new directory entry for an existing file. Both names refer to the same file, so they share the content
+/// and the metadata of the file. The file is deleted when its last name is removed.
+/// You do not have to check file permissions, but can assume that it is always ok to access the file.
+/// \param [in] path Name of the existing file, starting with "/".
+/// \param [in] newpath New name for the file, starting with "/".
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseLink(const char *path, const char *newpath) {
+    LOGM();
+    RequestLock request(*this, true);
 
-    // Remove the old file from the map
-    files.erase(oldIterator);
+    LOGF("--> Linking %s to %s\n", newpath, path);
 
-    // Update the change time of the new file
-    files.find(newpath)->second.ctime = time(nullptr);
+    // Check if the file exists
+    MyFsMemoryInfo *file = findFile(path);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
 
-    RETURN(0);
+    // Check if the directory of the new entry exists
+    const char *name;
+    MyFsMemoryInfo *parent = findParent(newpath, name);
+    if (parent == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = addLink(*file, *parent, name);
+    RETURN(ret);
 }
 
 /// @brief Get file meta data.
@@ -173,6 +245,7 @@ int MyInMemoryFS::fuseRename(const char *path, const char *newpath) {
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseGetattr(const char *path, struct stat *statbuf) {
     LOGM();
+    RequestLock request(*this, false);
 
     LOGF("\tAttributes of %s requested\n", path);
 
@@ -193,25 +266,26 @@ int MyInMemoryFS::fuseGetattr(const char *path, struct stat *statbuf) {
 
     statbuf->st_uid = getuid(); // The owner of the file/directory is the user who mounted the filesystem
     statbuf->st_gid = getgid(); // The group of the file/directory is the same as the group of the user who mounted the filesystem
-    statbuf->st_atime = time(NULL); // The last "a"ccess of the file/directory is right now
 
     if (strcmp( path, "/" ) == 0) {
+        statbuf->st_ino = ROOT_INODE;
         statbuf->st_mode = S_IFDIR | 0755;
         statbuf->st_nlink = 2; // Why "two" hardlinks instead of "one"? The answer is here: http://unix.stackexchange.com/a/101536
+        statbuf->st_atime = this->root.atime;
+        statbuf->st_mtime = this->root.mtime;
+        statbuf->st_ctime = this->root.ctime;
     }
     else if(strlen(path) > 0) {
         LOG("Path length > 0");
-        auto iterator = files.find(path);
+        MyFsMemoryInfo *file = findFile(path);
 
-        if(iterator == files.end()) {
+        if(file == nullptr) {
             LOG("File does not exist");
             RETURN(-ENOENT);
         }
 
-        statbuf->st_mode = iterator->second.mode;
-        statbuf->st_nlink = 1;
-        statbuf->st_size = iterator->second.content.size();
-        statbuf->st_mtime = iterator->second.mtime; // The last "m"odification of the file/directory is right now
+        LockHolder<RwLock> fileLock(file->lock, false);
+        fillStat(*file, statbuf);
     }
     else {
         LOG("Path length <= 0");
@@ -230,21 +304,27 @@ int MyInMemoryFS::fuseGetattr(const char *path, struct stat *statbuf) {
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseChmod(const char *path, mode_t mode) {
     LOGM();
+    RequestLock request(*this, true);
 
     LOGF("--> Changing permissions of %s\n", path);
 
     // Check if the file exists
-    auto iterator = files.find(path);
-    if (iterator == files.end()) {
+    MyFsMemoryInfo *file = findFile(path);
+    if (file == nullptr) {
         LOG("File does not exists");
         RETURN(-ENOENT);
     }
 
+    int ret = logOp(OPLOG_CHMOD, file->ino, 0, mode);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
     // Update the mode field
-    iterator->second.mode = mode;
+    file->mode = mode;
 
     // Update the changed time
-    iterator->second.ctime = time(nullptr);
+    file->ctime = time(nullptr);
 
     RETURN(0);
 }
@@ -259,22 +339,28 @@ int MyInMemoryFS::fuseChmod(const char *path, mode_t mode) {
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseChown(const char *path, uid_t uid, gid_t gid) {
     LOGM();
+    RequestLock request(*this, true);
 
     LOGF("--> Changing the owner of %s\n", path);
 
     // Check if the file exists
-    auto iterator = files.find(path);
-    if (iterator == files.end()) {
+    MyFsMemoryInfo *file = findFile(path);
+    if (file == nullptr) {
         LOG("File does not exists");
         RETURN(-ENOENT);
     }
 
+    int ret = logOp(OPLOG_CHOWN, file->ino, 0, (uint64_t) uid << 32 | (uint32_t) gid);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
     // Update the uid and gid fields
-    iterator->second.uid = uid;
-    iterator->second.gid = gid;
+    file->uid = uid;
+    file->gid = gid;
 
     // Update the changed time
-    iterator->second.ctime = time(nullptr);
+    file->ctime = time(nullptr);
 
     RETURN(0);
 }
@@ -285,38 +371,22 @@ int MyInMemoryFS::fuseChown(const char *path, uid_t uid, gid_t gid) {
 /// open file count.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
 /// \param [in] path Name of the file, starting with "/".
-/// \param [out] fileInfo Can be ignored in Part 1
+/// \param [out] fileInfo The handle of the open file is stored in fileInfo->fh.
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
+    RequestLock request(*this, false);
 
     LOGF("--> Opening %s\n", path);
 
-    // Check how many files are open
-    if (openFiles.size() > NUM_OPEN_FILES) {
-        LOG("Too many open files");
-        RETURN(-EMFILE);
-    }
-
-    // Check if the file is already open
-    if (openFiles.find(path) != openFiles.end()) {
-        LOG("File is already open");
-        RETURN(-EPERM);
-    }
-
-    // Add the file to the open files set
-    openFiles.insert(path);
-
     // Check if the file exists
-    auto iterator = files.find(path);
-    if (iterator == files.end()) {
+    MyFsMemoryInfo *file = findFile(path);
+    if (file == nullptr) {
         LOG("File does not exists");
         RETURN(-ENOENT);
     }
 
-    // Store the file data pointer in the fuse_file_info struct
-    fileInfo->fh = reinterpret_cast<uint64_t>(&iterator->second.content);
-
+    openHandle(*file, fileInfo);
     RETURN(0);
 }
 
@@ -334,35 +404,57 @@ int MyInMemoryFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
 /// \param [in] size Number of bytes to read
 /// \param [in] offset Starting position in the file, i.e., number of the first byte to read relative to the first byte of
 /// the file
-/// \param [in] fileInfo Can be ignored in Part 1
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
 /// \return The Number of bytes read on success. This may be less than size if the file does not contain sufficient bytes.
 /// -ERRNO on failure.
 int MyInMemoryFS::fuseRead(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
+    RequestLock request(*this, false);
 
     LOGF("--> Reading %s\n", path);
 
-    // Find the file in the map and copy its contents into the buffer
-    if (files.find(path) == files.end()) {
+    // Find the file and copy its contents into the buffer
+    MyFsMemoryInfo *file = openFile(path, fileInfo);
+    if (file == nullptr) {
         LOG("File does not exists");
         RETURN(-ENOENT);
     }
 
-    // Get a pointer to the file data
-    vector<char>* content = reinterpret_cast<vector<char>*>(fileInfo->fh);
+    // Other requests may read the file at the same time
+    LockHolder<RwLock> fileLock(file->lock, false);
 
     // Check if the offset is within the file bounds
-    if (offset < 0 || offset >= content->size()) {
+    if (offset < 0 || offset >= (off_t) file->content.size()) {
         LOG("Offset is not within the file bounds");
         RETURN(0);  // EOF
     }
 
-    // Read data from the file
-    size_t count = min(size, content->size() - offset);
-    copy(content->begin() + offset, content->begin() + offset + count, buf);
+    // A spilled or compressed file is loaded back first, which changes it
+    if (file->spilled || file->compressed != nullptr) {
+        fileLock.upgrade();
+        int ret = loadFile(*file);
+        if (ret < 0) {
+            LOGF("ERROR: Loading the file failed with error %d", ret);
+            RETURN(ret);
+        }
+    }
+
+    // Read data from the file, a file of the snapshot is read from its mapping
+    size_t count;
+    if (file->image != nullptr) {
+        count = readImage(*file, offset, size, buf);
+    } else {
+        count = file->content.read(offset, size, buf);
+        touchFile(*file);
+    }
 
-    // Update the access time
-    files.find(path)->second.atime = time(nullptr);
+    // Update the access time as the mount options demand
+    time_t now = time(nullptr);
+    if (updatesAtime(file->atime, file->mtime, file->ctime, now)) {
+        fileLock.upgrade();
+        file->atime = now;
+        invalidateInode(file->ino);
+    }
 
     RETURN(count);
 }
@@ -380,15 +472,20 @@ int MyInMemoryFS::fuseRead(const char *path, char *buf, size_t size, off_t offse
 /// \param [in] size Number of bytes to write.
 /// \param [in] offset Starting position in the file, i.e., number of the first byte to read relative to the first byte of
 /// the file.
-/// \param [in] fileInfo Can be ignored in Part 1 .
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
 /// \return Number of bytes written on success, -ERRNO on failure.
 int MyInMemoryFS::fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
+    RequestLock request(*this, false);
 
     LOGF("--> Writing %s\n", path);
 
-    // Get a pointer to the file data
-    vector<char>* content = reinterpret_cast<vector<char>*>(fileInfo->fh);
+    // Check if the file exists
+    MyFsMemoryInfo *file = openFile(path, fileInfo);
+    if (file == nullptr) {
+        LOG("File does not exists");
+        RETURN(-ENOENT);
+    }
 
     // Check if the offset is within the file bounds
     if (offset < 0) {
@@ -396,18 +493,43 @@ int MyInMemoryFS::fuseWrite(const char *path, const char *buf, size_t size, off_
         return -EINVAL;
     }
 
-    // Truncate the file data
-    if (offset + size > content->size()) {
-        LOG("Truncate file");
-        content->resize(offset + size);
+    // Requests on other files go on while this one changes the file
+    LockHolder<RwLock> fileLock(file->lock, true);
+
+    // Make room for the new pages within the memory limit, a spilled file is loaded back first
+    int ret = loadFile(*file);
+    if (ret >= 0)
+        ret = reserveMemory(*file, file->content.missingPages(offset, size) * PagedContent::PAGE_BYTES);
+    if (ret < 0) {
+        LOGF("No memory for the data, error %d", ret);
+        RETURN(ret);
     }
 
-    // Write data to the file
-    copy(buf, buf + size, content->begin() + offset);
+    // The data goes into the log in records of at most one request before it is written, only what was logged is
+    // written
+    size_t logged = 0;
+    while (logged < size) {
+        size_t count = min(size - logged, (size_t) MAX_REQUEST_SIZE);
+        ret = logOp(OPLOG_WRITE, file->ino, 0, offset + logged, buf + logged, count);
+        if (ret < 0)
+            break;
+        logged += count;
+    }
+    if (ret < 0) {
+        LOGF("ERROR: Logging the write failed with error %d", ret);
+        if (logged == 0) {
+            RETURN(ret);
+        }
+    }
+    size = logged;
+
+    // Write data to the file, the content grows if the data ends behind it
+    file->content.write(offset, buf, size);
+    file->contentVersion++;
+    touchFile(*file);
 
     // Update the modification and changed time
-    auto iterator = files.find(path);
-    iterator->second.mtime = iterator->second.ctime = time(nullptr);
+    file->mtime = file->ctime = time(nullptr);
 
     RETURN(size);
 }
@@ -416,23 +538,27 @@ int MyInMemoryFS::fuseWrite(const char *path, const char *buf, size_t size, off_
 ///
 /// In Part 1 this includes decrementing the open file count.
 /// \param [in] path Name of the file, starting with "/".
-/// \param [in] fileInfo Can be ignored in Part 1 .
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
 
     LOGF("--> Removing the file %s\n", path);
 
-    // Check if the file exists
-    if (files.find(path) == files.end()) {
-        LOG("File does not exists");
-        RETURN(-ENOENT);
+    // Close the handle, a deleted file is freed with its last handle, which needs the namespace lock for writing
+    int ret;
+    {
+        RequestLock request(*this, false);
+        ret = closeHandle(fileInfo, false);
     }
+    if (ret == -EAGAIN) {
+        RequestLock request(*this, true);
+        ret = closeHandle(fileInfo, true);
+    }
+    if (ret < 0)
+        LOG("File is not open");
 
-    // Remove the file from the open files set
-    openFiles.erase(path);
-
-    RETURN(0);
+    RETURN(ret);
 }
 
 /// @brief Truncate a file.
@@ -445,24 +571,21 @@ int MyInMemoryFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo)
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseTruncate(const char *path, off_t newSize) {
     LOGM();
+    RequestLock request(*this, false);
 
     LOGF("--> Set the size of %s\n", path);
 
     // Check if the file exists
-    auto iterator = files.find(path);
-    if (iterator == files.end()) {
+    MyFsMemoryInfo *file = findFile(path);
+    if (file == nullptr) {
         LOG("File already exists");
         RETURN(-EEXIST);
     }
 
-    // Truncate the file data
-    iterator->second.content.resize(newSize);
-
-    // Update the modification and changed time
-    iterator->second.mtime = time(nullptr);
-    iterator->second.ctime = time(nullptr);
-
-    return 0;
+    // Truncate the file data, this updates the modification and changed time
+    LockHolder<RwLock> fileLock(file->lock, true);
+    int ret = resizeContent(*file, newSize);
+    RETURN(ret);
 }
 
 /// @brief Truncate a file.
@@ -473,32 +596,226 @@ int MyInMemoryFS::fuseTruncate(const char *path, off_t newSize) {
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
 /// \param [in] path Name of the file, starting with "/".
 /// \param [in] newSize New size of the file.
-/// \param [in] fileInfo Can be ignored in Part 1.
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file_info *fileInfo) {
     LOGM();
+    RequestLock request(*this, false);
 
     LOGF("--> Set the size of %s\n", path);
 
-    // Get a pointer to the file data
-    vector<char>* content = reinterpret_cast<vector<char>*>(fileInfo->fh);
+    // Check if the file exists
+    MyFsMemoryInfo *file = openFile(path, fileInfo);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-EEXIST);
+    }
+
+    // Truncate the file data, this updates the modification and changed time
+    LockHolder<RwLock> fileLock(file->lock, true);
+    int ret = resizeContent(*file, newSize);
+    RETURN(ret);
+}
 
-    // Truncate the file data
-    content->resize(newSize);
+/// @brief Create and open a file.
+///
+/// Create a new regular file with given name and permissions and open it, like fuseMknod() followed by fuseOpen().
+/// You do not have to check file permissions, but can assume that it is always ok to access the file.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] mode Permissions for file access.
+/// \param [out] fileInfo The handle of the open file is stored in fileInfo->fh.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseCreate(const char *path, mode_t mode, struct fuse_file_info *fileInfo) {
+    LOGM();
+    RequestLock request(*this, true);
 
-    // Update the modification and changed time
-    auto iterator = files.find(path);
-    iterator->second.mtime = time(nullptr);
-    iterator->second.ctime = time(nullptr);
+    LOGF("--> Creating and opening %s\n", path);
 
+    MyFsMemoryInfo *file;
+    int ret = createFile(path, S_IFREG | (mode & ~S_IFMT), file);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    openHandle(*file, fileInfo);
     RETURN(0);
 }
 
+/// @brief Find data or a hole in a file.
+///
+/// Move to the next position at or behind offset that holds data (SEEK_DATA) or lies in a hole (SEEK_HOLE). The end
+/// of the file counts as a hole. Other values of whence are handled by the kernel.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] offset Position to start at.
+/// \param [in] whence SEEK_DATA or SEEK_HOLE.
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return The new position on success, -ENXIO if there is no data behind offset, -ERRNO on failure.
+off_t MyInMemoryFS::fuseLseek(const char *path, off_t offset, int whence, struct fuse_file_info *fileInfo) {
+    LOGM();
+    RequestLock request(*this, false);
+
+    LOGF("--> Seeking in %s\n", path);
+
+    // Check if the file exists
+    MyFsMemoryInfo *file = openFile(path, fileInfo);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    if (whence != SEEK_DATA && whence != SEEK_HOLE) {
+        LOG("Invalid whence");
+        RETURN(-EINVAL);
+    }
+
+    // Check if the offset is within the file bounds
+    LockHolder<RwLock> fileLock(file->lock, false);
+    if (offset < 0 || offset >= (off_t) file->content.size()) {
+        LOG("Offset is not within the file bounds");
+        RETURN(-ENXIO);
+    }
+
+    // Holes are found page by page, a spilled or compressed file or a file of the snapshot is loaded into memory first
+    if (file->spilled || file->compressed != nullptr || file->image != nullptr)
+        fileLock.upgrade();
+    int ret = loadFile(*file);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    off_t position = (whence == SEEK_DATA) ? file->content.nextData(offset) : file->content.nextHole(offset);
+    if (whence == SEEK_DATA && position >= (off_t) file->content.size()) {
+        LOG("No data behind the offset");
+        RETURN(-ENXIO);
+    }
+
+    RETURN(position);
+}
+
+/// @brief Copy a range of one file into another.
+///
+/// Whole pages that keep their position within a page are shared with the source instead of copied, they are copied
+/// when one of the files writes them.
+/// \param [in] pathIn Name of the source file, starting with "/".
+/// \param [in] fileInfoIn File handle for the source file set by fuseOpen.
+/// \param [in] offsetIn Position of the first byte to copy.
+/// \param [in] pathOut Name of the target file, starting with "/".
+/// \param [in] fileInfoOut File handle for the target file set by fuseOpen.
+/// \param [in] offsetOut Position the first byte is copied to, the target grows if the bytes end behind it.
+/// \param [in] size Number of bytes to copy.
+/// \param [in] flags Must be 0.
+/// \return Number of bytes copied on success, less than size at the end of the source. -ERRNO on failure.
+ssize_t MyInMemoryFS::fuseCopyFileRange(const char *pathIn, struct fuse_file_info *fileInfoIn, off_t offsetIn,
+                                        const char *pathOut, struct fuse_file_info *fileInfoOut, off_t offsetOut,
+                                        size_t size, int flags) {
+    LOGM();
+    RequestLock request(*this, false);
+
+    LOGF("--> Copying %s to %s\n", pathIn, pathOut);
+
+    MyFsMemoryInfo *source = openFile(pathIn, fileInfoIn);
+    MyFsMemoryInfo *target = openFile(pathOut, fileInfoOut);
+    if (source == nullptr || target == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    if (offsetIn < 0 || offsetOut < 0 || flags != 0 || !S_ISREG(source->mode) || !S_ISREG(target->mode)) {
+        LOG("Invalid range or file");
+        RETURN(-EINVAL);
+    }
+
+    // Files are locked in the order of their addresses, so copies in opposite directions do not wait for each other
+    LockHolder<RwLock> firstLock, secondLock;
+    if (source == target) {
+        firstLock.acquire(target->lock, true);
+    } else if (target < source) {
+        firstLock.acquire(target->lock, true);
+        secondLock.acquire(source->lock, false);
+    } else {
+        firstLock.acquire(source->lock, false);
+        secondLock.acquire(target->lock, true);
+    }
+
+    int ret = copyContent(*target, offsetOut, *source, offsetIn, size);
+    if (ret < 0)
+        LOGF("ERROR: Copying failed with error %d", ret);
+
+    RETURN(ret);
+}
+
+/// @brief Set an extended attribute of a file.
+///
+/// Extended attributes are not stored. Setting CLONE_XATTR to the name of another file replaces the content of the
+/// file by a clone of it, both share their pages until one of them writes them.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] name Name of the attribute.
+/// \param [in] value Value of the attribute, for CLONE_XATTR the name of the source file, starting with "/" and
+/// without empty, "." or ".." components.
+/// \param [in] size Number of bytes of the value.
+/// \param [in] flags Can be ignored.
+/// \return 0 on success, -ERRNO on failure.
+#ifdef __APPLE__
+int MyInMemoryFS::fuseSetxattr(const char *path, const char *name, const char *value, size_t size, int flags,
+                               uint32_t x) {
+#else
+int MyInMemoryFS::fuseSetxattr(const char *path, const char *name, const char *value, size_t size, int flags) {
+#endif
+    LOGM();
+    RequestLock request(*this, true);
+
+    MyFsMemoryInfo *file = findFile(path);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    if (strcmp(name, CLONE_XATTR) != 0) {
+        RETURN(0);
+    }
+
+    LOGF("--> Cloning %.*s to %s\n", (int) size, value, path);
+    int ret = cloneFromPath(*file, value, size);
+    RETURN(ret);
+}
+
+/// @brief Get an extended attribute of a file.
+///
+/// Extended attributes are not stored, only COMPRESSION_XATTR can be read. It holds the bytes of the pages of the file
+/// before and after compression and their ratio, for the root directory those of all files.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] name Name of the attribute.
+/// \param [out] value Buffer for the value, the value is not terminated by '\0'.
+/// \param [in] size Size of the buffer, 0 to get the length of the value only.
+/// \return Length of the value on success, -ERANGE if it does not fit into the buffer, -ERRNO on failure.
+#ifdef __APPLE__
+int MyInMemoryFS::fuseGetxattr(const char *path, const char *name, char *value, size_t size, uint x) {
+#else
+int MyInMemoryFS::fuseGetxattr(const char *path, const char *name, char *value, size_t size) {
+#endif
+    LOGM();
+    RequestLock request(*this, false);
+
+    MyFsMemoryInfo *file = findFile(path, strlen(path));
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    if (strcmp(name, COMPRESSION_XATTR) != 0) {
+        RETURN(-ENODATA);
+    }
+
+    LockHolder<RwLock> fileLock(file->lock, false);
+    int ret = compressionXattr(*file, value, size);
+    RETURN(ret);
+}
+
 /// @brief Read a directory.
 ///
-/// Read the content of the (only) directory.
+/// Read the content of a directory.
 /// You do not have to check file permissions, but can assume that it is always ok to access the directory.
-/// \param [in] path Path of the directory. Should be "/" in our case.
+/// \param [in] path Path of the directory, starting with "/".
 /// \param [out] buf A buffer for storing the directory entries.
 /// \param [in] filler A function for putting entries into the buffer.
 /// \param [in] offset Can be ignored.
@@ -506,25 +823,69 @@ int MyInMemoryFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file
 /// \return 0 on success, -ERRNO on failure.
 int MyInMemoryFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
+    RequestLock request(*this, false);
 
     LOGF("--> Getting The List of Files of %s\n", path);
 
+    // Check if the directory exists
+    MyFsMemoryInfo *directory = findDirectory(path, strlen(path));
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
     LOG("Add the '.' and '..' entries");
-    filler(buf, ".", NULL, 0); // Current Directory
-    filler(buf, "..", NULL, 0); // Parent Directory
-
-    // If the user is trying to show the files of the root directory show the following
-    if (strcmp(path, "/") == 0) {
-        // Add the names of the files in the directory
-        for (const auto& iterator : files) {
-            LOGF("Add '%s'", iterator.first.c_str());
-            filler(buf, (iterator.first.c_str() + 1), NULL, 0);
-        }
+    FILL_DIR(filler, buf, "."); // Current Directory
+    FILL_DIR(filler, buf, ".."); // Parent Directory
+
+    // Add the names of the files in the directory
+    for (const auto *entry : orderedChildren(*directory)) {
+        LOGF("Add '%s'", entry->first.c_str());
+        FILL_DIR(filler, buf, entry->first.c_str());
     }
 
     RETURN(0);
 }
 
+/// @brief Synchronize a file.
+///
+/// Files are only kept in memory, with an operation log all changes so far are written to the disk.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] datasync Can be ignored.
+/// \param [in] fileInfo Can be ignored.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseFsync(const char *path, int datasync, struct fuse_file_info *fileInfo) {
+    LOGM();
+    RequestLock request(*this, false);
+
+    int ret = opLog.isOpen() ? opLog.sync() : 0;
+    RETURN(ret);
+}
+
+/// @brief Synchronize the content of a directory.
+///
+/// Files are only kept in memory, there is nothing to synchronize but the snapshot. Syncing any directory writes the
+/// snapshot of all files if one was given at mount, it takes over the operation log.
+/// \param [in] path Name of the directory, starting with "/".
+/// \param [in] datasync Can be ignored.
+/// \param [in] fileInfo Can be ignored.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::fuseFsyncdir(const char *path, int datasync, struct fuse_file_info *fileInfo) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    if (mountInfo()->snapshotFile == nullptr) {
+        RETURN(0);
+    }
+
+    LOGF("Writing the snapshot %s", mountInfo()->snapshotFile);
+    int ret = compactLog(false);
+    if (ret < 0)
+        LOGF("ERROR: Writing the snapshot failed with error %d", ret);
+
+    RETURN(ret);
+}
+
 /// Initialize a file system.
 ///
 /// This function is called when the file system is mounted. You may add some initializing code here.
@@ -532,9 +893,9 @@ int MyInMemoryFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t fille
 /// \return 0.
 void* MyInMemoryFS::fuseInit(struct fuse_conn_info *conn) {
     // Open logfile
-    this->logFile= fopen(((MyFsInfo *) fuse_get_context()->private_data)->logFile, "w+");
+    this->logFile= fopen(mountInfo()->logFile, "w+");
     if(this->logFile == NULL) {
-        fprintf(stderr, "ERROR: Cannot open logfile %s\n", ((MyFsInfo *) fuse_get_context()->private_data)->logFile);
+        fprintf(stderr, "ERROR: Cannot open logfile %s\n", mountInfo()->logFile);
     } else {
         // turn of logfile buffering
         setvbuf(this->logFile, NULL, _IOLBF, 0);
@@ -542,10 +903,98 @@ void* MyInMemoryFS::fuseInit(struct fuse_conn_info *conn) {
         LOG("Starting logging...\n");
 
         LOG("Using in-memory mode");
+
+        configureConnection(conn);
+        if (conn != nullptr)
+            LOGF("Maximum write request: %d bytes", (int) conn->max_write);
+    }
+
+    setMountOptions(mountInfo());
+    stopCompression();
+    pageArena.setHugePages(mountInfo()->hugePages != 0);
+
+    freeAllFiles();  // Initialize files, the dentry cache, the open files and the inode numbers
+    unmapImage();
+    nextIno = ROOT_INODE + 1;
+
+    // Cold files are spilled into a container of the on-disk file system, it only holds files of this mount. A
+    // container left by an earlier mount is replaced, any other file of that name is not touched.
+    initFailed = false;
+    memoryLimit = mountInfo()->memoryLimit;
+    spill.reset();
+    if (memoryLimit > 0 && mountInfo()->spillFile != nullptr) {
+        if (access(mountInfo()->spillFile, F_OK) == 0 && !MyOnDiskFS::isContainer(mountInfo()->spillFile)) {
+            LOGF("ERROR: The spill file %s is not a container, not mounting", mountInfo()->spillFile);
+            initFailed = true;
+            RETURN(0);
+        }
+
+        unlink(mountInfo()->spillFile);
+        memset(&spillInfo, 0, sizeof(spillInfo));
+        spillInfo.contFile = mountInfo()->spillFile;
+        spillInfo.logFile = (char *) "/dev/null";
+        spillInfo.atimeMode = ATIME_NOATIME;
+
+        spill.reset(new MyOnDiskFS());
+        spill->setMountInfo(&spillInfo);
+        spill->disableFlusher();
+        spill->fuseInit(nullptr);
+        if (spill->mountFailed()) {
+            LOGF("ERROR: Cannot create the spill container %s, files are not spilled", mountInfo()->spillFile);
+            spill.reset();
+        }
+    }
+    if (memoryLimit > 0)
+        LOGF("Memory limit: %zu bytes, spill container: %s", memoryLimit, spill ? spillInfo.contFile : "none");
+
+    // Files of the last mount come from the snapshot, their content is read from the mapped image when it is used.
+    // A snapshot that cannot be loaded is not mounted, so the unmount does not overwrite it with an empty one.
+    if (mountInfo()->snapshotFile != nullptr) {
+        int ret = readSnapshot(mountInfo()->snapshotFile);
+        if (ret == 0) {
+            LOGF("Loaded %zu files from the snapshot %s", nodes.size(), mountInfo()->snapshotFile);
+        } else if (ret == -ENOENT) {
+            LOGF("No snapshot %s yet, starting empty", mountInfo()->snapshotFile);
+        } else {
+            LOGF("ERROR: Cannot load the snapshot %s, error %d, not mounting", mountInfo()->snapshotFile, ret);
+            initFailed = true;
+            RETURN(0);
+        }
+    }
+
+    // Changes after the snapshot are replayed from the operation log, then a new snapshot takes them over
+    opLog.close();
+    compactor = 0;
+    compactAt = OPLOG_COMPACT_BYTES;
+    compactDue = false;
+    if (mountInfo()->opLogFile != nullptr && mountInfo()->snapshotFile == nullptr) {
+        LOG("ERROR: The operation log needs a snapshot, changes are not logged");
+    } else if (mountInfo()->opLogFile != nullptr) {
+        // The snapshot and the log stay as they are if a record cannot be applied, a new snapshot would drop the rest
+        uint64_t last = (image != nullptr) ? imageHeader().sequence : 0;
+        int ret = replayLog(mountInfo()->opLogFile, last);
+        if (ret < 0) {
+            LOGF("ERROR: Replaying the operation log stopped at record %llu, not mounting", (unsigned long long) last + 1);
+            initFailed = true;
+            RETURN(0);
+        }
+        LOGF("Replayed %d operations from the log %s", ret, mountInfo()->opLogFile);
+
+        opLog.setSequence(last);
+        ret = opLog.open(mountInfo()->opLogFile, mountInfo()->opLogSync);
+        if (ret < 0) {
+            LOGF("ERROR: Cannot open the operation log, error %d, changes are not logged", ret);
+        } else if (opLog.size() > 0 || access(OpLog::oldPath(mountInfo()->opLogFile).c_str(), F_OK) == 0) {
+            ret = compactLog(false);
+            if (ret < 0)
+                LOGF("ERROR: Writing the snapshot after the replay failed with error %d", ret);
+        }
     }
 
-    files = {};  // Initialize files
-    openFiles = {};  // Initialize openFiles
+    // Files that were not used for a while are compressed in the background
+    startCompression();
+    if (compressAfter > 0)
+        LOGF("Compressing files after %d seconds without use", compressAfter);
 
     RETURN(0);
 }
@@ -556,14 +1005,468 @@ void* MyInMemoryFS::fuseInit(struct fuse_conn_info *conn) {
 void MyInMemoryFS::fuseDestroy() {
     LOGM();
 
-    LOG("Freeing memory...");
+    stopCompression();
+    if (compressedOriginal > 0)
+        LOGF("Compressed %zu bytes to %zu bytes", (size_t) compressedOriginal, (size_t) compressedStored);
+
+    ArenaUsage usage = memoryUsage();
+    if (initFailed) {
+        LOG("File system was not mounted, leaving the snapshot and the log untouched");
+    } else if (mountInfo()->snapshotFile != nullptr) {
+        LOGF("Writing the snapshot %s", mountInfo()->snapshotFile);
+        int ret = compactLog(false);
+        if (ret < 0)
+            LOGF("ERROR: Writing the snapshot failed with error %d, the last one and the log are kept", ret);
+    }
+    opLog.close();
 
-    files.clear();
-    openFiles.clear();
+    LOGF("Freeing memory, %zu of %zu bytes in use...", usage.bytesUsed, usage.bytesReserved);
+
+    freeAllFiles();
+    unmapImage();
+
+    if (spill) {
+        LOG("Removing the spill container");
+        spill->fuseDestroy();
+        spill.reset();
+        unlink(spillInfo.contFile);
+    }
 
     LOG("Shutting down");
 }
 
+/// @brief Look up a directory entry.
+///
+/// Files are freed when they are deleted, lookups are not counted.
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the entry.
+/// \param [out] statbuf Metadata of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeLookup(uint64_t parent, const char *name, struct stat *statbuf) {
+    LOGM();
+    RequestLock request(*this, false);
+
+    LOGF("--> Looking up %s in inode %d\n", name, (int) parent);
+
+    MyFsMemoryInfo *directory = findInodeDirectory(parent);
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    auto iterator = directory->children.find(name);
+    if (iterator == directory->children.end()) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    LockHolder<RwLock> fileLock(iterator->second->lock, false);
+    fillStat(*iterator->second, statbuf);
+    RETURN(0);
+}
+
+/// @brief Get the metadata of an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [out] statbuf Metadata of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeGetattr(uint64_t ino, struct stat *statbuf) {
+    LOGM();
+    RequestLock request(*this, false);
+
+    MyFsMemoryInfo *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    LockHolder<RwLock> fileLock(file->lock, false);
+    fillStat(*file, statbuf);
+    RETURN(0);
+}
+
+/// @brief Change the permissions of an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] mode New mode of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeChmod(uint64_t ino, mode_t mode) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    MyFsMemoryInfo *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    // The type of the file does not change
+    mode = (file->mode & S_IFMT) | (mode & ~S_IFMT);
+    int ret = logOp(OPLOG_CHMOD, file->ino, 0, mode);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    file->mode = mode;
+    file->ctime = time(nullptr);
+    RETURN(0);
+}
+
+/// @brief Change the owner of an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] uid New user id, -1 keeps the current one.
+/// \param [in] gid New group id, -1 keeps the current one.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeChown(uint64_t ino, uid_t uid, gid_t gid) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    MyFsMemoryInfo *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    if (uid == (uid_t) -1)
+        uid = file->uid;
+    if (gid == (gid_t) -1)
+        gid = file->gid;
+    int ret = logOp(OPLOG_CHOWN, file->ino, 0, (uint64_t) uid << 32 | (uint32_t) gid);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    file->uid = uid;
+    file->gid = gid;
+    file->ctime = time(nullptr);
+    RETURN(0);
+}
+
+/// @brief Truncate an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] newSize New size of the file.
+/// \param [in] fileInfo File handle if the file is truncated through an open file, otherwise nullptr.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeTruncate(uint64_t ino, off_t newSize, struct fuse_file_info *fileInfo) {
+    LOGM();
+    RequestLock request(*this, false);
+
+    // An open file may already be deleted
+    MyFsMemoryInfo *file = handleFile(fileInfo);
+    if (file == nullptr)
+        file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    LockHolder<RwLock> fileLock(file->lock, true);
+    int ret = resizeContent(*file, newSize);
+    RETURN(ret);
+}
+
+/// @brief Change the access and modification time of an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] times New access and modification time, UTIME_NOW and UTIME_OMIT in tv_nsec are supported.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeUtimens(uint64_t ino, const struct timespec times[2]) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    MyFsMemoryInfo *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    time_t now = time(nullptr);
+    int64_t logged[2] = {file->atime, file->mtime};
+    if (times[0].tv_nsec != UTIME_OMIT)
+        logged[0] = (times[0].tv_nsec == UTIME_NOW) ? now : times[0].tv_sec;
+    if (times[1].tv_nsec != UTIME_OMIT)
+        logged[1] = (times[1].tv_nsec == UTIME_NOW) ? now : times[1].tv_sec;
+    int ret = logOp(OPLOG_UTIMENS, file->ino, 0, 0, (const char *) logged, sizeof(logged));
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    file->atime = logged[0];
+    file->mtime = logged[1];
+    file->ctime = now;
+    RETURN(0);
+}
+
+/// @brief Create a file in a directory.
+///
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the new file.
+/// \param [in] mode Type and permissions of the file.
+/// \param [out] statbuf Metadata of the new file.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeMknod(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    LOGF("--> Creating %s in inode %d\n", name, (int) parent);
+
+    MyFsMemoryInfo *directory = findInodeDirectory(parent);
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    MyFsMemoryInfo *file;
+    int ret = createFile(*directory, name, mode, file);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    fillStat(*file, statbuf);
+    RETURN(0);
+}
+
+/// @brief Create a directory in a directory.
+///
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the new directory.
+/// \param [in] mode Permissions of the directory.
+/// \param [out] statbuf Metadata of the new directory.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeMkdir(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    int ret = inodeMknod(parent, name, S_IFDIR | (mode & ~S_IFMT), statbuf);
+    RETURN(ret);
+}
+
+/// @brief Delete a file from a directory.
+///
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeUnlink(uint64_t parent, const char *name) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    MyFsMemoryInfo *directory = findInodeDirectory(parent);
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = removeFile(*directory, name, nullptr, false);
+    RETURN(ret);
+}
+
+/// @brief Delete an empty directory from a directory.
+///
+/// \param [in] parent Inode number of the parent directory.
+/// \param [in] name Name of the directory.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeRmdir(uint64_t parent, const char *name) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    MyFsMemoryInfo *directory = findInodeDirectory(parent);
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = removeFile(*directory, name, nullptr, true);
+    RETURN(ret);
+}
+
+/// @brief Move a directory entry.
+///
+/// Like fuseRename(), an existing entry with the new name is not replaced.
+/// \param [in] parent Inode number of the directory of the entry.
+/// \param [in] name Name of the entry.
+/// \param [in] newParent Inode number of the new directory.
+/// \param [in] newName New name of the entry.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeRename(uint64_t parent, const char *name, uint64_t newParent, const char *newName) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    MyFsMemoryInfo *oldDirectory = findInodeDirectory(parent);
+    MyFsMemoryInfo *newDirectory = findInodeDirectory(newParent);
+    if (oldDirectory == nullptr || newDirectory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = moveFile(*oldDirectory, name, nullptr, *newDirectory, newName);
+    RETURN(ret);
+}
+
+/// @brief Create a hard link to an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] newParent Inode number of the directory of the new entry.
+/// \param [in] newName Name of the new entry.
+/// \param [out] statbuf Metadata of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeLink(uint64_t ino, uint64_t newParent, const char *newName, struct stat *statbuf) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    MyFsMemoryInfo *file = findInode(ino);
+    MyFsMemoryInfo *directory = findInodeDirectory(newParent);
+    if (file == nullptr || file->nlink == 0 || directory == nullptr) {
+        LOG("File or directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = addLink(*file, *directory, newName);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    fillStat(*file, statbuf);
+    RETURN(0);
+}
+
+/// @brief Open an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [out] fileInfo The handle of the open file is stored in fileInfo->fh.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeOpen(uint64_t ino, struct fuse_file_info *fileInfo) {
+    LOGM();
+    RequestLock request(*this, false);
+
+    MyFsMemoryInfo *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    openHandle(*file, fileInfo);
+    RETURN(0);
+}
+
+/// @brief Create and open a file in a directory.
+///
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the new file.
+/// \param [in] mode Permissions of the file.
+/// \param [out] fileInfo The handle of the open file is stored in fileInfo->fh.
+/// \param [out] statbuf Metadata of the new file.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeCreate(uint64_t parent, const char *name, mode_t mode, struct fuse_file_info *fileInfo,
+                              struct stat *statbuf) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    int ret = inodeMknod(parent, name, S_IFREG | (mode & ~S_IFMT), statbuf);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    ret = inodeOpen(statbuf->st_ino, fileInfo);
+    RETURN(ret);
+}
+
+/// @brief Read a directory by its inode.
+///
+/// The listing starts with "." and "..", followed by the entries in the order of their names. The parent of a
+/// directory is not known, ".." carries the inode number of the directory itself.
+/// \param [in] ino Inode number of the directory.
+/// \param [in] buf Buffer passed to the filler.
+/// \param [in] filler Function that adds an entry to the buffer.
+/// \param [in] offset Offset of the first entry to add, as passed to the filler with the entry before it.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeReaddir(uint64_t ino, void *buf, MyFsFiller filler, off_t offset) {
+    LOGM();
+    RequestLock request(*this, false);
+
+    MyFsMemoryInfo *directory = findInodeDirectory(ino);
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(statbuf));
+    statbuf.st_ino = ino;
+    statbuf.st_mode = S_IFDIR;
+
+    const auto &entries = orderedChildren(*directory);
+    for (off_t index = offset; index < (off_t) entries.size() + 2; index++) {
+        const char *name = (index == 0) ? "." : "..";
+        if (index >= 2) {
+            name = entries[index - 2]->first.c_str();
+            statbuf.st_ino = entries[index - 2]->second->ino;
+            statbuf.st_mode = entries[index - 2]->second->mode & S_IFMT;
+        }
+
+        // Stop when the buffer is full
+        if (filler(buf, name, &statbuf, index + 1) != 0)
+            break;
+    }
+
+    RETURN(0);
+}
+
+/// @brief Set an extended attribute of an inode.
+///
+/// Extended attributes are not stored, only CLONE_XATTR is supported, see fuseSetxattr().
+/// \param [in] ino Inode number of the file.
+/// \param [in] name Name of the attribute.
+/// \param [in] value Value of the attribute.
+/// \param [in] size Number of bytes of the value.
+/// \param [in] flags Can be ignored.
+/// \return 0 on success, -ERRNO on failure.
+int MyInMemoryFS::inodeSetxattr(uint64_t ino, const char *name, const char *value, size_t size, int flags) {
+    LOGM();
+    RequestLock request(*this, true);
+
+    MyFsMemoryInfo *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    if (strcmp(name, CLONE_XATTR) != 0) {
+        RETURN(-ENOTSUP);
+    }
+
+    int ret = cloneFromPath(*file, value, size);
+    RETURN(ret);
+}
+
+/// @brief Get an extended attribute of an inode.
+///
+/// Extended attributes are not stored, only COMPRESSION_XATTR can be read, see fuseGetxattr().
+/// \param [in] ino Inode number of the file.
+/// \param [in] name Name of the attribute.
+/// \param [out] value Buffer for the value.
+/// \param [in] size Size of the buffer, 0 to get the length of the value only.
+/// \return Length of the value on success, -ERANGE if it does not fit into the buffer, -ERRNO on failure.
+int MyInMemoryFS::inodeGetxattr(uint64_t ino, const char *name, char *value, size_t size) {
+    LOGM();
+    RequestLock request(*this, false);
+
+    MyFsMemoryInfo *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    if (strcmp(name, COMPRESSION_XATTR) != 0) {
+        RETURN(-ENODATA);
+    }
+
+    LockHolder<RwLock> fileLock(file->lock, false);
+    int ret = compressionXattr(*file, value, size);
+    RETURN(ret);
+}
+
 // DO NOT EDIT ANYTHING BELOW THIS LINE!!!
 
 /// @brief Set the static instance of the file system.
@@ -15,6 +15,7 @@
 #define DEBUG_RETURN_VALUES
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <string.h>
 #include <errno.h>
 
@@ -32,12 +33,21 @@ MyOnDiskFS::MyOnDiskFS() : MyFS() {
 
     // TODO: [PART 2] Add your constructor code here
 
+    resetInodes();
+    this->journalHead = 1;
+    this->journalSequence = 1;
+    this->journalCommitted = 1;
+    this->journalGroupOps = 0;
+    this->journalGroupStart = 0;
+    this->lazyStart = 0;
 }
 
 /// @brief Destructor of the on-disk file system class.
 ///
 /// You may add your own destructor code here.
 MyOnDiskFS::~MyOnDiskFS() {
+    stopFlusher();
+
     // free block device object
     delete this->blockDevice;
 
@@ -55,53 +65,41 @@ MyOnDiskFS::~MyOnDiskFS() {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseMknod(const char *path, mode_t mode, dev_t dev) {
     LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Creating %s", path);
 
-    readDmap();
-    readFat();
-    readRoot();
-
-    // Check if the filesystem is full
-    if(this->root.size() >= NUM_DIR_ENTRIES) {
-        LOG("Filesystem is full");
-        RETURN(-ENOSPC);
+    MyFsFile *file;
+    int ret = createEntry(path, mode, file);
+    if (ret < 0) {
+        RETURN(ret);
     }
 
-    // Check length of given filename
-    if (strlen(path) - 1 > NAME_LENGTH) {
-        LOG("Filename too long");
-        RETURN(-EINVAL);
-    }
-
-    // Check if a file with the same name already exists
-    if(root.find(path) != this->root.end()) {
-        LOG("File already exists");
-        RETURN(-EEXIST);
-    }
-
-    LOG("Create file");
-    MyFsDiskInfo file;
-
-    // Strip the slash from the path to get the filename
-    strcpy(file.name, path+1);
+    ret = journalAppend();
+    RETURN(ret);
+}
 
-    file.size = 0;
-    file.data = NULL;
-    file.gid = getgid();
-    file.uid = getuid();
-    file.mode = mode;
-    file.atime = file.ctime = file.mtime = time(NULL);
+/// @brief Create a directory.
+///
+/// Create a new, empty directory with given name and permissions.
+/// You do not have to check file permissions, but can assume that it is always ok to access the directory.
+/// \param [in] path Name of the directory, starting with "/".
+/// \param [in] mode Permissions for directory access.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseMkdir(const char *path, mode_t mode) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
-    LOG("Adding file to filesystem");
-    // Insert the file into the map
-    this->root.emplace(path, move(file));
+    LOGF("--> Creating the directory %s", path);
 
-    writeDmap();
-    writeFat();
-    writeRoot();
+    MyFsFile *directory;
+    int ret = createEntry(path, S_IFDIR | (mode & ~S_IFMT), directory);
+    if (ret < 0) {
+        RETURN(ret);
+    }
 
-    RETURN(0);
+    ret = journalAppend();
+    RETURN(ret);
 }
 
 /// @brief Delete a file.
@@ -112,35 +110,42 @@ int MyOnDiskFS::fuseMknod(const char *path, mode_t mode, dev_t dev) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseUnlink(const char *path) {
     LOGM();
-
-    readDmap();
-    readFat();
-    readRoot();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Deleting %s", path);
 
     // Check if the file exists
-    auto iterator = this->root.find(path);
-    if(iterator == this->root.end()) {
+    MyFsDirEntry *entry = findEntry(path);
+    if(entry == nullptr) {
         LOG("File does not exist");
         RETURN(-ENOENT);
     }
 
-    // Check if the file has data
-    if(iterator->second.size > 0) {
-        LOG("Freeing allocated files");
-        // Free all blocks that are allocated by this file
-        freeBlocks(iterator->second.data, bytesToBlocks(iterator->second.size));
-    }
+    int ret = unlinkEntry(*entry, path);
+    RETURN(ret);
+}
 
-    // Remove the file from the map
-    this->root.erase(iterator);
+/// @brief Delete a directory.
+///
+/// Delete an empty directory with given name from the file system.
+/// You do not have to check file permissions, but can assume that it is always ok to access the directory.
+/// \param [in] path Name of the directory, starting with "/".
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseRmdir(const char *path) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
-    writeDmap();
-    writeFat();
-    writeRoot();
+    LOGF("--> Deleting the directory %s", path);
 
-    RETURN(0);
+    // Check if the directory exists
+    MyFsDirEntry *entry = findEntry(path);
+    if (entry == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = removeDirectory(*entry, path);
+    RETURN(ret);
 }
 
 /// @brief Rename a file.
@@ -154,37 +159,60 @@ int MyOnDiskFS::fuseUnlink(const char *path) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseRename(const char *path, const char *newpath) {
     LOGM();
-
-    readRoot();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Renaming %s into %s", path, newpath);
 
     // Check if the old file exists
-    auto oldIterator = this->root.find(path);
-    if (oldIterator == this->root.end()) {
+    MyFsDirEntry *entry = findEntry(path);
+    if (entry == nullptr) {
         LOG("File does not exist");
         RETURN(-ENOENT);
     }
 
-    // Check if the new file already exists
-    auto newIterator = this->root.find(newpath);
-    if (newIterator != this->root.end()) {
-        LOG("File already exists");
-        RETURN(-EEXIST);
+    // Check if the new directory exists
+    const char *name;
+    MyFsDirectory *parent = findParent(newpath, name);
+    if (parent == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
     }
 
-    // Move the file to the new name in the map
-    this->root.emplace(newpath, move(oldIterator->second));
+    int ret = moveEntry(*entry, path, *parent, name);
+    RETURN(ret);
+}
 
-    // Remove the old file from the map
-    this->root.erase(oldIterator);
+/// @brief Create a hard link.
+///
+/// Create a new directory entry for an existing file. Both names refer to the same inode, so they share the content
+/// and the metadata of the file. The file is deleted when its last name is removed.
+/// You do not have to check file permissions, but can assume that it is always ok to access the file.
+/// \param [in] path Name of the existing file, starting with "/".
+/// \param [in] newpath New name for the file, starting with "/".
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseLink(const char *path, const char *newpath) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Linking %s to %s", newpath, path);
 
-    // Update the change time of the new file
-    this->root.find(newpath)->second.ctime = time(NULL);
+    // Check if the file exists
+    MyFsDirEntry *entry = findEntry(path);
+    if (entry == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
 
-    writeRoot();
+    // Check if the directory of the new entry exists
+    const char *name;
+    MyFsDirectory *parent = findParent(newpath, name);
+    if (parent == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
 
-    RETURN(0);
+    int ret = addLink(this->inodes[entry->ino], *parent, name);
+    RETURN(ret);
 }
 
 /// @brief Get file meta data.
@@ -195,43 +223,24 @@ int MyOnDiskFS::fuseRename(const char *path, const char *newpath) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseGetattr(const char *path, struct stat *statbuf) {
     LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Get the metadata of %s", path);
 
-    readRoot();
-
-    statbuf->st_uid = getuid(); // The owner of the file/directory is the user who mounted the filesystem
-    statbuf->st_gid = getgid(); // The group of the file/directory is the same as the group of the user who mounted the filesystem
-    statbuf->st_atime = time(NULL); // The last "a"ccess of the file/directory is right now
-
-    if (strcmp(path, "/") == 0) {
-        statbuf->st_mode = S_IFDIR | 0755;
-        statbuf->st_nlink = 2; // Why "two" hardlinks instead of "one"? The answer is here: http://unix.stackexchange.com/a/101536
+    if (strlen(path) == 0) {
+        LOG("Path length <= 0");
+        RETURN(-ENOENT);
     }
-    else if(strlen(path) > 0) {
-        LOG("Path length > 0");
-
-        // Check if the file exists
-        auto iterator = this->root.find(path);
-        if(iterator == this->root.end()) {
-            LOG("File does not exist");
-            RETURN(-ENOENT);
-        }
 
-        statbuf->st_mode = iterator->second.mode;
-        statbuf->st_nlink = 1;
-        statbuf->st_size = iterator->second.size;
-
-        // The last "a"ccess and "m"odification  of the file is right now
-        statbuf->st_atime = iterator->second.atime = time(NULL);
-        statbuf->st_mtime = iterator->second.mtime = time(NULL);
-    }
-    else {
-        LOG("Path length <= 0");
+    // Check if the file exists, the root directory has an inode as well
+    MyFsFile *file = findFile(path);
+    if(file == nullptr) {
+        LOG("File does not exist");
         RETURN(-ENOENT);
     }
 
-    writeRoot();
+    // Reading the metadata does not change it
+    fillStat(*file, statbuf);
 
     RETURN(0);
 }
@@ -245,28 +254,19 @@ int MyOnDiskFS::fuseGetattr(const char *path, struct stat *statbuf) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseChmod(const char *path, mode_t mode) {
     LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Changing permissions of %s", path);
 
-    LOG("Reading root blocks");
-    readRoot();
-
     // Check if the file exists
-    auto iterator = this->root.find(path);
-    if (iterator == this->root.end()) {
+    MyFsFile *file = findFile(path);
+    if (file == nullptr) {
         LOG("File does not exists");
         RETURN(-ENOENT);
     }
 
-    // Update the mode field
-    iterator->second.mode = mode;
-
-    // Update the changed time
-    iterator->second.ctime = time(NULL);
-
-    writeRoot();
-
-    RETURN(0);
+    int ret = changeMode(*file, mode);
+    RETURN(ret);
 }
 
 /// @brief Change the owner of a file.
@@ -279,28 +279,19 @@ int MyOnDiskFS::fuseChmod(const char *path, mode_t mode) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseChown(const char *path, uid_t uid, gid_t gid) {
     LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Changing the owner of %s", path);
 
-    readRoot();
-
     // Check if the file exists
-    auto iterator = this->root.find(path);
-    if (iterator == this->root.end()) {
+    MyFsFile *file = findFile(path);
+    if (file == nullptr) {
         LOG("File does not exists");
         RETURN(-ENOENT);
     }
 
-    // Update the uid and gid fields
-    iterator->second.uid = uid;
-    iterator->second.gid = gid;
-
-    // Update the changed time
-    iterator->second.ctime = time(NULL);
-
-    writeRoot();
-
-    RETURN(0);
+    int ret = changeOwner(*file, uid, gid);
+    RETURN(ret);
 }
 
 /// @brief Open a file.
@@ -309,40 +300,22 @@ int MyOnDiskFS::fuseChown(const char *path, uid_t uid, gid_t gid) {
 /// open file count.
 /// You do not have to check file permissions, but can assume that it is always ok to access the file.
 /// \param [in] path Name of the file, starting with "/".
-/// \param [out] fileInfo Can be ignored in Part 1
+/// \param [out] fileInfo The handle of the open file is stored in fileInfo->fh.
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Opening %s", path);
 
-    readRoot();
-
-    // Check how many files are open
-    if (this->openFiles.size() > NUM_OPEN_FILES) {
-        LOG("Too many open files");
-        RETURN(-EMFILE);
-    }
-
-    // Check if the file is already open
-    if (this->openFiles.find(path) != this->openFiles.end()) {
-        LOG("File is already open");
-        RETURN(-EPERM);
-    }
-
     // Check if the file exists
-    auto iterator = this->root.find(path);
-    if (iterator == this->root.end()) {
+    MyFsFile *file = findFile(path);
+    if (file == nullptr) {
         LOG("File does not exists");
         RETURN(-ENOENT);
     }
 
-    // Add the file to the open files set
-    this->openFiles.insert(path);
-
-    // Store the first block in the fuse_file_info struct
-    fileInfo->fh = iterator->second.data;
-
+    openHandle(*file, fileInfo);
     RETURN(0);
 }
 
@@ -360,74 +333,88 @@ int MyOnDiskFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
 /// \param [in] size Number of bytes to read
 /// \param [in] offset Starting position in the file, i.e., number of the first byte to read relative to the first byte of
 /// the file
-/// \param [in] fileInfo Can be ignored in Part 1
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
 /// \return The Number of bytes read on success. This may be less than size if the file does not contain sufficient bytes.
 /// -ERRNO on failure.
 int MyOnDiskFS::fuseRead(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Reading %s", path);
-    readFat();
-    readRoot();
 
     // Check if the file exists
-    auto iterator = this->root.find(path);
-    if (this->root.find(path) == this->root.end()) {
+    MyFsHandle *handle;
+    MyFsFile *file = openFile(path, fileInfo, &handle);
+    if (file == nullptr) {
         LOG("File does not exists");
         RETURN(-ENOENT);
     }
 
     // Check if the offset is within the file bounds
-    if (offset < 0 || offset >= iterator->second.size) {
+    if (offset < 0 || (uint64_t) offset >= file->size) {
         LOG("Offset is not within the file bounds");
         size = 0; // The Number of bytes read
     }
 
     // Check if the file has blocks to read
-    if(iterator->second.size == 0) {
+    if(file->size == 0) {
         LOG("File is empty");
         size = 0; // The Number of bytes read
     }
 
+    // Do not read beyond the end of the file
+    if(size > 0 && offset + size > file->size) {
+        size = file->size - offset;
+    }
+
     // Check if we need to read
     if(size > 0) {
 
         off_t blockOffset = offset / BLOCK_SIZE;
         off_t byteOffset = offset % BLOCK_SIZE;
-        size_t numBlocks = ceil((double) (byteOffset + size) / BLOCK_SIZE);
-
-        // Get the first block
-        uint16_t firstBlock = iterator->second.data;
-        for (int i = 0; i < blockOffset; ++i) {
-            // Check if we are in the bounds of the FAT
-            if(fat.at(firstBlock).isLast && (i < (blockOffset-1))) {
-                LOG("File table overflow");
-                RETURN(-ENFILE);
-            }
-
-            // Set next block as starting block
-            firstBlock = fat.at(firstBlock).nextBlock;
-        }
+        size_t numBlocks = bytesToBlocks(byteOffset + size);
 
         LOGF("Trying to read %d bytes with an offset of %d bytes", size, offset);
-        LOGF("Reading %d file blocks starting from block %d", numBlocks, firstBlock);
-
-        // Allocate a buffer for the read size
-        char *buffer = (char*) malloc(size);
-        memset(buffer, 0, size);
-
-        // Write the file into the buffer
-        readFile(firstBlock, buffer, numBlocks);
+        LOGF("Reading %d file blocks starting from block %d of the file", numBlocks, blockOffset);
+
+        if (handle != nullptr) {
+            // Reads that continue where the last one ended double the readahead window, others reset it
+            if (offset == handle->nextOffset && offset > 0)
+                handle->window = min(max(handle->window * 2, (uint32_t) READAHEAD_MIN_BLOCKS),
+                                     (uint32_t) READAHEAD_MAX_BLOCKS);
+            else
+                handle->window = 0;
+            handle->nextOffset = offset + size;
+        }
 
-        // Write the buffer to the output buffer with offset and size
-        memcpy(buf, (buffer + byteOffset), size);
-        free(buffer);
+        int ret;
+        if (handle != nullptr && numBlocks < READAHEAD_MAX_BLOCKS) {
+            // Small reads are served from the readahead buffer of the handle
+            vector<char> buffer(numBlocks * BLOCK_SIZE);
+            ret = readAhead(*file, *handle, blockOffset, numBlocks, buffer.data());
+            if (ret >= 0)
+                memcpy(buf, buffer.data() + byteOffset, size);
+        } else {
+            // Large reads are as large as the window, their whole blocks go straight into the output buffer
+            ret = readRange(*file, handle, offset, size, buf);
+        }
+        if (ret < 0) {
+            RETURN(ret);
+        }
     }
 
-    // Update the access time
-    iterator->second.atime = time(NULL);
+    // Update the access time as the mount options demand
+    time_t now = time(NULL);
+    if (updatesAtime(file->atime, file->mtime, file->ctime, now)) {
+        file->atime = now;
+        touchInode(*file);
+        invalidateInode(file->ino);
+    }
 
-    writeRoot();
+    int ret = journalAppend();
+    if (ret < 0) {
+        RETURN(ret);
+    }
 
     RETURN(size);
 }
@@ -445,19 +432,18 @@ int MyOnDiskFS::fuseRead(const char *path, char *buf, size_t size, off_t offset,
 /// \param [in] size Number of bytes to write.
 /// \param [in] offset Starting position in the file, i.e., number of the first byte to read relative to the first byte of
 /// the file.
-/// \param [in] fileInfo Can be ignored in Part 1 .
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
 /// \return Number of bytes written on success, -ERRNO on failure.
 int MyOnDiskFS::fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Writing %s", path);
-    readDmap();
-    readFat();
-    readRoot();
 
     // Check if the file exists
-    auto iterator = this->root.find(path);
-    if (this->root.find(path) == this->root.end()) {
+    MyFsHandle *handle;
+    MyFsFile *inode = openFile(path, fileInfo, &handle);
+    if (inode == nullptr) {
         LOG("File does not exists");
         RETURN(-ENOENT);
     }
@@ -470,57 +456,113 @@ int MyOnDiskFS::fuseWrite(const char *path, const char *buf, size_t size, off_t
 
     LOGF("Trying to write %d bytes with an offset of %d bytes", size, offset);
 
-    // Calculate the block number and byte offset
-    off_t currentBlockNumber = max((u_long) bytesToBlocks(iterator->second.size), 1UL);
+    MyFsFile &file = *inode;
+
+    // Files cannot grow beyond the data area, the caller gets a short write
+    off_t maxSize = (off_t) FILE_BLOCK_COUNT * BLOCK_SIZE;
+    if (offset + (off_t) size > maxSize) {
+        if (offset >= maxSize) {
+            LOG("File too large");
+            RETURN(-EFBIG);
+        }
+        size = maxSize - offset;
+    }
+
     off_t blockOffset = offset / BLOCK_SIZE;
     off_t byteOffset = offset % BLOCK_SIZE;
     size_t numBlocks = bytesToBlocks(byteOffset + size);
 
-    // Check if we need to allocate more blocks
-    if(currentBlockNumber < blockOffset + numBlocks) {
-        fuseTruncate(path, offset + size);
+    // Walk with a temporary position if the caller has no handle
+    MyFsHandle cursor;
+    if (handle == nullptr)
+        handle = &cursor;
+
+    // Collect the blocks to write, holes get blocks when they are written. Write as much as fits into the free
+    // blocks, the caller gets a short write.
+    vector<uint16_t> blocks;
+    blocks.reserve(numBlocks);
+    bool full = false;
+    while (blocks.size() < numBlocks && !full) {
+        int first;
+        uint32_t run = mapBlocks(file, handle, blockOffset + blocks.size(), numBlocks - blocks.size(), first);
+
+        for (uint32_t i = 0; i < run && first >= 0; i++)
+            blocks.push_back(first + i);
+
+        for (uint32_t i = 0; i < run && first < 0 && !full; i++) {
+            int block = linkBlock(file, handle, blockOffset + blocks.size());
+            full = block < 0;
+
+            // New blocks that are only partially written start as zeros
+            if (!full && (blocks.empty() || blocks.size() == numBlocks - 1))
+                cacheBlock(file, block, false);
+            if (!full)
+                blocks.push_back(block);
+        }
     }
 
-    // Get the first block to be written
-    uint16_t firstBlock = iterator->second.data;
-    for (int i = 0; i < blockOffset; ++i) {
-        // Check if we are in the bounds of the FAT
-        if(fat.at(firstBlock).isLast && (i < (blockOffset-1))) {
-            LOG("File table overflow");
-            RETURN(-ENFILE);
+    if (blocks.size() < numBlocks) {
+        if (blocks.empty()) {
+            LOG("No space left on device");
+            RETURN(-ENOSPC);
         }
-
-        // Set next block as starting block
-        firstBlock = fat.at(firstBlock).nextBlock;
+        numBlocks = blocks.size();
+        size = numBlocks * BLOCK_SIZE - byteOffset;
     }
 
-    LOGF("Writing %d file blocks starting from block %d", numBlocks, firstBlock);
-
-    // Allocate a buffer for the file blocks
-    char *buffer = (char*) malloc(numBlocks * BLOCK_SIZE);
-    memset(buffer, 0, numBlocks * BLOCK_SIZE);
-
-    // Read the file into the buffer
-    readFile(firstBlock, buffer, numBlocks);
-
-    // Write the input buffer into the write buffer
-    memcpy(buffer + byteOffset, buf, size);
-
-    // Write the buffer into the file
-    writeFile(firstBlock, buffer, numBlocks);
+    LOGF("Writing %d file blocks starting from block %d", numBlocks, blocks[0]);
+
+    // Copy the input buffer block by block into the write-back cache. Large writes send whole blocks that follow each
+    // other on disk straight to the container, one request per run.
+    bool writeThroughCache = numBlocks >= WRITE_THROUGH_MIN_BLOCKS;
+    size_t written = 0;
+    for (size_t i = 0; i < numBlocks;) {
+        size_t start = (i == 0) ? byteOffset : 0;
+        size_t count = min((size_t) BLOCK_SIZE - start, size - written);
+        size_t run = 1;
+
+        if (writeThroughCache && count == BLOCK_SIZE) {
+            while (i + run < numBlocks && size - written >= (run + 1) * BLOCK_SIZE
+                   && blocks[i + run] == blocks[i] + run)
+                run++;
+            count = run * BLOCK_SIZE;
+
+            int ret = writeThrough(file, blocks[i], run, buf + written);
+            if (ret < 0) {
+                RETURN(ret);
+            }
+        } else {
+            // Partially written blocks keep the rest of their content
+            memcpy(cacheBlock(file, blocks[i], count < BLOCK_SIZE) + start, buf + written, count);
+        }
 
-    // Free the buffer
-    free(buffer);
+        written += count;
+        i += run;
+    }
 
-    // Update size of the file
-    iterator->second.size = max(offset + size, iterator->second.size);
+    // Update the size and the modification time, overwriting in place only changes the timestamps
+    file.contentVersion++;
+    file.mtime = file.ctime = time(NULL);
+    if (offset + size > file.size) {
+        file.size = offset + size;
+        markInodeDirty(file, true);
+    } else {
+        touchInode(file);
+    }
 
-    // Update the access and modified time
-    iterator->second.atime = iterator->second.mtime = time(NULL);
+    int ret = journalAppend();
+    if (ret < 0) {
+        RETURN(ret);
+    }
 
-    writeDmap();
-    writeFat();
-    writeRoot();
+    // Write back the cache if it is full
+    if (this->dataCache.size() > DATA_CACHE_MAX_BLOCKS) {
+        LOG("Writing back the data cache");
+        ret = flushDataCache();
+        if (ret < 0) {
+            RETURN(ret);
+        }
+    }
 
     RETURN(size);
 }
@@ -532,17 +574,28 @@ int MyOnDiskFS::fuseWrite(const char *path, const char *buf, size_t size, off_t
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
     LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Closing %s", path);
 
-    // Check if the file exists
-    if (this->root.find(path) == this->root.end()) {
-        LOG("File does not exists");
-        RETURN(-ENOENT);
+    // Check if the handle is open
+    MyFsHandle *handle = (fileInfo != nullptr) ? this->handles.get(fileInfo->fh) : nullptr;
+    if (handle == nullptr) {
+        LOG("File is not open");
+        RETURN(-EBADF);
     }
 
-    // Remove the file from the open files set
-    this->openFiles.erase(path);
+    MyFsFile &file = this->inodes[handle->ino];
+    this->handles.close(fileInfo->fh);
+
+    // A file that was deleted while it was open is freed with its last handle
+    if (--file.openCount == 0 && file.nlink == 0 && !inUse(file)) {
+        LOG("Freeing the deleted file");
+        deleteFile(file);
+
+        int ret = journalAppend();
+        RETURN(ret);
+    }
 
     RETURN(0);
 }
@@ -557,106 +610,139 @@ int MyOnDiskFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize) {
     LOGM();
-
-    readDmap();
-    readFat();
-    readRoot();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Set the size of %s", path);
 
     // Check if the file exists
-    auto iterator = this->root.find(path);
-    if (iterator == this->root.end()) {
+    MyFsFile *file = findFile(path);
+    if (file == nullptr) {
         LOG("File does not exist");
         RETURN(-EEXIST);
     }
 
-    LOGF("Change the size from %d to %d", iterator->second.size, newSize);
-
-    // Calculate the new block number
-    off_t newBlockNumber = bytesToBlocks(newSize);
-
-    // Check if the file has blocks
-    if(iterator->second.size == 0 && newSize > 0) {
+    int ret = truncateFile(*file, newSize);
+    RETURN(ret);
+}
 
-        LOG("File is empty. Init first block");
+/// @brief Truncate a file.
+///
+/// Set the size of a file to the new size. If the new size is smaller than the old size, spare bytes are removed. If
+/// the new size is larger than the old size, the new bytes may be random. This function is called for files that are
+/// open.
+/// You do not have to check file permissions, but can assume that it is always ok to access the file.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] newSize New size of the file.
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file_info *fileInfo) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
-        // Check if enough blocks available
-        if (this->superBlock.numFreeBlocks < newBlockNumber) {
-            LOG("No space left on device");
-            RETURN(-ENOSPC);
-        }
+    LOGF("--> Set the size of %s", path);
 
-        LOGF("Allocate %d block(s)", newBlockNumber);
-        iterator->second.data = allocateBlocks(-1, newBlockNumber);
-        LOGF("First block is %d", iterator->second.data);
+    // Check if the file exists
+    MyFsHandle *handle;
+    MyFsFile *file = openFile(path, fileInfo, &handle);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-EEXIST);
+    }
 
-    } else if(newSize > 0) {
+    int ret = truncateFile(*file, newSize);
+    RETURN(ret);
+}
 
-        // Calculate the current block number
-        off_t oldBlockNumber = bytesToBlocks(iterator->second.size);
-        LOGF("Change the required blocks from %d to %d", oldBlockNumber, newBlockNumber);
+/// @brief Create and open a file.
+///
+/// Create a new regular file with given name and permissions and open it, like fuseMknod() followed by fuseOpen().
+/// The new entry and inode are logged as one journal operation.
+/// You do not have to check file permissions, but can assume that it is always ok to access the file.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] mode Permissions for file access.
+/// \param [out] fileInfo The handle of the open file is stored in fileInfo->fh.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseCreate(const char *path, mode_t mode, struct fuse_file_info *fileInfo) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
-        // Truncate block number
-        if (newBlockNumber < oldBlockNumber) {
-            LOG("Free blocks to fit the new size");
-            freeBlocks(iterator->second.data, newBlockNumber);
+    LOGF("--> Creating and opening %s", path);
 
-        } else if (newBlockNumber > oldBlockNumber) {
+    MyFsFile *file;
+    int ret = createEntry(path, S_IFREG | (mode & ~S_IFMT), file);
+    if (ret < 0) {
+        RETURN(ret);
+    }
 
-            // Check if enough blocks are available
-            if (this->superBlock.numFreeBlocks < (newBlockNumber - oldBlockNumber)) {
-                LOG("No space left on device");
-                RETURN(-ENOSPC);
-            }
+    openHandle(*file, fileInfo);
+    ret = journalAppend();
+    RETURN(ret);
+}
 
-            LOG("Allocate blocks to fit the new size");
-            allocateBlocks(iterator->second.data, newBlockNumber);
+/// @brief Find data or a hole in a file.
+///
+/// Move to the next position at or behind offset that holds data (SEEK_DATA) or lies in a hole (SEEK_HOLE). The end
+/// of the file counts as a hole. Other values of whence are handled by the kernel.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] offset Position to start at.
+/// \param [in] whence SEEK_DATA or SEEK_HOLE.
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return The new position on success, -ENXIO if there is no data behind offset, -ERRNO on failure.
+off_t MyOnDiskFS::fuseLseek(const char *path, off_t offset, int whence, struct fuse_file_info *fileInfo) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
-        }
+    LOGF("--> Seeking in %s", path);
 
-    } else if(newSize == 0 && iterator->second.size > 0) {
-        LOG("Freeing all allocated files");
-        // Free all blocks that are allocated by this file
-        freeBlocks(iterator->second.data, bytesToBlocks(iterator->second.size));
+    // Check if the file exists
+    MyFsHandle *handle;
+    MyFsFile *file = openFile(path, fileInfo, &handle);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
     }
 
-    // Truncate the file size
-    iterator->second.size = newSize;
-
-    // Update the changed and modified time
-    iterator->second.ctime = iterator->second.mtime = time(NULL);
-
-    writeDmap();
-    writeFat();
-    writeRoot();
+    if (whence != SEEK_DATA && whence != SEEK_HOLE) {
+        LOG("Invalid whence");
+        RETURN(-EINVAL);
+    }
 
-    RETURN(0);
-}
+    // Check if the offset is within the file bounds
+    if (offset < 0 || offset >= (off_t) file->size) {
+        LOG("Offset is not within the file bounds");
+        RETURN(-ENXIO);
+    }
 
-/// @brief Truncate a file.
-///
-/// Set the size of a file to the new size. If the new size is smaller than the old size, spare bytes are removed. If
-/// the new size is larger than the old size, the new bytes may be random. This function is called for files that are
-/// open.
-/// You do not have to check file permissions, but can assume that it is always ok to access the file.
-/// \param [in] path Name of the file, starting with "/".
-/// \param [in] newSize New size of the file.
-/// \param [in] fileInfo Can be ignored in Part 1.
-/// \return 0 on success, -ERRNO on failure.
-int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file_info *fileInfo) {
-    LOGM();
+    // Walk with a temporary position if the caller has no handle
+    MyFsHandle cursor;
+    if (handle == nullptr)
+        handle = &cursor;
+
+    // Skip runs of blocks until one with data or a hole is found, a block that was written counts as data
+    uint32_t fileBlocks = bytesToBlocks(file->size);
+    uint32_t index = offset / BLOCK_SIZE;
+    while (index < fileBlocks) {
+        int first;
+        uint32_t run = mapBlocks(*file, handle, index, fileBlocks - index, first);
+        if ((first >= 0) == (whence == SEEK_DATA))
+            break;
+        index += run;
+    }
 
-    fuseTruncate(path, newSize);
+    if (index >= fileBlocks && whence == SEEK_DATA) {
+        LOG("No data behind the offset");
+        RETURN(-ENXIO);
+    }
 
-    RETURN(0);
+    off_t position = min(max(offset, (off_t) index * BLOCK_SIZE), (off_t) file->size);
+    RETURN(position);
 }
 
 /// @brief Read a directory.
 ///
-/// Read the content of the (only) directory.
+/// Read the content of a directory.
 /// You do not have to check file permissions, but can assume that it is always ok to access the directory.
-/// \param [in] path Path of the directory. Should be "/" in our case.
+/// \param [in] path Path of the directory, starting with "/".
 /// \param [out] buf A buffer for storing the directory entries.
 /// \param [in] filler A function for putting entries into the buffer.
 /// \param [in] offset Can be ignored.
@@ -664,23 +750,25 @@ int MyOnDiskFS::fuseTruncate(const char *path, off_t newSize, struct fuse_file_i
 /// \return 0 on success, -ERRNO on failure.
 int MyOnDiskFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fileInfo) {
     LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
 
     LOGF("--> Read the content of the directory %s", path);
 
-    LOG("Reading the Root");
-    readRoot();
+    // Check if the directory exists
+    MyFsDirectory *directory = findDirectory(path, strlen(path));
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
 
     LOG("Adding '.' and '..'");
-    filler(buf, ".", NULL, 0); // Current Directory
-    filler(buf, "..", NULL, 0); // Parent Directory
-
-    // If the user is trying to show the files of the root directory show the following
-    if(strcmp(path, "/") == 0) {
-        // Add the names of the files in the directory
-        for(const auto& iterator : this->root) {
-            LOGF("Adding '%s'", iterator.first.c_str());
-            filler(buf, (iterator.second.name), NULL, 0);
-        }
+    FILL_DIR(filler, buf, "."); // Current Directory
+    FILL_DIR(filler, buf, ".."); // Parent Directory
+
+    // Add the names of the files in the directory
+    for(const auto *entry : directory->entries.ordered()) {
+        LOGF("Adding '%s'", entry->first.c_str());
+        FILL_DIR(filler, buf, entry->first.c_str());
     }
 
     RETURN(0);
@@ -693,9 +781,9 @@ int MyOnDiskFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler,
 /// \return 0.
 void* MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
     // Open logfile
-    this->logFile= fopen(((MyFsInfo *) fuse_get_context()->private_data)->logFile, "w+");
+    this->logFile= fopen(mountInfo()->logFile, "w+");
     if(this->logFile == NULL) {
-        fprintf(stderr, "ERROR: Cannot open logfile %s\n", ((MyFsInfo *) fuse_get_context()->private_data)->logFile);
+        fprintf(stderr, "ERROR: Cannot open logfile %s\n", mountInfo()->logFile);
     } else {
         // turn of logfile buffering
         setvbuf(this->logFile, NULL, _IOLBF, 0);
@@ -704,21 +792,54 @@ void* MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
 
         LOG("Using on-disk mode");
 
-        LOGF("Container file name: %s", ((MyFsInfo *) fuse_get_context()->private_data)->contFile);
+        configureConnection(conn);
+        if (conn != nullptr)
+            LOGF("Maximum write request: %d bytes", (int) conn->max_write);
+
+        LOGF("Container file name: %s", mountInfo()->contFile);
 
-        int ret = this->blockDevice->open(((MyFsInfo *) fuse_get_context()->private_data)->contFile);
+        setMountOptions(mountInfo());
+        LOGF("Access times: %s%s", this->atimeMode == ATIME_NOATIME ? "noatime"
+                                   : this->atimeMode == ATIME_STRICT ? "strictatime" : "relatime",
+             this->lazytime ? ", lazytime" : "");
+
+        int ret = this->blockDevice->open(mountInfo()->contFile);
 
         if(ret >= 0) {
             LOG("Container file does exist, reading");
-            readSuperblock();
-            readDmap();
-            readFat();
-            readRoot();
+            auto start = chrono::steady_clock::now();
+
+            // A container that cannot be read is not mounted, so nothing is written to it
+            ret = readMetadata();
+            if (ret < 0) {
+                LOGF("ERROR: Reading the metadata failed with error %d, not mounting", ret);
+                this->initFailed = true;
+                this->blockDevice->close();
+                return 0;
+            }
+            LOGF("Replayed %d metadata blocks from the journal", ret);
+
+            // The DMAP can only be trusted after a clean unmount
+            if (this->superBlock.clean) {
+                LOG("File system was unmounted cleanly");
+            } else {
+                LOG("File system was not unmounted cleanly, rebuilding the DMAP from the FAT");
+                rebuildDmap();
+                LOGF("%d blocks are free", this->superBlock.numFreeBlocks);
+            }
+
+            // Mark the file system as in use until it is unmounted
+            this->superBlock.clean = 0;
+            writeSuperblock();
+            ret = this->blockDevice->sync();
+
+            chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+            LOGF("Mounted in %.3f ms", elapsed.count());
 
         } else if(ret == -ENOENT) {
             LOG("Container file does not exist, creating a new one");
 
-            ret = this->blockDevice->create(((MyFsInfo *) fuse_get_context()->private_data)->contFile);
+            ret = this->blockDevice->create(mountInfo()->contFile);
 
             if (ret >= 0) {
 
@@ -726,7 +847,9 @@ void* MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
                 writeSuperblock();
                 writeDmap();
                 writeFat();
-                writeRoot();
+                initRoot();
+                writeInodes();
+                writeJournalHeader();
 
                 LOG("Initialing the last block in the container file");
                 char *buffer = (char*) malloc(BLOCK_SIZE);
@@ -739,9 +862,13 @@ void* MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
 
         if(ret < 0) {
             LOGF("ERROR: Access to container file failed with error %d", ret);
+            this->initFailed = true;
         }
      }
 
+    if (!this->initFailed)
+        startFlusher();
+
     return 0;
 }
 
@@ -751,8 +878,552 @@ void* MyOnDiskFS::fuseInit(struct fuse_conn_info *conn) {
 void MyOnDiskFS::fuseDestroy() {
     LOGM();
 
-    // TODO: [PART 2] Implement this!
+    stopFlusher();
 
+    if (this->initFailed) {
+        LOG("File system was not mounted, leaving the container untouched");
+        return;
+    }
+
+    // Files that were deleted while they were open or known to the kernel are freed now
+    LOGF("Closing %d open files", (int) this->handles.size());
+    this->handles.clear();
+    for (MyFsFile &file : this->inodes) {
+        if (file.nlink == 0 && inUse(file)) {
+            file.openCount = 0;
+            file.lookups = 0;
+            deleteFile(file);
+        }
+    }
+
+    LOG("Writing back the data cache");
+    flushDataCache();
+
+    LOG("Committing the metadata journal");
+    writeLazyInodes(true);
+    journalAppend();
+    journalCommit();
+    journalCheckpoint();
+
+    LOG("Marking the file system as clean");
+    this->superBlock.clean = 1;
+    writeSuperblock();
+    this->blockDevice->sync();
+    this->blockDevice->close();
+}
+
+/// @brief Flush a file.
+///
+/// This function is called whenever a file descriptor of the file is closed. The dirty data of the file is handed to
+/// the container file, so it survives a crash of this process. It is not synced to stable storage, use fsync() for
+/// that.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseFlush(const char *path, struct fuse_file_info *fileInfo) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Flushing %s", path);
+
+    // Check if the file exists
+    MyFsHandle *handle;
+    MyFsFile *file = openFile(path, fileInfo, &handle);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = flushFileData(*file);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    RETURN(0);
+}
+
+/// @brief Synchronize a file.
+///
+/// Write the dirty data blocks of the file and wait until they are on stable storage. If the metadata of the file
+/// changed since the last journal commit, the journal is committed as well. If datasync is set, changes that are not
+/// needed to read the data back (i.e. timestamps, owner and permissions) do not force a commit.
+/// \param [in] path Name of the file, starting with "/".
+/// \param [in] datasync Only synchronize the data and the metadata needed to read it.
+/// \param [in] fileInfo File handle for the file set by fuseOpen.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseFsync(const char *path, int datasync, struct fuse_file_info *fileInfo) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Synchronizing %s", path);
+
+    // Check if the file exists
+    MyFsHandle *handle;
+    MyFsFile *file = openFile(path, fileInfo, &handle);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    // Write the dirty data of the file
+    int ret = flushFileData(*file);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+    int flushed = ret;
+
+    // Timestamps kept in memory are part of the metadata of the file
+    if (!datasync && this->lazyInodes.count(file->ino) > 0) {
+        markInodeDirty(*file);
+        ret = journalAppend();
+        if (ret < 0) {
+            RETURN(ret);
+        }
+    }
+
+    // Check if the file depends on metadata that is not committed yet
+    uint32_t sequence = datasync ? file->dataSequence : file->metaSequence;
+    if (sequence >= this->journalCommitted && !this->journalBuffer.empty()) {
+        LOG("Committing the metadata journal");
+        ret = journalCommit();
+    } else if (flushed > 0 || file->unsyncedData) {
+        LOGF("Syncing %d data blocks", flushed);
+        ret = this->blockDevice->sync();
+    }
+    if (ret >= 0)
+        file->unsyncedData = false;
+
+    RETURN(ret);
+}
+
+/// @brief Synchronize a directory.
+///
+/// Commit the metadata journal, so created, renamed and deleted files are on stable storage.
+/// \param [in] path Path of the directory.
+/// \param [in] datasync Can be ignored.
+/// \param [in] fileInfo Can be ignored.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::fuseFsyncdir(const char *path, int datasync, struct fuse_file_info *fileInfo) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Synchronizing the directory %s", path);
+
+    int ret = journalCommit();
+    RETURN(ret);
+}
+
+/// @brief Look up a directory entry.
+///
+/// The found inode counts as looked up once more, it is kept until the lookup is forgotten.
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the entry.
+/// \param [out] statbuf Metadata of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeLookup(uint64_t parent, const char *name, struct stat *statbuf) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Looking up %s in inode %d", name, (int) parent);
+
+    MyFsDirEntry *entry = lookupEntry(parent, name);
+    if (entry == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    MyFsFile &file = this->inodes[entry->ino];
+    file.lookups++;
+    fillStat(file, statbuf);
+
+    RETURN(0);
+}
+
+/// @brief Forget lookups of an inode.
+///
+/// A deleted file is freed when it is neither looked up nor open any more.
+/// \param [in] ino Inode number of the file.
+/// \param [in] count Number of lookups to forget.
+void MyOnDiskFS::inodeForget(uint64_t ino, uint64_t count) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    if (ino == 0 || ino >= NUM_INODES)
+        return;
+
+    MyFsFile &file = this->inodes[ino];
+    file.lookups -= min(count, file.lookups);
+
+    if (file.nlink == 0 && file.lookups == 0 && file.openCount == 0 && file.ino != ROOT_INODE && file.mode != 0) {
+        LOGF("Freeing the deleted inode %d", (int) ino);
+        deleteFile(file);
+        journalAppend();
+    }
+}
+
+/// @brief Get the metadata of an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [out] statbuf Metadata of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeGetattr(uint64_t ino, struct stat *statbuf) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    MyFsFile *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    fillStat(*file, statbuf);
+    RETURN(0);
+}
+
+/// @brief Change the permissions of an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] mode New mode of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeChmod(uint64_t ino, mode_t mode) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    MyFsFile *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = changeMode(*file, mode);
+    RETURN(ret);
+}
+
+/// @brief Change the owner of an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] uid New user id, -1 keeps the current one.
+/// \param [in] gid New group id, -1 keeps the current one.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeChown(uint64_t ino, uid_t uid, gid_t gid) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    MyFsFile *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = changeOwner(*file, uid, gid);
+    RETURN(ret);
+}
+
+/// @brief Truncate an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] newSize New size of the file.
+/// \param [in] fileInfo File handle if the file is truncated through an open file, otherwise nullptr.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeTruncate(uint64_t ino, off_t newSize, struct fuse_file_info *fileInfo) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    MyFsFile *file = findInode(ino);
+    if (file == nullptr || file->directory) {
+        LOG("File does not exist or is a directory");
+        RETURN(file == nullptr ? -ENOENT : -EISDIR);
+    }
+
+    int ret = truncateFile(*file, newSize);
+    RETURN(ret);
+}
+
+/// @brief Change the access and modification time of an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] times New access and modification time, UTIME_NOW and UTIME_OMIT in tv_nsec are supported.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeUtimens(uint64_t ino, const struct timespec times[2]) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    MyFsFile *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = changeTimes(*file, times);
+    RETURN(ret);
+}
+
+/// @brief Create a file in a directory.
+///
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the new file.
+/// \param [in] mode Type and permissions of the file.
+/// \param [out] statbuf Metadata of the new file, it counts as a lookup.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeMknod(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Creating %s in inode %d", name, (int) parent);
+
+    MyFsDirectory *directory = findDirectory(parent);
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    MyFsFile *file;
+    int ret = createEntry(*directory, name, mode, file);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    file->lookups++;
+    fillStat(*file, statbuf);
+
+    ret = journalAppend();
+    RETURN(ret);
+}
+
+/// @brief Create a directory in a directory.
+///
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the new directory.
+/// \param [in] mode Permissions of the directory.
+/// \param [out] statbuf Metadata of the new directory, it counts as a lookup.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeMkdir(uint64_t parent, const char *name, mode_t mode, struct stat *statbuf) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    int ret = inodeMknod(parent, name, S_IFDIR | (mode & ~S_IFMT), statbuf);
+    RETURN(ret);
+}
+
+/// @brief Delete a file from a directory.
+///
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the file.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeUnlink(uint64_t parent, const char *name) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Deleting %s in inode %d", name, (int) parent);
+
+    MyFsDirEntry *entry = lookupEntry(parent, name);
+    if (entry == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = unlinkEntry(*entry, nullptr);
+    RETURN(ret);
+}
+
+/// @brief Delete an empty directory from a directory.
+///
+/// \param [in] parent Inode number of the parent directory.
+/// \param [in] name Name of the directory.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeRmdir(uint64_t parent, const char *name) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Deleting the directory %s in inode %d", name, (int) parent);
+
+    MyFsDirEntry *entry = lookupEntry(parent, name);
+    if (entry == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = removeDirectory(*entry, nullptr);
+    RETURN(ret);
+}
+
+/// @brief Move a directory entry.
+///
+/// Like fuseRename(), an existing entry with the new name is not replaced.
+/// \param [in] parent Inode number of the directory of the entry.
+/// \param [in] name Name of the entry.
+/// \param [in] newParent Inode number of the new directory.
+/// \param [in] newName New name of the entry.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeRename(uint64_t parent, const char *name, uint64_t newParent, const char *newName) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Renaming %s in inode %d into %s in inode %d", name, (int) parent, newName, (int) newParent);
+
+    MyFsDirEntry *entry = lookupEntry(parent, name);
+    if (entry == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    MyFsDirectory *directory = findDirectory(newParent);
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = moveEntry(*entry, nullptr, *directory, newName);
+    RETURN(ret);
+}
+
+/// @brief Create a hard link to an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [in] newParent Inode number of the directory of the new entry.
+/// \param [in] newName Name of the new entry.
+/// \param [out] statbuf Metadata of the file, it counts as a lookup.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeLink(uint64_t ino, uint64_t newParent, const char *newName, struct stat *statbuf) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    MyFsFile *file = findInode(ino);
+    MyFsDirectory *directory = findDirectory(newParent);
+    if (file == nullptr || file->nlink == 0 || directory == nullptr) {
+        LOG("File or directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    int ret = addLink(*file, *directory, newName);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    file->lookups++;
+    fillStat(*file, statbuf);
+
+    RETURN(0);
+}
+
+/// @brief Open an inode.
+///
+/// \param [in] ino Inode number of the file.
+/// \param [out] fileInfo The handle of the open file is stored in fileInfo->fh.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeOpen(uint64_t ino, struct fuse_file_info *fileInfo) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    MyFsFile *file = findInode(ino);
+    if (file == nullptr) {
+        LOG("File does not exist");
+        RETURN(-ENOENT);
+    }
+
+    openHandle(*file, fileInfo);
+    RETURN(0);
+}
+
+/// @brief Create and open a file in a directory.
+///
+/// \param [in] parent Inode number of the directory.
+/// \param [in] name Name of the new file.
+/// \param [in] mode Permissions of the file.
+/// \param [out] fileInfo The handle of the open file is stored in fileInfo->fh.
+/// \param [out] statbuf Metadata of the new file, it counts as a lookup.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeCreate(uint64_t parent, const char *name, mode_t mode, struct fuse_file_info *fileInfo,
+                            struct stat *statbuf) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    LOGF("--> Creating and opening %s in inode %d", name, (int) parent);
+
+    MyFsDirectory *directory = findDirectory(parent);
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    MyFsFile *file;
+    int ret = createEntry(*directory, name, S_IFREG | (mode & ~S_IFMT), file);
+    if (ret < 0) {
+        RETURN(ret);
+    }
+
+    openHandle(*file, fileInfo);
+    file->lookups++;
+    fillStat(*file, statbuf);
+
+    ret = journalAppend();
+    RETURN(ret);
+}
+
+/// @brief Read a directory by its inode.
+///
+/// The listing starts with "." and "..", followed by the entries in the order of their names. The parent of a
+/// directory is not known, ".." carries the inode number of the directory itself.
+/// \param [in] ino Inode number of the directory.
+/// \param [in] buf Buffer passed to the filler.
+/// \param [in] filler Function that adds an entry to the buffer.
+/// \param [in] offset Offset of the first entry to add, as passed to the filler with the entry before it.
+/// \return 0 on success, -ERRNO on failure.
+int MyOnDiskFS::inodeReaddir(uint64_t ino, void *buf, MyFsFiller filler, off_t offset) {
+    LOGM();
+    lock_guard<recursive_mutex> request(this->requestLock);
+
+    MyFsDirectory *directory = findDirectory(ino);
+    if (directory == nullptr) {
+        LOG("Directory does not exist");
+        RETURN(-ENOENT);
+    }
+
+    struct stat statbuf;
+    memset(&statbuf, 0, sizeof(statbuf));
+    statbuf.st_ino = ino;
+    statbuf.st_mode = S_IFDIR;
+
+    const auto &entries = directory->entries.ordered();
+    for (off_t index = offset; index < (off_t) entries.size() + 2; index++) {
+        const char *name = (index == 0) ? "." : "..";
+        if (index >= 2) {
+            const MyFsFile &file = this->inodes[entries[index - 2]->second.ino];
+            name = entries[index - 2]->first.c_str();
+            statbuf.st_ino = file.ino;
+            statbuf.st_mode = file.mode & S_IFMT;
+        }
+
+        // Stop when the buffer is full
+        if (filler(buf, name, &statbuf, index + 1) != 0)
+            break;
+    }
+
+    RETURN(0);
+}
+
+/// @brief Check whether a file is a container of this file system.
+///
+/// \param [in] path Name of the file.
+/// \return True if the file starts with a superblock of this file system.
+bool MyOnDiskFS::isContainer(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    SuperBlock superBlock;
+    ssize_t count = pread(fd, &superBlock, sizeof(SuperBlock), SUPERBLOCK_OFFSET * BLOCK_SIZE);
+    close(fd);
+    return count == (ssize_t) sizeof(SuperBlock) && superBlock.magic == SUPERBLOCK_MAGIC;
+}
+
+/// @brief Do not commit journal groups in the background.
+///
+/// Requests still commit a group whose deadline passed when they append to it. The in-memory file system calls it
+/// once before it initializes its spill container, which does not have to survive a crash because it is replaced at
+/// the next mount, so it needs no thread of its own.
+void MyOnDiskFS::disableFlusher() {
+    this->flushEnabled = false;
 }
 
 // TODO: [PART 2] You may add your own additional methods here!
@@ -101,7 +101,10 @@ int wrap_getxattr(const char *path, const char *name, char *value, size_t size)
 }
 #endif
 void* wrap_init(struct fuse_conn_info *conn) {
-    return MyFS::Instance()->fuseInit(conn);
+    void *data = MyFS::Instance()->fuseInit(conn);
+    if (MyFS::Instance()->mountFailed())
+        fuse_exit(fuse_get_context()->fuse);
+    return data;
 }
 int wrap_listxattr(const char *path, char *list, size_t size) {
     return MyFS::Instance()->fuseListxattr(path, list, size);
@@ -0,0 +1,274 @@
+//
+//  benchmark.cpp
+//  testing
+//
+//  Measures the throughput of both file systems without FUSE, by calling their methods the way the kernel does.
+//  Usage: benchmark [container file]
+//
+
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "myfs.h"
+#include "myinmemoryfs.h"
+#include "myondiskfs.h"
+#include "myfs-info.h"
+
+using namespace std;
+
+#define BENCHMARK_FILE_SIZE (16 * 1024 * 1024)     // Bytes written and read per request size, half of the container
+#define BENCHMARK_SMALL_FILES 10000                 // Files created and deleted per round of the small file benchmark
+#define BENCHMARK_SMALL_ROUNDS 10
+#define BENCHMARK_THREAD_FILE_SIZE (4 * 1024 * 1024)   // Bytes written and read by each thread per round
+#define BENCHMARK_THREAD_REQUEST 65536
+#define BENCHMARK_THREAD_ROUNDS 8
+#define BENCHMARK_CODEC_BYTES (64 * 1024 * 1024)     // Bytes compressed and decompressed page by page
+
+static double megabytesPerSecond(size_t bytes, chrono::steady_clock::time_point start) {
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    return bytes / elapsed.count() / (1024 * 1024);
+}
+
+/// @brief Write and read a file sequentially with requests of different sizes.
+///
+/// \param [in] fs Mounted file system.
+/// \param [in] name Name of the file system in the output.
+/// \return 0 on success, -ERRNO on failure.
+static int benchmarkRequestSizes(MyFS *fs, const char *name) {
+    static const size_t requestSizes[] = {4096, 16384, 65536, 131072, 1048576, 4194304};
+
+    vector<char> data(BENCHMARK_FILE_SIZE);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (char) (i * 7 + i / 4096);
+    vector<char> buffer(requestSizes[sizeof(requestSizes) / sizeof(requestSizes[0]) - 1]);
+
+    printf("%-10s %12s %12s %12s\n", name, "request", "write MB/s", "read MB/s");
+    for (size_t requestSize : requestSizes) {
+        struct fuse_file_info fileInfo;
+        memset(&fileInfo, 0, sizeof(fileInfo));
+        fileInfo.flags = O_RDWR;
+
+        int ret = fs->fuseCreate("/benchmark", S_IFREG | 0644, &fileInfo);
+        if (ret < 0)
+            return ret;
+
+        // Writes include syncing the file, so the on-disk file system cannot keep the data in its cache
+        auto start = chrono::steady_clock::now();
+        for (size_t offset = 0; offset < data.size() && ret >= 0; offset += requestSize)
+            ret = fs->fuseWrite("/benchmark", data.data() + offset, requestSize, offset, &fileInfo);
+        if (ret >= 0)
+            ret = fs->fuseFsync("/benchmark", 1, &fileInfo);
+        double writeSpeed = megabytesPerSecond(data.size(), start);
+        fs->fuseRelease("/benchmark", &fileInfo);
+        if (ret < 0)
+            return ret;
+
+        ret = fs->fuseOpen("/benchmark", &fileInfo);
+        start = chrono::steady_clock::now();
+        for (size_t offset = 0; offset < data.size() && ret >= 0; offset += requestSize) {
+            ret = fs->fuseRead("/benchmark", buffer.data(), requestSize, offset, &fileInfo);
+            if (ret >= 0 && memcmp(buffer.data(), data.data() + offset, requestSize) != 0)
+                ret = -EIO;
+        }
+        double readSpeed = megabytesPerSecond(data.size(), start);
+        fs->fuseRelease("/benchmark", &fileInfo);
+        if (ret < 0)
+            return ret;
+
+        printf("%-10s %12zu %12.1f %12.1f\n", "", requestSize, writeSpeed, readSpeed);
+
+        ret = fs->fuseUnlink("/benchmark");
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+/// @brief Create, write and delete many small files, the way build trees and mail spools churn through them.
+///
+/// \param [in] fs Mounted file system.
+/// \param [in] name Name of the file system in the output.
+/// \return 0 on success, -ERRNO on failure.
+static int benchmarkSmallFiles(MyFS *fs, const char *name) {
+    char data[1000];
+    memset(data, 'x', sizeof(data));
+
+    auto start = chrono::steady_clock::now();
+    int ret = 0;
+    for (int round = 0; round < BENCHMARK_SMALL_ROUNDS && ret >= 0; round++) {
+        for (int i = 0; i < BENCHMARK_SMALL_FILES && ret >= 0; i++) {
+            char path[32];
+            snprintf(path, sizeof(path), "/small%d", i);
+            ret = fs->fuseMknod(path, S_IFREG | 0644, 0);
+            if (ret >= 0)
+                ret = fs->fuseWrite(path, data, sizeof(data), 0, nullptr);
+        }
+        for (int i = 0; i < BENCHMARK_SMALL_FILES && ret >= 0; i++) {
+            char path[32];
+            snprintf(path, sizeof(path), "/small%d", i);
+            ret = fs->fuseUnlink(path);
+        }
+    }
+    if (ret < 0)
+        return ret;
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    printf("%-10s %12s %12.0f files/s\n", name, "small files",
+           BENCHMARK_SMALL_FILES * BENCHMARK_SMALL_ROUNDS / elapsed.count());
+
+    return 0;
+}
+
+/// @brief Write and read one file per thread with a growing number of threads.
+///
+/// Threads work on different files, the throughput of all of them grows with the number of threads as far as the file
+/// system lets their requests run in parallel.
+/// \param [in] fs Mounted file system, it must be thread-safe.
+/// \param [in] name Name of the file system in the output.
+/// \return 0 on success, -ERRNO on failure.
+static int benchmarkThreads(MyFS *fs, const char *name) {
+    static const int threadCounts[] = {1, 2, 4, 8};
+    static const int maxThreads = threadCounts[sizeof(threadCounts) / sizeof(threadCounts[0]) - 1];
+
+    vector<char> data(BENCHMARK_THREAD_FILE_SIZE);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (char) (i * 13 + i / 4096);
+
+    vector<struct fuse_file_info> fileInfos(maxThreads);
+    int ret = 0;
+    for (int i = 0; i < maxThreads && ret >= 0; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "/thread%d", i);
+        memset(&fileInfos[i], 0, sizeof(fileInfos[i]));
+        fileInfos[i].flags = O_RDWR;
+        ret = fs->fuseCreate(path, S_IFREG | 0644, &fileInfos[i]);
+    }
+
+    printf("%-10s %12s %12s\n", name, "threads", "MB/s");
+    for (int threads : threadCounts) {
+        if (ret < 0)
+            break;
+
+        vector<int> results(threads, 0);
+        vector<thread> workers;
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < threads; i++) {
+            workers.emplace_back([fs, i, &data, &fileInfos, &results]() {
+                char path[32];
+                snprintf(path, sizeof(path), "/thread%d", i);
+                vector<char> buffer(BENCHMARK_THREAD_REQUEST);
+                int result = 0;
+                for (int round = 0; round < BENCHMARK_THREAD_ROUNDS && result >= 0; round++) {
+                    for (size_t offset = 0; offset < data.size() && result >= 0; offset += buffer.size())
+                        result = fs->fuseWrite(path, data.data() + offset, buffer.size(), offset, &fileInfos[i]);
+                    for (size_t offset = 0; offset < data.size() && result >= 0; offset += buffer.size()) {
+                        result = fs->fuseRead(path, buffer.data(), buffer.size(), offset, &fileInfos[i]);
+                        if (result >= 0 && memcmp(buffer.data(), data.data() + offset, buffer.size()) != 0)
+                            result = -EIO;
+                    }
+                }
+                results[i] = result;
+            });
+        }
+        for (thread &worker : workers)
+            worker.join();
+        for (int result : results)
+            ret = min(ret, result);
+
+        // Every round writes and reads the file once
+        double speed = megabytesPerSecond((size_t) threads * BENCHMARK_THREAD_ROUNDS * 2 * data.size(), start);
+        if (ret >= 0)
+            printf("%-10s %12d %12.1f\n", "", threads, speed);
+    }
+
+    for (int i = 0; i < maxThreads; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "/thread%d", i);
+        fs->fuseRelease(path, &fileInfos[i]);
+        fs->fuseUnlink(path);
+    }
+    return ret;
+}
+
+/// @brief Compress and decompress pages of text with the codec of cold in-memory files.
+///
+/// \return 0 on success, -EIO if a page does not come back as it was.
+static int benchmarkCodec() {
+    string text;
+    for (int line = 0; text.size() < PagedContent::PAGE_BYTES * 16; line++)
+        text += "line " + to_string(line) + " of a log file, " + to_string(line * 7919 % 1000) + " ms\n";
+
+    vector<char> packed(PagedContent::PAGE_BYTES), page(PagedContent::PAGE_BYTES);
+    vector<size_t> lengths(16);
+    size_t stored = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t done = 0; done < BENCHMARK_CODEC_BYTES; done += PagedContent::PAGE_BYTES) {
+        size_t index = done / PagedContent::PAGE_BYTES % lengths.size();
+        lengths[index] = PageCodec::compress(&text[index * PagedContent::PAGE_BYTES], PagedContent::PAGE_BYTES,
+                                             packed.data(), packed.size());
+        stored += lengths[index];
+    }
+    double compressSpeed = megabytesPerSecond(BENCHMARK_CODEC_BYTES, start);
+
+    // The last page is decompressed over and over, which is what a read of a cold file does
+    int ret = 0;
+    start = chrono::steady_clock::now();
+    for (size_t done = 0; done < BENCHMARK_CODEC_BYTES && ret >= 0; done += PagedContent::PAGE_BYTES)
+        ret = (int) PageCodec::decompress(packed.data(), lengths.back(), page.data(), page.size());
+    double decompressSpeed = megabytesPerSecond(BENCHMARK_CODEC_BYTES, start);
+    const char *last = &text[(lengths.size() - 1) * PagedContent::PAGE_BYTES];
+    if (ret != PagedContent::PAGE_BYTES || memcmp(page.data(), last, page.size()) != 0)
+        return -EIO;
+
+    printf("%-10s %12s %12s %12s\n", "codec", "ratio", "compress", "decompress");
+    printf("%-10s %12.2f %12.1f %12.1f\n", "", (double) BENCHMARK_CODEC_BYTES / stored, compressSpeed, decompressSpeed);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    char containerFile[PATH_MAX];
+    char logFile[] = "/dev/null";
+    snprintf(containerFile, sizeof(containerFile), "%s", argc > 1 ? argv[1] : "/tmp/myfs-benchmark.bin");
+
+    for (int onDisk = 0; onDisk <= 1; onDisk++) {
+        MyFsInfo info;
+        memset(&info, 0, sizeof(info));
+        info.contFile = onDisk ? containerFile : nullptr;
+        info.logFile = logFile;
+        unlink(containerFile);
+
+        MyFS *fs = onDisk ? (MyFS *) new MyOnDiskFS() : (MyFS *) new MyInMemoryFS();
+        fs->setMountInfo(&info);
+        fs->fuseInit(nullptr);
+
+        int ret = benchmarkRequestSizes(fs, onDisk ? "on-disk" : "in-memory");
+        if (ret >= 0)
+            ret = benchmarkSmallFiles(fs, onDisk ? "on-disk" : "in-memory");
+        if (ret >= 0 && !onDisk)
+            ret = benchmarkThreads(fs, "in-memory");
+        if (ret >= 0 && !onDisk)
+            ret = benchmarkCodec();
+        if (ret >= 0 && !onDisk) {
+            ArenaUsage usage = ((MyInMemoryFS *) fs)->memoryUsage();
+            printf("%-10s %12s %12zu of %zu bytes in use\n", "", "memory", usage.bytesUsed, usage.bytesReserved);
+        }
+        if (ret < 0)
+            fprintf(stderr, "Benchmark failed with error %d\n", ret);
+
+        fs->fuseDestroy();
+        delete fs;
+        if (ret < 0)
+            return 1;
+    }
+
+    unlink(containerFile);
+    return 0;
+}
@@ -8,6 +8,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <errno.h>
 
 #include <dirent.h>
 
@@ -19,7 +20,8 @@
 #define SMALL_SIZE 1024
 #define LARGE_SIZE 20*1024*1024
 #define OVERFLOW_SIZE ((1 << 16) + 1) * 512
-#define MAX_SIZE (1 << 16) * 512
+#define MAX_SIZE ((1 << 16) - 1) * 512   // One block of the data area holds the root directory
+#define MANY_FILES 1000
 
 #define FBLOCKS 512*4
 #define FOBLOCKS 512+(512/2)
@@ -497,6 +499,71 @@ TEST_CASE("T-1.10", "[Part_1]") {
     REQUIRE(unlink(FILENAME) >= 0);
 }
 
+TEST_CASE("T-1.11", "[Part_1]") {
+    printf("Testcase 1.11: Create, move & remove directories\n");
+    int fd;
+    struct stat s;
+
+    // remove directories (just to be sure)
+    unlink("dir/sub/" FILENAME);
+    rmdir("dir/sub");
+    rmdir("moved");
+    rmdir("dir");
+
+    // Create nested directories with a file
+    REQUIRE(mkdir("dir", 0755) == 0);
+    REQUIRE(mkdir("dir/sub", 0755) == 0);
+    REQUIRE(stat("dir/sub", &s) == 0);
+    REQUIRE(S_ISDIR(s.st_mode));
+
+    fd = open("dir/sub/" FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+    REQUIRE(close(fd) >= 0);
+
+    // Only empty directories can be removed
+    REQUIRE(rmdir("dir") < 0);
+    REQUIRE(errno == ENOTEMPTY);
+
+    // Move the subdirectory with its file
+    REQUIRE(rename("dir/sub", "moved") == 0);
+    REQUIRE(stat("dir/sub/" FILENAME, &s) < 0);
+    REQUIRE(stat("moved/" FILENAME, &s) == 0);
+
+    // Remove everything
+    REQUIRE(unlink("moved/" FILENAME) == 0);
+    REQUIRE(rmdir("moved") == 0);
+    REQUIRE(rmdir("dir") == 0);
+    REQUIRE(stat("dir", &s) < 0);
+}
+
+TEST_CASE("T-1.12", "[Part_1]") {
+    printf("Testcase 1.12: Rename & remove an open file\n");
+    const char *buf1= "abcdefghijklmnopqrstuvwxyz";
+    char buf2[27];
+    int fd;
+    struct stat s;
+
+    unlink(FILENAME);
+    unlink(FILENAME "-moved");
+
+    fd = open(FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, buf1, 13) == 13);
+
+    // The open file keeps working under its new name
+    REQUIRE(rename(FILENAME, FILENAME "-moved") == 0);
+    REQUIRE(write(fd, buf1 + 13, 13) == 13);
+    REQUIRE(stat(FILENAME "-moved", &s) == 0);
+    REQUIRE(s.st_size == 26);
+
+    // ... and after its last name was removed
+    REQUIRE(unlink(FILENAME "-moved") == 0);
+    REQUIRE(stat(FILENAME "-moved", &s) < 0);
+    REQUIRE(pread(fd, buf2, 26, 0) == 26);
+    REQUIRE(memcmp(buf1, buf2, 26) == 0);
+    REQUIRE(close(fd) >= 0);
+}
+
 TEST_CASE("T-2.1", "[Part_2]") {
     printf("Testcase 2.1: Readdir function returns '.' and '..'\n");
 
@@ -854,4 +921,176 @@ TEST_CASE("T-2.7", "[Part_2]") {
 
     // remove file
     REQUIRE(unlink(FILENAME) >= 0);
-}
\ No newline at end of file
+}
+TEST_CASE("T-2.8", "[Part_2]") {
+    printf("Testcase 2.8: Synchronize a file\n");
+    int fd;
+
+    // remove file (just to be sure)
+    unlink(FILENAME);
+
+    // set up read & write buffer
+    char* r= new char[SMALL_SIZE];
+    memset(r, 0, SMALL_SIZE);
+    char* w= new char[SMALL_SIZE];
+    memset(w, 0, SMALL_SIZE);
+    gen_random(w, SMALL_SIZE);
+
+    // Create file
+    fd = open(FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+
+    // Write to the file and synchronize data and metadata
+    REQUIRE(write(fd, w, SMALL_SIZE) == SMALL_SIZE);
+    REQUIRE(fsync(fd) == 0);
+
+    // Overwrite a part of the file and synchronize the data only
+    REQUIRE(lseek(fd, 0, SEEK_SET) == 0);
+    REQUIRE(write(fd, w + SMALL_SIZE/2, SMALL_SIZE/2) == SMALL_SIZE/2);
+    memcpy(w, w + SMALL_SIZE/2, SMALL_SIZE/2);
+    REQUIRE(fdatasync(fd) == 0);
+
+    // Close file
+    REQUIRE(close(fd) >= 0);
+
+    // Open file again
+    fd = open(FILENAME, O_EXCL | O_RDWR, 0666);
+    REQUIRE(fd >= 0);
+
+    // Read from the file
+    REQUIRE(read(fd, r, SMALL_SIZE) == SMALL_SIZE);
+    REQUIRE(memcmp(r, w, SMALL_SIZE) == 0);
+
+    // Close file
+    REQUIRE(close(fd) >= 0);
+
+    // remove file
+    REQUIRE(unlink(FILENAME) >= 0);
+
+    delete [] r;
+    delete [] w;
+}
+TEST_CASE("T-2.9", "[Part_2]") {
+    printf("Testcase 2.9: Create & remove many files\n");
+    int fd;
+    char name[32];
+
+    // Create more files than fit into a single directory block
+    for (int i = 0; i < MANY_FILES; i++) {
+        sprintf(name, "%s-%d", FILENAME, i);
+        unlink(name);
+        fd = open(name, O_EXCL | O_RDWR | O_CREAT, 0666);
+        REQUIRE(fd >= 0);
+        REQUIRE(close(fd) >= 0);
+    }
+
+    // Remove every second file
+    for (int i = 0; i < MANY_FILES; i += 2) {
+        sprintf(name, "%s-%d", FILENAME, i);
+        REQUIRE(unlink(name) >= 0);
+    }
+
+    // Count the remaining files
+    DIR *dir = opendir(".");
+    REQUIRE(dir != NULL);
+    int count = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, FILENAME "-", strlen(FILENAME) + 1) == 0)
+            count++;
+    }
+    REQUIRE(closedir(dir) == 0);
+    REQUIRE(count == MANY_FILES / 2);
+
+    // Remove the remaining files
+    for (int i = 1; i < MANY_FILES; i += 2) {
+        sprintf(name, "%s-%d", FILENAME, i);
+        REQUIRE(unlink(name) >= 0);
+    }
+}
+
+TEST_CASE("T-2.10", "[Part_2]") {
+    printf("Testcase 2.10: Hard links\n");
+    const char *buf1= "abcdefghijklmnopqrstuvwxyz";
+    const char *buf2= "ABC";
+    char buf3[27];
+    int fd;
+    struct stat s1, s2;
+
+    unlink(FILENAME);
+    unlink(FILENAME "-link");
+
+    // Create a file and a second name for it
+    fd = open(FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, buf1, 26) == 26);
+    REQUIRE(close(fd) >= 0);
+
+    REQUIRE(link(FILENAME, FILENAME "-link") == 0);
+    REQUIRE(link(FILENAME, FILENAME "-link") < 0);
+    REQUIRE(errno == EEXIST);
+
+    // Both names share the inode
+    REQUIRE(stat(FILENAME, &s1) == 0);
+    REQUIRE(stat(FILENAME "-link", &s2) == 0);
+    REQUIRE(s1.st_nlink == 2);
+    REQUIRE(s2.st_nlink == 2);
+    REQUIRE(s2.st_size == 26);
+
+    // Changes through one name are visible through the other
+    fd = open(FILENAME "-link", O_RDWR);
+    REQUIRE(fd >= 0);
+    REQUIRE(write(fd, buf2, 3) == 3);
+    REQUIRE(close(fd) >= 0);
+
+    // The content survives removing the first name
+    REQUIRE(unlink(FILENAME) >= 0);
+    REQUIRE(stat(FILENAME "-link", &s2) == 0);
+    REQUIRE(s2.st_nlink == 1);
+
+    fd = open(FILENAME "-link", O_RDONLY);
+    REQUIRE(fd >= 0);
+    REQUIRE(read(fd, buf3, 26) == 26);
+    REQUIRE(memcmp(buf3, "ABCdefghijklmnopqrstuvwxyz", 26) == 0);
+    REQUIRE(close(fd) >= 0);
+
+    REQUIRE(unlink(FILENAME "-link") >= 0);
+}
+
+TEST_CASE("T-2.11", "[Part_2]") {
+    printf("Testcase 2.11: Sparse files\n");
+    char* w = new char[SMALL_SIZE];
+    char* r = new char[3 * SMALL_SIZE];
+    int fd;
+    struct stat s;
+
+    unlink(FILENAME);
+    gen_random(w, SMALL_SIZE);
+
+    // Growing a file does not allocate space for it
+    fd = open(FILENAME, O_EXCL | O_RDWR | O_CREAT, 0666);
+    REQUIRE(fd >= 0);
+    REQUIRE(ftruncate(fd, LARGE_SIZE) == 0);
+    REQUIRE(fstat(fd, &s) == 0);
+    REQUIRE(s.st_size == LARGE_SIZE);
+    REQUIRE(s.st_blocks == 0);
+
+    // Only the written range gets space, the hole around it reads as zeros
+    REQUIRE(pwrite(fd, w, SMALL_SIZE, LARGE_SIZE / 2) == SMALL_SIZE);
+    REQUIRE(fstat(fd, &s) == 0);
+    REQUIRE(s.st_blocks > 0);
+    REQUIRE(s.st_blocks * 512 < 4 * SMALL_SIZE + 8192);
+
+    REQUIRE(pread(fd, r, 3 * SMALL_SIZE, LARGE_SIZE / 2 - SMALL_SIZE) == 3 * SMALL_SIZE);
+    for (int i = 0; i < SMALL_SIZE; i++) {
+        REQUIRE(r[i] == 0);
+        REQUIRE(r[2 * SMALL_SIZE + i] == 0);
+    }
+    REQUIRE(memcmp(r + SMALL_SIZE, w, SMALL_SIZE) == 0);
+    REQUIRE(close(fd) >= 0);
+
+    REQUIRE(unlink(FILENAME) >= 0);
+
+    delete[] w;
+    delete[] r;
+}
@@ -82,6 +82,55 @@ TEST_CASE( "BD_OPEN_NON-EXISTING_FILE", "[blockdevice]" ) {
     REQUIRE(bd.open(BD_PATH) < 0);
 }
 
+TEST_CASE( "BD_WRITE_READ_BLOCK_RANGES", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd(BLOCK_SIZE);
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    SECTION("range write is visible to single block reads") {
+        REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+        REQUIRE(bd.sync() == 0);
+
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            REQUIRE(bd.read(b, r + b*BD_BLOCK_SIZE) == 0);
+        }
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+    }
+
+    SECTION("range read returns single block writes") {
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            REQUIRE(bd.write(b, w + b*BD_BLOCK_SIZE) == 0);
+        }
+
+        REQUIRE(bd.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+    }
+
+    SECTION("range read beyond the end of the container returns zeros") {
+        REQUIRE(bd.writeBlocks(0, 1, w) == 0);
+
+        REQUIRE(bd.readBlocks(0, 4, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE) == 0);
+        for(int i= BD_BLOCK_SIZE; i < 4*BD_BLOCK_SIZE; i++) {
+            REQUIRE(r[i] == 0);
+        }
+    }
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
 // ***
 // *** Helper functions
 // ***
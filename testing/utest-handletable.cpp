@@ -0,0 +1,72 @@
+//
+//  utest-handletable.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <string>
+#include <vector>
+
+#include "handletable.h"
+
+#define NUM_TESTHANDLES 100
+
+TEST_CASE( "HT_OPEN_GET_CLOSE", "[handletable]" ) {
+
+    HandleTable<string> table;
+
+    REQUIRE(table.empty());
+    REQUIRE(table.get(0) == nullptr);
+    REQUIRE(table.get(1) == nullptr);
+
+    SECTION("Open and find handles") {
+        vector<uint64_t> ids;
+        for (int i = 0; i < NUM_TESTHANDLES; i++) {
+            uint64_t fh = table.open("file" + to_string(i));
+            REQUIRE(fh != 0);
+            ids.push_back(fh);
+        }
+        REQUIRE(table.size() == NUM_TESTHANDLES);
+
+        for (int i = 0; i < NUM_TESTHANDLES; i++) {
+            REQUIRE(table.get(ids[i]) != nullptr);
+            REQUIRE(*table.get(ids[i]) == "file" + to_string(i));
+        }
+        REQUIRE(table.get(0) == nullptr);
+        REQUIRE(table.get(NUM_TESTHANDLES + 1) == nullptr);
+    }
+
+    SECTION("Closed handles are reused") {
+        uint64_t first = table.open("first");
+        uint64_t second = table.open("second");
+
+        REQUIRE(table.close(first));
+        REQUIRE_FALSE(table.close(first));
+        REQUIRE(table.get(first) == nullptr);
+        REQUIRE(table.size() == 1);
+
+        uint64_t third = table.open("third");
+        REQUIRE(third == first);
+        REQUIRE(*table.get(third) == "third");
+        REQUIRE(*table.get(second) == "second");
+    }
+
+    SECTION("Visit and clear all handles") {
+        for (int i = 0; i < NUM_TESTHANDLES; i++)
+            table.open(to_string(i));
+        for (int i = 1; i <= NUM_TESTHANDLES; i += 2)
+            table.close(i);
+
+        size_t count = 0;
+        table.forEach([&count](uint64_t fh, string &handle) {
+            REQUIRE(handle == to_string(fh - 1));
+            count++;
+        });
+        REQUIRE(count == NUM_TESTHANDLES / 2);
+
+        table.clear();
+        REQUIRE(table.empty());
+        REQUIRE(table.get(2) == nullptr);
+    }
+}
@@ -0,0 +1,114 @@
+//
+//  utest-memoryarena.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "memoryarena.h"
+
+#define NUM_TESTOBJECTS 10000
+
+TEST_CASE( "SA_CREATE_DESTROY", "[memoryarena]" ) {
+
+    SlabAllocator<string> slab;
+
+    REQUIRE(slab.size() == 0);
+    REQUIRE(slab.usage().bytesReserved == 0);
+
+    SECTION("Objects are constructed and keep their values") {
+        vector<string *> objects;
+        for (int i = 0; i < NUM_TESTOBJECTS; i++)
+            objects.push_back(slab.create("object" + to_string(i)));
+        REQUIRE(slab.size() == NUM_TESTOBJECTS);
+
+        for (int i = 0; i < NUM_TESTOBJECTS; i++)
+            REQUIRE(*objects[i] == "object" + to_string(i));
+
+        ArenaUsage usage = slab.usage();
+        REQUIRE(usage.bytesUsed >= NUM_TESTOBJECTS * sizeof(string));
+        REQUIRE(usage.bytesReserved >= usage.bytesUsed);
+
+        for (string *object : objects)
+            slab.destroy(object);
+        REQUIRE(slab.size() == 0);
+        REQUIRE(slab.usage().bytesUsed == 0);
+        REQUIRE(slab.usage().bytesReserved == usage.bytesReserved);
+    }
+
+    SECTION("Destroyed slots are reused") {
+        string *first = slab.create("first");
+        string *second = slab.create("second");
+        size_t reserved = slab.usage().bytesReserved;
+
+        slab.destroy(first);
+        string *third = slab.create("third");
+        REQUIRE(third == first);
+        REQUIRE(*third == "third");
+        REQUIRE(*second == "second");
+        REQUIRE(slab.usage().bytesReserved == reserved);
+
+        slab.destroy(second);
+        slab.destroy(third);
+    }
+}
+
+TEST_CASE( "PA_ALLOCATE_FREE", "[memoryarena]" ) {
+
+    PageArena arena;
+
+    SECTION("Pages are zero, distinct and reused") {
+        vector<char *> pages;
+        for (int i = 0; i < PageArena::CHUNK_BYTES / PageArena::PAGE_BYTES + 1; i++) {
+            char *page = arena.allocate();
+            REQUIRE(page[0] == 0);
+            REQUIRE(page[PageArena::PAGE_BYTES - 1] == 0);
+            memset(page, 0xff, PageArena::PAGE_BYTES);
+            pages.push_back(page);
+        }
+        REQUIRE(set<char *>(pages.begin(), pages.end()).size() == pages.size());
+        REQUIRE(arena.usage().bytesUsed == pages.size() * PageArena::PAGE_BYTES);
+        REQUIRE(arena.usage().bytesReserved == 2 * PageArena::CHUNK_BYTES);
+
+        arena.free(pages[5]);
+        REQUIRE(arena.size() == pages.size() - 1);
+        char *page = arena.allocate();
+        REQUIRE(page == pages[5]);
+        REQUIRE(page[0] == 0);
+        REQUIRE(page[PageArena::PAGE_BYTES - 1] == 0);
+        REQUIRE(arena.usage().bytesReserved == 2 * PageArena::CHUNK_BYTES);
+
+        for (char *page : pages)
+            arena.free(page);
+        REQUIRE(arena.usage().bytesUsed == 0);
+    }
+
+    SECTION("Shared pages are kept until every owner freed them") {
+        char *page = arena.allocate();
+        REQUIRE_FALSE(arena.isShared(page));
+        REQUIRE(arena.share(page) == page);
+        arena.share(page);
+        REQUIRE(arena.isShared(page));
+        REQUIRE(arena.size() == 1);
+
+        arena.free(page);
+        arena.free(page);
+        REQUIRE_FALSE(arena.isShared(page));
+        REQUIRE(arena.size() == 1);
+        arena.free(page);
+        REQUIRE(arena.size() == 0);
+        REQUIRE(arena.allocate() == page);
+    }
+
+    SECTION("Chunks are aligned with huge pages") {
+        arena.setHugePages(true);
+        char *page = arena.allocate();
+        REQUIRE((uintptr_t) page % PageArena::CHUNK_BYTES == 0);
+        REQUIRE(page[0] == 0);
+        arena.free(page);
+    }
+}
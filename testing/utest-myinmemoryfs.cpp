@@ -0,0 +1,414 @@
+//
+//  utest-myinmemoryfs.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "myinmemoryfs.h"
+#include "tools.hpp"
+
+#define SNAPSHOT_PATH "/tmp/myfs-snapshot.bin"
+#define OPLOG_PATH "/tmp/myfs-oplog.bin"
+#define TEST_SIZE (3 * PagedContent::PAGE_BYTES + 321)
+#define COMPRESS_TIMEOUT 10     // Seconds to wait for the background thread to compress a file
+#define NUM_HANDLES 1000
+
+static char logFile[] = "/dev/null";
+static char snapshotFile[] = SNAPSHOT_PATH;
+static char opLogFile[] = OPLOG_PATH;
+
+/// @brief Mount options with a snapshot and, if asked for, an operation log that is synced by every operation.
+static MyFsInfo mountOptions(bool withLog) {
+    MyFsInfo info;
+    memset(&info, 0, sizeof(info));
+    info.logFile = logFile;
+    info.snapshotFile = snapshotFile;
+    info.opLogFile = withLog ? opLogFile : nullptr;
+    info.opLogSync = OPLOG_SYNC_ALWAYS;
+    return info;
+}
+
+static MyInMemoryFS *mountFs(MyFsInfo &info) {
+    MyInMemoryFS *fs = new MyInMemoryFS();
+    fs->setMountInfo(&info);
+    fs->fuseInit(nullptr);
+    return fs;
+}
+
+static void unmountFs(MyInMemoryFS *fs) {
+    fs->fuseDestroy();
+    delete fs;
+}
+
+/// @brief End a mount without unmounting, like a crash, only the operation log keeps its changes.
+static void crashFs(MyInMemoryFS *fs) {
+    delete fs;
+}
+
+static void removeFiles() {
+    remove(SNAPSHOT_PATH);
+    remove(OPLOG_PATH);
+    remove(OpLog::oldPath(OPLOG_PATH).c_str());
+}
+
+/// @brief Write to a file, it is created if it does not exist.
+static void writeFile(MyInMemoryFS *fs, const char *path, const char *data, size_t size, off_t offset) {
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    if (fs->fuseOpen(path, &fileInfo) == -ENOENT)
+        REQUIRE(fs->fuseCreate(path, S_IFREG | 0644, &fileInfo) == 0);
+    REQUIRE(fs->fuseWrite(path, data, size, offset, &fileInfo) == (int) size);
+    REQUIRE(fs->fuseRelease(path, &fileInfo) == 0);
+}
+
+/// @brief Read the whole content of a file.
+static string readFile(MyInMemoryFS *fs, const char *path) {
+    struct stat statbuf;
+    REQUIRE(fs->fuseGetattr(path, &statbuf) == 0);
+
+    string content(statbuf.st_size, '\0');
+    REQUIRE(fs->fuseRead(path, &content[0], content.size(), 0, nullptr) == (int) content.size());
+    return content;
+}
+
+static off_t fileSize(const char *path) {
+    struct stat statbuf;
+    return stat(path, &statbuf) == 0 ? statbuf.st_size : -1;
+}
+
+static int fileMode(MyInMemoryFS *fs, const char *path) {
+    struct stat statbuf;
+    return fs->fuseGetattr(path, &statbuf) == 0 ? (int) statbuf.st_mode : -1;
+}
+
+/// @brief Get the bytes of a file before and after compression.
+static void compressedBytes(MyInMemoryFS *fs, const char *path, size_t &original, size_t &stored) {
+    char value[64];
+    int length = fs->fuseGetxattr(path, COMPRESSION_XATTR, value, sizeof(value) - 1);
+    REQUIRE(length > 0);
+    value[length] = '\0';
+    REQUIRE(sscanf(value, "%zu %zu", &original, &stored) == 2);
+}
+
+/// @brief Wait until the background thread compressed a file.
+static bool waitCompressed(MyInMemoryFS *fs, const char *path) {
+    size_t original, stored;
+    for (int i = 0; i < COMPRESS_TIMEOUT * 10; i++) {
+        compressedBytes(fs, path, original, stored);
+        if (stored < original)
+            return true;
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    return false;
+}
+
+/// @brief Change a header field of the snapshot in place.
+static void patchSnapshot(size_t offset, const void *value, size_t size) {
+    int fd = open(SNAPSHOT_PATH, O_WRONLY);
+    REQUIRE(fd >= 0);
+    REQUIRE(pwrite(fd, value, size, offset) == (ssize_t) size);
+    close(fd);
+}
+
+static string readSnapshot() {
+    string image;
+    FILE *file = fopen(SNAPSHOT_PATH, "rb");
+    REQUIRE(file != nullptr);
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        image.append(buffer, count);
+    fclose(file);
+    return image;
+}
+
+TEST_CASE( "IMFS_SNAPSHOT", "[myinmemoryfs]" ) {
+
+    removeFiles();
+    MyFsInfo info = mountOptions(false);
+
+    vector<char> data(TEST_SIZE);
+    gen_random(data.data(), TEST_SIZE);
+
+    // A directory, a file with a hole between two written ranges and a second name of it, and an empty file
+    MyInMemoryFS *fs = mountFs(info);
+    REQUIRE(!fs->mountFailed());
+    REQUIRE(fs->fuseMkdir("/dir", 0750) == 0);
+    writeFile(fs, "/dir/file", data.data(), 100, 0);
+    writeFile(fs, "/dir/file", data.data(), TEST_SIZE, 2 * TEST_SIZE);
+    REQUIRE(fs->fuseLink("/dir/file", "/link") == 0);
+    REQUIRE(fs->fuseChmod("/link", S_IFREG | 0600) == 0);
+    writeFile(fs, "/empty", data.data(), 0, 0);
+    string expected = readFile(fs, "/dir/file");
+    unmountFs(fs);
+
+    SECTION("Files are loaded from the snapshot") {
+        fs = mountFs(info);
+        REQUIRE(!fs->mountFailed());
+        REQUIRE(fileMode(fs, "/dir") == (S_IFDIR | 0750));
+        REQUIRE(fileMode(fs, "/dir/file") == (S_IFREG | 0600));
+        REQUIRE(readFile(fs, "/dir/file") == expected);
+        REQUIRE(readFile(fs, "/link") == expected);
+        REQUIRE(readFile(fs, "/empty").empty());
+
+        // Changes of loaded files go into the next snapshot
+        writeFile(fs, "/link", "changed", 7, 50);
+        expected.replace(50, 7, "changed");
+        REQUIRE(fs->fuseUnlink("/empty") == 0);
+        unmountFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(readFile(fs, "/dir/file") == expected);
+        REQUIRE(fileMode(fs, "/empty") == -1);
+        unmountFs(fs);
+    }
+
+    SECTION("Damaged snapshots are not mounted or overwritten") {
+        string image = readSnapshot();
+        SnapshotHeader header;
+        memcpy(&header, image.data(), sizeof(header));
+
+        SECTION("Wrong magic number") {
+            uint32_t magic = header.magic + 1;
+            patchSnapshot(offsetof(SnapshotHeader, magic), &magic, sizeof(magic));
+        }
+        SECTION("Wrong version") {
+            uint32_t version = header.version + 1;
+            patchSnapshot(offsetof(SnapshotHeader, version), &version, sizeof(version));
+        }
+        SECTION("Image not written completely") {
+            REQUIRE(truncate(SNAPSHOT_PATH, image.size() - 1) == 0);
+        }
+        SECTION("File records beyond the image") {
+            uint64_t numFiles = image.size();
+            patchSnapshot(offsetof(SnapshotHeader, numFiles), &numFiles, sizeof(numFiles));
+        }
+        SECTION("Misaligned entries") {
+            uint64_t entriesOffset = header.entriesOffset + 1;
+            patchSnapshot(offsetof(SnapshotHeader, entriesOffset), &entriesOffset, sizeof(entriesOffset));
+        }
+        SECTION("Files without an entry") {
+            uint64_t numEntries = 0;
+            patchSnapshot(offsetof(SnapshotHeader, numEntries), &numEntries, sizeof(numEntries));
+        }
+
+        string damaged = readSnapshot();
+        fs = mountFs(info);
+        REQUIRE(fs->mountFailed());
+        unmountFs(fs);
+        REQUIRE(readSnapshot() == damaged);
+    }
+
+    removeFiles();
+}
+
+TEST_CASE( "IMFS_OPLOG", "[myinmemoryfs]" ) {
+
+    removeFiles();
+    MyFsInfo info = mountOptions(true);
+
+    vector<char> data(TEST_SIZE);
+    gen_random(data.data(), TEST_SIZE);
+
+    SECTION("Changes are replayed after a crash") {
+        MyInMemoryFS *fs = mountFs(info);
+        REQUIRE(fs->fuseMkdir("/dir", 0700) == 0);
+        writeFile(fs, "/dir/file", data.data(), TEST_SIZE, 0);
+        writeFile(fs, "/dir/file", "end", 3, 2 * TEST_SIZE);
+        REQUIRE(fs->fuseRename("/dir/file", "/dir/moved") == 0);
+        REQUIRE(fs->fuseLink("/dir/moved", "/link") == 0);
+        REQUIRE(fs->fuseChmod("/link", S_IFREG | 0600) == 0);
+        writeFile(fs, "/gone", data.data(), 10, 0);
+        REQUIRE(fs->fuseUnlink("/gone") == 0);
+        writeFile(fs, "/short", data.data(), TEST_SIZE, 0);
+        REQUIRE(fs->fuseTruncate("/short", 1000) == 0);
+        writeFile(fs, "/clone", data.data(), 0, 0);
+        REQUIRE(fs->fuseSetxattr("/clone", CLONE_XATTR, "/short", 6, 0) == 0);
+        string expected = readFile(fs, "/link");
+        REQUIRE(fileSize(OPLOG_PATH) > 0);
+        crashFs(fs);
+
+        // The replay ends with a new snapshot and an empty log, both mounts must see the same files
+        for (int round = 0; round < 2; round++) {
+            fs = mountFs(info);
+            REQUIRE(!fs->mountFailed());
+            REQUIRE(fileSize(OPLOG_PATH) == 0);
+            REQUIRE(fileMode(fs, "/dir") == (S_IFDIR | 0700));
+            REQUIRE(fileMode(fs, "/dir/file") == -1);
+            REQUIRE(fileMode(fs, "/dir/moved") == (S_IFREG | 0600));
+            REQUIRE(readFile(fs, "/dir/moved") == expected);
+            REQUIRE(readFile(fs, "/link") == expected);
+            REQUIRE(fileMode(fs, "/gone") == -1);
+            REQUIRE(readFile(fs, "/short") == string(data.data(), 1000));
+            REQUIRE(readFile(fs, "/clone") == string(data.data(), 1000));
+            unmountFs(fs);
+        }
+    }
+
+    SECTION("Writes to and copies from deleted files are replayed") {
+        MyInMemoryFS *fs = mountFs(info);
+        writeFile(fs, "/deleted", data.data(), TEST_SIZE - 4, 0);
+
+        struct fuse_file_info source, target;
+        memset(&source, 0, sizeof(source));
+        memset(&target, 0, sizeof(target));
+        REQUIRE(fs->fuseOpen("/deleted", &source) == 0);
+        REQUIRE(fs->fuseUnlink("/deleted") == 0);
+        REQUIRE(fs->fuseWrite("/deleted", data.data() + TEST_SIZE - 4, 4, TEST_SIZE - 4, &source) == 4);
+
+        // The copy cannot name its source, so it is logged as writes of the copied bytes
+        REQUIRE(fs->fuseCreate("/copy", S_IFREG | 0644, &target) == 0);
+        REQUIRE(fs->fuseCopyFileRange("/deleted", &source, 0, "/copy", &target, 0, TEST_SIZE, 0) == TEST_SIZE);
+        REQUIRE(fs->fuseRelease("/copy", &target) == 0);
+        REQUIRE(fs->fuseRelease("/deleted", &source) == 0);
+        crashFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(!fs->mountFailed());
+        REQUIRE(fileMode(fs, "/deleted") == -1);
+        REQUIRE(readFile(fs, "/copy") == string(data.data(), TEST_SIZE));
+        unmountFs(fs);
+    }
+
+    SECTION("A log that cannot be replayed is not mounted") {
+        MyInMemoryFS *fs = mountFs(info);
+        REQUIRE(fs->fuseMkdir("/dir", 0700) == 0);
+        crashFs(fs);
+
+        // Without the log the directory goes into the snapshot, then the logged mkdir fails
+        info.opLogFile = nullptr;
+        fs = mountFs(info);
+        REQUIRE(fs->fuseMkdir("/dir", 0700) == 0);
+        unmountFs(fs);
+        info.opLogFile = opLogFile;
+
+        off_t snapshotSize = fileSize(SNAPSHOT_PATH);
+        off_t logSize = fileSize(OPLOG_PATH);
+        fs = mountFs(info);
+        REQUIRE(fs->mountFailed());
+        unmountFs(fs);
+        REQUIRE(fileSize(SNAPSHOT_PATH) == snapshotSize);
+        REQUIRE(fileSize(OPLOG_PATH) == logSize);
+        REQUIRE(logSize > 0);
+    }
+
+    removeFiles();
+}
+
+TEST_CASE( "IMFS_COMPRESSION", "[myinmemoryfs]" ) {
+
+    removeFiles();
+    MyFsInfo info = mountOptions(false);
+    info.compressAfter = 1;
+
+    // Text that compresses well, in two ranges with a hole between them
+    string text;
+    while (text.size() < TEST_SIZE)
+        text += "Cold files are compressed in the background. ";
+    text.resize(TEST_SIZE);
+
+    MyInMemoryFS *fs = mountFs(info);
+    writeFile(fs, "/cold", text.data(), PagedContent::PAGE_BYTES + 100, 0);
+    writeFile(fs, "/cold", text.data(), TEST_SIZE, 2 * TEST_SIZE);
+    string expected = readFile(fs, "/cold");
+    REQUIRE(waitCompressed(fs, "/cold"));
+
+    size_t original, stored;
+    compressedBytes(fs, "/", original, stored);
+    REQUIRE(stored < original);
+
+    SECTION("Copies read the compressed pages") {
+        struct fuse_file_info target;
+        memset(&target, 0, sizeof(target));
+        REQUIRE(fs->fuseCreate("/copy", S_IFREG | 0644, &target) == 0);
+        REQUIRE(fs->fuseCopyFileRange("/cold", nullptr, 10, "/copy", &target, 0, expected.size(), 0)
+                == (ssize_t) expected.size() - 10);
+        REQUIRE(fs->fuseRelease("/copy", &target) == 0);
+
+        compressedBytes(fs, "/cold", original, stored);
+        REQUIRE(stored < original);
+        REQUIRE(readFile(fs, "/copy") == expected.substr(10));
+    }
+
+    SECTION("Reads decompress the file") {
+        REQUIRE(readFile(fs, "/cold") == expected);
+        compressedBytes(fs, "/cold", original, stored);
+        REQUIRE(stored == original);
+
+        // Written files are compressed again once they are cold
+        writeFile(fs, "/cold", "changed", 7, 50);
+        expected.replace(50, 7, "changed");
+        REQUIRE(waitCompressed(fs, "/cold"));
+        REQUIRE(readFile(fs, "/cold") == expected);
+    }
+
+    SECTION("Compressed files go into the snapshot") {
+        unmountFs(fs);
+        fs = mountFs(info);
+        REQUIRE(!fs->mountFailed());
+        REQUIRE(readFile(fs, "/cold") == expected);
+    }
+
+    unmountFs(fs);
+    removeFiles();
+}
+
+TEST_CASE( "IMFS_OPEN_HANDLES", "[myinmemoryfs]" ) {
+
+    removeFiles();
+    MyFsInfo info = mountOptions(false);
+
+    vector<char> data(TEST_SIZE);
+    gen_random(data.data(), TEST_SIZE);
+
+    MyInMemoryFS *fs = mountFs(info);
+    writeFile(fs, "/file", data.data(), TEST_SIZE, 0);
+
+    SECTION("A file is open many times") {
+        vector<struct fuse_file_info> handles(NUM_HANDLES);
+        for (struct fuse_file_info &fileInfo : handles) {
+            memset(&fileInfo, 0, sizeof(fileInfo));
+            REQUIRE(fs->fuseOpen("/file", &fileInfo) == 0);
+        }
+
+        // The deleted file is kept until its last handle is closed
+        REQUIRE(fs->fuseUnlink("/file") == 0);
+        vector<char> buffer(TEST_SIZE);
+        for (size_t i = 0; i < handles.size(); i++) {
+            REQUIRE(fs->fuseRead("/file", buffer.data(), 100, i, &handles[i]) == 100);
+            REQUIRE(memcmp(buffer.data(), data.data() + i, 100) == 0);
+        }
+        for (struct fuse_file_info &fileInfo : handles)
+            REQUIRE(fs->fuseRelease("/file", &fileInfo) == 0);
+        REQUIRE(fs->fuseRelease("/file", &handles[0]) == -EBADF);
+    }
+
+    SECTION("Many files are open at the same time") {
+        vector<struct fuse_file_info> handles(NUM_HANDLES);
+        for (size_t i = 0; i < handles.size(); i++) {
+            string path = "/file" + to_string(i);
+            memset(&handles[i], 0, sizeof(handles[i]));
+            REQUIRE(fs->fuseCreate(path.c_str(), S_IFREG | 0644, &handles[i]) == 0);
+            REQUIRE(fs->fuseWrite(path.c_str(), path.data(), path.size(), 0, &handles[i]) == (int) path.size());
+        }
+        for (size_t i = 0; i < handles.size(); i++)
+            REQUIRE(fs->fuseRelease(("/file" + to_string(i)).c_str(), &handles[i]) == 0);
+
+        for (size_t i = 0; i < handles.size(); i++) {
+            string path = "/file" + to_string(i);
+            REQUIRE(readFile(fs, path.c_str()) == path);
+        }
+    }
+
+    unmountFs(fs);
+    removeFiles();
+}
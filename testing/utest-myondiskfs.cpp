@@ -0,0 +1,687 @@
+//
+//  utest-myondiskfs.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <cstddef>
+#include <set>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "myondiskfs.h"
+#include "tools.hpp"
+
+#define CONTAINER_PATH "/tmp/myfs-ondisk.bin"
+#define TEST_SIZE (10 * BLOCK_SIZE + 123)
+#define NUM_DIR_FILES 5000
+#define NUM_HANDLES 1000
+
+static char logFile[] = "/dev/null";
+static char containerFile[] = CONTAINER_PATH;
+
+/// @brief Gives the tests access to the allocation metadata of the file system.
+class InspectedOnDiskFS : public MyOnDiskFS {
+public:
+    using MyOnDiskFS::superBlock;
+    using MyOnDiskFS::dmap;
+    using MyOnDiskFS::fat;
+    using MyOnDiskFS::inodes;
+};
+
+static MyFsInfo mountOptions() {
+    MyFsInfo info;
+    memset(&info, 0, sizeof(info));
+    info.logFile = logFile;
+    info.contFile = containerFile;
+    return info;
+}
+
+static InspectedOnDiskFS *mountFs(MyFsInfo &info) {
+    InspectedOnDiskFS *fs = new InspectedOnDiskFS();
+    fs->setMountInfo(&info);
+    fs->fuseInit(nullptr);
+    return fs;
+}
+
+static void unmountFs(MyOnDiskFS *fs) {
+    fs->fuseDestroy();
+    delete fs;
+}
+
+/// @brief End a mount without unmounting, like a crash, only committed journal groups keep their changes.
+static void crashFs(MyOnDiskFS *fs) {
+    delete fs;
+}
+
+/// @brief Write to a file, it is created if it does not exist, and hand the data to the container like a close.
+static void writeFile(MyOnDiskFS *fs, const char *path, const char *data, size_t size, off_t offset) {
+    struct fuse_file_info fileInfo;
+    memset(&fileInfo, 0, sizeof(fileInfo));
+    if (fs->fuseOpen(path, &fileInfo) == -ENOENT)
+        REQUIRE(fs->fuseCreate(path, S_IFREG | 0644, &fileInfo) == 0);
+    REQUIRE(fs->fuseWrite(path, data, size, offset, &fileInfo) == (int) size);
+    REQUIRE(fs->fuseFlush(path, &fileInfo) == 0);
+    REQUIRE(fs->fuseRelease(path, &fileInfo) == 0);
+}
+
+/// @brief Read the whole content of a file.
+static string readFile(MyOnDiskFS *fs, const char *path) {
+    struct stat statbuf;
+    REQUIRE(fs->fuseGetattr(path, &statbuf) == 0);
+
+    string content(statbuf.st_size, '\0');
+    REQUIRE(fs->fuseRead(path, &content[0], content.size(), 0, nullptr) == (int) content.size());
+    return content;
+}
+
+static int fileMode(MyOnDiskFS *fs, const char *path) {
+    struct stat statbuf;
+    return fs->fuseGetattr(path, &statbuf) == 0 ? (int) statbuf.st_mode : -1;
+}
+
+static off_t fileSize(MyOnDiskFS *fs, const char *path) {
+    struct stat statbuf;
+    return fs->fuseGetattr(path, &statbuf) == 0 ? statbuf.st_size : -1;
+}
+
+static int addName(void *buf, const char *name, const struct stat *statbuf, off_t offset) {
+    ((set<string> *) buf)->insert(name);
+    return 0;
+}
+
+/// @brief Get the names of the entries of a directory, without "." and "..".
+static set<string> listDirectory(MyOnDiskFS *fs, const char *path) {
+    set<string> names;
+    REQUIRE(fs->fuseReaddir(path, &names, addName, 0, nullptr) == 0);
+    REQUIRE(names.erase(".") == 1);
+    REQUIRE(names.erase("..") == 1);
+    return names;
+}
+
+/// @brief Find the descriptor of the last record in the journal of the container.
+static off_t lastJournalRecord() {
+    int fd = open(CONTAINER_PATH, O_RDONLY);
+    REQUIRE(fd >= 0);
+
+    JournalHeader header;
+    off_t journal = (off_t) JOURNAL_BLOCK_OFFSET * BLOCK_SIZE;
+    REQUIRE(pread(fd, &header, sizeof(header), journal) == sizeof(header));
+    REQUIRE(header.magic == JOURNAL_MAGIC);
+
+    // Records follow the header with ascending sequence numbers
+    off_t last = -1;
+    uint32_t position = 1;
+    uint32_t sequence = header.sequence;
+    JournalRecord record;
+    while (position < JOURNAL_BLOCK_COUNT
+           && pread(fd, &record, sizeof(record), journal + (off_t) position * BLOCK_SIZE) == sizeof(record)
+           && record.magic == JOURNAL_MAGIC && record.sequence == sequence) {
+        last = journal + (off_t) position * BLOCK_SIZE;
+        position += 1 + record.numBlocks;
+        sequence++;
+    }
+    close(fd);
+
+    REQUIRE(last >= 0);
+    return last;
+}
+
+static void patchContainer(off_t offset, const void *value, size_t size) {
+    int fd = open(CONTAINER_PATH, O_WRONLY);
+    REQUIRE(fd >= 0);
+    REQUIRE(pwrite(fd, value, size, offset) == (ssize_t) size);
+    close(fd);
+}
+
+static SuperBlock readSuperBlock() {
+    SuperBlock superBlock;
+    int fd = open(CONTAINER_PATH, O_RDONLY);
+    REQUIRE(fd >= 0);
+    REQUIRE(pread(fd, &superBlock, sizeof(superBlock), (off_t) SUPERBLOCK_OFFSET * BLOCK_SIZE) == sizeof(superBlock));
+    close(fd);
+    return superBlock;
+}
+
+/// @brief Check that the DMAP marks exactly the blocks of the FAT chains of all files as used.
+/// \return Number of free blocks.
+static uint32_t checkAllocation(InspectedOnDiskFS *fs) {
+    vector<bool> used(FILE_BLOCK_COUNT, false);
+    size_t shared = 0, shortChains = 0;
+    for (const MyFsFile &file : fs->inodes) {
+        if (file.nlink == 0 || file.blocks == 0)
+            continue;
+
+        uint32_t found = 0;
+        for (uint16_t block = file.data; found < file.blocks; block = fs->fat[block].nextBlock) {
+            shared += used[block] ? 1 : 0;
+            used[block] = true;
+            found++;
+            if (fs->fat[block].isLast)
+                break;
+        }
+        shortChains += (found < file.blocks) ? 1 : 0;
+    }
+    REQUIRE(shared == 0);
+    REQUIRE(shortChains == 0);
+
+    uint32_t numFree = 0;
+    size_t wrong = 0;
+    for (size_t block = 0; block < FILE_BLOCK_COUNT; block++) {
+        numFree += used[block] ? 0 : 1;
+        wrong += (fs->dmap[block].isFree == used[block]) ? 1 : 0;
+    }
+    REQUIRE(wrong == 0);
+    REQUIRE(fs->superBlock.numFreeBlocks == numFree);
+    return numFree;
+}
+
+static JournalHeader readJournalHeader() {
+    JournalHeader header;
+    int fd = open(CONTAINER_PATH, O_RDONLY);
+    REQUIRE(fd >= 0);
+    REQUIRE(pread(fd, &header, sizeof(header), (off_t) JOURNAL_BLOCK_OFFSET * BLOCK_SIZE) == sizeof(header));
+    close(fd);
+    return header;
+}
+
+TEST_CASE( "ODFS_JOURNAL", "[myondiskfs]" ) {
+
+    remove(CONTAINER_PATH);
+    MyFsInfo info = mountOptions();
+
+    vector<char> data(TEST_SIZE);
+    gen_random(data.data(), TEST_SIZE);
+
+    SECTION("Committed changes are replayed after a crash") {
+        MyOnDiskFS *fs = mountFs(info);
+        REQUIRE(!fs->mountFailed());
+        REQUIRE(fs->fuseMkdir("/dir", 0700) == 0);
+        writeFile(fs, "/dir/file", data.data(), TEST_SIZE, 0);
+        writeFile(fs, "/dir/file", "end", 3, 3 * TEST_SIZE);
+        REQUIRE(fs->fuseRename("/dir/file", "/dir/moved") == 0);
+        REQUIRE(fs->fuseLink("/dir/moved", "/link") == 0);
+        REQUIRE(fs->fuseChmod("/link", S_IFREG | 0600) == 0);
+        writeFile(fs, "/gone", data.data(), 10, 0);
+        REQUIRE(fs->fuseUnlink("/gone") == 0);
+        writeFile(fs, "/short", data.data(), TEST_SIZE, 0);
+        REQUIRE(fs->fuseTruncate("/short", 1000) == 0);
+        string expected = readFile(fs, "/link");
+        REQUIRE(fs->fuseFsyncdir("/", 0, nullptr) == 0);
+        crashFs(fs);
+
+        // The replay empties the journal, so the second mount reads the same tree from the home locations
+        for (int round = 0; round < 2; round++) {
+            fs = mountFs(info);
+            REQUIRE(!fs->mountFailed());
+            REQUIRE(fileMode(fs, "/dir") == (S_IFDIR | 0700));
+            REQUIRE(fileMode(fs, "/dir/file") == -1);
+            REQUIRE(fileMode(fs, "/dir/moved") == (S_IFREG | 0600));
+            REQUIRE(readFile(fs, "/dir/moved") == expected);
+            REQUIRE(readFile(fs, "/link") == expected);
+            REQUIRE(fileMode(fs, "/gone") == -1);
+            REQUIRE(readFile(fs, "/short") == string(data.data(), 1000));
+            if (round == 0)
+                crashFs(fs);
+            else
+                unmountFs(fs);
+        }
+    }
+
+    SECTION("Groups that were not committed are lost") {
+        MyOnDiskFS *fs = mountFs(info);
+        REQUIRE(fs->fuseMkdir("/committed", 0755) == 0);
+        REQUIRE(fs->fuseFsyncdir("/", 0, nullptr) == 0);
+        REQUIRE(fs->fuseMkdir("/pending", 0755) == 0);
+        crashFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(fileMode(fs, "/committed") == (S_IFDIR | 0755));
+        REQUIRE(fileMode(fs, "/pending") == -1);
+        unmountFs(fs);
+    }
+
+    SECTION("A damaged last record is dropped") {
+        MyOnDiskFS *fs = mountFs(info);
+        REQUIRE(fs->fuseMkdir("/first", 0755) == 0);
+        REQUIRE(fs->fuseFsyncdir("/", 0, nullptr) == 0);
+        REQUIRE(fs->fuseMkdir("/second", 0755) == 0);
+        REQUIRE(fs->fuseFsyncdir("/", 0, nullptr) == 0);
+        crashFs(fs);
+
+        off_t last = lastJournalRecord();
+        JournalRecord record;
+        int fd = open(CONTAINER_PATH, O_RDONLY);
+        REQUIRE(pread(fd, &record, sizeof(record), last) == sizeof(record));
+        close(fd);
+
+        SECTION("Wrong checksum") {
+            record.checksum ^= 1;
+            patchContainer(last + offsetof(JournalRecord, checksum), &record.checksum, sizeof(record.checksum));
+        }
+        SECTION("Block image not written completely") {
+            vector<char> torn(BLOCK_SIZE / 2, 0x5a);
+            patchContainer(last + (off_t) record.numBlocks * BLOCK_SIZE + BLOCK_SIZE / 2, torn.data(), torn.size());
+        }
+
+        fs = mountFs(info);
+        REQUIRE(!fs->mountFailed());
+        REQUIRE(fileMode(fs, "/first") == (S_IFDIR | 0755));
+        REQUIRE(fileMode(fs, "/second") == -1);
+        REQUIRE(fs->fuseMkdir("/second", 0755) == 0);
+        unmountFs(fs);
+    }
+
+    SECTION("A full journal is checkpointed to the home locations") {
+        MyOnDiskFS *fs = mountFs(info);
+        REQUIRE(readJournalHeader().sequence == 1);
+        for (int i = 0; i < 1000; i++)
+            REQUIRE(fs->fuseMknod(("/file" + to_string(i)).c_str(), S_IFREG | 0644, 0) == 0);
+        REQUIRE(fs->fuseFsyncdir("/", 0, nullptr) == 0);
+        crashFs(fs);
+
+        // Records before the last checkpoint are no longer valid, their changes are at home
+        REQUIRE(readJournalHeader().sequence > 1);
+        fs = mountFs(info);
+        for (int i = 0; i < 1000; i++)
+            REQUIRE(fileMode(fs, ("/file" + to_string(i)).c_str()) == (S_IFREG | 0644));
+        unmountFs(fs);
+    }
+
+    remove(CONTAINER_PATH);
+}
+
+TEST_CASE( "ODFS_CLEAN_FLAG", "[myondiskfs]" ) {
+
+    remove(CONTAINER_PATH);
+    MyFsInfo info = mountOptions();
+
+    vector<char> data(TEST_SIZE);
+    gen_random(data.data(), TEST_SIZE);
+
+    SECTION("The container is marked clean while it is not mounted") {
+        MyOnDiskFS *fs = mountFs(info);
+        writeFile(fs, "/file", data.data(), TEST_SIZE, 0);
+        unmountFs(fs);
+        REQUIRE(readSuperBlock().clean == 1);
+
+        fs = mountFs(info);
+        REQUIRE(readSuperBlock().clean == 0);
+        REQUIRE(readFile(fs, "/file") == string(data.data(), TEST_SIZE));
+        crashFs(fs);
+        REQUIRE(readSuperBlock().clean == 0);
+    }
+
+    SECTION("The DMAP is rebuilt from the FAT chains after a crash") {
+        // Files of different sizes, some with holes, and gaps left by deleted files
+        InspectedOnDiskFS *fs = mountFs(info);
+        for (int i = 0; i < 300; i++) {
+            string path = "/file" + to_string(i);
+            writeFile(fs, path.c_str(), data.data(), (i * 977) % TEST_SIZE + 1, 0);
+            if (i % 4 == 0)
+                writeFile(fs, path.c_str(), data.data(), 100, (off_t) (i % 7 + 2) * TEST_SIZE);
+        }
+        for (int i = 0; i < 300; i += 3)
+            REQUIRE(fs->fuseUnlink(("/file" + to_string(i)).c_str()) == 0);
+        REQUIRE(fs->fuseFsyncdir("/", 0, nullptr) == 0);
+        uint32_t numFree = checkAllocation(fs);
+        REQUIRE(numFree < FILE_BLOCK_COUNT);
+        crashFs(fs);
+
+        // The DMAP at home claims every block is used, only the journal may still hold some correct blocks of it
+        vector<char> allUsed((size_t) DMAP_BLOCK_COUNT * BLOCK_SIZE, 0);
+        patchContainer((off_t) DMAP_BLOCK_OFFSET * BLOCK_SIZE, allUsed.data(), allUsed.size());
+
+        fs = mountFs(info);
+        REQUIRE(!fs->mountFailed());
+        REQUIRE(checkAllocation(fs) == numFree);
+        for (int i = 1; i < 300; i += 3) {
+            string path = "/file" + to_string(i);
+            REQUIRE(readFile(fs, path.c_str()).compare(0, (i * 977) % TEST_SIZE + 1, data.data(),
+                                                       (i * 977) % TEST_SIZE + 1) == 0);
+        }
+
+        // New files get blocks that are free
+        writeFile(fs, "/new", data.data(), TEST_SIZE, 0);
+        REQUIRE(checkAllocation(fs) == numFree - (TEST_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        REQUIRE(readFile(fs, "/new") == string(data.data(), TEST_SIZE));
+        unmountFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(checkAllocation(fs) == numFree - (TEST_SIZE + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        unmountFs(fs);
+    }
+
+    remove(CONTAINER_PATH);
+}
+
+TEST_CASE( "ODFS_DIRECTORY_GROWTH", "[myondiskfs]" ) {
+
+    remove(CONTAINER_PATH);
+    MyFsInfo info = mountOptions();
+
+    // Far more entries than fit into one block of the directory
+    MyOnDiskFS *fs = mountFs(info);
+    REQUIRE(fs->fuseMkdir("/big", 0755) == 0);
+    set<string> expected;
+    for (int i = 0; i < NUM_DIR_FILES; i++) {
+        string name = "entry" + to_string(i);
+        REQUIRE(fs->fuseMknod(("/big/" + name).c_str(), S_IFREG | 0644, 0) == 0);
+        expected.insert(name);
+    }
+    off_t size = fileSize(fs, "/big");
+    REQUIRE(size > 100 * BLOCK_SIZE);
+    REQUIRE(size % BLOCK_SIZE == 0);
+    REQUIRE(listDirectory(fs, "/big") == expected);
+    unmountFs(fs);
+
+    SECTION("Entries are read back from all blocks") {
+        fs = mountFs(info);
+        REQUIRE(fileSize(fs, "/big") == size);
+        REQUIRE(listDirectory(fs, "/big") == expected);
+        for (int i = 0; i < NUM_DIR_FILES; i += 97)
+            REQUIRE(fileMode(fs, ("/big/entry" + to_string(i)).c_str()) == (S_IFREG | 0644));
+        unmountFs(fs);
+    }
+
+    SECTION("Space of removed entries is reused") {
+        fs = mountFs(info);
+        for (int i = 0; i < NUM_DIR_FILES; i += 2) {
+            string name = "entry" + to_string(i);
+            REQUIRE(fs->fuseUnlink(("/big/" + name).c_str()) == 0);
+            expected.erase(name);
+        }
+        REQUIRE(fs->fuseFsyncdir("/big", 0, nullptr) == 0);
+        crashFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(listDirectory(fs, "/big") == expected);
+        for (int i = 0; i < NUM_DIR_FILES; i += 2)
+            REQUIRE(fs->fuseMknod(("/big/other" + to_string(i)).c_str(), S_IFREG | 0644, 0) == 0);
+        REQUIRE(fileSize(fs, "/big") == size);
+        unmountFs(fs);
+    }
+
+    remove(CONTAINER_PATH);
+}
+
+TEST_CASE( "ODFS_SUBDIRECTORIES", "[myondiskfs]" ) {
+
+    remove(CONTAINER_PATH);
+    MyFsInfo info = mountOptions();
+
+    vector<char> data(TEST_SIZE);
+    gen_random(data.data(), TEST_SIZE);
+
+    // Resolve the paths once, so they are in the dentry cache before they change
+    MyOnDiskFS *fs = mountFs(info);
+    REQUIRE(fs->fuseMkdir("/a", 0755) == 0);
+    REQUIRE(fs->fuseMkdir("/a/b", 0750) == 0);
+    REQUIRE(fs->fuseMkdir("/c", 0755) == 0);
+    writeFile(fs, "/a/b/f", data.data(), TEST_SIZE, 0);
+    REQUIRE(fileMode(fs, "/a/b") == (S_IFDIR | 0750));
+    REQUIRE(readFile(fs, "/a/b/f") == string(data.data(), TEST_SIZE));
+
+    SECTION("Moved directories are found under their new path only") {
+        REQUIRE(fs->fuseRename("/a/b", "/c/b") == 0);
+        REQUIRE(fileMode(fs, "/a/b") == -1);
+        REQUIRE(fileMode(fs, "/a/b/f") == -1);
+        REQUIRE(fs->fuseUnlink("/a/b/f") == -ENOENT);
+        REQUIRE(fileMode(fs, "/c/b") == (S_IFDIR | 0750));
+        REQUIRE(readFile(fs, "/c/b/f") == string(data.data(), TEST_SIZE));
+        REQUIRE(listDirectory(fs, "/a").empty());
+        REQUIRE(listDirectory(fs, "/c") == set<string>({"b"}));
+
+        // The old path can be used again
+        REQUIRE(fs->fuseMkdir("/a/b", 0700) == 0);
+        REQUIRE(fileMode(fs, "/a/b") == (S_IFDIR | 0700));
+        REQUIRE(fileMode(fs, "/a/b/f") == -1);
+        unmountFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(fileMode(fs, "/a/b") == (S_IFDIR | 0700));
+        REQUIRE(readFile(fs, "/c/b/f") == string(data.data(), TEST_SIZE));
+        unmountFs(fs);
+    }
+
+    SECTION("Removed directories are not found anymore") {
+        REQUIRE(fs->fuseRmdir("/a/b") == -ENOTEMPTY);
+        REQUIRE(fs->fuseRmdir("/a/b/f") == -ENOTDIR);
+        REQUIRE(fs->fuseUnlink("/a/b") == -EISDIR);
+        REQUIRE(fs->fuseUnlink("/a/b/f") == 0);
+        REQUIRE(fileMode(fs, "/a/b/f") == -1);
+        REQUIRE(fs->fuseRmdir("/a/b") == 0);
+        REQUIRE(fileMode(fs, "/a/b") == -1);
+        REQUIRE(fs->fuseMknod("/a/b/f", S_IFREG | 0644, 0) == -ENOENT);
+        REQUIRE(fs->fuseRmdir("/a/b") == -ENOENT);
+        REQUIRE(listDirectory(fs, "/a").empty());
+        REQUIRE(fs->fuseFsyncdir("/", 0, nullptr) == 0);
+        crashFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(fileMode(fs, "/a") == (S_IFDIR | 0755));
+        REQUIRE(fileMode(fs, "/a/b") == -1);
+        REQUIRE(fs->fuseRmdir("/a") == 0);
+        unmountFs(fs);
+    }
+
+    SECTION("Directories are not moved into themselves") {
+        REQUIRE(fs->fuseRename("/a", "/a/b/a") == -EINVAL);
+        REQUIRE(fs->fuseRename("/a", "/a/a") == -EINVAL);
+        REQUIRE(fs->fuseRename("/a/b", "/c") == -EEXIST);
+        REQUIRE(readFile(fs, "/a/b/f") == string(data.data(), TEST_SIZE));
+
+        // Moving the parent keeps the whole tree below it
+        REQUIRE(fs->fuseRename("/a", "/c/a") == 0);
+        REQUIRE(fileMode(fs, "/a") == -1);
+        REQUIRE(readFile(fs, "/c/a/b/f") == string(data.data(), TEST_SIZE));
+        REQUIRE(fs->fuseFsyncdir("/", 0, nullptr) == 0);
+        crashFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(listDirectory(fs, "/") == set<string>({"c"}));
+        REQUIRE(listDirectory(fs, "/c/a/b") == set<string>({"f"}));
+        REQUIRE(readFile(fs, "/c/a/b/f") == string(data.data(), TEST_SIZE));
+        unmountFs(fs);
+    }
+
+    remove(CONTAINER_PATH);
+}
+
+TEST_CASE( "ODFS_HARD_LINKS", "[myondiskfs]" ) {
+
+    remove(CONTAINER_PATH);
+    MyFsInfo info = mountOptions();
+
+    vector<char> data(TEST_SIZE);
+    gen_random(data.data(), TEST_SIZE);
+
+    InspectedOnDiskFS *fs = mountFs(info);
+    REQUIRE(fs->fuseMkdir("/dir", 0755) == 0);
+    REQUIRE(fs->fuseMknod("/dir/empty", S_IFREG | 0644, 0) == 0);
+    uint32_t numFree = checkAllocation(fs);
+    writeFile(fs, "/file", data.data(), TEST_SIZE, 0);
+    REQUIRE(fs->fuseLink("/file", "/dir/link") == 0);
+    REQUIRE(fs->fuseLink("/file", "/dir/link") == -EEXIST);
+    REQUIRE(fs->fuseLink("/dir", "/other") == -EPERM);
+    REQUIRE(fs->fuseLink("/missing", "/other") == -ENOENT);
+
+    // Both names refer to the same inode
+    struct stat first, second;
+    REQUIRE(fs->fuseGetattr("/file", &first) == 0);
+    REQUIRE(fs->fuseGetattr("/dir/link", &second) == 0);
+    REQUIRE(first.st_ino == second.st_ino);
+    REQUIRE(first.st_nlink == 2);
+    REQUIRE(second.st_nlink == 2);
+    ino_t ino = first.st_ino;
+
+    REQUIRE(fs->fuseChmod("/dir/link", S_IFREG | 0600) == 0);
+    REQUIRE(fileMode(fs, "/file") == (S_IFREG | 0600));
+    writeFile(fs, "/dir/link", "changed", 7, 0);
+    memcpy(data.data(), "changed", 7);
+    REQUIRE(readFile(fs, "/file") == string(data.data(), TEST_SIZE));
+
+    // A moved name keeps the inode
+    REQUIRE(fs->fuseRename("/dir/link", "/moved") == 0);
+    REQUIRE(fs->fuseGetattr("/moved", &second) == 0);
+    REQUIRE(second.st_ino == ino);
+    REQUIRE(second.st_nlink == 2);
+
+    SECTION("The inode table is kept across a remount") {
+        unmountFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(fs->fuseGetattr("/file", &first) == 0);
+        REQUIRE(fs->fuseGetattr("/moved", &second) == 0);
+        REQUIRE(first.st_ino == ino);
+        REQUIRE(second.st_ino == ino);
+        REQUIRE(first.st_nlink == 2);
+        REQUIRE(first.st_mode == (S_IFREG | 0600));
+        REQUIRE(readFile(fs, "/moved") == string(data.data(), TEST_SIZE));
+        unmountFs(fs);
+    }
+
+    SECTION("The data is kept until the last name is removed") {
+        REQUIRE(fs->fuseUnlink("/file") == 0);
+        REQUIRE(fileMode(fs, "/file") == -1);
+        REQUIRE(fs->fuseGetattr("/moved", &second) == 0);
+        REQUIRE(second.st_ino == ino);
+        REQUIRE(second.st_nlink == 1);
+        REQUIRE(fs->fuseFsyncdir("/", 0, nullptr) == 0);
+        crashFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(fs->fuseGetattr("/moved", &second) == 0);
+        REQUIRE(second.st_ino == ino);
+        REQUIRE(second.st_nlink == 1);
+        REQUIRE(readFile(fs, "/moved") == string(data.data(), TEST_SIZE));
+        REQUIRE(fs->fuseUnlink("/moved") == 0);
+        unmountFs(fs);
+
+        // The blocks of the file are free again
+        fs = mountFs(info);
+        REQUIRE(listDirectory(fs, "/") == set<string>({"dir"}));
+        REQUIRE(checkAllocation(fs) == numFree);
+        unmountFs(fs);
+    }
+
+    remove(CONTAINER_PATH);
+}
+
+TEST_CASE( "ODFS_NAME_LENGTHS", "[myondiskfs]" ) {
+
+    remove(CONTAINER_PATH);
+    MyFsInfo info = mountOptions();
+
+    // Records of all lengths, so they share blocks in every combination and the longest fill a block on their own
+    MyOnDiskFS *fs = mountFs(info);
+    REQUIRE(fs->fuseMkdir("/names", 0755) == 0);
+    set<string> expected;
+    for (size_t length = 1; length < NAME_LENGTH; length++) {
+        string name(length, 'a' + length % 26);
+        name[0] = 'A' + length % 26;
+        writeFile(fs, ("/names/" + name).c_str(), name.data(), name.size(), 0);
+        expected.insert(name);
+    }
+    REQUIRE(expected.size() == NAME_LENGTH - 1);
+    REQUIRE(listDirectory(fs, "/names") == expected);
+
+    // Names that do not fit into an entry are rejected
+    string tooLong(NAME_LENGTH, 'x');
+    REQUIRE(fs->fuseMknod(("/names/" + tooLong).c_str(), S_IFREG | 0644, 0) == -EINVAL);
+    REQUIRE(fs->fuseMkdir(("/names/" + tooLong).c_str(), 0755) == -EINVAL);
+    REQUIRE(fs->fuseRename(("/names/" + *expected.begin()).c_str(), ("/" + tooLong).c_str()) == -EINVAL);
+    REQUIRE(fs->fuseLink(("/names/" + *expected.begin()).c_str(), ("/" + tooLong).c_str()) == -EINVAL);
+    REQUIRE(listDirectory(fs, "/names") == expected);
+
+    SECTION("Names are read back after a remount") {
+        unmountFs(fs);
+    }
+    SECTION("Names are read back after a crash") {
+        REQUIRE(fs->fuseFsyncdir("/names", 0, nullptr) == 0);
+        crashFs(fs);
+    }
+
+    fs = mountFs(info);
+    REQUIRE(listDirectory(fs, "/names") == expected);
+    for (const string &name : expected)
+        REQUIRE(readFile(fs, ("/names/" + name).c_str()) == name);
+
+    // Renaming to names of other lengths moves the records between blocks
+    string longest(NAME_LENGTH - 1, 'z');
+    string medium(250, 'b');
+    REQUIRE(fs->fuseRename(("/names/" + *expected.begin()).c_str(), ("/names/" + longest).c_str()) == 0);
+    REQUIRE(fs->fuseRename(("/names/" + *expected.rbegin()).c_str(), ("/" + medium).c_str()) == 0);
+    REQUIRE(readFile(fs, ("/names/" + longest).c_str()) == *expected.begin());
+    REQUIRE(readFile(fs, ("/" + medium).c_str()) == *expected.rbegin());
+    unmountFs(fs);
+
+    fs = mountFs(info);
+    REQUIRE(readFile(fs, ("/names/" + longest).c_str()) == *expected.begin());
+    REQUIRE(readFile(fs, ("/" + medium).c_str()) == *expected.rbegin());
+    REQUIRE(listDirectory(fs, "/") == set<string>({"names", medium}));
+    unmountFs(fs);
+
+    remove(CONTAINER_PATH);
+}
+
+TEST_CASE( "ODFS_OPEN_HANDLES", "[myondiskfs]" ) {
+
+    remove(CONTAINER_PATH);
+    MyFsInfo info = mountOptions();
+
+    vector<char> data(TEST_SIZE);
+    gen_random(data.data(), TEST_SIZE);
+
+    MyOnDiskFS *fs = mountFs(info);
+    writeFile(fs, "/file", data.data(), TEST_SIZE, 0);
+
+    SECTION("A file is open many times") {
+        vector<struct fuse_file_info> handles(NUM_HANDLES);
+        for (struct fuse_file_info &fileInfo : handles) {
+            memset(&fileInfo, 0, sizeof(fileInfo));
+            REQUIRE(fs->fuseOpen("/file", &fileInfo) == 0);
+        }
+
+        // The deleted file is kept until its last handle is closed
+        REQUIRE(fs->fuseUnlink("/file") == 0);
+        vector<char> buffer(TEST_SIZE);
+        for (size_t i = 0; i < handles.size(); i++) {
+            REQUIRE(fs->fuseRead("/file", buffer.data(), 100, i, &handles[i]) == 100);
+            REQUIRE(memcmp(buffer.data(), data.data() + i, 100) == 0);
+        }
+        for (struct fuse_file_info &fileInfo : handles)
+            REQUIRE(fs->fuseRelease("/file", &fileInfo) == 0);
+        REQUIRE(fs->fuseRelease("/file", &handles[0]) == -EBADF);
+        unmountFs(fs);
+
+        fs = mountFs(info);
+        REQUIRE(listDirectory(fs, "/").empty());
+        unmountFs(fs);
+    }
+
+    SECTION("Many files are open at the same time") {
+        vector<struct fuse_file_info> handles(NUM_HANDLES);
+        for (size_t i = 0; i < handles.size(); i++) {
+            string path = "/file" + to_string(i);
+            memset(&handles[i], 0, sizeof(handles[i]));
+            REQUIRE(fs->fuseCreate(path.c_str(), S_IFREG | 0644, &handles[i]) == 0);
+            REQUIRE(fs->fuseWrite(path.c_str(), path.data(), path.size(), 0, &handles[i]) == (int) path.size());
+        }
+        for (size_t i = 0; i < handles.size(); i++)
+            REQUIRE(fs->fuseRelease(("/file" + to_string(i)).c_str(), &handles[i]) == 0);
+        unmountFs(fs);
+
+        fs = mountFs(info);
+        for (size_t i = 0; i < handles.size(); i++) {
+            string path = "/file" + to_string(i);
+            REQUIRE(readFile(fs, path.c_str()) == path);
+        }
+        unmountFs(fs);
+    }
+
+    remove(CONTAINER_PATH);
+}
@@ -0,0 +1,163 @@
+//
+//  utest-oplog.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "oplog.h"
+
+#define OPLOG_PATH "/tmp/oplog.bin"
+#define NUM_TESTRECORDS 1000
+
+/// @brief Append records numbered 0 to count - 1, the number is stored in the value and as text in the payload.
+static void appendRecords(OpLog &log, int first, int count) {
+    for (int i = first; i < first + count; i++) {
+        OpLogRecord record;
+        record.type = 1;
+        record.value = i;
+        string payload = "record" + to_string(i);
+        REQUIRE(log.append(record, payload.c_str(), payload.size()) == 0);
+    }
+}
+
+/// @brief Replay a log and collect the values of its records.
+static int64_t replayRecords(const string &path, vector<uint64_t> &values) {
+    return OpLog::replay(path, [&values](const OpLogRecord &record, const char *payload) {
+        REQUIRE(string(payload) == "record" + to_string(record.value));
+        REQUIRE(record.sequence == values.size() + 1);
+        values.push_back(record.value);
+        return true;
+    });
+}
+
+static void removeLogs() {
+    remove(OPLOG_PATH);
+    remove(OpLog::oldPath(OPLOG_PATH).c_str());
+}
+
+TEST_CASE( "OL_APPEND_REPLAY", "[oplog]" ) {
+
+    removeLogs();
+
+    OpLog log;
+    REQUIRE(log.open(OPLOG_PATH, OPLOG_SYNC_ALWAYS) == 0);
+    REQUIRE(log.isOpen());
+    REQUIRE(log.size() == 0);
+    REQUIRE(log.sequence() == 0);
+
+    appendRecords(log, 0, NUM_TESTRECORDS);
+    REQUIRE(log.sequence() == NUM_TESTRECORDS);
+    uint64_t size = log.size();
+    log.close();
+
+    SECTION("All records are replayed in order") {
+        vector<uint64_t> values;
+        REQUIRE(replayRecords(OPLOG_PATH, values) == (int64_t) size);
+        REQUIRE(values.size() == NUM_TESTRECORDS);
+        for (int i = 0; i < NUM_TESTRECORDS; i++)
+            REQUIRE(values[i] == (uint64_t) i);
+    }
+
+    SECTION("Reopened logs append and continue the sequence") {
+        REQUIRE(log.open(OPLOG_PATH, OPLOG_SYNC_NEVER) == 0);
+        REQUIRE(log.size() == size);
+        log.setSequence(NUM_TESTRECORDS);
+        appendRecords(log, NUM_TESTRECORDS, 10);
+        REQUIRE(log.sync() == 0);
+        log.close();
+
+        vector<uint64_t> values;
+        REQUIRE(replayRecords(OPLOG_PATH, values) > (int64_t) size);
+        REQUIRE(values.size() == NUM_TESTRECORDS + 10);
+    }
+
+    SECTION("Torn records end the log") {
+        REQUIRE(truncate(OPLOG_PATH, size - 3) == 0);
+
+        vector<uint64_t> values;
+        int64_t valid = replayRecords(OPLOG_PATH, values);
+        REQUIRE(values.size() == NUM_TESTRECORDS - 1);
+        REQUIRE(valid < (int64_t) size - 3);
+    }
+
+    SECTION("Corrupted records end the log") {
+        FILE *file = fopen(OPLOG_PATH, "r+");
+        REQUIRE(file != nullptr);
+        fseek(file, (long) (size / 2), SEEK_SET);
+        int byte = fgetc(file);
+        fseek(file, (long) (size / 2), SEEK_SET);
+        fputc(byte ^ 0xff, file);
+        fclose(file);
+
+        vector<uint64_t> values;
+        replayRecords(OPLOG_PATH, values);
+        REQUIRE(values.size() < NUM_TESTRECORDS);
+        for (size_t i = 0; i < values.size(); i++)
+            REQUIRE(values[i] == i);
+    }
+
+    SECTION("Replaying stops when asked") {
+        int count = 0;
+        OpLog::replay(OPLOG_PATH, [&count](const OpLogRecord &, const char *) { return ++count < 10; });
+        REQUIRE(count == 10);
+    }
+
+    SECTION("Missing logs cannot be replayed") {
+        removeLogs();
+        REQUIRE(OpLog::replay(OPLOG_PATH, [](const OpLogRecord &, const char *) { return true; }) == -ENOENT);
+    }
+
+    removeLogs();
+}
+
+TEST_CASE( "OL_ROTATE_DISCARD", "[oplog]" ) {
+
+    removeLogs();
+
+    OpLog log;
+    REQUIRE(log.open(OPLOG_PATH, 5) == 0);
+    appendRecords(log, 0, 10);
+
+    SECTION("Rotated records move to the old log") {
+        REQUIRE(log.rotate() == 0);
+        REQUIRE(log.size() == 0);
+        appendRecords(log, 10, 5);
+
+        // A second rotation adds to the old log that was not discarded
+        REQUIRE(log.rotate() == 0);
+        appendRecords(log, 15, 5);
+        log.close();
+
+        vector<uint64_t> values;
+        replayRecords(OpLog::oldPath(OPLOG_PATH), values);
+        REQUIRE(values.size() == 15);
+        replayRecords(OPLOG_PATH, values);
+        REQUIRE(values.size() == 20);
+
+        REQUIRE(log.open(OPLOG_PATH, OPLOG_SYNC_ALWAYS) == 0);
+        log.discardOld();
+        REQUIRE(access(OpLog::oldPath(OPLOG_PATH).c_str(), F_OK) < 0);
+        REQUIRE(access(OPLOG_PATH, F_OK) == 0);
+    }
+
+    SECTION("Discarded logs are empty") {
+        REQUIRE(log.rotate() == 0);
+        appendRecords(log, 10, 5);
+        REQUIRE(log.discard() == 0);
+        REQUIRE(log.size() == 0);
+        REQUIRE(log.sequence() == 15);
+        log.close();
+
+        REQUIRE(access(OpLog::oldPath(OPLOG_PATH).c_str(), F_OK) < 0);
+        vector<uint64_t> values;
+        REQUIRE(replayRecords(OPLOG_PATH, values) == 0);
+        REQUIRE(values.empty());
+    }
+
+    removeLogs();
+}
@@ -0,0 +1,91 @@
+//
+//  utest-pagecodec.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "pagecodec.h"
+
+#define PAGE_BYTES 4096
+
+/// @brief Compress a block, decompress it again and return the compressed size.
+static size_t roundTrip(const vector<char> &data) {
+    vector<char> packed(data.size() + data.size() / 255 + 16);
+    size_t size = PageCodec::compress(data.data(), data.size(), packed.data(), packed.size());
+    REQUIRE((size > 0 || data.empty()));
+
+    vector<char> unpacked(data.size() + 1);
+    ssize_t count = PageCodec::decompress(packed.data(), size, unpacked.data(), unpacked.size());
+    REQUIRE(count == (ssize_t) data.size());
+    REQUIRE(equal(data.begin(), data.end(), unpacked.begin()));
+    return size;
+}
+
+TEST_CASE( "PC_ROUND_TRIP", "[pagecodec]" ) {
+
+    SECTION("Text compresses") {
+        string text;
+        for (int i = 0; text.size() < PAGE_BYTES; i++)
+            text += "line " + to_string(i % 37) + ": the quick brown fox jumps over the lazy dog\n";
+        vector<char> data(text.begin(), text.begin() + PAGE_BYTES);
+        REQUIRE(roundTrip(data) < PAGE_BYTES / 4);
+    }
+
+    SECTION("Zeros and repeated bytes compress to almost nothing") {
+        REQUIRE(roundTrip(vector<char>(PAGE_BYTES, 0)) < 32);
+        REQUIRE(roundTrip(vector<char>(PageCodec::MAX_BLOCK_BYTES, 'x')) < 300);
+    }
+
+    SECTION("Random bytes survive") {
+        vector<char> data(PAGE_BYTES);
+        uint32_t state = 1;
+        for (char &byte : data) {
+            state = state * 1103515245 + 12345;
+            byte = (char) (state >> 16);
+        }
+        REQUIRE(roundTrip(data) > PAGE_BYTES);
+    }
+
+    SECTION("Short blocks are literals") {
+        for (size_t size = 0; size < 20; size++)
+            roundTrip(vector<char>(size, 'a'));
+    }
+}
+
+TEST_CASE( "PC_LIMITS", "[pagecodec]" ) {
+
+    vector<char> data(PAGE_BYTES);
+    uint32_t state = 7;
+    for (char &byte : data) {
+        state = state * 1103515245 + 12345;
+        byte = (char) (state >> 16);
+    }
+
+    SECTION("Blocks that do not fit are not compressed") {
+        vector<char> packed(PAGE_BYTES - 1);
+        REQUIRE(PageCodec::compress(data.data(), data.size(), packed.data(), packed.size()) == 0);
+    }
+
+    SECTION("Damaged blocks fail without writing behind the buffer") {
+        vector<char> text(PAGE_BYTES, 'a');
+        for (size_t i = 0; i < text.size(); i += 7)
+            text[i] = (char) ('a' + i % 5);
+        vector<char> packed(2 * PAGE_BYTES);
+        size_t size = PageCodec::compress(text.data(), text.size(), packed.data(), packed.size());
+        REQUIRE(size > 0);
+
+        vector<char> unpacked(PAGE_BYTES);
+        REQUIRE(PageCodec::decompress(packed.data(), size, unpacked.data(), PAGE_BYTES - 1) == -EIO);
+        REQUIRE(PageCodec::decompress(packed.data(), size - 1, unpacked.data(), unpacked.size()) != PAGE_BYTES);
+        for (size_t i = 0; i < size; i++) {
+            vector<char> damaged(packed.begin(), packed.begin() + size);
+            damaged[i] ^= 0x5a;
+            PageCodec::decompress(damaged.data(), size, unpacked.data(), unpacked.size());
+        }
+    }
+}
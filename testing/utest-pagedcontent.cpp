@@ -0,0 +1,258 @@
+//
+//  utest-pagedcontent.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <vector>
+#include <unistd.h>
+
+#include "myinmemoryfs.h"
+#include "pagedcontent.h"
+
+#define TEST_SIZE (5 * PagedContent::PAGE_BYTES + 123)
+#define SPILL_PATH "/tmp/myfs-spill.bin"
+#define SPILL_FILES 8
+#define SPILL_RUN (16 * PagedContent::PAGE_BYTES)  // Bytes of each run of data and of the hole between them
+
+TEST_CASE( "PC_WRITE_READ", "[pagedcontent]" ) {
+
+    PagedContent content;
+    vector<char> data(TEST_SIZE);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (char) (i * 7 + 1);
+
+    REQUIRE(content.empty());
+
+    SECTION("Write and read across pages") {
+        // Write in chunks that do not line up with the pages
+        for (size_t offset = 0; offset < data.size(); offset += 1000)
+            content.write(offset, data.data() + offset, min((size_t) 1000, data.size() - offset));
+        REQUIRE(content.size() == TEST_SIZE);
+
+        vector<char> buffer(TEST_SIZE);
+        REQUIRE(content.read(0, buffer.size(), buffer.data()) == TEST_SIZE);
+        REQUIRE(buffer == data);
+
+        // Reads stop at the end of the content
+        REQUIRE(content.read(TEST_SIZE - 10, 100, buffer.data()) == 10);
+        REQUIRE(memcmp(buffer.data(), data.data() + TEST_SIZE - 10, 10) == 0);
+        REQUIRE(content.read(TEST_SIZE, 100, buffer.data()) == 0);
+    }
+
+    SECTION("Unwritten ranges read as zeros") {
+        content.write(3 * PagedContent::PAGE_BYTES + 10, data.data(), 100);
+        REQUIRE(content.size() == 3 * PagedContent::PAGE_BYTES + 110);
+
+        vector<char> buffer(content.size(), 'x');
+        REQUIRE(content.read(0, buffer.size(), buffer.data()) == buffer.size());
+        for (size_t i = 0; i < 3 * PagedContent::PAGE_BYTES + 10; i++)
+            REQUIRE(buffer[i] == 0);
+        REQUIRE(memcmp(buffer.data() + 3 * PagedContent::PAGE_BYTES + 10, data.data(), 100) == 0);
+        REQUIRE(content.allocatedPages() == 1);
+    }
+
+    SECTION("Holes are found page by page") {
+        content.resize(TEST_SIZE);
+        REQUIRE(content.allocatedPages() == 0);
+        REQUIRE(content.nextData(0) == TEST_SIZE);
+        REQUIRE(content.nextHole(10) == 10);
+
+        content.write(2 * PagedContent::PAGE_BYTES + 1, data.data(), 1);
+        REQUIRE(content.nextData(0) == 2 * PagedContent::PAGE_BYTES);
+        REQUIRE(content.nextData(2 * PagedContent::PAGE_BYTES + 7) == 2 * PagedContent::PAGE_BYTES + 7);
+        REQUIRE(content.nextHole(2 * PagedContent::PAGE_BYTES) == 3 * PagedContent::PAGE_BYTES);
+        REQUIRE(content.nextData(3 * PagedContent::PAGE_BYTES) == TEST_SIZE);
+
+        // The hole at the end of the content ends at its size
+        content.write(0, data.data(), data.size());
+        REQUIRE(content.nextHole(0) == TEST_SIZE);
+        REQUIRE(content.allocatedPages() == 6);
+    }
+
+    SECTION("Shrinking and growing again exposes zeros") {
+        content.write(0, data.data(), data.size());
+        content.resize(PagedContent::PAGE_BYTES + 5);
+        REQUIRE(content.size() == PagedContent::PAGE_BYTES + 5);
+        REQUIRE(content.allocatedPages() == 2);
+
+        content.resize(TEST_SIZE);
+        vector<char> buffer(TEST_SIZE, 'x');
+        REQUIRE(content.read(0, buffer.size(), buffer.data()) == TEST_SIZE);
+        REQUIRE(memcmp(buffer.data(), data.data(), PagedContent::PAGE_BYTES + 5) == 0);
+        for (size_t i = PagedContent::PAGE_BYTES + 5; i < TEST_SIZE; i++)
+            REQUIRE(buffer[i] == 0);
+    }
+
+    SECTION("Pages can be counted and dropped") {
+        content.write(PagedContent::PAGE_BYTES, data.data(), 10);
+        REQUIRE(content.missingPages(0, 3 * PagedContent::PAGE_BYTES) == 2);
+        REQUIRE(content.missingPages(PagedContent::PAGE_BYTES + 5, 100) == 0);
+        REQUIRE(content.missingPages(0, 0) == 0);
+        REQUIRE(content.numPages() == 2);
+        REQUIRE(content.page(0) == nullptr);
+        REQUIRE(memcmp(content.page(1), data.data(), 10) == 0);
+
+        content.dropPages();
+        REQUIRE(content.size() == PagedContent::PAGE_BYTES + 10);
+        REQUIRE(content.allocatedPages() == 0);
+        REQUIRE(content.nextData(0) == content.size());
+    }
+
+    SECTION("Clearing removes the content") {
+        content.write(0, data.data(), data.size());
+        content.clear();
+        REQUIRE(content.empty());
+        char c;
+        REQUIRE(content.read(0, 1, &c) == 0);
+    }
+}
+
+TEST_CASE( "PC_COPY_CLONE", "[pagedcontent]" ) {
+
+    PageArena arena;
+    PagedContent source, target;
+    source.setArena(&arena);
+    target.setArena(&arena);
+    vector<char> data(TEST_SIZE);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (char) (i * 7 + 1);
+    source.write(0, data.data(), data.size());
+    REQUIRE(arena.size() == 6);
+
+    SECTION("Clones share all pages until they are written") {
+        target.clone(source);
+        REQUIRE(target.size() == TEST_SIZE);
+        REQUIRE(target.allocatedPages() == 6);
+        REQUIRE(arena.size() == 6);
+        REQUIRE(target.page(2) == source.page(2));
+
+        // Writing copies only the page that is written
+        REQUIRE(target.missingPages(2 * PagedContent::PAGE_BYTES, 1) == 1);
+        target.write(2 * PagedContent::PAGE_BYTES, "x", 1);
+        REQUIRE(arena.size() == 7);
+        REQUIRE(target.page(2) != source.page(2));
+
+        vector<char> buffer(TEST_SIZE);
+        REQUIRE(source.read(0, buffer.size(), buffer.data()) == TEST_SIZE);
+        REQUIRE(buffer == data);
+        REQUIRE(target.read(0, buffer.size(), buffer.data()) == TEST_SIZE);
+        REQUIRE(buffer[2 * PagedContent::PAGE_BYTES] == 'x');
+        buffer[2 * PagedContent::PAGE_BYTES] = data[2 * PagedContent::PAGE_BYTES];
+        REQUIRE(buffer == data);
+
+        // Cutting off the shared last page does not change the source
+        target.resize(5 * PagedContent::PAGE_BYTES + 10);
+        REQUIRE(source.read(0, buffer.size(), buffer.data()) == TEST_SIZE);
+        REQUIRE(buffer == data);
+
+        source.clear();
+        REQUIRE(arena.size() == 6);
+        target.clear();
+        REQUIRE(arena.size() == 0);
+    }
+
+    SECTION("Aligned ranges share whole pages") {
+        target.copy(source, 100, PagedContent::PAGE_BYTES + 100, 3 * PagedContent::PAGE_BYTES);
+        REQUIRE(target.size() == 4 * PagedContent::PAGE_BYTES + 100);
+        REQUIRE(target.page(0) == nullptr);
+        REQUIRE(target.page(2) == source.page(1));
+        REQUIRE(target.page(3) == source.page(2));
+        REQUIRE(arena.size() == 8);
+
+        vector<char> buffer(3 * PagedContent::PAGE_BYTES);
+        REQUIRE(target.read(PagedContent::PAGE_BYTES + 100, buffer.size(), buffer.data()) == buffer.size());
+        REQUIRE(memcmp(buffer.data(), data.data() + 100, buffer.size()) == 0);
+    }
+
+    SECTION("Unaligned ranges are copied") {
+        REQUIRE(target.copy(source, 10, 0, TEST_SIZE) == TEST_SIZE - 10);
+        REQUIRE(target.size() == TEST_SIZE - 10);
+        REQUIRE(arena.size() == 12);
+
+        vector<char> buffer(TEST_SIZE - 10);
+        REQUIRE(target.read(0, buffer.size(), buffer.data()) == buffer.size());
+        REQUIRE(memcmp(buffer.data(), data.data() + 10, buffer.size()) == 0);
+    }
+
+    SECTION("Holes stay holes") {
+        source.resize(20 * PagedContent::PAGE_BYTES);
+        target.copy(source, 0, 0, source.size());
+        REQUIRE(target.size() == source.size());
+        REQUIRE(target.allocatedPages() == 6);
+        REQUIRE(arena.size() == 6);
+        REQUIRE(target.nextHole(0) == 6 * PagedContent::PAGE_BYTES);
+    }
+
+    SECTION("Ranges of the same content can be copied") {
+        source.copy(source, 0, 8 * PagedContent::PAGE_BYTES, 2 * PagedContent::PAGE_BYTES);
+        REQUIRE(source.size() == 10 * PagedContent::PAGE_BYTES);
+        REQUIRE(source.page(8) == source.page(0));
+        REQUIRE(arena.size() == 6);
+
+        source.write(0, "x", 1);
+        char c;
+        REQUIRE(source.read(8 * PagedContent::PAGE_BYTES, 1, &c) == 1);
+        REQUIRE(c == data[0]);
+    }
+}
+
+TEST_CASE( "PC_SPILL_LOAD", "[pagedcontent]" ) {
+
+    // Files of the in-memory file system get twice as much content as its memory limit allows
+    static char logFile[] = "/dev/null";
+    static char spillFile[] = SPILL_PATH;
+    MyFsInfo info;
+    memset(&info, 0, sizeof(info));
+    info.logFile = logFile;
+    info.spillFile = spillFile;
+    info.memoryLimit = SPILL_FILES * SPILL_RUN;
+
+    MyInMemoryFS fs;
+    fs.setMountInfo(&info);
+    fs.fuseInit(nullptr);
+    REQUIRE(!fs.mountFailed());
+
+    // Every file has a run of data, a hole and a second run that ends within a page
+    size_t size = 3 * SPILL_RUN + 100;
+    vector<char> data(SPILL_FILES * size);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (char) (i * 13 + 5);
+    for (size_t file = 0; file < SPILL_FILES; file++) {
+        memset(&data[file * size + SPILL_RUN], 0, SPILL_RUN);
+
+        string path = "/file" + to_string(file);
+        struct fuse_file_info fileInfo;
+        memset(&fileInfo, 0, sizeof(fileInfo));
+        REQUIRE(fs.fuseCreate(path.c_str(), S_IFREG | 0644, &fileInfo) == 0);
+        REQUIRE(fs.fuseWrite(path.c_str(), &data[file * size], SPILL_RUN, 0, &fileInfo) == SPILL_RUN);
+        REQUIRE(fs.fuseWrite(path.c_str(), &data[file * size + 2 * SPILL_RUN], SPILL_RUN + 100, 2 * SPILL_RUN,
+                             &fileInfo) == SPILL_RUN + 100);
+        REQUIRE(fs.fuseRelease(path.c_str(), &fileInfo) == 0);
+    }
+
+    size_t spilled = 0;
+    for (auto &node : fs.nodes)
+        spilled += node.second->spilled ? 1 : 0;
+    REQUIRE(spilled > 0);
+    REQUIRE(fs.pageArena.usage().bytesUsed <= info.memoryLimit);
+    REQUIRE(access(SPILL_PATH, F_OK) == 0);
+
+    // Files are loaded again with their holes, the first ones were spilled first
+    for (size_t file = 0; file < SPILL_FILES; file++) {
+        string path = "/file" + to_string(file);
+        REQUIRE(fs.fuseLseek(path.c_str(), 0, SEEK_HOLE, nullptr) == SPILL_RUN);
+        REQUIRE(fs.fuseLseek(path.c_str(), SPILL_RUN, SEEK_DATA, nullptr) == 2 * SPILL_RUN);
+        REQUIRE(fs.fuseLseek(path.c_str(), 2 * SPILL_RUN, SEEK_HOLE, nullptr) == (off_t) size);
+
+        vector<char> buffer(size + 10);
+        REQUIRE(fs.fuseRead(path.c_str(), buffer.data(), buffer.size(), 0, nullptr) == (int) size);
+        REQUIRE(memcmp(buffer.data(), &data[file * size], size) == 0);
+        REQUIRE(fs.pageArena.usage().bytesUsed <= info.memoryLimit);
+    }
+
+    // The container only lives as long as the mount
+    fs.fuseDestroy();
+    REQUIRE(access(SPILL_PATH, F_OK) != 0);
+}
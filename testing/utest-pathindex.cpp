@@ -0,0 +1,126 @@
+//
+//  utest-pathindex.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <string>
+#include <vector>
+
+#include "pathindex.h"
+
+#define NUM_TESTPATHS 1000
+
+TEST_CASE( "PI_INSERT_FIND_ERASE", "[pathindex]" ) {
+
+    PathIndex<int> index;
+
+    REQUIRE(index.empty());
+    REQUIRE(index.find("/file") == index.end());
+
+    SECTION("Insert and find paths") {
+        for (int i = 0; i < NUM_TESTPATHS; i++) {
+            string path = "/file" + to_string(i);
+            REQUIRE(index.emplace(path, int(i)).second);
+        }
+        REQUIRE(index.size() == NUM_TESTPATHS);
+
+        for (int i = 0; i < NUM_TESTPATHS; i++) {
+            string path = "/file" + to_string(i);
+            auto iterator = index.find(path.c_str());
+            REQUIRE(iterator != index.end());
+            REQUIRE(iterator->first == path);
+            REQUIRE(iterator->second == i);
+        }
+        REQUIRE(index.find("/file") == index.end());
+        REQUIRE(index.find("/file1000") == index.end());
+    }
+
+    SECTION("Find components of a longer path") {
+        const char *path = "dir/file";
+        REQUIRE(index.emplace(path, 3, 1).second);
+        REQUIRE(index.emplace(path + 4, 2, 2).second);
+
+        REQUIRE(index.find("dir")->second == 1);
+        REQUIRE(index.find("fi")->second == 2);
+        REQUIRE(index.find(path, 3)->second == 1);
+        REQUIRE(index.find(path + 4, 2)->second == 2);
+        REQUIRE(index.find(path + 4) == index.end());
+        REQUIRE(index.find(path, 2) == index.end());
+    }
+
+    SECTION("Existing paths are not replaced") {
+        REQUIRE(index.emplace("/file", 1).second);
+        auto result = index.emplace("/file", 2);
+        REQUIRE_FALSE(result.second);
+        REQUIRE(result.first->second == 1);
+        REQUIRE(index.size() == 1);
+    }
+
+    SECTION("Erase paths and insert them again") {
+        for (int i = 0; i < NUM_TESTPATHS; i++)
+            index.emplace("/file" + to_string(i), int(i));
+
+        for (int i = 0; i < NUM_TESTPATHS; i += 2)
+            REQUIRE(index.erase(("/file" + to_string(i)).c_str()) == 1);
+        REQUIRE(index.size() == NUM_TESTPATHS / 2);
+        REQUIRE(index.erase("/file0") == 0);
+
+        for (int i = 0; i < NUM_TESTPATHS; i++)
+            REQUIRE((index.find("/file" + to_string(i)) != index.end()) == (i % 2 == 1));
+
+        for (int i = 0; i < NUM_TESTPATHS; i += 2)
+            REQUIRE(index.emplace("/file" + to_string(i), int(i)).second);
+        REQUIRE(index.size() == NUM_TESTPATHS);
+
+        size_t count = 0;
+        for (const auto &entry : index) {
+            REQUIRE(entry.first == "/file" + to_string(entry.second));
+            count++;
+        }
+        REQUIRE(count == NUM_TESTPATHS);
+    }
+
+    SECTION("Entries keep their address") {
+        int *first = &index.emplace("/first", 1).first->second;
+        for (int i = 0; i < NUM_TESTPATHS; i++)
+            index.emplace("/file" + to_string(i), int(i));
+        REQUIRE(&index.find("/first")->second == first);
+
+        // Erasing with an iterator from before the rehash finds the entry by its address
+        auto iterator = index.find("/second");
+        REQUIRE(iterator == index.end());
+        iterator = index.emplace("/second", 2).first;
+        for (int i = NUM_TESTPATHS; i < 2 * NUM_TESTPATHS; i++)
+            index.emplace("/file" + to_string(i), int(i));
+        index.erase(iterator);
+        REQUIRE(index.find("/second") == index.end());
+        REQUIRE(index.size() == 2 * NUM_TESTPATHS + 1);
+    }
+}
+
+TEST_CASE( "PI_ORDERED_VIEW", "[pathindex]" ) {
+
+    PathIndex<int> index;
+    vector<string> paths = {"/c", "/a", "/d", "/b"};
+    for (size_t i = 0; i < paths.size(); i++)
+        index.emplace(paths[i], int(i));
+
+    auto ordered = index.ordered();
+    REQUIRE(ordered.size() == 4);
+    REQUIRE(ordered[0]->first == "/a");
+    REQUIRE(ordered[1]->first == "/b");
+    REQUIRE(ordered[2]->first == "/c");
+    REQUIRE(ordered[3]->first == "/d");
+
+    // The view follows insertions and removals
+    index.erase("/b");
+    index.emplace("/aa", 4);
+    ordered = index.ordered();
+    REQUIRE(ordered.size() == 4);
+    REQUIRE(ordered[0]->first == "/a");
+    REQUIRE(ordered[1]->first == "/aa");
+    REQUIRE(ordered[2]->first == "/c");
+    REQUIRE(ordered[3]->first == "/d");
+}
@@ -0,0 +1,85 @@
+//
+//  utest-rwlock.cpp
+//  testing
+//
+
+#include "../catch/catch.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "rwlock.h"
+
+#define NUM_TESTTHREADS 8
+#define NUM_TESTROUNDS 10000
+
+/// @brief Let threads change a pair of counters under the lock and check that readers never see them differ.
+template<typename Lock>
+static void checkExclusion(Lock &lock) {
+    long first = 0, second = 0;
+    atomic<int> torn(0);
+
+    vector<thread> threads;
+    for (int i = 0; i < NUM_TESTTHREADS; i++) {
+        threads.emplace_back([&lock, &first, &second, &torn, i]() {
+            for (int round = 0; round < NUM_TESTROUNDS; round++) {
+                LockHolder<Lock> holder(lock, (round + i) % 4 == 0);
+                if (holder.isExclusive()) {
+                    first++;
+                    second++;
+                } else if (first != second) {
+                    torn++;
+                }
+            }
+        });
+    }
+    for (thread &worker : threads)
+        worker.join();
+
+    REQUIRE(torn == 0);
+    REQUIRE(first == second);
+    REQUIRE(first == NUM_TESTTHREADS * NUM_TESTROUNDS / 4);
+}
+
+TEST_CASE( "RW_EXCLUSION", "[rwlock]" ) {
+
+    SECTION("Writers exclude readers and each other") {
+        RwLock lock;
+        checkExclusion(lock);
+    }
+
+    SECTION("Writers of a sharded lock exclude readers of all shards") {
+        ShardedRwLock lock;
+        checkExclusion(lock);
+    }
+}
+
+TEST_CASE( "RW_HOLDER", "[rwlock]" ) {
+
+    RwLock lock;
+
+    SECTION("Locks are released when the holder goes out of scope") {
+        {
+            LockHolder<RwLock> holder(lock, false);
+            REQUIRE_FALSE(holder.isExclusive());
+            REQUIRE_FALSE(lock.tryLock());
+        }
+        REQUIRE(lock.tryLock());
+        lock.unlock();
+    }
+
+    SECTION("Upgraded locks are held for writing") {
+        LockHolder<RwLock> holder(lock, false);
+        holder.upgrade();
+        REQUIRE(holder.isExclusive());
+
+        bool taken = true;
+        thread([&lock, &taken]() { taken = lock.tryLock(); }).join();
+        REQUIRE_FALSE(taken);
+
+        holder.release();
+        REQUIRE(lock.tryLock());
+        lock.unlock();
+    }
+}